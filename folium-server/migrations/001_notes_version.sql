@@ -0,0 +1,4 @@
+-- Adds notes.version to databases created before it was part of schema.sql.
+-- Note reads select it, so run this once before starting an upgraded server:
+--   mysql -u root folium < migrations/001_notes_version.sql
+ALTER TABLE notes ADD COLUMN version BIGINT UNSIGNED NOT NULL DEFAULT 1;  -- Bumped by every write of the note; versions cached copies.
@@ -10,10 +10,11 @@ CREATE TABLE users (
 -- Classes table.
 CREATE TABLE classes (
     id INT AUTO_INCREMENT PRIMARY KEY,
+    user_id INT NOT NULL,  -- The class owner.
     name VARCHAR(100) NOT NULL,
     description TEXT,
     instructor VARCHAR(100),
-    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE
 );
 
@@ -35,5 +36,6 @@ CREATE TABLE notes (
     file_path VARCHAR(255) NOT NULL,  -- Stores the path to the shared note file.
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+    version BIGINT UNSIGNED NOT NULL DEFAULT 1,  -- Bumped by every write of the note; versions cached copies.
     FOREIGN KEY (class_id) REFERENCES classes(id) ON DELETE CASCADE
 );
@@ -39,6 +39,7 @@ CREATE TABLE notes (
     file_path VARCHAR(255) NOT NULL,  -- Stores the path to the shared note file.
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+    version BIGINT UNSIGNED NOT NULL DEFAULT 1,  -- Bumped by every write of the note; versions cached copies.
     FOREIGN KEY (class_id) REFERENCES classes(id) ON DELETE CASCADE
 );
 
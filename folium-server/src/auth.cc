@@ -153,6 +153,21 @@ bool auth::validateToken(const std::string& token) {
     }
 }
 
+// -----------------------------------------------------------------------------
+// userIdFromToken:
+// Verifies the token like validateToken and returns the user id from its subject.
+int auth::userIdFromToken(const std::string& token) {
+    try {
+        auto decoded = jwt::decode(token);
+        auto verifier = jwt::verify().allow_algorithm(jwt::algorithm::hs256{jwt_secret});
+        verifier.verify(decoded);
+        return std::stoi(decoded.get_subject());
+    } catch (const std::exception& e) {
+        authLogger.logErr("Token validation error: " + std::string(e.what()));
+        throw std::runtime_error("Invalid or expired token.");
+    }
+}
+
 // -----------------------------------------------------------------------------
 // refreshToken:
 // Refreshes a token by generating a new token for the same user with updated issued-at
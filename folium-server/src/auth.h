@@ -63,6 +63,14 @@ namespace auth {
      */
     bool validateToken(const std::string& token);
 
+    /**
+     * @brief Validates a JWT token and returns the user it was issued to.
+     * @param token The JWT token.
+     * @return The user id stored in the token's subject.
+     * @throws std::runtime_error if the token is invalid or expired.
+     */
+    int userIdFromToken(const std::string& token);
+
     /**
      * @brief Refreshes an expired token by generating a new token.
      * @param token The expired JWT token.
@@ -0,0 +1,414 @@
+#include "blob_store.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "compression.h"
+#include "file_engine.h"
+#include "logger.h"
+
+static logger::Logger blobLogger("blobs");
+
+namespace
+{
+    std::mutex rootMutex;
+    std::string root = "blobs";
+
+    // Striped locks: a blob's refcount is only ever touched under its stripe.
+    constexpr size_t kStripes = 64;
+    std::array<std::mutex, kStripes> stripes;
+
+    std::atomic<uint64_t> putCount{0};
+    std::atomic<uint64_t> dedupHits{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> bytesDeduped{0};
+    std::atomic<uint64_t> bytesStored{0};
+
+    // Dictionaries live in <root>/dictionaries/<id>.dict, "current" names the one new blobs use.
+    // Older dictionaries are kept for the blobs compressed with them.
+    std::mutex dictionaryMutex;
+    bool dictionariesLoaded = false;
+    std::unordered_map<unsigned, std::shared_ptr<const compression::Dictionary>> dictionaries;
+    std::shared_ptr<const compression::Dictionary> currentDictionary;
+
+    std::string rootDir()
+    {
+        std::lock_guard<std::mutex> lock(rootMutex);
+        return root;
+    }
+
+    std::string toHex(const unsigned char (&digest)[SHA256_DIGEST_LENGTH])
+    {
+        static const char *kHex = "0123456789abcdef";
+        std::string hex(2 * SHA256_DIGEST_LENGTH, '0');
+        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+        {
+            hex[2 * i] = kHex[digest[i] >> 4];
+            hex[2 * i + 1] = kHex[digest[i] & 0xF];
+        }
+        return hex;
+    }
+
+    std::string dictionaryDir()
+    {
+        return rootDir() + "/dictionaries";
+    }
+
+    // Reads the dictionaries not loaded yet and the current one. Another process, such as
+    // folium-import --compress-blobs, may have trained one since the last scan.
+    // dictionaryMutex must be held.
+    void scanDictionaries()
+    {
+        dictionariesLoaded = true;
+        const std::string dir = dictionaryDir();
+        if (!std::filesystem::exists(dir))
+            return;
+        for (const auto &file : std::filesystem::directory_iterator(dir))
+        {
+            if (file.path().extension() != ".dict")
+                continue;
+            unsigned id = 0;
+            try
+            {
+                id = static_cast<unsigned>(std::stoul(file.path().stem().string()));
+            }
+            catch (const std::exception &)
+            {
+            }
+            if (id != 0 && dictionaries.count(id))
+                continue;
+            auto dictionary = std::make_shared<const compression::Dictionary>(fileio::read(file.path().string()));
+            dictionaries[dictionary->id()] = dictionary;
+        }
+        if (std::filesystem::exists(dir + "/current"))
+        {
+            auto it = dictionaries.find(static_cast<unsigned>(std::stoul(fileio::read(dir + "/current"))));
+            if (it != dictionaries.end())
+                currentDictionary = it->second;
+            else
+                blobLogger.logWarn("current blob dictionary is missing, compressing without one");
+        }
+    }
+
+    // dictionaryMutex must be held.
+    void loadDictionaries()
+    {
+        if (!dictionariesLoaded)
+            scanDictionaries();
+    }
+
+    std::shared_ptr<const compression::Dictionary> dictionaryForWriting()
+    {
+        std::lock_guard<std::mutex> lock(dictionaryMutex);
+        loadDictionaries();
+        return currentDictionary;
+    }
+
+    // Content of a blob file: a zstd frame, or raw content written before blobs were compressed.
+    std::string decode(const std::string &stored, const std::string &hash)
+    {
+        if (!compression::isFrame(stored))
+            return stored;
+        std::shared_ptr<const compression::Dictionary> dictionary;
+        if (unsigned id = compression::dictionaryIdOf(stored))
+        {
+            std::lock_guard<std::mutex> lock(dictionaryMutex);
+            loadDictionaries();
+            auto it = dictionaries.find(id);
+            if (it == dictionaries.end())
+            {
+                scanDictionaries();
+                it = dictionaries.find(id);
+            }
+            if (it == dictionaries.end())
+                throw std::runtime_error("blobstore: blob " + hash + " needs missing dictionary " + std::to_string(id));
+            dictionary = it->second;
+        }
+        return compression::decompress(stored, dictionary.get());
+    }
+
+    // Training looks at the start of each blob; that is where the shared boilerplate is.
+    constexpr size_t kMaxSampleBytes = 16 << 10;
+
+    std::mutex &stripeFor(const std::string &hash)
+    {
+        return stripes[std::hash<std::string>{}(hash) % kStripes];
+    }
+
+    bool isValidHash(const std::string &hash)
+    {
+        if (hash.size() != 2 * SHA256_DIGEST_LENGTH)
+            return false;
+        for (char c : hash)
+        {
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                return false;
+        }
+        return true;
+    }
+
+    std::string blobPath(const std::string &hash)
+    {
+        if (!isValidHash(hash))
+        {
+            throw std::runtime_error("blobstore: invalid blob hash: " + hash);
+        }
+        std::lock_guard<std::mutex> lock(rootMutex);
+        return root + "/" + hash.substr(0, 2) + "/" + hash;
+    }
+
+    // Stripe lock must be held.
+    uint64_t readRefCount(const std::string &path)
+    {
+        std::string refPath = path + ".ref";
+        if (!std::filesystem::exists(refPath))
+            return 0;
+        try
+        {
+            return std::stoull(fileio::read(refPath));
+        }
+        catch (const std::invalid_argument &)
+        {
+            throw std::runtime_error("blobstore: corrupt reference count: " + refPath);
+        }
+    }
+
+    // Stripe lock must be held.
+    void writeRefCount(const std::string &path, uint64_t count)
+    {
+        fileio::writeAtomic(path + ".ref", std::to_string(count));
+    }
+}
+
+namespace blobstore
+{
+    void setRoot(const std::string &dir)
+    {
+        {
+            std::lock_guard<std::mutex> lock(rootMutex);
+            root = dir;
+        }
+        std::lock_guard<std::mutex> lock(dictionaryMutex);
+        dictionariesLoaded = false;
+        dictionaries.clear();
+        currentDictionary.reset();
+    }
+
+    std::string hashOf(const std::string &content)
+    {
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char *>(content.data()), content.size(), digest);
+        return toHex(digest);
+    }
+
+    struct Hasher::State
+    {
+        EVP_MD_CTX *context = EVP_MD_CTX_new();
+    };
+
+    Hasher::Hasher() : state_(std::make_unique<State>())
+    {
+        if (!state_->context || EVP_DigestInit_ex(state_->context, EVP_sha256(), nullptr) != 1)
+        {
+            throw std::runtime_error("blobstore: cannot start a SHA-256 digest");
+        }
+    }
+
+    Hasher::~Hasher()
+    {
+        EVP_MD_CTX_free(state_->context);
+    }
+
+    void Hasher::update(const char *data, size_t size)
+    {
+        EVP_DigestUpdate(state_->context, data, size);
+    }
+
+    std::string Hasher::finish()
+    {
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        EVP_DigestFinal_ex(state_->context, digest, nullptr);
+        return toHex(digest);
+    }
+
+    std::string put(const std::string &content)
+    {
+        const std::string hash = hashOf(content);
+        const std::string path = blobPath(hash);
+        putCount++;
+
+        std::lock_guard<std::mutex> lock(stripeFor(hash));
+        uint64_t count = readRefCount(path);
+        if (count > 0 && std::filesystem::exists(path))
+        {
+            dedupHits++;
+            bytesDeduped += content.size();
+        }
+        else
+        {
+            std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+            std::string stored = compression::compress(content, dictionaryForWriting().get());
+            fileio::writeAtomic(path, stored);
+            bytesWritten += content.size();
+            bytesStored += stored.size();
+            count = 0;
+        }
+        writeRefCount(path, count + 1);
+        return hash;
+    }
+
+    void addRef(const std::string &hash)
+    {
+        const std::string path = blobPath(hash);
+        std::lock_guard<std::mutex> lock(stripeFor(hash));
+        uint64_t count = readRefCount(path);
+        if (count == 0 || !std::filesystem::exists(path))
+        {
+            throw std::runtime_error("blobstore: addRef on missing blob " + hash);
+        }
+        writeRefCount(path, count + 1);
+    }
+
+    void release(const std::string &hash)
+    {
+        const std::string path = blobPath(hash);
+        std::lock_guard<std::mutex> lock(stripeFor(hash));
+        uint64_t count = readRefCount(path);
+        if (count <= 1)
+        {
+            fileio::remove(path);
+            fileio::remove(path + ".ref");
+            if (count == 0)
+            {
+                blobLogger.logWarn("release on blob without references: " + hash);
+            }
+            return;
+        }
+        writeRefCount(path, count - 1);
+    }
+
+    std::string get(const std::string &hash)
+    {
+        return decode(fileio::read(blobPath(hash)), hash);
+    }
+
+    std::vector<std::string> getMany(const std::vector<std::string> &hashes)
+    {
+        std::vector<std::string> paths;
+        paths.reserve(hashes.size());
+        for (const std::string &hash : hashes)
+        {
+            paths.push_back(blobPath(hash));
+        }
+        std::vector<std::string> contents = fileio::readMany(paths);
+        for (size_t i = 0; i < contents.size(); i++)
+        {
+            contents[i] = decode(contents[i], hashes[i]);
+        }
+        return contents;
+    }
+
+    uint64_t refCount(const std::string &hash)
+    {
+        const std::string path = blobPath(hash);
+        std::lock_guard<std::mutex> lock(stripeFor(hash));
+        return readRefCount(path);
+    }
+
+    unsigned trainDictionary(size_t maxSamples)
+    {
+        const std::string dir = rootDir();
+        std::vector<std::string> samples;
+        if (std::filesystem::exists(dir))
+        {
+            for (const auto &file : std::filesystem::recursive_directory_iterator(dir))
+            {
+                if (samples.size() >= maxSamples)
+                    break;
+                const std::string hash = file.path().filename().string();
+                if (!file.is_regular_file() || !isValidHash(hash))
+                    continue;
+                std::string content = decode(fileio::read(file.path().string()), hash);
+                content.resize(std::min(content.size(), kMaxSampleBytes));
+                samples.push_back(std::move(content));
+            }
+        }
+
+        auto dictionary = std::make_shared<const compression::Dictionary>(compression::train(samples));
+        std::filesystem::create_directories(dictionaryDir());
+        fileio::writeAtomic(dictionaryDir() + "/" + std::to_string(dictionary->id()) + ".dict", dictionary->bytes());
+        fileio::writeAtomic(dictionaryDir() + "/current", std::to_string(dictionary->id()));
+
+        std::lock_guard<std::mutex> lock(dictionaryMutex);
+        loadDictionaries();
+        dictionaries[dictionary->id()] = dictionary;
+        currentDictionary = dictionary;
+        blobLogger.log("trained blob dictionary " + std::to_string(dictionary->id()) + " (" +
+                       std::to_string(dictionary->bytes().size()) + " bytes) on " + std::to_string(samples.size()) +
+                       " blobs");
+        return dictionary->id();
+    }
+
+    size_t recompressAll()
+    {
+        std::shared_ptr<const compression::Dictionary> dictionary = dictionaryForWriting();
+        const unsigned id = dictionary ? dictionary->id() : 0;
+        const std::string dir = rootDir();
+        if (!std::filesystem::exists(dir))
+            return 0;
+
+        std::vector<std::string> hashes;
+        for (const auto &file : std::filesystem::recursive_directory_iterator(dir))
+        {
+            const std::string hash = file.path().filename().string();
+            if (file.is_regular_file() && isValidHash(hash))
+                hashes.push_back(hash);
+        }
+
+        size_t rewritten = 0;
+        for (const std::string &hash : hashes)
+        {
+            const std::string path = blobPath(hash);
+            std::lock_guard<std::mutex> lock(stripeFor(hash));
+            std::string stored;
+            try
+            {
+                stored = fileio::read(path);
+            }
+            catch (const std::exception &)
+            {
+                if (!std::filesystem::exists(path))
+                    continue; // released meanwhile
+                throw;
+            }
+            if (compression::isFrame(stored) && compression::dictionaryIdOf(stored) == id)
+                continue;
+            // The stripe lock does not exclude a running server, which may release the blob at
+            // any point; replaceExisting() then fails rather than bringing it back without a .ref.
+            if (fileio::replaceExisting(path, compression::compress(decode(stored, hash), dictionary.get())))
+                rewritten++;
+        }
+        return rewritten;
+    }
+
+    Stats stats()
+    {
+        std::shared_ptr<const compression::Dictionary> dictionary;
+        {
+            std::lock_guard<std::mutex> lock(dictionaryMutex);
+            dictionary = currentDictionary;
+        }
+        return {putCount.load(), dedupHits.load(), bytesWritten.load(), bytesDeduped.load(), bytesStored.load(),
+                dictionary ? dictionary->id() : 0};
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ * @file blob_store.h
+ * @brief Content-addressed, reference-counted storage for note unit content.
+ *
+ * Every blob is stored once under its SHA-256 hash, no matter how many units in
+ * how many classes embed it:
+ *
+ *     blobs/<first 2 hex chars>/<64 hex chars>       the content
+ *     blobs/<first 2 hex chars>/<64 hex chars>.ref   the reference count (text)
+ *
+ * put() of content that already exists only bumps the reference count, so a
+ * duplicate upload costs one small write. release() deletes the blob when the
+ * last reference goes away.
+ *
+ * Blobs are stored as zstd frames (see compression.h). Once trainDictionary()
+ * has been run, new blobs are compressed with a dictionary trained on the
+ * existing ones, which pays off on short units that share lecture boilerplate:
+ *
+ *     blobs/dictionaries/<id>.dict                    every dictionary still needed by some blob
+ *     blobs/dictionaries/current                      the id of the one new blobs use
+ *
+ * Each frame names its dictionary, so blobs written under an older dictionary,
+ * or before blobs were compressed at all, keep reading back unchanged.
+ * recompressAll() rewrites them with the current dictionary. The hash is always
+ * that of the uncompressed content.
+ *
+ * All functions throw std::runtime_error on I/O failure.
+ */
+
+#ifndef FOLSERV_BLOB_STORE_H_
+#define FOLSERV_BLOB_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace blobstore
+{
+    /**
+     * @brief Counters for judging how much deduplication saves.
+     */
+    struct Stats
+    {
+        uint64_t puts = 0;         // put() calls
+        uint64_t dedupHits = 0;    // put() calls whose content already existed
+        uint64_t bytesWritten = 0; // content bytes actually written
+        uint64_t bytesDeduped = 0; // content bytes that did not need writing
+        uint64_t bytesStored = 0;  // compressed bytes actually written for bytesWritten
+        unsigned dictionaryId = 0; // dictionary new blobs are compressed with, 0 for none
+    };
+
+    /// @brief Sets the blob directory (default "blobs"). Call before any other function.
+    void setRoot(const std::string &dir);
+
+    /// @return The lowercase hex SHA-256 of @p content.
+    std::string hashOf(const std::string &content);
+
+    /**
+     * @brief hashOf() of content that arrives in pieces.
+     */
+    class Hasher
+    {
+    public:
+        Hasher();
+        ~Hasher();
+        Hasher(const Hasher &) = delete;
+        Hasher &operator=(const Hasher &) = delete;
+
+        void update(const char *data, size_t size);
+
+        /// @return The hash of everything passed to update(); the hasher cannot be updated after.
+        std::string finish();
+
+    private:
+        struct State;
+        std::unique_ptr<State> state_;
+    };
+
+    /// @brief Stores @p content (if new) and takes one reference to it.
+    /// @return The content hash.
+    std::string put(const std::string &content);
+
+    /// @brief Takes one more reference to an existing blob.
+    /// @throws std::runtime_error if the blob does not exist.
+    void addRef(const std::string &hash);
+
+    /// @brief Drops one reference, deleting the blob when none remain.
+    void release(const std::string &hash);
+
+    /// @brief Reads a blob.
+    /// @throws std::runtime_error if the blob does not exist.
+    std::string get(const std::string &hash);
+
+    /// @brief Reads several blobs at once (submitted together by the file engine).
+    std::vector<std::string> getMany(const std::vector<std::string> &hashes);
+
+    /// @brief Trains a compression dictionary on up to @p maxSamples existing blobs and makes
+    /// it the one new blobs are compressed with.
+    /// @throws std::runtime_error if there are too few blobs to train on.
+    /// @return The dictionary id.
+    unsigned trainDictionary(size_t maxSamples = 4096);
+
+    /// @brief Rewrites every blob not yet compressed with the current dictionary.
+    /// Safe to run while the server is up; each blob is rewritten atomically under its lock.
+    /// @return The number of blobs rewritten.
+    size_t recompressAll();
+
+    /// @return The number of references held on @p hash (0 if it does not exist).
+    uint64_t refCount(const std::string &hash);
+
+    /// @return A snapshot of the store counters.
+    Stats stats();
+}
+
+#endif // FOLSERV_BLOB_STORE_H_
@@ -0,0 +1,181 @@
+#include "compression.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <zdict.h>
+#include <zstd.h>
+
+namespace
+{
+    struct CCtxDeleter
+    {
+        void operator()(ZSTD_CCtx *ctx) const { ZSTD_freeCCtx(ctx); }
+    };
+    struct DCtxDeleter
+    {
+        void operator()(ZSTD_DCtx *ctx) const { ZSTD_freeDCtx(ctx); }
+    };
+
+    ZSTD_CCtx *threadCCtx()
+    {
+        thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> ctx(ZSTD_createCCtx());
+        return ctx.get();
+    }
+
+    ZSTD_DCtx *threadDCtx()
+    {
+        thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx(ZSTD_createDCtx());
+        return ctx.get();
+    }
+
+    size_t check(size_t result, const char *what)
+    {
+        if (ZSTD_isError(result))
+            throw std::runtime_error(std::string("zstd: ") + what + ": " + ZSTD_getErrorName(result));
+        return result;
+    }
+
+    // Frames without a recorded size (e.g. from an external tool) are decompressed as a stream.
+    std::string decompressStream(std::string_view frame, ZSTD_DCtx *ctx)
+    {
+        std::string out;
+        std::string chunk(ZSTD_DStreamOutSize(), '\0');
+        ZSTD_inBuffer in{frame.data(), frame.size(), 0};
+        size_t remaining = 1;
+        while (in.pos < in.size && remaining != 0)
+        {
+            ZSTD_outBuffer buffer{chunk.data(), chunk.size(), 0};
+            remaining = check(ZSTD_decompressStream(ctx, &buffer, &in), "decompress");
+            out.append(chunk.data(), buffer.pos);
+        }
+        if (remaining != 0)
+            throw std::runtime_error("zstd: truncated frame");
+        return out;
+    }
+}
+
+namespace compression
+{
+    Dictionary::Dictionary(std::string bytes, int level)
+        : bytes_(std::move(bytes))
+    {
+        id_ = ZDICT_getDictID(bytes_.data(), bytes_.size());
+        if (id_ == 0)
+            throw std::runtime_error("zstd: not a dictionary");
+        cdict_ = ZSTD_createCDict(bytes_.data(), bytes_.size(), level);
+        ddict_ = ZSTD_createDDict(bytes_.data(), bytes_.size());
+        if (!cdict_ || !ddict_)
+        {
+            ZSTD_freeCDict(cdict_);
+            ZSTD_freeDDict(ddict_);
+            throw std::runtime_error("zstd: cannot load dictionary");
+        }
+    }
+
+    Dictionary::~Dictionary()
+    {
+        ZSTD_freeCDict(cdict_);
+        ZSTD_freeDDict(ddict_);
+    }
+
+    std::string compress(std::string_view data, const Dictionary *dictionary, int level)
+    {
+        std::string out(ZSTD_compressBound(data.size()), '\0');
+        ZSTD_CCtx *ctx = threadCCtx();
+        size_t size = dictionary
+                    ? ZSTD_compress_usingCDict(ctx, out.data(), out.size(), data.data(), data.size(), dictionary->cdict())
+                    : ZSTD_compressCCtx(ctx, out.data(), out.size(), data.data(), data.size(), level);
+        out.resize(check(size, "compress"));
+        return out;
+    }
+
+    bool isFrame(std::string_view data)
+    {
+        if (data.size() < sizeof(uint32_t))
+            return false;
+        uint32_t magic;
+        std::memcpy(&magic, data.data(), sizeof(magic)); // little-endian, like the frame
+        return magic == ZSTD_MAGICNUMBER;
+    }
+
+    unsigned dictionaryIdOf(std::string_view frame)
+    {
+        return ZSTD_getDictID_fromFrame(frame.data(), frame.size());
+    }
+
+    std::string decompress(std::string_view frame, const Dictionary *dictionary)
+    {
+        ZSTD_DCtx *ctx = threadDCtx();
+        check(ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters), "reset");
+        check(ZSTD_DCtx_refDDict(ctx, dictionary ? dictionary->ddict() : nullptr), "dictionary");
+
+        unsigned long long size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+        if (size == ZSTD_CONTENTSIZE_ERROR)
+            throw std::runtime_error("zstd: not a frame");
+        if (size == ZSTD_CONTENTSIZE_UNKNOWN)
+            return decompressStream(frame, ctx);
+
+        std::string out(size, '\0');
+        size_t written = check(ZSTD_decompressDCtx(ctx, out.data(), out.size(), frame.data(), frame.size()),
+                               "decompress");
+        if (written != size)
+            throw std::runtime_error("zstd: frame shorter than its recorded size");
+        return out;
+    }
+
+    std::string train(const std::vector<std::string> &samples, size_t capacity)
+    {
+        std::string buffer;
+        std::vector<size_t> sizes;
+        for (const std::string &sample : samples)
+        {
+            buffer += sample;
+            sizes.push_back(sample.size());
+        }
+        std::string dictionary(capacity, '\0');
+        size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), buffer.data(), sizes.data(),
+                                            static_cast<unsigned>(sizes.size()));
+        if (ZDICT_isError(size))
+            throw std::runtime_error(std::string("zstd: cannot train dictionary: ") + ZDICT_getErrorName(size));
+        dictionary.resize(size);
+        return dictionary;
+    }
+
+    bool acceptsZstd(std::string_view acceptEncoding)
+    {
+        // e.g. "gzip, deflate, br, zstd" or "zstd;q=0"
+        size_t start = 0;
+        while (start <= acceptEncoding.size())
+        {
+            size_t end = acceptEncoding.find(',', start);
+            if (end == std::string_view::npos)
+                end = acceptEncoding.size();
+            std::string_view item = acceptEncoding.substr(start, end - start);
+            start = end + 1;
+
+            size_t params = item.find(';');
+            std::string_view name = item.substr(0, params);
+            while (!name.empty() && std::isspace(static_cast<unsigned char>(name.front())))
+                name.remove_prefix(1);
+            while (!name.empty() && std::isspace(static_cast<unsigned char>(name.back())))
+                name.remove_suffix(1);
+            if (name != "zstd")
+                continue;
+
+            if (params == std::string_view::npos)
+                return true;
+            std::string_view q = item.substr(params + 1);
+            size_t at = q.find("q=");
+            if (at == std::string_view::npos)
+                return true;
+            // q=0, q=0.0, q=0.00 ... refuse it
+            std::string_view value = q.substr(at + 2);
+            return value.find_first_not_of("0. ") != std::string_view::npos;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ * @file compression.h
+ * @brief zstd compression helpers: frames, trained dictionaries and HTTP content negotiation.
+ *
+ * Compression and decompression contexts are kept per thread and reused, so
+ * small payloads do not pay for context setup. A Dictionary is digested once
+ * for both directions and can be shared between threads.
+ *
+ * All functions throw std::runtime_error if zstd reports an error.
+ */
+
+#ifndef FOLSERV_COMPRESSION_H_
+#define FOLSERV_COMPRESSION_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace compression
+{
+    // Good ratio at several hundred MB/s; higher levels buy little on note text.
+    constexpr int kLevel = 3;
+
+    /**
+     * @brief A trained zstd dictionary, ready for compression and decompression.
+     */
+    class Dictionary
+    {
+    public:
+        /// @throws std::runtime_error if @p bytes is not a zstd dictionary.
+        explicit Dictionary(std::string bytes, int level = kLevel);
+        ~Dictionary();
+
+        Dictionary(const Dictionary &) = delete;
+        Dictionary &operator=(const Dictionary &) = delete;
+
+        /// @return The dictionary ID written into the header of every frame it compresses.
+        unsigned id() const { return id_; }
+
+        /// @return The raw dictionary, as it is stored on disk.
+        const std::string &bytes() const { return bytes_; }
+
+        const ZSTD_CDict_s *cdict() const { return cdict_; }
+        const ZSTD_DDict_s *ddict() const { return ddict_; }
+
+    private:
+        std::string bytes_;
+        unsigned id_ = 0;
+        ZSTD_CDict_s *cdict_ = nullptr;
+        ZSTD_DDict_s *ddict_ = nullptr;
+    };
+
+    /// @brief Compresses @p data into one zstd frame that records its size.
+    /// @param dictionary Optional; the dictionary's level overrides @p level.
+    std::string compress(std::string_view data, const Dictionary *dictionary = nullptr, int level = kLevel);
+
+    /// @return True if @p data starts with a zstd frame header.
+    bool isFrame(std::string_view data);
+
+    /// @return The ID of the dictionary @p frame was compressed with, 0 for none.
+    unsigned dictionaryIdOf(std::string_view frame);
+
+    /// @brief Decompresses one zstd frame.
+    /// @param dictionary Must be the dictionary the frame was compressed with, if any.
+    /// @throws std::runtime_error if the frame is corrupt or needs another dictionary.
+    std::string decompress(std::string_view frame, const Dictionary *dictionary = nullptr);
+
+    /// @brief Trains a dictionary on sample payloads.
+    /// @param capacity Maximum dictionary size in bytes.
+    /// @throws std::runtime_error if there are too few samples to train on.
+    /// @return The raw dictionary, for Dictionary's constructor.
+    std::string train(const std::vector<std::string> &samples, size_t capacity = 112 << 10);
+
+    /// @return True if an HTTP Accept-Encoding header value accepts zstd.
+    bool acceptsZstd(std::string_view acceptEncoding);
+}
+
+#endif // FOLSERV_COMPRESSION_H_
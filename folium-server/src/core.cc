@@ -1,55 +1,135 @@
 #include "core.h"
 #include "data_access_layer.h"
+#include "logger.h"
+#include "near_duplicate.h"
+#include "note_actor.h"
+#include "note_buffer.h"
+#include "note_history.h"
+#include "note_pipeline.h"
+#include "note_store.h"
+#include "search_index.h"
 #include <stdexcept>
 #include <sstream>
 #include <fstream> 
 #include <nlohmann/json.hpp>
 #include <filesystem>
 #include <ctime>  // For std::time()
+#include <algorithm>
+#include <functional>
 
 using json = nlohmann::json;
 
 namespace Core {
 
+// Records a version in the note's history. The edit has already been applied by then,
+// so a failure is logged rather than failing the request.
+static void recordHistory(const std::string& notePath, const std::function<size_t()>& record) {
+    try {
+        record();
+    } catch (const std::exception& e) {
+        logger::logErr("Failed to record history of " + notePath + ": " + e.what());
+    }
+}
+
+// Brings the class's units in the search index up to date. Like history, a failure
+// leaves the edit in place and is only logged.
+static void indexForSearch(int classId, const std::function<void()>& update) {
+    try {
+        update();
+    } catch (const std::exception& e) {
+        logger::logErr("Failed to index class " + std::to_string(classId) + " for search: " + e.what());
+    }
+}
+
+// Rethrows the exception being handled with @p context in front of its message, keeping its
+// kind so the gateway can still tell a forbidden or missing resource from a failure.
+[[noreturn]] static void rethrowWithContext(const std::string& context, const std::exception& e) {
+    try {
+        throw;
+    } catch (const Forbidden&) {
+        throw Forbidden(context + e.what());
+    } catch (const NotFound&) {
+        throw NotFound(context + e.what());
+    } catch (const std::invalid_argument&) {
+        throw std::invalid_argument(context + e.what());
+    } catch (...) {
+        throw std::runtime_error(context + e.what());
+    }
+}
+
+// Runs a mutation of the class's note on its actor (see note_actor.h), so it never interleaves
+// with another mutation of the same note; DAL calls stay tagged with the requesting user.
+static json onClassActor(int classId, int userId, const std::function<json()>& mutation) {
+    return NoteActor::instance().run(classId, [userId, mutation]() {
+        DAL::SessionScope session(std::to_string(userId));
+        return mutation();
+    });
+}
+
 // Retrieve the big note for a specific class
 json getBigNote(int classId, int userId) {
     try {
         // Verify user access
-        std::string accessQuery = "SELECT 1 FROM user_classes WHERE class_id = " + std::to_string(classId) +
-                                  " AND user_id = " + std::to_string(userId) + ";";
-        if (!DAL::query_returns_results(accessQuery)) {
-            throw std::runtime_error("User does not have access to this class.");
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User does not have access to this class.");
         }
 
-        // Retrieve the file path for the note
-        std::string filePathQuery = "SELECT file_path FROM notes WHERE class_id = " + std::to_string(classId) + ";";
-        std::string filePath = DAL::get_single_result(filePathQuery);
-        if (filePath.empty()) {
+        // Retrieve the file path and version of the note
+        std::optional<DAL::NoteRef> note = DAL::getNoteForClass(classId);
+        if (!note) {
             // Return an empty JSON object instead of throwing an error
             return json::object();
         }
 
-        // Check if the file exists
-        if (!std::filesystem::exists(filePath)) {
-            throw std::runtime_error("Note file does not exist at path: " + filePath);
+        // Served from the write-behind buffer so pending edits are visible;
+        // a resident copy from another version of the note is reloaded
+        std::shared_ptr<const json> noteJson = NoteBuffer::instance().read(classId, note->path, note->version);
+        if (noteJson->is_null()) {
+            return json::object(); // Empty or unparsable file
         }
+        return *noteJson;
+    } catch (const std::exception& e) {
+        rethrowWithContext("Failed to retrieve big note: ", e);
+    }
+}
 
-        // Read the file content
-        std::string fileContent = DAL::readFile(filePath);
-        if (fileContent.empty()) {
-            return json::object(); // Return empty JSON object
+// Retrieve part of the big note; see note_page.h
+json getBigNotePage(int classId, int userId, const notestore::PageQuery& query) {
+    try {
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User does not have access to this class.");
         }
 
-        // Parse the file content as JSON
-        json noteJson;
-        try {
-            noteJson = json::parse(fileContent);
-            return noteJson;
-        } catch (const json::parse_error& e) {
-            throw std::runtime_error("Failed to parse note content as JSON: " + std::string(e.what()));
+        std::optional<DAL::NoteRef> note = DAL::getNoteForClass(classId);
+        if (!note) {
+            return json::object();
         }
+
+        // Pending edits are visible as in getBigNote(), but a note that is not resident
+        // is not loaded whole: only the selected units are read from the file
+        return NoteBuffer::instance().readPage(classId, note->path, note->version, query);
     } catch (const std::exception& e) {
-        throw std::runtime_error("Failed to retrieve big note: " + std::string(e.what()));
+        rethrowWithContext("Failed to retrieve big note: ", e);
+    }
+}
+
+// Build a note from JSON or plain text content
+json noteFromContent(const std::string& content, const std::string& title) {
+    try {
+        // Try to parse the content as JSON first
+        return json::parse(content);
+    } catch (const json::parse_error& e) {
+        // If parsing fails, wrap the content as a string in a JSON object
+        return {
+            {"title", title},
+            {"units", json::array({
+                {
+                    {"unitId", "unit_1"},
+                    {"title", title},
+                    {"content", content}
+                }
+            })}
+        };
     }
 }
 
@@ -57,215 +137,108 @@ json getBigNote(int classId, int userId) {
 bool createBigNote(int classId, int userId, const std::string& content, const std::string& title) {
     try {
         // Verify user enrollment
-        if (!DAL::query_returns_results("SELECT 1 FROM user_classes WHERE user_id = " + std::to_string(userId) + 
-                                        " AND class_id = " + std::to_string(classId) + ";")) {
-            throw std::runtime_error("User is not enrolled in this class.");
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User is not enrolled in this class.");
         }
 
-        // Ensure the notes directory exists
-        std::filesystem::create_directories("notes");
-
-        // Create the note file as JSON
-        std::string notePath = "notes/class_" + std::to_string(classId) + "_note.json";
-        
-        // Create a proper JSON structure
-        json noteJson;
-        try {
-            // Try to parse the content as JSON first
-            noteJson = json::parse(content);
-        } catch (const json::parse_error& e) {
-            // If parsing fails, wrap the content as a string in a JSON object
-            noteJson = {
-                {"title", title},
-                {"units", json::array({
-                    {
-                        {"unitId", "unit_1"},
-                        {"title", title},
-                        {"content", content}
-                    }
-                })}
-            };
-        }
-        
-        // Write the JSON to file
-        if (!DAL::writeFile(notePath, noteJson.dump())) {
-            throw std::runtime_error("Failed to create note file: " + notePath);
-        }
+        onClassActor(classId, userId, [&]() {
+            // Create the note file as JSON, in its hashed notes/ subdirectory
+            std::string notePath = notestore::pathFor(classId);
+            std::filesystem::create_directories(std::filesystem::path(notePath).parent_path());
 
-        // Insert the note record into the database
-        std::string query = "INSERT INTO notes (class_id, file_path, title, created_at, updated_at) VALUES (" +
-                            std::to_string(classId) + ", '" + DAL::escape_string(notePath) + "', '" +
-                            DAL::escape_string(title) + "', NOW(), NOW());";
-        if (!DAL::execute_query(query)) {
-            throw std::runtime_error("Failed to insert note record into database.");
-        }
+            // Create a proper JSON structure
+            json noteJson = noteFromContent(content, title);
+
+            // Write the JSON to file, unit content goes to the blob store
+            notestore::save(notePath, noteJson);
+            NoteBuffer::instance().invalidate(classId);
 
+            // Insert the note record into the database
+            std::string query = "INSERT INTO notes (class_id, file_path, title, created_at, updated_at) VALUES (" +
+                                std::to_string(classId) + ", '" + DAL::escape_string(notePath) + "', '" +
+                                DAL::escape_string(title) + "', NOW(), NOW());";
+            if (!DAL::execute_query(query)) {
+                throw std::runtime_error("Failed to insert note record into database.");
+            }
+
+            recordHistory(notePath, [&]() {
+                return notehistory::snapshot(notePath, userId, "Created note", noteJson);
+            });
+            indexForSearch(classId, [&]() { searchindex::replaceClass(classId, noteJson); });
+            neardup::forget(classId);
+            return json(true);
+        });
         return true;
     } catch (const std::exception& e) {
-        throw std::runtime_error("Failed to create big note: " + std::string(e.what()));
+        rethrowWithContext("Failed to create big note: ", e);
     }
 }
 
 // Upload and integrate a new note
-bool uploadNote(int classId, int userId, const std::string& filePath, const std::string& title) {
+bool uploadNote(int classId, int userId, const std::string& filePath, const std::string& title,
+                std::string* uploadId) {
     try {
         // Verify user access
-        if (!DAL::query_returns_results("SELECT 1 FROM user_classes WHERE class_id = " + std::to_string(classId) + 
-                                        " AND user_id = " + std::to_string(userId) + ";")) {
-            throw std::runtime_error("User is not enrolled in this class.");
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User is not enrolled in this class.");
         }
 
-        // Read the uploaded file content
-        std::string fileContent = DAL::readFile(filePath);
-        if (fileContent.empty()) {
-            throw std::runtime_error("Uploaded file is empty or could not be read.");
+        // The file is staged as is; decoding and merging into the big note happen in the pipeline
+        std::error_code ec;
+        if (std::filesystem::file_size(filePath, ec) == 0 || ec) {
+            throw std::invalid_argument("Uploaded file is empty or could not be read.");
         }
-
-        // Try to parse as JSON, fall back to text content
-        json uploadedJson;
-        try {
-            uploadedJson = json::parse(fileContent);
-        } catch (const json::parse_error& e) {
-            // Create a basic JSON structure for text content
-            uploadedJson = {
-                {"title", title.empty() ? "Uploaded Note" : title},
-                {"content", fileContent}
-            };
-        }
-
-        // Check if a note already exists
-        std::string existingFilePath = DAL::get_single_result("SELECT file_path FROM notes WHERE class_id = " 
-                                    + std::to_string(classId) + ";");
-        
-        if (existingFilePath.empty()) {
-            // Create a new note if none exists
-            json newNote = {
-                {"title", title.empty() ? "Uploaded Note" : title},
-                {"units", json::array({
-                    {
-                        {"unitId", "unit_1"},
-                        {"title", title.empty() ? "Uploaded Note" : title},
-                        {"content", uploadedJson.dump()}
-                    }
-                })}
-            };
-            return createBigNote(classId, userId, newNote.dump(), title.empty() ? "Uploaded Note" : title);
+        std::string id = NotePipeline::instance().submitFile(classId, userId, filePath, title);
+        if (uploadId) {
+            *uploadId = id;
         }
-
-        // Read the existing note content
-        std::string existingContent = DAL::readFile(existingFilePath);
-        json existingJson;
-        
-        if (!existingContent.empty()) {
-            try {
-                existingJson = json::parse(existingContent);
-            } catch (const json::parse_error& e) {
-                // If existing content isn't valid JSON, create a new structure
-                existingJson = {
-                    {"title", title.empty() ? "Note Collection" : title},
-                    {"units", json::array()}
-                };
-            }
-        } else {
-            // If file is empty or doesn't exist, create a new JSON structure
-            existingJson = {
-                {"title", title.empty() ? "Note Collection" : title},
-                {"units", json::array()}
-            };
-        }
-
-        // Ensure "units" exists as an array
-        if (!existingJson.contains("units")) {
-            existingJson["units"] = json::array();
-        } else if (!existingJson["units"].is_array()) {
-            // If units exists but isn't an array, replace it with an array
-            existingJson["units"] = json::array();
-        }
-
-        // Generate a unique unit ID
-        std::string unitId = "unit_" + std::to_string(
-            existingJson["units"].is_array() ? existingJson["units"].size() + 1 : 1);
-
-        // Create a new unit containing the uploaded content
-        json newUnit = {
-            {"unitId", unitId},
-            {"title", title.empty() ? "Uploaded Note" : title},
-            {"content", uploadedJson.dump()}
-        };
-
-        // Append the new unit to the "units" array
-        existingJson["units"].push_back(newUnit);
-
-        // Write the updated JSON back to the file
-        if (!DAL::writeFile(existingFilePath, existingJson.dump())) {
-            throw std::runtime_error("Failed to write integrated content to file.");
-        }
-
-        // Update the database timestamp
-        std::string query = "UPDATE notes SET updated_at = NOW() WHERE class_id = " + std::to_string(classId) + ";";
-        if (!DAL::execute_query(query)) {
-            throw std::runtime_error("Failed to update note timestamp in database.");
-        }
-
         return true;
     } catch (const std::exception& e) {
-        throw std::runtime_error("Failed to upload note: " + std::string(e.what()));
+        rethrowWithContext("Failed to upload note: ", e);
+    }
+}
+
+// Report the progress of an upload
+json getUploadStatus(int classId, int userId, const std::string& uploadId) {
+    if (!DAL::isEnrolled(userId, classId)) {
+        throw Forbidden("User does not have access to this class.");
+    }
+    std::optional<json> status = NotePipeline::instance().status(uploadId);
+    if (!status || status->value("classId", 0) != classId) {
+        throw NotFound("Upload not found.");
     }
+    return *status;
 }
 
 // Edit the big note for a class
 bool editBigNote(int classId, int userId, const std::string& content, const std::string& title) {
     try {
         // Verify user access
-        if (!DAL::query_returns_results("SELECT 1 FROM user_classes WHERE class_id = " + std::to_string(classId) + 
-                                        " AND user_id = " + std::to_string(userId) + ";")) {
-            throw std::runtime_error("User is not enrolled in this class.");
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User is not enrolled in this class.");
         }
 
         // Retrieve the file path for the note
-        std::string filePath = DAL::get_single_result("SELECT file_path FROM notes WHERE class_id = " + std::to_string(classId) + ";");
+        std::string filePath = DAL::getNotePathForClass(classId);
         if (filePath.empty()) {
-            throw std::runtime_error("No big note exists for this class. Use createBigNote first.");
+            throw NotFound("No big note exists for this class. Use createBigNote first.");
         }
 
-        // Read the existing file content
-        std::string existingContent = DAL::readFile(filePath);
-        json noteJson;
-        
-        // Process the content
-        try {
-            // First, try to parse the new content as JSON
-            noteJson = json::parse(content);
-        } catch (const json::parse_error&) {
-            // If the new content is not valid JSON, try to parse the existing file
-            try {
-                if (!existingContent.empty()) {
-                    noteJson = json::parse(existingContent);
-                    
-                    // Update the title if provided
-                    if (!title.empty()) {
-                        noteJson["title"] = title;
-                    }
-                    
-                    // Create or update the content in a new unit
-                    std::string unitId = "unit_edited_" + std::to_string(std::time(nullptr));
-                    
-                    json newUnit = {
-                        {"unitId", unitId},
-                        {"title", title.empty() ? "Edited Note" : title},
-                        {"content", content}
-                    };
-                    
-                    // Ensure units array exists
-                    if (!noteJson.contains("units")) {
-                        noteJson["units"] = json::array();
-                    } else if (!noteJson["units"].is_array()) {
-                        noteJson["units"] = json::array();
-                    }
-                    
-                    noteJson["units"].push_back(newUnit);
-                } else {
-                    // If there's no existing content, create a new JSON structure
+        onClassActor(classId, userId, [&]() {
+            // What the edit did, for the history: null if it replaced the whole note
+            json records;
+
+            // Apply the edit to the resident note; the buffer writes it back later
+            NoteBuffer::instance().apply(classId, filePath, [&](json& noteJson) {
+                // If the new content is a full JSON document, it replaces the note
+                json replacement = json::parse(content, nullptr, false);
+                if (!replacement.is_discarded()) {
+                    noteJson = std::move(replacement);
+                    return;
+                }
+
+                if (noteJson.is_null()) {
+                    // If there's no usable existing content, create a new JSON structure
                     noteJson = {
                         {"title", title.empty() ? "Edited Note" : title},
                         {"units", json::array({
@@ -276,39 +249,269 @@ bool editBigNote(int classId, int userId, const std::string& content, const std:
                             }
                         })}
                     };
+                    return;
+                }
+
+                // Update the title if provided
+                records = json::array();
+                if (!title.empty()) {
+                    noteJson["title"] = title;
+                    records.push_back(notestore::record::title(title));
                 }
-            } catch (const std::exception&) {
-                // If anything goes wrong with the existing file, create a new structure
-                noteJson = {
+
+                // Ensure units array exists
+                if (!noteJson.contains("units") || !noteJson["units"].is_array()) {
+                    noteJson["units"] = json::array();
+                    records = nullptr;
+                }
+
+                // Store the content in a new unit
+                json unit = {
+                    {"unitId", "unit_edited_" + std::to_string(std::time(nullptr))},
                     {"title", title.empty() ? "Edited Note" : title},
-                    {"units", json::array({
-                        {
-                            {"unitId", "unit_1"},
-                            {"title", title.empty() ? "Edited Note" : title},
-                            {"content", content}
-                        }
-                    })}
+                    {"content", content}
                 };
-            }
+                if (records.is_array()) {
+                    records.push_back(notestore::record::append(noteJson["units"].size(), unit));
+                }
+                noteJson["units"].push_back(std::move(unit));
+            }, content.size());
+
+            // Update the title and timestamp in the database
+            DAL::bumpNoteVersion(classId, title);
+
+            // An appended unit is a delta; a replaced note is a snapshot
+            recordHistory(filePath, [&]() {
+                auto current = [&]() { return *NoteBuffer::instance().read(classId, filePath); };
+                return records.is_array() ? notehistory::record(filePath, userId, "Edited note", records, current)
+                                          : notehistory::snapshot(filePath, userId, "Edited note", current());
+            });
+            indexForSearch(classId, [&]() { searchindex::replaceClass(classId, *NoteBuffer::instance().read(classId, filePath)); });
+            neardup::forget(classId);
+            return json(true);
+        });
+        return true;
+    } catch (const std::exception& e) {
+        rethrowWithContext("Failed to edit big note: ", e);
+    }
+}
+
+// Update or insert one unit of the big note by its ID
+json editBigNoteUnit(int classId, int userId, const std::string& unitId, const json& fields, const std::string& after) {
+    try {
+        // Verify user access
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User is not enrolled in this class.");
+        }
+        if (unitId.empty()) {
+            throw std::invalid_argument("Unit ID is empty.");
+        }
+        if (!fields.is_object()) {
+            throw std::invalid_argument("Unit fields must be an object.");
         }
 
-        // Write the updated content to the file
-        if (!DAL::writeFile(filePath, noteJson.dump())) {
-            throw std::runtime_error("Failed to write updated note content to file at path: " + filePath);
+        std::string filePath = DAL::getNotePathForClass(classId);
+        if (filePath.empty()) {
+            throw NotFound("No big note exists for this class. Use createBigNote first.");
         }
 
-        // Update the title and timestamp in the database
-        std::string query = title.empty() 
-                          ? "UPDATE notes SET updated_at = NOW() WHERE class_id = " + std::to_string(classId) + ";"
-                          : "UPDATE notes SET title = '" + DAL::escape_string(title) + "', updated_at = NOW() WHERE class_id = " + std::to_string(classId) + ";";
-        if (!DAL::execute_query(query)) {
-            throw std::runtime_error("Failed to update note in database.");
+        // Only this unit is appended to the note file when the buffer writes back
+        return onClassActor(classId, userId, [&]() {
+            NoteBuffer::UnitEdit edit = NoteBuffer::instance().upsertUnit(classId, filePath, unitId, fields, after,
+                                                                          fields.dump().size());
+
+            DAL::bumpNoteVersion(classId);
+
+            recordHistory(filePath, [&]() {
+                return notehistory::record(filePath, userId, (edit.inserted ? "Inserted " : "Edited ") + unitId,
+                                           json::array({edit.record}),
+                                           [&]() { return *NoteBuffer::instance().read(classId, filePath); });
+            });
+            indexForSearch(classId, [&]() { searchindex::update(classId, edit.record[edit.inserted ? "insert" : "set"]); });
+            neardup::update(classId, edit.record[edit.inserted ? "insert" : "set"]);
+            return json({
+                {"unitId", unitId},
+                {"status", edit.inserted ? "inserted" : "updated"},
+                {"position", edit.position}
+            });
+        });
+    } catch (const std::exception& e) {
+        rethrowWithContext("Failed to edit unit: ", e);
+    }
+}
+
+// Delete one unit of the big note by its ID
+json deleteBigNoteUnit(int classId, int userId, const std::string& unitId) {
+    try {
+        // Verify user access
+        if (!DAL::isEnrolled(userId, classId)) {
+            throw Forbidden("User is not enrolled in this class.");
         }
 
-        return true;
+        std::string filePath = DAL::getNotePathForClass(classId);
+        if (filePath.empty()) {
+            throw NotFound("No big note exists for this class.");
+        }
+
+        return onClassActor(classId, userId, [&]() {
+            std::optional<size_t> position = NoteBuffer::instance().deleteUnit(classId, filePath, unitId);
+            if (!position) {
+                throw NotFound("Unit " + unitId + " not found.");
+            }
+
+            DAL::bumpNoteVersion(classId);
+
+            recordHistory(filePath, [&]() {
+                return notehistory::record(filePath, userId, "Deleted " + unitId,
+                                           json::array({notestore::record::remove(unitId)}),
+                                           [&]() { return *NoteBuffer::instance().read(classId, filePath); });
+            });
+            indexForSearch(classId, [&]() { searchindex::remove(classId, unitId); });
+            neardup::remove(classId, unitId);
+            return json({
+                {"unitId", unitId},
+                {"status", "deleted"},
+                {"position", *position}
+            });
+        });
     } catch (const std::exception& e) {
-        throw std::runtime_error("Failed to edit big note: " + std::string(e.what()));
+        rethrowWithContext("Failed to delete unit: ", e);
+    }
+}
+
+// List the versions of the big note, served from the history index alone
+json getBigNoteHistory(int classId, int userId) {
+    if (!DAL::isEnrolled(userId, classId)) {
+        throw Forbidden("User does not have access to this class.");
+    }
+    std::string filePath = DAL::getNotePathForClass(classId);
+    if (filePath.empty()) {
+        throw NotFound("No big note exists for this class.");
     }
+
+    json history = json::array();
+    for (const notehistory::Version& version : notehistory::list(filePath)) {
+        history.push_back({
+            {"version", version.version},
+            {"timestamp", version.timestamp},
+            {"userId", version.userId},
+            {"description", version.description}
+        });
+    }
+    return {{"history", history}};
+}
+
+// Rebuild one version of the big note from its history
+json getBigNoteVersion(int classId, int userId, size_t version) {
+    if (!DAL::isEnrolled(userId, classId)) {
+        throw Forbidden("User does not have access to this class.");
+    }
+    std::string filePath = DAL::getNotePathForClass(classId);
+    if (filePath.empty()) {
+        throw NotFound("No big note exists for this class.");
+    }
+    return {{"version", version}, {"bigNote", notehistory::at(filePath, version)}};
+}
+
+// Flush the note so the gateway can render it straight from the file
+json prepareExport(int classId, int userId) {
+    if (!DAL::isEnrolled(userId, classId)) {
+        throw Forbidden("User does not have access to this class.");
+    }
+    std::optional<DAL::NoteRef> note = DAL::getNoteForClass(classId);
+    if (!note) {
+        throw NotFound("No big note exists for this class.");
+    }
+    NoteBuffer::instance().flush(classId);
+    return {{"path", note->path}, {"version", std::to_string(note->version)}};
+}
+
+// Search the units of the user's classes
+json searchNotes(int userId, const std::string& query, size_t limit) {
+    std::vector<int> classIds = DAL::getClassIds(static_cast<unsigned int>(userId));
+    size_t total = 0;
+    json results = json::array();
+    for (const searchindex::Hit& hit : searchindex::search(query, {classIds.begin(), classIds.end()}, limit, &total)) {
+        results.push_back({
+            {"classId", hit.classId},
+            {"unitId", hit.unitId},
+            {"title", hit.title},
+            {"score", hit.score},
+            {"positions", hit.positions}
+        });
+    }
+    return {{"query", query}, {"total", total}, {"results", results}};
+}
+
+// Shape of a class in API responses
+static json classToJson(const DAL::ClassDetail& detail) {
+    json out = {
+        {"id", detail.classId},
+        {"name", detail.name},
+        {"description", detail.description},
+        {"instructor", detail.instructor},
+        {"ownerId", detail.ownerId},
+        {"owner", detail.ownerUsername},
+        {"noteId", nullptr},
+        {"title", detail.noteTitle},
+        {"updatedAt", detail.noteUpdatedAt}
+    };
+    if (detail.noteId) {
+        out["noteId"] = *detail.noteId;
+    }
+    return out;
+}
+
+// List a user's classes with owners and notes
+json getUserClasses(int userId) {
+    json classes = json::array();
+    for (const DAL::ClassDetail& detail : DAL::getClassDetails(static_cast<unsigned int>(userId))) {
+        classes.push_back(classToJson(detail));
+    }
+    return {{"classes", classes}};
+}
+
+// Retrieve one class with its owner and note
+json getClassDetails(int classId, int userId) {
+    std::optional<DAL::ClassDetail> detail =
+        DAL::getClassDetail(static_cast<unsigned int>(userId), static_cast<unsigned int>(classId));
+    if (!detail) {
+        throw NotFound("Class not found.");
+    }
+    return classToJson(*detail);
+}
+
+// Enroll a list of users into a class the requester owns
+json bulkEnroll(int classId, int userId, const std::vector<std::string>& usernames) {
+    std::optional<DAL::ClassDetail> detail =
+        DAL::getClassDetail(static_cast<unsigned int>(userId), static_cast<unsigned int>(classId));
+    if (!detail) {
+        throw NotFound("Class not found.");
+    }
+    if (detail->ownerId != static_cast<unsigned int>(userId)) {
+        throw Forbidden("Class not owned by the user.");
+    }
+
+    std::unordered_map<std::string, unsigned int> ids = DAL::getUserIds(usernames);
+    std::vector<unsigned int> userIds;
+    json unknown = json::array();
+    for (const std::string& username : usernames) {
+        auto it = ids.find(username);
+        if (it == ids.end()) {
+            unknown.push_back(username);
+        } else {
+            userIds.push_back(it->second);
+        }
+    }
+    std::sort(userIds.begin(), userIds.end());
+    userIds.erase(std::unique(userIds.begin(), userIds.end()), userIds.end());
+
+    size_t enrolled = DAL::enrollUsers(static_cast<unsigned int>(classId), userIds);
+    return {
+        {"enrolled", enrolled},
+        {"alreadyEnrolled", userIds.size() - enrolled},
+        {"unknown", unknown}
+    };
 }
 
 } // namespace Core
\ No newline at end of file
@@ -18,10 +18,32 @@
  #include <string>
  #include <vector>
  #include <map>
+ #include <stdexcept>
  #include <nlohmann/json.hpp>
+ #include "note_page.h"
  
  namespace Core
  {
+     /**
+      * @brief Thrown when the requesting user may not act on the class: not enrolled, or not its owner.
+      */
+     class Forbidden : public std::runtime_error
+     {
+     public:
+         using std::runtime_error::runtime_error;
+     };
+
+     /**
+      * @brief Thrown when the class, its big note, a unit or an upload does not exist.
+      */
+     class NotFound : public std::runtime_error
+     {
+     public:
+         using std::runtime_error::runtime_error;
+     };
+
+     // Bad input is reported with std::invalid_argument; any other exception is an internal failure.
+
      /**
       * @brief Retrieves the big note for a specific class
       * @param classId The ID of the class
@@ -31,14 +53,35 @@
     nlohmann::json getBigNote(int classId, int userId);
      
      /**
-      * @brief Uploads and integrates a new note into a class's big note
+      * @brief Retrieves a page of the big note: a range or list of units, optionally without content
+      * @param classId The ID of the class
+      * @param userId The ID of the requesting user (for access verification)
+      * @param query Which units and fields to return (see note_page.h)
+      * @return The note's fields with the selected units and "totalUnits", or an empty object if there is no note
+      */
+     nlohmann::json getBigNotePage(int classId, int userId, const notestore::PageQuery& query);
+
+     /**
+      * @brief Stages a new note for merging into a class's big note (see note_pipeline.h)
       * @param classId The ID of the class
       * @param userId The ID of the user uploading the note
       * @param filePath Path to the uploaded file
       * @param title Optional title for the note
-      * @return True if the upload and integration was successful
+      * @param uploadId If given, receives the id to poll getUploadStatus() with
+      * @return True once the upload is durably staged (merged too, if the pipeline is not started)
+      */
+     bool uploadNote(int classId, int userId, const std::string& filePath, const std::string& title = "",
+                     std::string* uploadId = nullptr);
+
+     /**
+      * @brief Reports how far an upload has got through the note pipeline
+      * @param classId The ID of the class the upload was made to
+      * @param userId The ID of the requesting user (for access verification)
+      * @param uploadId The id returned by uploadNote()
+      * @return {"uploadId", "classId", "status": "staged" | "merged" | "duplicate" | "failed", ...}
+      * @throws Forbidden if the user cannot access the class, NotFound if the upload is unknown
       */
-     bool uploadNote(int classId, int userId, const std::string& filePath, const std::string& title = "");
+     nlohmann::json getUploadStatus(int classId, int userId, const std::string& uploadId);
      
      /**
       * @brief Directly edits the content of a class's big note
@@ -50,6 +93,69 @@
       */
      bool editBigNote(int classId, int userId, const std::string& content, const std::string& title = "");
      
+     /**
+      * @brief Updates one unit of a class's big note, or inserts it if no unit has that ID
+      * @param classId The ID of the class
+      * @param userId The ID of the user editing the note
+      * @param unitId The unit to edit
+      * @param fields Unit fields to set (e.g. "title", "content")
+      * @param after When inserting, the unit to place it after; empty for the end of the note
+      * @return {"unitId", "status": "updated" or "inserted", "position"}
+      * @throws Forbidden if the user cannot edit the note, NotFound if there is none,
+      *         std::invalid_argument if @p after is not a unit of it
+      */
+     nlohmann::json editBigNoteUnit(int classId, int userId, const std::string& unitId, const nlohmann::json& fields,
+                                    const std::string& after = "");
+
+     /**
+      * @brief Deletes one unit of a class's big note
+      * @param classId The ID of the class
+      * @param userId The ID of the user editing the note
+      * @param unitId The unit to delete
+      * @return {"unitId", "status": "deleted", "position"}
+      * @throws Forbidden if the user cannot edit the note, NotFound if it or the unit does not exist
+      */
+     nlohmann::json deleteBigNoteUnit(int classId, int userId, const std::string& unitId);
+
+     /**
+      * @brief Lists the versions of a class's big note
+      * @param classId The ID of the class
+      * @param userId The ID of the requesting user (for access verification)
+      * @return {"history": [{"version", "timestamp", "userId", "description"}, ...]}, oldest first
+      * @throws Forbidden if the user cannot access the class, NotFound if it has no big note
+      */
+     nlohmann::json getBigNoteHistory(int classId, int userId);
+
+     /**
+      * @brief Rebuilds a past version of a class's big note
+      * @param classId The ID of the class
+      * @param userId The ID of the requesting user (for access verification)
+      * @param version A version number from getBigNoteHistory()
+      * @return {"version", "bigNote"}
+      * @throws Forbidden if the user cannot access the class, NotFound if it has no big note
+      * @throws std::invalid_argument if the note has no such version
+      */
+     nlohmann::json getBigNoteVersion(int classId, int userId, size_t version);
+
+     /**
+      * @brief Prepares a class's big note for export: makes buffered edits durable so the
+      *        note file is current, and reports where it is
+      * @param classId The ID of the class
+      * @param userId The ID of the requesting user (for access verification)
+      * @return {"path", "version"}, version being notes.version (see note_export.h)
+      * @throws Forbidden if the user cannot access the class, NotFound if it has no big note
+      */
+     nlohmann::json prepareExport(int classId, int userId);
+
+     /**
+      * @brief Full-text search over the units of every class the user is enrolled in
+      * @param userId The ID of the searching user
+      * @param query Terms that must all occur; "quoted phrases" must occur in order
+      * @param limit Most results to return
+      * @return {"query", "total", "results": [{"classId", "unitId", "title", "score", "positions"}, ...]}, best first
+      */
+     nlohmann::json searchNotes(int userId, const std::string& query, size_t limit = 20);
+
      /**
       * @brief Creates a new big note for a class (internal use, typically called by uploadNote for first-time uploads)
       * @param classId The ID of the class
@@ -59,6 +165,40 @@
       * @return True if creation was successful
       */
      bool createBigNote(int classId, int userId, const std::string& content, const std::string& title);
+
+     /**
+      * @brief Builds a big note from uploaded content
+      * @param content JSON note content, or plain text that becomes the note's only unit
+      * @param title Title used when the content is plain text
+      * @return The note JSON
+      */
+     nlohmann::json noteFromContent(const std::string& content, const std::string& title);
+
+     /**
+      * @brief Lists the classes a user is enrolled in or owns
+      * @param userId The ID of the requesting user
+      * @return {"classes": [...]} with owner and note details filled in (one DB round trip)
+      */
+     nlohmann::json getUserClasses(int userId);
+
+     /**
+      * @brief Retrieves one class with its owner and note details
+      * @param classId The ID of the class
+      * @param userId The ID of the requesting user (for access verification)
+      * @return The class object, same shape as an entry of getUserClasses()
+      * @throws std::runtime_error if the class does not exist or the user cannot access it
+      */
+     nlohmann::json getClassDetails(int classId, int userId);
+
+     /**
+      * @brief Enrolls many users into a class with batched inserts in one transaction
+      * @param classId The ID of the class
+      * @param userId The ID of the requesting user, who must own the class
+      * @param usernames The users to enroll
+      * @return {"enrolled", "alreadyEnrolled", "unknown": [usernames that do not exist]}
+      * @throws std::runtime_error if the class is not found or not owned by the user
+      */
+     nlohmann::json bulkEnroll(int classId, int userId, const std::vector<std::string>& usernames);
  }
  
  #endif // FOLSERV_CORE_H_
@@ -12,20 +12,42 @@
  *   "mysql_port": 3306,
  *   "mysql_user": "root",
  *   "mysql_password": "",
- *   "mysql_database": "folium"
+ *   "mysql_database": "folium",
+ *   "mysql_replicas": [ { "host": "127.0.0.1", "port": 3307 } ],   (optional)
+ *   "replica_max_lag_ms": 2000,                                      (optional)
+ *   "read_your_writes_ms": 5000,                                     (optional)
+ *   "pool_max_connections": 16,                                      (optional, per server)
+ *   "pool_max_idle": 4,                                              (optional, per server)
+ *   "pool_acquire_timeout_ms": 5000,                                 (optional)
+ *   "connect_timeout_s": 5, "read_timeout_s": 30, "write_timeout_s": 30,  (optional)
+ *   "query_cache_bytes": 8388608                                     (optional)
  * }
  *
+ * Replicas inherit user, password and database from the primary unless they
+ * override them. Reads are routed through a ReadRouter (see db_router.h); writes
+ * always go to the primary. Connections are leased from a ConnectionPool (see
+ * db_pool.h). reloadDbConfig() re-reads the file and applies new pool limits and
+ * timeouts without dropping queries in flight. Lookups that rarely change (note
+ * paths, enrollment checks, class details) are served from a QueryCache (see
+ * query_cache.h) that writes through the DAL invalidate by table.
+ *
  * All functions use robust error handling:
  *   - Errors are logged via the new Logger instance.
  *   - Exceptions are thrown to ensure the caller is informed.
  *   - No function fails silently.
  *
  * File I/O operations now use per-file mutexes to ensure that each open file is independently
- * protected, enabling concurrent operations on different files.
+ * protected, enabling concurrent operations on different files. The actual reads and writes
+ * go through the file engine (see file_engine.h), which batches them on io_uring when the
+ * server was started with that backend. Writes replace the file atomically (tmp + fsync + rename).
  */
 
 #include "data_access_layer.h"
 #include "logger.h"
+#include "file_engine.h"
+#include "db_router.h"
+#include "db_pool.h"
+#include "query_cache.h"
 #include <mysql/mysql.h>
 #include <nlohmann/json.hpp>
 #include <fstream>
@@ -38,6 +60,11 @@
 #include <unordered_map>
 #include <memory>
 #include <iostream> // Add this line for std::cerr
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
 
 //----------------------------------------------------------------------
 // Global per-file mutex management
@@ -82,6 +109,17 @@ static logger::Logger dalLogger("DAL");
 
 namespace DAL {
 
+    /**
+     * @brief Connection parameters for one MySQL server.
+     */
+    struct DBEndpoint {
+        std::string host;
+        unsigned int port;
+        std::string user;
+        std::string password;
+        std::string database;
+    };
+
     /**
      * @brief A simple struct to hold DB connection parameters.
      */
@@ -91,68 +129,107 @@ namespace DAL {
         std::string user;
         std::string password;
         std::string database;
+        std::vector<DBEndpoint> replicas;
+        unsigned int replicaMaxLagMs = 2000;
+        unsigned int readYourWritesMs = 5000;
+        PoolLimits pool;
+        unsigned int connectTimeoutS = 0; // 0 leaves the client library default
+        unsigned int readTimeoutS = 0;
+        unsigned int writeTimeoutS = 0;
+        size_t queryCacheBytes = 8u << 20;
     };
 
     /**
-     * @brief Retrieve database configuration from dbConfig.json.
-     *
-     * Loads the connection parameters using static storage so the file is read only once.
+     * @brief Parse dbConfig.json.
      *
      * @return A DBConfig struct containing the configuration.
      */
-    static DBConfig getDbConfig() {
-        static bool loaded = false;
-        static DBConfig config;
-        if (!loaded) {
-            std::ifstream configFile("dbConfig.json");
-            if (!configFile.is_open()) {
-                dalLogger.logErr("getDbConfig: Unable to open dbConfig.json. Check file path.");
-                throw std::runtime_error("getDbConfig: Unable to open dbConfig.json.");
-            }
-            nlohmann::json j;
-            try {
-                configFile >> j;
-            } catch (const std::exception &e) {
-                dalLogger.logErr("getDbConfig: JSON parse error: " + std::string(e.what()));
-                throw;
-            }
-            config.host     = j.value("mysql_host", "127.0.0.1");
-            config.port     = j.value("mysql_port", 3306);
-            config.user     = j.value("mysql_user", "root");
-            config.password = j.value("mysql_password", "");
-            config.database = j.value("mysql_database", "folium");
-            loaded = true;
+    static DBConfig loadDbConfig() {
+        std::ifstream configFile("dbConfig.json");
+        if (!configFile.is_open()) {
+            dalLogger.logErr("getDbConfig: Unable to open dbConfig.json. Check file path.");
+            throw std::runtime_error("getDbConfig: Unable to open dbConfig.json.");
+        }
+        nlohmann::json j;
+        try {
+            configFile >> j;
+        } catch (const std::exception &e) {
+            dalLogger.logErr("getDbConfig: JSON parse error: " + std::string(e.what()));
+            throw;
         }
+        DBConfig config;
+        config.host     = j.value("mysql_host", "127.0.0.1");
+        config.port     = j.value("mysql_port", 3306);
+        config.user     = j.value("mysql_user", "root");
+        config.password = j.value("mysql_password", "");
+        config.database = j.value("mysql_database", "folium");
+        for (const auto& r : j.value("mysql_replicas", nlohmann::json::array())) {
+            config.replicas.push_back({
+                r.value("host", config.host),
+                r.value("port", config.port),
+                r.value("user", config.user),
+                r.value("password", config.password),
+                r.value("database", config.database)
+            });
+        }
+        config.replicaMaxLagMs  = j.value("replica_max_lag_ms", 2000u);
+        config.readYourWritesMs = j.value("read_your_writes_ms", 5000u);
+        config.pool.maxOpen        = std::max(1u, j.value("pool_max_connections", config.pool.maxOpen));
+        config.pool.maxIdle        = j.value("pool_max_idle", config.pool.maxIdle);
+        config.pool.acquireTimeout = std::chrono::milliseconds(
+            j.value("pool_acquire_timeout_ms", static_cast<unsigned int>(config.pool.acquireTimeout.count())));
+        config.connectTimeoutS = j.value("connect_timeout_s", 0u);
+        config.readTimeoutS    = j.value("read_timeout_s", 0u);
+        config.writeTimeoutS   = j.value("write_timeout_s", 0u);
+        config.queryCacheBytes = j.value("query_cache_bytes", config.queryCacheBytes);
         return config;
     }
 
+    // Current configuration; swapped whole by reloadDbConfig().
+    static std::mutex configMutex;
+    static std::shared_ptr<const DBConfig> currentConfig;
+
     /**
-     * @brief Create and return a MySQL connection.
+     * @brief Retrieve database configuration from dbConfig.json.
      *
-     * Uses connection parameters from dbConfig.json. If the connection fails,
-     * an exception is thrown.
+     * The file is read by the first caller; concurrent first callers wait for it
+     * instead of racing. A failed load is retried on the next call.
      *
-     * @return MYSQL* pointer to the MySQL connection.
+     * @return The current configuration, valid for as long as the caller holds it.
      */
-    static MYSQL* createConnection() {
-        DBConfig cfg;
-        try {
-            cfg = getDbConfig();
-        } catch (...) {
-            throw std::runtime_error("createConnection: Failed to load database configuration.");
+    static std::shared_ptr<const DBConfig> getDbConfig() {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (!currentConfig) {
+            currentConfig = std::make_shared<const DBConfig>(loadDbConfig());
         }
+        return currentConfig;
+    }
+
+    /**
+     * @brief Open a MySQL connection to one endpoint, throwing on failure.
+     */
+    static MYSQL* connectTo(const DBEndpoint& endpoint, const DBConfig& cfg) {
         MYSQL *conn = mysql_init(nullptr);
         if (!conn) {
             dalLogger.logErr("createConnection: mysql_init() failed.");
             throw std::runtime_error("createConnection: mysql_init() failed.");
         }
+        if (cfg.connectTimeoutS) {
+            mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &cfg.connectTimeoutS);
+        }
+        if (cfg.readTimeoutS) {
+            mysql_options(conn, MYSQL_OPT_READ_TIMEOUT, &cfg.readTimeoutS);
+        }
+        if (cfg.writeTimeoutS) {
+            mysql_options(conn, MYSQL_OPT_WRITE_TIMEOUT, &cfg.writeTimeoutS);
+        }
         if (!mysql_real_connect(
                 conn,
-                cfg.host.c_str(),
-                cfg.user.c_str(),
-                cfg.password.c_str(),
-                cfg.database.c_str(),
-                cfg.port,
+                endpoint.host.c_str(),
+                endpoint.user.c_str(),
+                endpoint.password.c_str(),
+                endpoint.database.c_str(),
+                endpoint.port,
                 nullptr,
                 0))
         {
@@ -164,6 +241,436 @@ namespace DAL {
         return conn;
     }
 
+    static DBEndpoint primaryOf(const DBConfig& cfg) {
+        return {cfg.host, cfg.port, cfg.user, cfg.password, cfg.database};
+    }
+
+    //----------------------------------------------------------------------
+    // Connection pool (endpoint 0 is the primary, replica i is endpoint i + 1)
+    //----------------------------------------------------------------------
+
+    static ConnectionPool& connectionPool() {
+        static ConnectionPool pool = []() {
+            std::shared_ptr<const DBConfig> cfg = getDbConfig();
+            return ConnectionPool(
+                1 + cfg->replicas.size(), cfg->pool,
+                [](size_t endpoint) {
+                    std::shared_ptr<const DBConfig> current = getDbConfig();
+                    return connectTo(endpoint == 0 ? primaryOf(*current) : current->replicas[endpoint - 1], *current);
+                },
+                [](MYSQL* conn) { mysql_close(conn); },
+                [](MYSQL* conn) { return mysql_ping(conn) == 0; });
+        }();
+        return pool;
+    }
+
+    /**
+     * @brief Lease a connection to the primary.
+     *
+     * Uses connection parameters from dbConfig.json. If no connection can be
+     * made, an exception is thrown. Hand it back with releaseConnection().
+     *
+     * @return MYSQL* pointer to the MySQL connection.
+     */
+    static MYSQL* createConnection() {
+        ConnectionPool* pool;
+        try {
+            pool = &connectionPool();
+        } catch (...) {
+            throw std::runtime_error("createConnection: Failed to load database configuration.");
+        }
+        return pool->acquire(0);
+    }
+
+    /**
+     * @brief Return a connection leased by createConnection() or connectForRead().
+     *
+     * Connections that hit a client-side error (CR_* codes, 2000-2999: server
+     * gone, lost, out of sync) are closed instead of being reused.
+     */
+    static void releaseConnection(MYSQL* conn) {
+        unsigned int err = mysql_errno(conn);
+        connectionPool().release(conn, err < 2000 || err >= 3000);
+    }
+
+    static QueryCache& queryCache();
+
+    void reloadDbConfig() {
+        DBConfig fresh;
+        try {
+            fresh = loadDbConfig();
+        } catch (const std::exception& e) {
+            dalLogger.logErr(std::string("reloadDbConfig: Keeping the current configuration: ") + e.what());
+            throw;
+        }
+
+        std::shared_ptr<const DBConfig> previous;
+        {
+            std::lock_guard<std::mutex> lock(configMutex);
+            previous = currentConfig;
+            if (previous && fresh.replicas.size() != previous->replicas.size()) {
+                dalLogger.logWarn("reloadDbConfig: Adding or removing replicas needs a restart; keeping the current replica list.");
+                fresh.replicas = previous->replicas;
+            }
+            currentConfig = std::make_shared<const DBConfig>(fresh);
+        }
+
+        auto sameEndpoint = [](const DBEndpoint& a, const DBEndpoint& b) {
+            return a.host == b.host && a.port == b.port && a.user == b.user &&
+                   a.password == b.password && a.database == b.database;
+        };
+        bool reconnect = !previous ||
+            !sameEndpoint(primaryOf(*previous), primaryOf(fresh)) ||
+            previous->connectTimeoutS != fresh.connectTimeoutS ||
+            previous->readTimeoutS != fresh.readTimeoutS ||
+            previous->writeTimeoutS != fresh.writeTimeoutS;
+        for (size_t i = 0; previous && i < fresh.replicas.size(); i++) {
+            reconnect = reconnect || !sameEndpoint(previous->replicas[i], fresh.replicas[i]);
+        }
+
+        // Leased connections finish their queries; only their return is affected.
+        connectionPool().reconfigure(fresh.pool, reconnect);
+        queryCache().setBudget(fresh.queryCacheBytes);
+        dalLogger.log("reloadDbConfig: Pool limits now " + std::to_string(fresh.pool.maxOpen) + " open / " +
+                          std::to_string(fresh.pool.maxIdle) + " idle per server" +
+                          (reconnect ? "; reconnecting with the new settings." : "."));
+    }
+
+    nlohmann::json poolStats() {
+        try {
+            return connectionPool().stats();
+        } catch (const std::exception&) {
+            return nullptr; // no configuration yet
+        }
+    }
+
+    //----------------------------------------------------------------------
+    // Read routing (primary + replicas)
+    //----------------------------------------------------------------------
+
+    // Session tag for the current thread, see SessionScope.
+    static thread_local std::string currentSession;
+
+    SessionScope::SessionScope(const std::string& session)
+        : previous_(currentSession) {
+        currentSession = session;
+    }
+
+    SessionScope::~SessionScope() {
+        currentSession = previous_;
+    }
+
+    // Untagged threads are their own session.
+    static std::string sessionKey() {
+        if (!currentSession.empty()) {
+            return currentSession;
+        }
+        std::ostringstream ss;
+        ss << "thread:" << std::this_thread::get_id();
+        return ss.str();
+    }
+
+    static ReadRouter& readRouter() {
+        static ReadRouter router = []() {
+            DBConfig cfg;
+            try {
+                cfg = *getDbConfig();
+            } catch (...) {
+                // No config yet: behave as primary-only, connect calls will report the error.
+            }
+            return ReadRouter(cfg.replicas.size(),
+                              std::chrono::milliseconds(cfg.replicaMaxLagMs),
+                              std::chrono::milliseconds(cfg.readYourWritesMs));
+        }();
+        return router;
+    }
+
+    /**
+     * @brief Measure a replica's replication lag with SHOW REPLICA STATUS.
+     * @return The lag, or nullopt if the replica is unreachable or not replicating.
+     */
+    static std::optional<std::chrono::milliseconds> measureLag(const DBEndpoint& endpoint, const DBConfig& cfg) {
+        MYSQL* conn = nullptr;
+        try {
+            conn = connectTo(endpoint, cfg);
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+        std::optional<std::chrono::milliseconds> lag;
+        bool legacy = false;
+        if (mysql_query(conn, "SHOW REPLICA STATUS;")) {
+            legacy = true; // MySQL < 8.0.22
+            if (mysql_query(conn, "SHOW SLAVE STATUS;")) {
+                mysql_close(conn);
+                return std::nullopt;
+            }
+        }
+        MYSQL_RES* result = mysql_store_result(conn);
+        if (result) {
+            const char* column = legacy ? "Seconds_Behind_Master" : "Seconds_Behind_Source";
+            MYSQL_FIELD* fields = mysql_fetch_fields(result);
+            unsigned int numFields = mysql_num_fields(result);
+            MYSQL_ROW row = mysql_fetch_row(result);
+            for (unsigned int i = 0; row && i < numFields; i++) {
+                if (std::string(fields[i].name) == column && row[i] != nullptr) {
+                    lag = std::chrono::seconds(std::stoll(row[i]));
+                }
+            }
+            mysql_free_result(result);
+        }
+        mysql_close(conn);
+        return lag; // NULL lag means replication is stopped
+    }
+
+    /**
+     * @brief Open a connection for a read issued by @p endpoint (the DAL function name).
+     *
+     * Goes to a healthy replica when one is configured, otherwise to the primary.
+     */
+    static MYSQL* connectForRead(const std::string& endpoint) {
+        ReadRouter& router = readRouter();
+        if (router.replicaCount() == 0) {
+            return createConnection();
+        }
+        std::shared_ptr<const DBConfig> cfg = getDbConfig();
+
+        // Whoever claims a due lag check measures it; everyone else uses the last value.
+        for (size_t i = 0; i < router.replicaCount(); i++) {
+            if (router.claimLagCheck(i)) {
+                router.reportLag(i, measureLag(cfg->replicas[i], *cfg));
+            }
+        }
+
+        RouteDecision decision = router.route(endpoint, sessionKey());
+        if (decision.replica == RouteDecision::kPrimary) {
+            return createConnection();
+        }
+        try {
+            return connectionPool().acquire(static_cast<size_t>(decision.replica) + 1);
+        } catch (const std::exception&) {
+            router.recordConnectFailure(endpoint, decision.replica);
+            return createConnection();
+        }
+    }
+
+    // Escape with an open connection so the connection's charset is respected.
+    static std::string escapeWith(MYSQL* conn, const std::string& input) {
+        std::string escaped(input.size() * 2 + 1, '\0');
+        unsigned long length = mysql_real_escape_string(conn, escaped.data(), input.c_str(), input.size());
+        escaped.resize(length);
+        return escaped;
+    }
+
+    //----------------------------------------------------------------------
+    // Query result cache
+    //----------------------------------------------------------------------
+
+    // Catches writes made by other processes; writes through this DAL invalidate immediately.
+    static constexpr std::chrono::seconds kQueryCacheTtl{30};
+
+    static QueryCache& queryCache() {
+        static QueryCache cache = []() {
+            size_t budget = DBConfig().queryCacheBytes;
+            try {
+                budget = getDbConfig()->queryCacheBytes;
+            } catch (...) {
+                // No config yet: start with the default budget.
+            }
+            return QueryCache(budget, kQueryCacheTtl);
+        }();
+        return cache;
+    }
+
+    /**
+     * @brief A read whose results go through the query cache.
+     *
+     * Parameters replace the '?' placeholders in order, escaped and quoted.
+     * The tables are the cache tags: a write to any of them drops the entry.
+     */
+    struct CachedStatement {
+        const char* id;
+        const char* sql;
+        std::vector<std::string> tables;
+    };
+
+    static const CachedStatement kEnrollment{
+        "enrollment",
+        "SELECT 1 FROM user_classes WHERE class_id = ? AND user_id = ? LIMIT 1;",
+        {"user_classes"}};
+
+    static const CachedStatement kNoteByClass{
+        "noteByClass",
+        "SELECT file_path, version FROM notes WHERE class_id = ?;",
+        {"notes"}};
+
+    static const CachedStatement kNotePathById{
+        "getNoteFilePath",
+        "SELECT file_path FROM notes WHERE id = ?;",
+        {"notes"}};
+
+    static const CachedStatement kClassDetails{
+        "getClassDetails",
+        "SELECT c.id, c.name, c.description, c.instructor, c.user_id, u.username, "
+        "n.id, n.title, n.updated_at "
+        "FROM classes c "
+        "LEFT JOIN users u ON u.id = c.user_id "
+        "LEFT JOIN notes n ON n.class_id = c.id "
+        "WHERE c.user_id = ? OR c.id IN (SELECT class_id FROM user_classes WHERE user_id = ?) "
+        "ORDER BY c.name, c.id;",
+        {"classes", "users", "notes", "user_classes"}};
+
+    /**
+     * @brief Run a cached statement, or return its cached rows.
+     *
+     * Misses are read from the primary: a replica could still be behind a write
+     * that just invalidated the entry, and its rows would then be cached (and
+     * served to the writer) for the whole TTL.
+     */
+    static QueryCache::Rows cachedQuery(const CachedStatement& statement, const std::vector<std::string>& params) {
+        QueryCache& cache = queryCache();
+        if (std::optional<QueryCache::Rows> cached = cache.get(statement.id, params)) {
+            return std::move(*cached);
+        }
+        uint64_t ticket = cache.ticket();
+        const std::string caller = statement.id;
+
+        MYSQL* conn = createConnection();
+        std::string query;
+        size_t next = 0;
+        for (const char* c = statement.sql; *c; c++) {
+            if (*c == '?' && next < params.size()) {
+                query += "'" + escapeWith(conn, params[next++]) + "'";
+            } else {
+                query += *c;
+            }
+        }
+        if (mysql_query(conn, query.c_str())) {
+            std::string err = mysql_error(conn);
+            dalLogger.logErr(caller + ": Query failed: " + err);
+            releaseConnection(conn);
+            throw std::runtime_error(caller + ": Query failed: " + err);
+        }
+        MYSQL_RES* result = mysql_store_result(conn);
+        if (!result) {
+            std::string err = mysql_error(conn);
+            dalLogger.logErr(caller + ": Failed to retrieve result: " + err);
+            releaseConnection(conn);
+            throw std::runtime_error(caller + ": Failed to retrieve result: " + err);
+        }
+        unsigned int numFields = mysql_num_fields(result);
+        QueryCache::Rows rows;
+        rows.reserve(mysql_num_rows(result));
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(result))) {
+            unsigned long* lengths = mysql_fetch_lengths(result);
+            QueryCache::Row fields;
+            fields.reserve(numFields);
+            for (unsigned int i = 0; i < numFields; i++) {
+                fields.push_back(row[i] ? std::optional<std::string>(std::in_place, row[i], lengths[i])
+                                        : std::nullopt);
+            }
+            rows.push_back(std::move(fields));
+        }
+        mysql_free_result(result);
+        releaseConnection(conn);
+
+        cache.put(statement.id, params, rows, statement.tables, ticket);
+        return rows;
+    }
+
+    void invalidateClassDetails() {
+        for (const std::string& table : kClassDetails.tables) {
+            queryCache().invalidate(table);
+        }
+    }
+
+    // Pin the current session to the primary so it reads its own writes,
+    // and drop cached reads of the tables that were written.
+    static void recordWrite(const std::vector<std::string>& tables) {
+        readRouter().recordWrite(sessionKey());
+        for (const std::string& table : tables) {
+            queryCache().invalidate(table);
+        }
+    }
+
+    /**
+     * @brief The table a raw INSERT/UPDATE/DELETE/REPLACE statement writes to.
+     * @return The table name, or nullopt if the statement is not recognized.
+     */
+    static std::optional<std::string> tableWrittenBy(const std::string& query) {
+        std::istringstream words(query);
+        std::vector<std::string> tokens;
+        std::string word;
+        while (tokens.size() < 4 && words >> word) {
+            std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::tolower(c); });
+            tokens.push_back(word);
+        }
+        size_t at = 0;
+        auto skip = [&](const char* expected) {
+            if (at < tokens.size() && tokens[at] == expected) {
+                at++;
+                return true;
+            }
+            return false;
+        };
+        if (skip("insert") || skip("replace")) {
+            skip("ignore");
+            if (!skip("into")) {
+                return std::nullopt;
+            }
+        } else if (skip("delete")) {
+            if (!skip("from")) {
+                return std::nullopt;
+            }
+        } else if (!skip("update")) {
+            return std::nullopt;
+        }
+        if (at >= tokens.size()) {
+            return std::nullopt;
+        }
+        std::string table = tokens[at];
+        table.erase(std::remove(table.begin(), table.end(), '`'), table.end());
+        table = table.substr(0, table.find_first_of(" (;"));
+        return table.empty() ? std::nullopt : std::optional<std::string>(table);
+    }
+
+    nlohmann::json queryCacheStats() {
+        return queryCache().stats();
+    }
+
+    bool isEnrolled(const unsigned int user_id, const unsigned int class_id) {
+        if (user_id == 0 || class_id == 0) {
+            dalLogger.logErr("isEnrolled: Invalid user or class ID (0) provided.");
+            throw std::invalid_argument("isEnrolled: user_id and class_id must be non-zero.");
+        }
+        return !cachedQuery(kEnrollment, {std::to_string(class_id), std::to_string(user_id)}).empty();
+    }
+
+    std::string getNotePathForClass(const unsigned int class_id) {
+        if (class_id == 0) {
+            dalLogger.logErr("getNotePathForClass: Invalid class ID (0) provided.");
+            throw std::invalid_argument("getNotePathForClass: class_id must be non-zero.");
+        }
+        std::optional<NoteRef> note = getNoteForClass(class_id);
+        return note ? note->path : std::string();
+    }
+
+    std::optional<NoteRef> getNoteForClass(const unsigned int class_id) {
+        if (class_id == 0) {
+            dalLogger.logErr("getNoteForClass: Invalid class ID (0) provided.");
+            throw std::invalid_argument("getNoteForClass: class_id must be non-zero.");
+        }
+        QueryCache::Rows rows = cachedQuery(kNoteByClass, {std::to_string(class_id)});
+        if (rows.empty() || !rows[0][0] || rows[0][0]->empty()) {
+            return std::nullopt;
+        }
+        return NoteRef{*rows[0][0], rows[0][1] ? std::stoull(*rows[0][1]) : 0};
+    }
+
+    nlohmann::json routingStats() {
+        return readRouter().stats();
+    }
+
     //----------------------------------------------------------------------    
     // SQL Query Functions
     //----------------------------------------------------------------------
@@ -177,19 +684,19 @@ namespace DAL {
      * @return A vector of strings containing table names.
      */
     std::vector<std::string> getTables() {
-        MYSQL* conn = createConnection();
+        MYSQL* conn = connectForRead("getTables");
         const char* query = "SHOW TABLES;";
         if (mysql_query(conn, query)) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getTables: Query failed: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getTables: Query failed: " + err);
         }
         MYSQL_RES* result = mysql_store_result(conn);
         if (!result) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getTables: Failed to retrieve result: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getTables: Failed to retrieve result: " + err);
         }
         std::vector<std::string> tables;
@@ -200,7 +707,7 @@ namespace DAL {
             }
         }
         mysql_free_result(result);
-        mysql_close(conn);
+        releaseConnection(conn);
         return tables;
     }
 
@@ -217,21 +724,21 @@ namespace DAL {
             dalLogger.logErr("getClassIds: Invalid user ID (0) provided.");
             throw std::invalid_argument("getClassIds: user_id must be non-zero.");
         }
-        MYSQL* conn = createConnection();
+        MYSQL* conn = connectForRead("getClassIds");
         std::stringstream ss;
         ss << "SELECT class_id FROM user_classes WHERE user_id = " << user_id << ";";
         std::string query = ss.str();
         if (mysql_query(conn, query.c_str())) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getClassIds: Query failed: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getClassIds: Query failed: " + err);
         }
         MYSQL_RES* result = mysql_store_result(conn);
         if (!result) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getClassIds: Failed to retrieve result: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getClassIds: Failed to retrieve result: " + err);
         }
         std::vector<int> classIds;
@@ -243,7 +750,7 @@ namespace DAL {
             }
         }
         mysql_free_result(result);
-        mysql_close(conn);
+        releaseConnection(conn);
         dalLogger.logDebug("getClassIds: Retrieved class ids for user " + std::to_string(user_id));
         return classIds;
     }
@@ -261,7 +768,7 @@ namespace DAL {
             dalLogger.logErr("getNoteIds: Invalid user ID (0) provided.");
             throw std::invalid_argument("getNoteIds: user_id must be non-zero.");
         }
-        MYSQL* conn = createConnection();
+        MYSQL* conn = connectForRead("getNoteIds");
         std::stringstream ss;
         ss << "SELECT n.id FROM notes n INNER JOIN user_classes uc ON n.class_id = uc.class_id "
            << "WHERE uc.user_id = " << user_id << ";";
@@ -269,14 +776,14 @@ namespace DAL {
         if (mysql_query(conn, query.c_str())) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getNoteIds: Query failed: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getNoteIds: Query failed: " + err);
         }
         MYSQL_RES* result = mysql_store_result(conn);
         if (!result) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getNoteIds: Failed to retrieve result: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getNoteIds: Failed to retrieve result: " + err);
         }
         std::vector<int> noteIds;
@@ -288,11 +795,73 @@ namespace DAL {
             }
         }
         mysql_free_result(result);
-        mysql_close(conn);
+        releaseConnection(conn);
         dalLogger.logDebug("getNoteIds: Retrieved note ids for user " + std::to_string(user_id));
         return noteIds;
     }
 
+    /**
+     * @brief Retrieve all classes of a user with owner and note columns filled in.
+     *
+     * One JOIN query (kClassDetails), served from the query cache when fresh.
+     * Covers classes the user is enrolled in as well as classes they own; owner and
+     * note are LEFT JOINed so classes without a note (or a deleted owner) still show up.
+     *
+     * @param user_id The ID of the user.
+     * @return The hydrated class rows.
+     */
+    std::vector<ClassDetail> getClassDetails(const unsigned int user_id) {
+        if (user_id == 0) {
+            dalLogger.logErr("getClassDetails: Invalid user ID (0) provided.");
+            throw std::invalid_argument("getClassDetails: user_id must be non-zero.");
+        }
+        QueryCache::Rows rows = cachedQuery(kClassDetails, {std::to_string(user_id), std::to_string(user_id)});
+        auto text = [](const std::optional<std::string>& field) { return field.value_or(""); };
+        std::vector<ClassDetail> details;
+        details.reserve(rows.size());
+        for (const QueryCache::Row& row : rows) {
+            if (!row[0]) {
+                continue;
+            }
+            ClassDetail d;
+            d.classId = static_cast<unsigned int>(std::stoul(*row[0]));
+            d.name = text(row[1]);
+            d.description = text(row[2]);
+            d.instructor = text(row[3]);
+            d.ownerId = row[4] ? static_cast<unsigned int>(std::stoul(*row[4])) : 0;
+            d.ownerUsername = text(row[5]);
+            if (row[6]) {
+                d.noteId = static_cast<unsigned int>(std::stoul(*row[6]));
+            }
+            d.noteTitle = text(row[7]);
+            d.noteUpdatedAt = text(row[8]);
+            details.push_back(std::move(d));
+        }
+        dalLogger.logDebug("getClassDetails: Retrieved " + std::to_string(details.size()) +
+                           " classes for user " + std::to_string(user_id));
+        return details;
+    }
+
+    /**
+     * @brief Retrieve a single class of a user with owner and note columns filled in.
+     *
+     * @param user_id The ID of the user.
+     * @param class_id The ID of the class.
+     * @return The class, or std::nullopt if the user cannot see it.
+     */
+    std::optional<ClassDetail> getClassDetail(const unsigned int user_id, const unsigned int class_id) {
+        if (class_id == 0) {
+            dalLogger.logErr("getClassDetail: Invalid class ID (0) provided.");
+            throw std::invalid_argument("getClassDetail: class_id must be non-zero.");
+        }
+        for (ClassDetail& detail : getClassDetails(user_id)) {
+            if (detail.classId == class_id) {
+                return std::move(detail);
+            }
+        }
+        return std::nullopt;
+    }
+
     /**
      * @brief Retrieve the file path for a specific note.
      *
@@ -306,35 +875,12 @@ namespace DAL {
             dalLogger.logErr("getNoteFilePath: Invalid note id (0) provided.");
             throw std::invalid_argument("getNoteFilePath: note_id must be non-zero.");
         }
-        MYSQL* conn = createConnection();
-        std::stringstream ss;
-        ss << "SELECT file_path FROM notes WHERE id = " << note_id << ";";
-        std::string query = ss.str();
-        if (mysql_query(conn, query.c_str())) {
-            std::string err = mysql_error(conn);
-            dalLogger.logErr("getNoteFilePath: Query failed: " + err);
-            mysql_close(conn);
-            throw std::runtime_error("getNoteFilePath: Query failed: " + err);
-        }
-        MYSQL_RES* result = mysql_store_result(conn);
-        if (!result) {
-            std::string err = mysql_error(conn);
-            dalLogger.logErr("getNoteFilePath: Failed to retrieve result: " + err);
-            mysql_close(conn);
-            throw std::runtime_error("getNoteFilePath: Failed to retrieve result: " + err);
-        }
-        std::string filePath;
-        MYSQL_ROW row = mysql_fetch_row(result);
-        if (row && row[0]) {
-            filePath = row[0];
-        } else {
+        QueryCache::Rows rows = cachedQuery(kNotePathById, {std::to_string(note_id)});
+        if (rows.empty() || !rows[0][0]) {
             dalLogger.logErr("getNoteFilePath: No file path found for note id " + std::to_string(note_id));
-            mysql_free_result(result);
-            mysql_close(conn);
             throw std::runtime_error("getNoteFilePath: File path not found for note id " + std::to_string(note_id));
         }
-        mysql_free_result(result);
-        mysql_close(conn);
+        std::string filePath = *rows[0][0];
         dalLogger.logDebug("getNoteFilePath: Retrieved file path for note " + std::to_string(note_id));
         return filePath;
     }
@@ -354,22 +900,22 @@ namespace DAL {
     std::string readFile(const std::string& file_path) {
         auto fileMtx = getFileMutex(file_path);
         std::lock_guard<std::mutex> lock(*fileMtx);
-        std::ifstream in(file_path);
-        if (!in.is_open()) {
-            dalLogger.logErr("readFile: Cannot open file for reading: " + file_path);
+        std::string content;
+        try {
+            content = fileio::read(file_path);
+        } catch (const std::exception& e) {
+            dalLogger.logErr("readFile: Cannot open file for reading: " + file_path + " (" + e.what() + ")");
             throw std::runtime_error("readFile: Cannot open file: " + file_path);
         }
-        std::ostringstream ss;
-        ss << in.rdbuf();
         dalLogger.logDebug("readFile: Successfully read file: " + file_path);
-        return ss.str();
+        return content;
     }
 
     /**
      * @brief Write data to a file.
      *
-     * Locks the mutex dedicated to the given file path.
-     * On failure, an exception is thrown.
+     * Locks the mutex dedicated to the given file path and replaces the file
+     * atomically through the file engine. On failure, an exception is thrown.
      *
      * @param file_path The file path to write.
      * @param data The data to write.
@@ -378,20 +924,73 @@ namespace DAL {
     bool writeFile(const std::string& file_path, const std::string& data) {
         auto fileMtx = getFileMutex(file_path);
         std::lock_guard<std::mutex> lock(*fileMtx);
-        std::ofstream out(file_path);
-        if (!out.is_open()) {
-            dalLogger.logErr("writeFile: Cannot open file for writing: " + file_path);
-            throw std::runtime_error("writeFile: Cannot open file: " + file_path);
-        }
-        out << data;
-        if (!out.good()) {
-            dalLogger.logErr("writeFile: Error occurred while writing to file: " + file_path);
+        try {
+            fileio::writeAtomic(file_path, data);
+        } catch (const std::exception& e) {
+            dalLogger.logErr("writeFile: Error occurred while writing to file: " + file_path + " (" + e.what() + ")");
             throw std::runtime_error("writeFile: Failed to write file: " + file_path);
         }
         dalLogger.logDebug("writeFile: Successfully wrote file: " + file_path);
         return true;
     }
 
+    /**
+     * @brief Append data to a file.
+     *
+     * Locks the mutex dedicated to the given file path and appends through the
+     * file engine, which fsyncs before returning. On failure, an exception is thrown.
+     *
+     * @param file_path The file path to append to (created if missing).
+     * @param data The data to append.
+     */
+    void appendFile(const std::string& file_path, const std::string& data) {
+        auto fileMtx = getFileMutex(file_path);
+        std::lock_guard<std::mutex> lock(*fileMtx);
+        try {
+            fileio::append(file_path, data);
+        } catch (const std::exception& e) {
+            dalLogger.logErr("appendFile: Error occurred while appending to file: " + file_path + " (" + e.what() + ")");
+            throw std::runtime_error("appendFile: Failed to append to file: " + file_path);
+        }
+        dalLogger.logDebug("appendFile: Successfully appended to file: " + file_path);
+    }
+
+    /**
+     * @brief Write many files with one batch of fsyncs.
+     *
+     * Locks every file's mutex (in path order, so concurrent batches cannot
+     * deadlock) and hands all writes to the file engine together.
+     *
+     * @param files (path, data) pairs.
+     */
+    void writeFiles(const std::vector<std::pair<std::string, std::string>>& files) {
+        std::vector<std::string> paths;
+        paths.reserve(files.size());
+        for (const auto& file : files) {
+            paths.push_back(file.first);
+        }
+        std::sort(paths.begin(), paths.end());
+        if (std::adjacent_find(paths.begin(), paths.end()) != paths.end()) {
+            dalLogger.logErr("writeFiles: Duplicate path in batch.");
+            throw std::invalid_argument("writeFiles: Paths must be distinct.");
+        }
+        std::vector<std::shared_ptr<std::mutex>> mutexes;
+        std::vector<std::unique_lock<std::mutex>> locks;
+        mutexes.reserve(paths.size());
+        locks.reserve(paths.size());
+        for (const std::string& path : paths) {
+            mutexes.push_back(getFileMutex(path));
+            locks.emplace_back(*mutexes.back());
+        }
+        try {
+            fileio::writeAtomicMany(files);
+        } catch (const std::exception& e) {
+            dalLogger.logErr(std::string("writeFiles: Error occurred while writing batch: ") + e.what());
+            throw std::runtime_error(std::string("writeFiles: Failed to write files: ") + e.what());
+        }
+        dalLogger.logDebug("writeFiles: Successfully wrote " + std::to_string(files.size()) + " files.");
+    }
+
     /**
      * @brief Read the contents of a plain text file.
      *
@@ -415,14 +1014,16 @@ namespace DAL {
     nlohmann::json readJsonFile(const std::string& file_path) {
         auto fileMtx = getFileMutex(file_path);
         std::lock_guard<std::mutex> lock(*fileMtx);
-        std::ifstream in(file_path);
-        if (!in.is_open()) {
+        std::string content;
+        try {
+            content = fileio::read(file_path);
+        } catch (const std::exception& e) {
             dalLogger.logErr("readJsonFile: Cannot open JSON file for reading: " + file_path);
             throw std::runtime_error("readJsonFile: Cannot open file: " + file_path);
         }
         nlohmann::json j;
         try {
-            in >> j;
+            j = nlohmann::json::parse(content);
         } catch (const std::exception& e) {
             dalLogger.logErr("readJsonFile: Error parsing JSON from " + file_path + ": " + e.what());
             throw std::runtime_error("readJsonFile: Failed to parse JSON file: " + file_path);
@@ -447,24 +1048,458 @@ namespace DAL {
         std::string file_path = data["file_path"].get<std::string>();
         auto fileMtx = getFileMutex(file_path);
         std::lock_guard<std::mutex> lock(*fileMtx);
-        std::ofstream out(file_path);
-        if (!out.is_open()) {
-            dalLogger.logErr("writeJsonFile: Cannot open file for writing JSON: " + file_path);
-            throw std::runtime_error("writeJsonFile: Cannot open JSON file: " + file_path);
-        }
+        std::string serialized;
         try {
-            out << data.dump(4);
+            serialized = data.dump(4);
         } catch (const std::exception& e) {
             dalLogger.logErr("writeJsonFile: Error writing JSON data to " + file_path + ": " + e.what());
             throw std::runtime_error("writeJsonFile: Failed to write JSON file: " + file_path);
         }
-        if (!out.good()) {
-            dalLogger.logErr("writeJsonFile: I/O error occurred while writing JSON file: " + file_path);
+        try {
+            fileio::writeAtomic(file_path, serialized);
+        } catch (const std::exception& e) {
+            dalLogger.logErr("writeJsonFile: I/O error occurred while writing JSON file: " + file_path + " (" + e.what() + ")");
             throw std::runtime_error("writeJsonFile: I/O error writing JSON file: " + file_path);
         }
         dalLogger.logDebug("writeJsonFile: Successfully wrote JSON file: " + file_path);
     }
 
+    //----------------------------------------------------------------------
+    // Batched Writes
+    //----------------------------------------------------------------------
+
+    // Number of rows in each statement buildInsertBatches() produces.
+    static std::vector<size_t> planInsertBatches(size_t headSize,
+                                                 const std::vector<std::string>& rows,
+                                                 size_t maxRows,
+                                                 size_t maxBytes) {
+        std::vector<size_t> counts;
+        size_t i = 0;
+        while (i < rows.size()) {
+            size_t size = headSize + 1; // trailing ';'
+            size_t count = 0;
+            while (i < rows.size() && count < maxRows &&
+                   (count == 0 || size + 1 + rows[i].size() <= maxBytes)) {
+                size += rows[i++].size() + (count > 0 ? 1 : 0);
+                count++;
+            }
+            counts.push_back(count);
+        }
+        return counts;
+    }
+
+    std::vector<std::string> buildInsertBatches(const std::string& head,
+                                                const std::vector<std::string>& rows,
+                                                size_t maxRows,
+                                                size_t maxBytes) {
+        std::vector<std::string> statements;
+        size_t i = 0;
+        for (size_t count : planInsertBatches(head.size(), rows, maxRows, maxBytes)) {
+            std::string statement = head;
+            for (size_t k = 0; k < count; k++) {
+                if (k > 0) {
+                    statement += ',';
+                }
+                statement += rows[i++];
+            }
+            statement += ';';
+            statements.push_back(std::move(statement));
+        }
+        return statements;
+    }
+
+    static void beginTransaction(MYSQL* conn, const std::string& caller) {
+        if (mysql_query(conn, "START TRANSACTION;")) {
+            std::string err = mysql_error(conn);
+            dalLogger.logErr(caller + ": Failed to start transaction: " + err);
+            throw std::runtime_error(caller + ": Failed to start transaction: " + err);
+        }
+    }
+
+    /**
+     * @brief Run statements inside the open transaction on @p conn; rolls back and throws on the first failure.
+     *
+     * @param insertIds If set, receives each statement's first auto-increment id.
+     * @return Total affected rows.
+     */
+    static uint64_t executeStatements(MYSQL* conn, const std::string& caller,
+                                      const std::vector<std::string>& statements,
+                                      std::vector<uint64_t>* insertIds = nullptr) {
+        uint64_t affected = 0;
+        for (const std::string& statement : statements) {
+            if (mysql_query(conn, statement.c_str())) {
+                std::string err = mysql_error(conn);
+                mysql_query(conn, "ROLLBACK;");
+                dalLogger.logErr(caller + ": Batch failed, rolled back: " + err);
+                throw std::runtime_error(caller + ": Batch failed: " + err);
+            }
+            affected += mysql_affected_rows(conn);
+            if (insertIds) {
+                insertIds->push_back(mysql_insert_id(conn));
+            }
+        }
+        return affected;
+    }
+
+    static void commitTransaction(MYSQL* conn, const std::string& caller) {
+        if (mysql_query(conn, "COMMIT;")) {
+            std::string err = mysql_error(conn);
+            mysql_query(conn, "ROLLBACK;");
+            dalLogger.logErr(caller + ": Commit failed: " + err);
+            throw std::runtime_error(caller + ": Commit failed: " + err);
+        }
+    }
+
+    /**
+     * @brief Run statements in a single transaction on @p conn.
+     *
+     * Rolls back and throws on the first failure. The connection stays open either way.
+     *
+     * @param insertIds If set, receives each statement's first auto-increment id.
+     * @return Total affected rows.
+     */
+    static uint64_t executeInTransaction(MYSQL* conn, const std::string& caller,
+                                         const std::vector<std::string>& statements,
+                                         std::vector<uint64_t>* insertIds = nullptr) {
+        beginTransaction(conn, caller);
+        uint64_t affected = executeStatements(conn, caller, statements, insertIds);
+        commitTransaction(conn, caller);
+        dalLogger.logDebug(caller + ": Committed " + std::to_string(statements.size()) +
+                           " statements, " + std::to_string(affected) + " rows.");
+        return affected;
+    }
+
+    /**
+     * @brief Create many users with multi-row INSERTs in one transaction.
+     *
+     * @param users (username, hashed password) pairs.
+     * @return The number of users created.
+     */
+    size_t createUsers(const std::vector<std::pair<std::string, std::string>>& users) {
+        for (const auto& [username, hashedPassword] : users) {
+            if (username.empty() || hashedPassword.empty()) {
+                dalLogger.logErr("createUsers: Username or hashedPassword is empty.");
+                throw std::invalid_argument("createUsers: Username and hashedPassword cannot be empty.");
+            }
+        }
+        if (users.empty()) {
+            return 0;
+        }
+        MYSQL* conn = createConnection();
+        std::vector<std::string> rows;
+        rows.reserve(users.size());
+        for (const auto& [username, hashedPassword] : users) {
+            rows.push_back("('" + escapeWith(conn, username) + "', '" + escapeWith(conn, hashedPassword) + "')");
+        }
+        uint64_t created;
+        try {
+            created = executeInTransaction(conn, "createUsers",
+                buildInsertBatches("INSERT INTO users (username, password_hash) VALUES ", rows));
+        } catch (...) {
+            releaseConnection(conn);
+            throw;
+        }
+        releaseConnection(conn);
+        recordWrite({"users"});
+        dalLogger.logDebug("createUsers: Created " + std::to_string(created) + " users.");
+        return static_cast<size_t>(created);
+    }
+
+    /**
+     * @brief Resolve usernames to ids, kMaxBatchRows names per query.
+     *
+     * @param usernames The usernames to look up.
+     * @return Map of the found usernames to their ids.
+     */
+    std::unordered_map<std::string, unsigned int> getUserIds(const std::vector<std::string>& usernames) {
+        std::unordered_map<std::string, unsigned int> ids;
+        if (usernames.empty()) {
+            return ids;
+        }
+        MYSQL* conn = connectForRead("getUserIds");
+        for (size_t start = 0; start < usernames.size(); start += kMaxBatchRows) {
+            size_t end = std::min(usernames.size(), start + kMaxBatchRows);
+            std::string query = "SELECT id, username FROM users WHERE username IN (";
+            for (size_t i = start; i < end; i++) {
+                query += (i > start ? ", '" : "'") + escapeWith(conn, usernames[i]) + "'";
+            }
+            query += ");";
+            if (mysql_query(conn, query.c_str())) {
+                std::string err = mysql_error(conn);
+                dalLogger.logErr("getUserIds: Query failed: " + err);
+                releaseConnection(conn);
+                throw std::runtime_error("getUserIds: Query failed: " + err);
+            }
+            MYSQL_RES* result = mysql_store_result(conn);
+            if (!result) {
+                std::string err = mysql_error(conn);
+                dalLogger.logErr("getUserIds: Failed to retrieve result: " + err);
+                releaseConnection(conn);
+                throw std::runtime_error("getUserIds: Failed to retrieve result: " + err);
+            }
+            MYSQL_ROW row;
+            while ((row = mysql_fetch_row(result))) {
+                if (row[0] && row[1]) {
+                    ids[row[1]] = static_cast<unsigned int>(std::stoul(row[0]));
+                }
+            }
+            mysql_free_result(result);
+        }
+        releaseConnection(conn);
+        return ids;
+    }
+
+    /**
+     * @brief Enroll many users into a class with multi-row INSERTs in one transaction.
+     *
+     * @param class_id The class.
+     * @param user_ids The users to enroll.
+     * @return The number of new enrollments.
+     */
+    size_t enrollUsers(const unsigned int class_id, const std::vector<unsigned int>& user_ids) {
+        if (class_id == 0) {
+            dalLogger.logErr("enrollUsers: Invalid class ID (0) provided.");
+            throw std::invalid_argument("enrollUsers: class_id must be non-zero.");
+        }
+        std::vector<std::pair<unsigned int, unsigned int>> enrollments;
+        enrollments.reserve(user_ids.size());
+        for (unsigned int user_id : user_ids) {
+            enrollments.push_back({user_id, class_id});
+        }
+        return enrollMany(enrollments);
+    }
+
+    /**
+     * @brief Enroll (user, class) pairs with multi-row INSERTs in one transaction.
+     *
+     * INSERT IGNORE skips pairs that are already enrolled.
+     *
+     * @param enrollments (user_id, class_id) pairs.
+     * @return The number of new enrollments.
+     */
+    size_t enrollMany(const std::vector<std::pair<unsigned int, unsigned int>>& enrollments) {
+        if (enrollments.empty()) {
+            return 0;
+        }
+        std::vector<std::string> rows;
+        rows.reserve(enrollments.size());
+        for (const auto& [user_id, class_id] : enrollments) {
+            rows.push_back("(" + std::to_string(user_id) + ", " + std::to_string(class_id) + ")");
+        }
+        MYSQL* conn = createConnection();
+        uint64_t enrolled;
+        try {
+            enrolled = executeInTransaction(conn, "enrollMany",
+                buildInsertBatches("INSERT IGNORE INTO user_classes (user_id, class_id) VALUES ", rows));
+        } catch (...) {
+            releaseConnection(conn);
+            throw;
+        }
+        releaseConnection(conn);
+        recordWrite({"user_classes"});
+        dalLogger.logDebug("enrollMany: Created " + std::to_string(enrolled) + " enrollments.");
+        return static_cast<size_t>(enrolled);
+    }
+
+    static const std::string kClassInsertHead = "INSERT INTO classes (user_id, name, description, instructor) VALUES ";
+    static const std::string kEnrollInsertHead = "INSERT IGNORE INTO user_classes (user_id, class_id) VALUES ";
+    static const std::string kNoteInsertHead =
+        "INSERT INTO notes (class_id, file_path, title, created_at, updated_at) VALUES ";
+
+    static void checkNewClasses(const std::string& caller, const std::vector<NewClass>& classes) {
+        for (const NewClass& c : classes) {
+            if (c.ownerId == 0 || c.name.empty()) {
+                dalLogger.logErr(caller + ": Class without owner or name.");
+                throw std::invalid_argument(caller + ": Every class needs an owner and a name.");
+            }
+        }
+    }
+
+    static std::vector<std::string> classRows(MYSQL* conn, const std::vector<NewClass>& classes) {
+        std::vector<std::string> rows;
+        rows.reserve(classes.size());
+        for (const NewClass& c : classes) {
+            rows.push_back("(" + std::to_string(c.ownerId) + ", '" + escapeWith(conn, c.name) + "', '" +
+                           escapeWith(conn, c.description) + "', '" + escapeWith(conn, c.instructor) + "')");
+        }
+        return rows;
+    }
+
+    // Each statement's rows got consecutive ids starting at its first insert id.
+    static std::vector<unsigned int> classIdsFrom(const std::vector<std::string>& rows,
+                                                  const std::vector<uint64_t>& firstIds) {
+        std::vector<size_t> counts = planInsertBatches(kClassInsertHead.size(), rows, kMaxBatchRows, kMaxBatchBytes);
+        std::vector<unsigned int> ids;
+        ids.reserve(rows.size());
+        for (size_t k = 0; k < counts.size(); k++) {
+            for (size_t i = 0; i < counts[k]; i++) {
+                ids.push_back(static_cast<unsigned int>(firstIds[k] + i));
+            }
+        }
+        return ids;
+    }
+
+    static std::vector<std::string> enrollmentRows(const std::vector<std::pair<unsigned int, unsigned int>>& enrollments) {
+        std::vector<std::string> rows;
+        rows.reserve(enrollments.size());
+        for (const auto& [user_id, class_id] : enrollments) {
+            rows.push_back("(" + std::to_string(user_id) + ", " + std::to_string(class_id) + ")");
+        }
+        return rows;
+    }
+
+    static std::vector<std::string> noteRows(MYSQL* conn, const std::vector<NewNote>& notes) {
+        std::vector<std::string> rows;
+        rows.reserve(notes.size());
+        for (const NewNote& n : notes) {
+            rows.push_back("(" + std::to_string(n.classId) + ", '" + escapeWith(conn, n.filePath) + "', '" +
+                           escapeWith(conn, n.title) + "', NOW(), NOW())");
+        }
+        return rows;
+    }
+
+    /**
+     * @brief Create classes with multi-row INSERTs in one transaction.
+     *
+     * @param classes The classes to create.
+     * @return The new ids, in input order.
+     */
+    std::vector<unsigned int> createClasses(const std::vector<NewClass>& classes) {
+        checkNewClasses("createClasses", classes);
+        std::vector<unsigned int> ids;
+        if (classes.empty()) {
+            return ids;
+        }
+        MYSQL* conn = createConnection();
+        std::vector<std::string> rows = classRows(conn, classes);
+        std::vector<uint64_t> firstIds;
+        try {
+            executeInTransaction(conn, "createClasses", buildInsertBatches(kClassInsertHead, rows), &firstIds);
+        } catch (...) {
+            releaseConnection(conn);
+            throw;
+        }
+        releaseConnection(conn);
+        recordWrite({"classes"});
+
+        ids = classIdsFrom(rows, firstIds);
+        dalLogger.logDebug("createClasses: Created " + std::to_string(ids.size()) + " classes.");
+        return ids;
+    }
+
+    /**
+     * @brief Create classes, their enrollments and their note rows in one transaction.
+     *
+     * The note files are written after the class ids are known and before the note
+     * rows are inserted; they are removed again if the transaction does not commit.
+     */
+    ImportedClasses importClasses(const std::vector<NewClass>& classes,
+                                  const std::function<ClassRows(const std::vector<unsigned int>&)>& plan) {
+        checkNewClasses("importClasses", classes);
+        ImportedClasses imported;
+        if (classes.empty()) {
+            return imported;
+        }
+        MYSQL* conn = createConnection();
+        std::vector<std::pair<std::string, std::string>> written;
+        try {
+            beginTransaction(conn, "importClasses");
+            try {
+                std::vector<std::string> rows = classRows(conn, classes);
+                std::vector<uint64_t> firstIds;
+                executeStatements(conn, "importClasses", buildInsertBatches(kClassInsertHead, rows), &firstIds);
+                imported.classIds = classIdsFrom(rows, firstIds);
+
+                ClassRows dependent = plan(imported.classIds);
+                imported.enrollments = executeStatements(conn, "importClasses",
+                    buildInsertBatches(kEnrollInsertHead, enrollmentRows(dependent.enrollments)));
+                // Files first so a note row never points at a missing file.
+                written = std::move(dependent.files);
+                writeFiles(written);
+                imported.notes = executeStatements(conn, "importClasses",
+                    buildInsertBatches(kNoteInsertHead, noteRows(conn, dependent.notes)));
+            } catch (...) {
+                mysql_query(conn, "ROLLBACK;");
+                throw;
+            }
+            commitTransaction(conn, "importClasses");
+        } catch (...) {
+            releaseConnection(conn);
+            for (const auto& file : written) {
+                std::error_code ec;
+                std::filesystem::remove(file.first, ec);
+            }
+            throw;
+        }
+        releaseConnection(conn);
+        recordWrite({"classes", "user_classes", "notes"});
+        dalLogger.logDebug("importClasses: Created " + std::to_string(imported.classIds.size()) + " classes, " +
+                           std::to_string(imported.enrollments) + " enrollments, " +
+                           std::to_string(imported.notes) + " notes.");
+        return imported;
+    }
+
+    /**
+     * @brief Create note rows with multi-row INSERTs in one transaction.
+     *
+     * @param notes The notes to create.
+     * @return The number of notes created.
+     */
+    size_t createNotes(const std::vector<NewNote>& notes) {
+        if (notes.empty()) {
+            return 0;
+        }
+        MYSQL* conn = createConnection();
+        std::vector<std::string> rows = noteRows(conn, notes);
+        uint64_t created;
+        try {
+            created = executeInTransaction(conn, "createNotes", buildInsertBatches(kNoteInsertHead, rows));
+        } catch (...) {
+            releaseConnection(conn);
+            throw;
+        }
+        releaseConnection(conn);
+        recordWrite({"notes"});
+        dalLogger.logDebug("createNotes: Created " + std::to_string(created) + " notes.");
+        return static_cast<size_t>(created);
+    }
+
+    /**
+     * @brief Repoint note rows with batched CASE updates in one transaction.
+     *
+     * @param moves (old, new) file paths.
+     * @return The number of rows updated.
+     */
+    size_t updateNotePaths(const std::vector<std::pair<std::string, std::string>>& moves) {
+        if (moves.empty()) {
+            return 0;
+        }
+        MYSQL* conn = createConnection();
+        std::vector<std::string> statements;
+        for (size_t start = 0; start < moves.size(); start += kMaxBatchRows) {
+            size_t end = std::min(moves.size(), start + kMaxBatchRows);
+            std::string cases, in;
+            for (size_t i = start; i < end; i++) {
+                std::string from = "'" + escapeWith(conn, moves[i].first) + "'";
+                cases += " WHEN " + from + " THEN '" + escapeWith(conn, moves[i].second) + "'";
+                in += (i > start ? ", " : "") + from;
+            }
+            statements.push_back("UPDATE notes SET file_path = CASE file_path" + cases +
+                                 " END WHERE file_path IN (" + in + ");");
+        }
+        uint64_t updated;
+        try {
+            updated = executeInTransaction(conn, "updateNotePaths", statements);
+        } catch (...) {
+            releaseConnection(conn);
+            throw;
+        }
+        releaseConnection(conn);
+        recordWrite({"notes"});
+        dalLogger.logDebug("updateNotePaths: Updated " + std::to_string(updated) + " notes.");
+        return static_cast<size_t>(updated);
+    }
+
     //----------------------------------------------------------------------    
     // Authentication Functions
     //----------------------------------------------------------------------
@@ -482,20 +1517,20 @@ namespace DAL {
             dalLogger.logWarn("getUserByUsername: Empty username provided.");
             return std::nullopt;
         }
-        MYSQL* conn = createConnection();
+        MYSQL* conn = connectForRead("getUserByUsername");
         // Note: For simplicity, building the query directly. Consider prepared statements for production.
         std::string query = "SELECT id, username, password_hash FROM users WHERE username = '" + username + "' LIMIT 1;";
         if (mysql_query(conn, query.c_str())) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getUserByUsername: Query failed: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getUserByUsername: Query failed: " + err);
         }
         MYSQL_RES* result = mysql_store_result(conn);
         if (!result) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("getUserByUsername: Failed to retrieve result: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("getUserByUsername: Failed to retrieve result: " + err);
         }
         std::optional<User> user = std::nullopt;
@@ -511,7 +1546,7 @@ namespace DAL {
             dalLogger.logDebug("getUserByUsername: No user found for username: " + username);
         }
         mysql_free_result(result);
-        mysql_close(conn);
+        releaseConnection(conn);
         return user;
     }
 
@@ -536,10 +1571,11 @@ namespace DAL {
         if (mysql_query(conn, query.c_str())) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("createUser: Query failed: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("createUser: Query failed: " + err);
         }
-        mysql_close(conn);
+        releaseConnection(conn);
+        recordWrite({"users"});
         dalLogger.logDebug("createUser: User '" + username + "' created successfully.");
         return true;
     }
@@ -565,14 +1601,45 @@ namespace DAL {
         if (mysql_query(conn, query.c_str())) {
             std::string err = mysql_error(conn);
             dalLogger.logErr("updateUserPassword: Query failed: " + err);
-            mysql_close(conn);
+            releaseConnection(conn);
             throw std::runtime_error("updateUserPassword: Query failed: " + err);
         }
-        mysql_close(conn);
+        releaseConnection(conn);
+        recordWrite({"users"});
         dalLogger.logDebug("updateUserPassword: Password updated successfully for user: " + username);
         return true;
     }
 
+    /**
+     * @brief Bump a note's version and timestamp, and its title if one is given.
+     *
+     * Cached copies of the note, in the query cache and the note buffer, are versioned
+     * by notes.version, so every write of the note goes through here.
+     *
+     * @param class_id The class whose note was written.
+     * @param title The new title, or empty to keep it.
+     */
+    void bumpNoteVersion(const unsigned int class_id, const std::string& title) {
+        if (class_id == 0) {
+            dalLogger.logErr("bumpNoteVersion: Invalid class ID (0) provided.");
+            throw std::invalid_argument("bumpNoteVersion: class_id must be non-zero.");
+        }
+        MYSQL* conn = createConnection();
+        std::string query = "UPDATE notes SET ";
+        if (!title.empty()) {
+            query += "title = '" + escapeWith(conn, title) + "', ";
+        }
+        query += "updated_at = NOW(), version = version + 1 WHERE class_id = " + std::to_string(class_id) + ";";
+        if (mysql_query(conn, query.c_str())) {
+            std::string err = mysql_error(conn);
+            dalLogger.logErr("bumpNoteVersion: Query failed: " + err);
+            releaseConnection(conn);
+            throw std::runtime_error("bumpNoteVersion: Query failed: " + err);
+        }
+        releaseConnection(conn);
+        recordWrite({"notes"});
+    }
+
 /**
  * @brief Execute an SQL query on the database
  * @param query The SQL query to execute
@@ -585,9 +1652,14 @@ bool execute_query(const std::string& query) {
     bool success = (mysql_query(conn, query.c_str()) == 0);
     if (!success) {
         std::cerr << "[ERROR] Query failed: " << mysql_error(conn) << "\n";
+    } else if (std::optional<std::string> table = tableWrittenBy(query)) {
+        recordWrite({*table});
+    } else {
+        readRouter().recordWrite(sessionKey());
+        queryCache().clear(); // unknown tables, drop everything
     }
     
-    mysql_close(conn);
+    releaseConnection(conn);
     return success;
 }
 /**
@@ -613,17 +1685,18 @@ std::string escape_string(const std::string& input) {
     mysql_real_escape_string(conn, escaped, input.c_str(), input.length());
     std::string result(escaped);
     delete[] escaped;
-    mysql_close(conn);
+    releaseConnection(conn);
     return result;
 }
 
 /**
  * @brief Execute a query and return the first column of the first row
  * @param query The SQL query to execute
+ * @param endpoint Label the read is counted under in routingStats()
  * @return The result string, or empty if no results
  */
-std::string get_single_result(const std::string& query) {
-    MYSQL* conn = createConnection();
+std::string get_single_result(const std::string& query, const std::string& endpoint) {
+    MYSQL* conn = connectForRead(endpoint);
     if (!conn) {
         std::cerr << "[ERROR] Failed to connect to database for query." << std::endl;
         return "";
@@ -631,7 +1704,7 @@ std::string get_single_result(const std::string& query) {
 
     if (mysql_query(conn, query.c_str())) {
         std::cerr << "[ERROR] Query failed: " << mysql_error(conn) << "\n";
-        mysql_close(conn);
+        releaseConnection(conn);
         return "";
     }
 
@@ -644,22 +1717,23 @@ std::string get_single_result(const std::string& query) {
         }
         mysql_free_result(result);
     }
-    mysql_close(conn);
+    releaseConnection(conn);
     return value;
 }
 
 /**
  * @brief Check if a query returns any results
  * @param query The SQL query to execute (should be a COUNT or similar query)
+ * @param endpoint Label the read is counted under in routingStats()
  * @return True if the query returns a non-zero result, false otherwise
  */
-bool query_returns_results(const std::string& query) {
-    MYSQL* conn = createConnection();
+bool query_returns_results(const std::string& query, const std::string& endpoint) {
+    MYSQL* conn = connectForRead(endpoint);
     if (!conn) return false;
 
     if (mysql_query(conn, query.c_str())) {
         std::cerr << "[ERROR] Query failed: " << mysql_error(conn) << "\n";
-        mysql_close(conn);
+        releaseConnection(conn);
         return false;
     }
 
@@ -675,7 +1749,7 @@ bool query_returns_results(const std::string& query) {
         mysql_free_result(result);
     }
     
-    mysql_close(conn);
+    releaseConnection(conn);
     return has_results;
 }
 
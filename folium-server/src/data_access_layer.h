@@ -8,7 +8,11 @@
  * higher-level components of the server.
  *
  * @section Responsibilities
- * - Database operations: Retrieve tables, class IDs, note IDs, and file paths.
+ * - Database operations: Retrieve tables, class IDs, note IDs, file paths and
+ *   hydrated class rows. Lookups that rarely change are cached by statement and
+ *   parameters, and invalidated per table by writes.
+ *   Reads are spread over read replicas when dbConfig.json lists any.
+ *   Connections are pooled; dbConfig.json can be reloaded while running.
  * - File operations: Read and write plain text and JSON files.
  * - JSON handling: Read and write structured data in JSON format.
  */
@@ -16,10 +20,14 @@
 #ifndef FOLSERV_DATA_ACCESS_LAYER_H_
 #define FOLSERV_DATA_ACCESS_LAYER_H_
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <unordered_map>
+#include <utility>
 
 namespace DAL {
 
@@ -30,10 +38,71 @@ namespace DAL {
         std::string password_hash;
     };
 
+    /**
+     * @brief A class row hydrated with its owner and shared note.
+     */
+    struct ClassDetail {
+        unsigned int classId = 0;
+        std::string name;
+        std::string description;
+        std::string instructor;
+        unsigned int ownerId = 0;
+        std::string ownerUsername;
+        std::optional<unsigned int> noteId; // empty until the class has a big note
+        std::string noteTitle;
+        std::string noteUpdatedAt;
+    };
+
+    struct NoteRef {
+        std::string path;
+        uint64_t version = 0; // notes.version, bumped by every write; versions cached copies
+    };
+
     //////////////
     /* DATABASE */
     //////////////
 
+    /**
+     * @brief Tags every DAL call made by this thread with a session (usually the user id).
+     *
+     * Reads are normally routed to replicas; a session that has just written is
+     * pinned to the primary for a short window so it reads its own writes.
+     * Threads without a scope are treated as their own session.
+     */
+    class SessionScope {
+    public:
+        explicit SessionScope(const std::string& session);
+        ~SessionScope();
+        SessionScope(const SessionScope&) = delete;
+        SessionScope& operator=(const SessionScope&) = delete;
+    private:
+        std::string previous_;
+    };
+
+    /**
+     * @brief Per-endpoint read routing counters and replica health.
+     * @return JSON with "endpoints" (primary/replica/fallback counts per DAL function) and "replicas".
+     */
+    nlohmann::json routingStats();
+
+    /**
+     * @brief Re-read dbConfig.json and apply it to the connection pool.
+     *
+     * Pool limits change at once; connections already leased finish their queries
+     * and are closed on return if they are now surplus. When the servers or
+     * timeouts changed, every pooled connection is replaced the same way.
+     * Adding or removing replicas still needs a restart.
+     *
+     * @throws std::runtime_error if the file is missing or malformed (the old configuration stays).
+     */
+    void reloadDbConfig();
+
+    /**
+     * @brief Connection pool limits and per-server counters.
+     * @return JSON with "limits", "generation" and "endpoints" (primary first, then replicas).
+     */
+    nlohmann::json poolStats();
+
     /**
      * @brief Retrieve the list of database tables.
      * @return A vector of strings containing the names of all tables in the database.
@@ -54,6 +123,62 @@ namespace DAL {
      */
     std::vector<int> getNoteIds(const unsigned int userId);
 
+    /**
+     * @brief Retrieve every class a user is enrolled in or owns, fully hydrated.
+     *
+     * One JOIN fetches the class, owner username and note title/updated_at for all
+     * of the user's classes. Results are cached per user for a short time and
+     * dropped whenever this process writes to the database.
+     *
+     * @param userId The ID of the user.
+     * @return The user's classes ordered by name.
+     */
+    std::vector<ClassDetail> getClassDetails(const unsigned int userId);
+
+    /**
+     * @brief Retrieve one of a user's classes, fully hydrated.
+     *
+     * Served from the same cached rows as getClassDetails().
+     *
+     * @param userId The ID of the user.
+     * @param classId The ID of the class.
+     * @return The class, or std::nullopt if it does not exist or the user has no access.
+     */
+    std::optional<ClassDetail> getClassDetail(const unsigned int userId, const unsigned int classId);
+
+    /**
+     * @brief Drop all cached class details, e.g. after class data changed outside the DAL.
+     */
+    void invalidateClassDetails();
+
+    /**
+     * @brief Check whether a user is enrolled in a class (query cache backed).
+     * @param userId The ID of the user.
+     * @param classId The ID of the class.
+     * @return True if the user is enrolled.
+     */
+    bool isEnrolled(const unsigned int userId, const unsigned int classId);
+
+    /**
+     * @brief Retrieve the file path of a class's big note (query cache backed).
+     * @param classId The ID of the class.
+     * @return The file path, or an empty string if the class has no note yet.
+     */
+    std::string getNotePathForClass(const unsigned int classId);
+
+    /**
+     * @brief Retrieve where a class's big note lives and its version (query cache backed).
+     * @param classId The ID of the class.
+     * @return The note's file path and notes.version, or nullopt if the class has no note yet.
+     */
+    std::optional<NoteRef> getNoteForClass(const unsigned int classId);
+
+    /**
+     * @brief Query cache counters.
+     * @return JSON with overall and per-statement hits/misses, entries, bytes and budget.
+     */
+    nlohmann::json queryCacheStats();
+
     /**
      * @brief Retrieve the file path for a specific note.
      * @param noteId The ID of the note whose file path is to be retrieved.
@@ -80,6 +205,21 @@ namespace DAL {
      */
     bool writeFile(const std::string& filePath, const std::string& data);
 
+    /**
+     * @brief Append data to a file, durably (fsynced before returning).
+     * @param filePath The path to the file, created if missing.
+     * @param data The data to append.
+     * @throws std::runtime_error on failure.
+     */
+    void appendFile(const std::string& filePath, const std::string& data);
+
+    /**
+     * @brief Write many files, batching their fsyncs through the file engine.
+     * @param files (path, data) pairs with distinct paths.
+     * @throws std::runtime_error on failure.
+     */
+    void writeFiles(const std::vector<std::pair<std::string, std::string>>& files);
+
     //////////
     /* TEXT */
     //////////
@@ -119,9 +259,10 @@ namespace DAL {
     /**
      * @brief Check if a query returns any results
      * @param query The SQL query to execute (should be a COUNT or similar query)
+     * @param endpoint Label the read is counted under in routingStats()
      * @return True if the query returns a non-zero result, false otherwise
      */
-    bool query_returns_results(const std::string& query);
+    bool query_returns_results(const std::string& query, const std::string& endpoint = "query_returns_results");
 
      /**
      * @brief Escape a string to make it safe for use in SQL queries
@@ -133,10 +274,149 @@ namespace DAL {
     /**
      * @brief Execute a query and return the first column of the first row
      * @param query The SQL query to execute
+     * @param endpoint Label the read is counted under in routingStats()
      * @return The result string, or empty if no results
      */
-    std::string get_single_result(const std::string& query);
+    std::string get_single_result(const std::string& query, const std::string& endpoint = "get_single_result");
     
+    // ===== BATCHED WRITES ===== //
+
+    /// Upper bound on rows in one multi-row INSERT.
+    constexpr size_t kMaxBatchRows = 500;
+    /// Upper bound on the size of one multi-row INSERT, well below MySQL's max_allowed_packet.
+    constexpr size_t kMaxBatchBytes = 1 << 20;
+
+    /**
+     * @brief Split rows into multi-row INSERT statements.
+     * @param head The statement up to VALUES, e.g. "INSERT INTO t (a, b) VALUES ".
+     * @param rows Pre-escaped value tuples, e.g. "(1, 'x')".
+     * @param maxRows Maximum rows per statement.
+     * @param maxBytes Maximum statement size; a single oversized row still gets its own statement.
+     * @return The statements, each terminated with ';'.
+     */
+    std::vector<std::string> buildInsertBatches(const std::string& head,
+                                                const std::vector<std::string>& rows,
+                                                size_t maxRows = kMaxBatchRows,
+                                                size_t maxBytes = kMaxBatchBytes);
+
+    /**
+     * @brief Create many users in one transaction.
+     * @param users (username, hashed password) pairs.
+     * @return The number of users created.
+     * @throws std::invalid_argument if any username or hash is empty.
+     * @throws std::runtime_error if any insert fails; nothing is created in that case.
+     */
+    size_t createUsers(const std::vector<std::pair<std::string, std::string>>& users);
+
+    /**
+     * @brief Look up many users by username with batched IN queries.
+     * @param usernames The usernames to resolve.
+     * @return Map of username to user id for the usernames that exist.
+     */
+    std::unordered_map<std::string, unsigned int> getUserIds(const std::vector<std::string>& usernames);
+
+    /**
+     * @brief Enroll many users into a class in one transaction.
+     *
+     * Users that are already enrolled are skipped.
+     *
+     * @param classId The class to enroll into.
+     * @param userIds The users to enroll.
+     * @return The number of new enrollments.
+     * @throws std::runtime_error if any insert fails; nobody is enrolled in that case.
+     */
+    size_t enrollUsers(const unsigned int classId, const std::vector<unsigned int>& userIds);
+
+    /**
+     * @brief Enroll many (userId, classId) pairs in one transaction, skipping existing enrollments.
+     * @param enrollments (userId, classId) pairs.
+     * @return The number of new enrollments.
+     * @throws std::runtime_error if any insert fails; nothing is enrolled in that case.
+     */
+    size_t enrollMany(const std::vector<std::pair<unsigned int, unsigned int>>& enrollments);
+
+    /**
+     * @brief A class to be inserted by createClasses().
+     */
+    struct NewClass {
+        unsigned int ownerId = 0;
+        std::string name;
+        std::string description;
+        std::string instructor;
+    };
+
+    /**
+     * @brief Create many classes in one transaction.
+     *
+     * Ids are taken from each multi-row INSERT's first auto-increment value, which
+     * requires consecutive ids per statement (innodb_autoinc_lock_mode 0 or 1, or no
+     * concurrent inserts into classes, as during an offline import).
+     *
+     * @param classes The classes to create.
+     * @return The new class ids, in the same order as @p classes.
+     * @throws std::runtime_error if any insert fails; nothing is created in that case.
+     */
+    std::vector<unsigned int> createClasses(const std::vector<NewClass>& classes);
+
+    /**
+     * @brief A note row to be inserted by createNotes().
+     */
+    struct NewNote {
+        unsigned int classId = 0;
+        std::string title;
+        std::string filePath;
+    };
+
+    /**
+     * @brief Create many note rows in one transaction.
+     * @param notes The notes to create; their files should already be written.
+     * @return The number of notes created.
+     * @throws std::runtime_error if any insert fails; nothing is created in that case.
+     */
+    size_t createNotes(const std::vector<NewNote>& notes);
+
+    /**
+     * @brief The rows importClasses() adds for classes it has just inserted.
+     */
+    struct ClassRows {
+        std::vector<std::pair<unsigned int, unsigned int>> enrollments; // (userId, classId), existing ones skipped
+        std::vector<std::pair<std::string, std::string>> files;         // (path, data) note files, distinct paths
+        std::vector<NewNote> notes;
+    };
+
+    /**
+     * @brief What importClasses() created.
+     */
+    struct ImportedClasses {
+        std::vector<unsigned int> classIds; // in the same order as the classes given
+        size_t enrollments = 0;
+        size_t notes = 0;
+    };
+
+    /**
+     * @brief Create classes with their enrollments and note rows in one transaction.
+     *
+     * Ids are assigned as in createClasses(). @p plan is called with them to build the
+     * dependent rows; its note files are written before the note rows are inserted and
+     * removed again if the transaction fails, so either all of it exists or none of it.
+     *
+     * @param classes The classes to create.
+     * @param plan Builds the enrollments, note files and note rows for the new class ids.
+     * @return The new class ids and the number of enrollments and notes created.
+     * @throws std::runtime_error if any insert or file write fails, or whatever @p plan throws;
+     *         nothing is created in that case.
+     */
+    ImportedClasses importClasses(const std::vector<NewClass>& classes,
+                                  const std::function<ClassRows(const std::vector<unsigned int>&)>& plan);
+
+    /**
+     * @brief Repoint note rows at new file paths in one transaction.
+     * @param moves (old file_path, new file_path) pairs.
+     * @return The number of rows updated.
+     * @throws std::runtime_error if an update fails; nothing is changed in that case.
+     */
+    size_t updateNotePaths(const std::vector<std::pair<std::string, std::string>>& moves);
+
     // ===== AUTH-RELATED FUNCTIONS ===== //
 
     /**
@@ -161,6 +441,14 @@ namespace DAL {
      * @return True if the password was successfully updated.
      */
     bool updateUserPassword(const std::string& username, const std::string& newHashedPassword);
+
+    /**
+     * @brief Record a write of a class's big note: bumps notes.version and updated_at.
+     * @param classId The ID of the class.
+     * @param title The note's new title, or empty to keep it.
+     * @throws std::runtime_error if the update fails.
+     */
+    void bumpNoteVersion(const unsigned int classId, const std::string& title = "");
 }
 
 #endif // FOLSERV_DATA_ACCESS_LAYER_H_
@@ -0,0 +1,228 @@
+#include "db_pool.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace DAL
+{
+    ConnectionPool::ConnectionPool(size_t endpoints, PoolLimits limits, Opener open, Closer close, Validator validate)
+        : open_(std::move(open)),
+          close_(std::move(close)),
+          validate_(std::move(validate)),
+          limits_(limits),
+          endpoints_(endpoints)
+    {
+    }
+
+    ConnectionPool::~ConnectionPool()
+    {
+        for (Endpoint &endpoint : endpoints_)
+        {
+            for (const Idle &idle : endpoint.idle)
+                close_(idle.conn);
+        }
+    }
+
+    MYSQL *ConnectionPool::acquire(size_t endpoint)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Endpoint &ep = endpoints_.at(endpoint);
+        Clock::time_point deadline = Clock::now() + limits_.acquireTimeout;
+        bool waited = false;
+
+        for (;;)
+        {
+            // Newest idle connection first; retired ones are closed on the way.
+            std::vector<MYSQL *> retired;
+            while (!ep.idle.empty())
+            {
+                Idle idle = ep.idle.back();
+                ep.idle.pop_back();
+                if (idle.generation != generation_)
+                {
+                    ep.open--;
+                    ep.retired++;
+                    retired.push_back(idle.conn);
+                    continue;
+                }
+                bool check = Clock::now() - idle.since >= limits_.validateAfter;
+                leased_[idle.conn] = {endpoint, idle.generation};
+                lock.unlock();
+                closeAll(retired);
+                retired.clear();
+                if (!check || validate_(idle.conn))
+                {
+                    lock.lock();
+                    ep.reused++;
+                    return idle.conn;
+                }
+                // The server dropped it while idle (wait_timeout, restart): try the next one.
+                close_(idle.conn);
+                lock.lock();
+                leased_.erase(idle.conn);
+                ep.open--;
+                ep.retired++;
+            }
+
+            if (ep.open < limits_.maxOpen)
+            {
+                ep.open++;
+                uint64_t generation = generation_;
+                lock.unlock();
+                closeAll(retired);
+                MYSQL *conn;
+                try
+                {
+                    conn = open_(endpoint);
+                }
+                catch (...)
+                {
+                    lock.lock();
+                    ep.open--;
+                    available_.notify_all();
+                    throw;
+                }
+                lock.lock();
+                ep.opened++;
+                leased_[conn] = {endpoint, generation};
+                return conn;
+            }
+
+            if (!retired.empty())
+            {
+                lock.unlock();
+                closeAll(retired);
+                lock.lock();
+                continue;
+            }
+
+            if (!waited)
+            {
+                ep.waits++;
+                waited = true;
+            }
+            if (available_.wait_until(lock, deadline) == std::cv_status::timeout &&
+                ep.idle.empty() && ep.open >= limits_.maxOpen)
+            {
+                ep.timeouts++;
+                throw std::runtime_error("ConnectionPool: no connection to endpoint " + std::to_string(endpoint) +
+                                         " became free within " + std::to_string(limits_.acquireTimeout.count()) +
+                                         " ms.");
+            }
+        }
+    }
+
+    void ConnectionPool::release(MYSQL *conn, bool reusable)
+    {
+        std::vector<MYSQL *> toClose;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = leased_.find(conn);
+            if (it == leased_.end())
+            {
+                toClose.push_back(conn); // not ours, just close it
+            }
+            else
+            {
+                Lease lease = it->second;
+                leased_.erase(it);
+                Endpoint &ep = endpoints_[lease.endpoint];
+                if (!reusable || lease.generation != generation_ || ep.open > limits_.maxOpen)
+                {
+                    ep.open--;
+                    ep.retired++;
+                    toClose.push_back(conn);
+                }
+                else
+                {
+                    ep.idle.push_back({conn, lease.generation, Clock::now()});
+                    trimIdle(ep, toClose);
+                }
+            }
+        }
+        // Waiters share one condition variable across endpoints, so wake them all.
+        available_.notify_all();
+        closeAll(toClose);
+    }
+
+    void ConnectionPool::reconfigure(const PoolLimits &limits, bool reconnect)
+    {
+        std::vector<MYSQL *> toClose;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            limits_ = limits;
+            if (reconnect)
+                generation_++;
+            for (Endpoint &ep : endpoints_)
+            {
+                if (reconnect)
+                {
+                    for (const Idle &idle : ep.idle)
+                        toClose.push_back(idle.conn);
+                    ep.open -= static_cast<unsigned int>(ep.idle.size());
+                    ep.retired += ep.idle.size();
+                    ep.idle.clear();
+                }
+                trimIdle(ep, toClose);
+            }
+        }
+        available_.notify_all();
+        closeAll(toClose);
+    }
+
+    // Mutex must be held. Drops the oldest idle connections past maxIdle, and past maxOpen after a shrink.
+    void ConnectionPool::trimIdle(Endpoint &ep, std::vector<MYSQL *> &toClose)
+    {
+        size_t drop = 0;
+        while (drop < ep.idle.size() &&
+               (ep.idle.size() - drop > limits_.maxIdle || ep.open - drop > limits_.maxOpen))
+        {
+            toClose.push_back(ep.idle[drop].conn);
+            drop++;
+        }
+        ep.idle.erase(ep.idle.begin(), ep.idle.begin() + static_cast<std::ptrdiff_t>(drop));
+        ep.open -= static_cast<unsigned int>(drop);
+        ep.retired += drop;
+    }
+
+    void ConnectionPool::closeAll(const std::vector<MYSQL *> &conns)
+    {
+        for (MYSQL *conn : conns)
+            close_(conn);
+    }
+
+    PoolLimits ConnectionPool::limits()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return limits_;
+    }
+
+    nlohmann::json ConnectionPool::stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nlohmann::json endpoints = nlohmann::json::array();
+        for (const Endpoint &ep : endpoints_)
+        {
+            endpoints.push_back({
+                {"open", ep.open},
+                {"idle", ep.idle.size()},
+                {"leased", ep.open - ep.idle.size()},
+                {"opened", ep.opened},
+                {"reused", ep.reused},
+                {"waits", ep.waits},
+                {"timeouts", ep.timeouts},
+                {"retired", ep.retired},
+            });
+        }
+        return {
+            {"limits", {
+                {"maxOpen", limits_.maxOpen},
+                {"maxIdle", limits_.maxIdle},
+                {"acquireTimeoutMs", limits_.acquireTimeout.count()},
+                {"validateAfterMs", limits_.validateAfter.count()},
+            }},
+            {"generation", generation_},
+            {"endpoints", endpoints},
+        };
+    }
+}
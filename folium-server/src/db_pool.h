@@ -0,0 +1,125 @@
+/**
+ * @file db_pool.h
+ * @brief Bounded pool of MySQL connections, one slot group per server.
+ *
+ * The DAL leases a connection for each call and hands it back when done, so
+ * busy workers reuse open connections instead of reconnecting every time. Each
+ * endpoint (the primary, then every replica) holds at most maxOpen connections;
+ * callers wait up to acquireTimeout for one to free up.
+ *
+ * Limits can be changed while connections are leased. Shrinking closes surplus
+ * idle connections at once and surplus leased ones when they come back, so a
+ * query already running is never cut off. A reconfigure with reconnect set
+ * retires every existing connection the same way, which is how new timeouts
+ * and endpoints take effect.
+ *
+ * Like ReadRouter, the pool only holds policy and counters; opening, closing
+ * and health checks are supplied by the DAL, which keeps it testable on its own.
+ */
+
+#ifndef FOLSERV_DB_POOL_H_
+#define FOLSERV_DB_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <mysql/mysql.h>
+#include <nlohmann/json.hpp>
+
+namespace DAL
+{
+    struct PoolLimits
+    {
+        unsigned int maxOpen = 16;                        // per endpoint, leased and idle together
+        unsigned int maxIdle = 4;                         // idle connections kept per endpoint
+        std::chrono::milliseconds acquireTimeout{5000};   // how long acquire() waits for a free slot
+        std::chrono::milliseconds validateAfter{30000};   // idle longer than this is checked before reuse
+    };
+
+    class ConnectionPool
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using Opener = std::function<MYSQL *(size_t endpoint)>;
+        using Closer = std::function<void(MYSQL *)>;
+        using Validator = std::function<bool(MYSQL *)>;
+
+        /**
+         * @param endpoints Number of servers (index 0 is the primary by DAL convention).
+         * @param limits Initial limits.
+         * @param open Opens a connection to an endpoint, throwing on failure.
+         * @param close Closes a connection.
+         * @param validate Returns false if a long-idle connection is no longer usable.
+         */
+        ConnectionPool(size_t endpoints, PoolLimits limits, Opener open, Closer close, Validator validate);
+        ~ConnectionPool();
+
+        ConnectionPool(const ConnectionPool &) = delete;
+        ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+        /// @return The number of endpoints.
+        size_t endpointCount() const { return endpoints_.size(); }
+
+        /// @brief Leases a connection to @p endpoint, reusing an idle one when possible.
+        /// @throws std::runtime_error if none frees up within acquireTimeout, or opening fails.
+        MYSQL *acquire(size_t endpoint);
+
+        /// @brief Returns a leased connection. Unusable connections (@p reusable false) are closed.
+        void release(MYSQL *conn, bool reusable = true);
+
+        /// @brief Applies new limits. With @p reconnect, every current connection is retired.
+        void reconfigure(const PoolLimits &limits, bool reconnect = false);
+
+        /// @return The current limits.
+        PoolLimits limits();
+
+        /// @return Per-endpoint open/idle/leased counts and acquire counters.
+        nlohmann::json stats();
+
+    private:
+        struct Idle
+        {
+            MYSQL *conn;
+            uint64_t generation;
+            Clock::time_point since;
+        };
+
+        struct Lease
+        {
+            size_t endpoint;
+            uint64_t generation;
+        };
+
+        struct Endpoint
+        {
+            std::vector<Idle> idle; // most recently released last
+            unsigned int open = 0;  // leased + idle + being opened
+            uint64_t opened = 0;
+            uint64_t reused = 0;
+            uint64_t waits = 0;
+            uint64_t timeouts = 0;
+            uint64_t retired = 0;
+        };
+
+        Opener open_;
+        Closer close_;
+        Validator validate_;
+
+        std::mutex mutex_;
+        std::condition_variable available_;
+        PoolLimits limits_;
+        uint64_t generation_ = 0;
+        std::vector<Endpoint> endpoints_;
+        std::unordered_map<MYSQL *, Lease> leased_;
+
+        void trimIdle(Endpoint &endpoint, std::vector<MYSQL *> &toClose);
+        void closeAll(const std::vector<MYSQL *> &conns);
+    };
+}
+
+#endif // FOLSERV_DB_POOL_H_
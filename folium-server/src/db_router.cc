@@ -0,0 +1,131 @@
+#include "db_router.h"
+
+namespace DAL
+{
+    // Sweep expired read-your-writes pins once the map grows past this size.
+    constexpr size_t kMaxTrackedSessions = 4096;
+
+    ReadRouter::ReadRouter(size_t replicaCount,
+                           std::chrono::milliseconds maxLag,
+                           std::chrono::milliseconds readYourWrites,
+                           std::chrono::milliseconds lagCheckInterval)
+        : maxLag_(maxLag),
+          readYourWrites_(readYourWrites),
+          lagCheckInterval_(lagCheckInterval),
+          replicas_(replicaCount)
+    {
+    }
+
+    void ReadRouter::reportLag(size_t replica, std::optional<std::chrono::milliseconds> lag)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ReplicaState &state = replicas_.at(replica);
+        state.healthy = lag.has_value();
+        state.lag = lag.value_or(std::chrono::milliseconds::max());
+        state.lastCheck = Clock::now();
+        state.checkInFlight = false;
+    }
+
+    bool ReadRouter::claimLagCheck(size_t replica)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ReplicaState &state = replicas_.at(replica);
+        bool checkedBefore = state.lastCheck != Clock::time_point{};
+        if (state.checkInFlight || (checkedBefore && Clock::now() - state.lastCheck < lagCheckInterval_))
+            return false;
+        state.checkInFlight = true;
+        return true;
+    }
+
+    void ReadRouter::recordWrite(const std::string &session)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        if (lastWrite_.size() >= kMaxTrackedSessions)
+            pruneWrites(now);
+        lastWrite_[session] = now;
+    }
+
+    // Mutex must be held.
+    void ReadRouter::pruneWrites(Clock::time_point now)
+    {
+        for (auto it = lastWrite_.begin(); it != lastWrite_.end();)
+        {
+            if (now - it->second >= readYourWrites_)
+                it = lastWrite_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    RouteDecision ReadRouter::route(const std::string &endpoint, const std::string &session)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        EndpointStats &stats = endpoints_[endpoint];
+        Clock::time_point now = Clock::now();
+        RouteDecision decision;
+
+        auto wrote = lastWrite_.find(session);
+        if (wrote != lastWrite_.end() && now - wrote->second < readYourWrites_)
+        {
+            decision.reason = "read-your-writes";
+            stats.readYourWrites++;
+            stats.primary++;
+            return decision;
+        }
+
+        for (size_t attempt = 0; attempt < replicas_.size(); attempt++)
+        {
+            size_t candidate = (next_ + attempt) % replicas_.size();
+            const ReplicaState &state = replicas_[candidate];
+            if (state.healthy && state.lag <= maxLag_)
+            {
+                next_ = candidate + 1;
+                decision.replica = static_cast<int>(candidate);
+                decision.reason = "replica";
+                stats.replica++;
+                return decision;
+            }
+        }
+
+        decision.reason = "no-healthy-replica";
+        if (!replicas_.empty())
+            stats.noHealthyReplica++;
+        stats.primary++;
+        return decision;
+    }
+
+    void ReadRouter::recordConnectFailure(const std::string &endpoint, size_t replica)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        EndpointStats &stats = endpoints_[endpoint];
+        stats.connectFailures++;
+        stats.replica--;
+        stats.primary++;
+        ReplicaState &state = replicas_.at(replica);
+        state.healthy = false;
+        state.lastCheck = Clock::now();
+    }
+
+    nlohmann::json ReadRouter::stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nlohmann::json out = {{"endpoints", nlohmann::json::object()}, {"replicas", nlohmann::json::array()}};
+        for (const auto &[name, s] : endpoints_)
+        {
+            out["endpoints"][name] = {
+                {"primary", s.primary},
+                {"replica", s.replica},
+                {"readYourWrites", s.readYourWrites},
+                {"noHealthyReplica", s.noHealthyReplica},
+                {"connectFailures", s.connectFailures}};
+        }
+        for (const ReplicaState &state : replicas_)
+        {
+            out["replicas"].push_back({
+                {"healthy", state.healthy},
+                {"lagMs", state.healthy ? state.lag.count() : -1}});
+        }
+        return out;
+    }
+}
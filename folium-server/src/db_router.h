@@ -0,0 +1,113 @@
+/**
+ * @file db_router.h
+ * @brief Read routing policy between the primary database and its replicas.
+ *
+ * The DAL asks the router where each read should go. Reads go to replicas in
+ * round-robin order, skipping any replica that is unreachable or lagging more
+ * than the configured maximum. A session that has just written is pinned to the
+ * primary for a short window so it always reads its own writes. When no replica
+ * qualifies the read falls back to the primary.
+ *
+ * The router only holds policy and counters; opening connections and measuring
+ * lag is done by the DAL, which makes this class easy to test on its own.
+ */
+
+#ifndef FOLSERV_DB_ROUTER_H_
+#define FOLSERV_DB_ROUTER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace DAL
+{
+    /**
+     * @brief Where a read was sent and why.
+     */
+    struct RouteDecision
+    {
+        static constexpr int kPrimary = -1;
+
+        int replica = kPrimary; // replica index, or kPrimary
+        std::string reason;     // "replica", "read-your-writes", "no-healthy-replica"
+    };
+
+    class ReadRouter
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * @param replicaCount Number of configured replicas.
+         * @param maxLag Replicas lagging more than this are skipped.
+         * @param readYourWrites How long a session stays on the primary after writing.
+         * @param lagCheckInterval How often a replica's lag should be re-measured.
+         */
+        ReadRouter(size_t replicaCount,
+                   std::chrono::milliseconds maxLag,
+                   std::chrono::milliseconds readYourWrites,
+                   std::chrono::milliseconds lagCheckInterval = std::chrono::seconds(1));
+
+        /// @return The number of configured replicas.
+        size_t replicaCount() const { return replicas_.size(); }
+
+        /// @brief Records a replica's measured lag, nullopt if it could not be reached.
+        void reportLag(size_t replica, std::optional<std::chrono::milliseconds> lag);
+
+        /// @brief Claims the lag check for @p replica if one is due. Only one caller wins per interval.
+        /// @return True if the caller should measure the lag and call reportLag().
+        bool claimLagCheck(size_t replica);
+
+        /// @brief Remembers that @p session wrote, pinning its reads to the primary for a while.
+        void recordWrite(const std::string &session);
+
+        /// @brief Picks the target for a read and counts it under @p endpoint.
+        RouteDecision route(const std::string &endpoint, const std::string &session);
+
+        /// @brief Counts a read that was sent to the primary because its replica failed to connect.
+        void recordConnectFailure(const std::string &endpoint, size_t replica);
+
+        /// @return Per-endpoint routing counters and per-replica health.
+        nlohmann::json stats();
+
+    private:
+        struct ReplicaState
+        {
+            bool healthy = true;
+            std::chrono::milliseconds lag{0};
+            Clock::time_point lastCheck{}; // epoch until first measured
+            bool checkInFlight = false;
+        };
+
+        struct EndpointStats
+        {
+            uint64_t primary = 0;
+            uint64_t replica = 0;
+            uint64_t readYourWrites = 0;
+            uint64_t noHealthyReplica = 0;
+            uint64_t connectFailures = 0;
+        };
+
+        std::chrono::milliseconds maxLag_;
+        std::chrono::milliseconds readYourWrites_;
+        std::chrono::milliseconds lagCheckInterval_;
+
+        std::mutex mutex_;
+        std::vector<ReplicaState> replicas_;
+        std::unordered_map<std::string, Clock::time_point> lastWrite_;
+        std::map<std::string, EndpointStats> endpoints_;
+        size_t next_ = 0;
+
+        void pruneWrites(Clock::time_point now);
+    };
+}
+
+#endif // FOLSERV_DB_ROUTER_H_
@@ -11,20 +11,216 @@
 #include "logger.h"
 #include "f_task.h"
 #include "fifo_channel.h"
+#include "near_duplicate.h"
+#include "note_actor.h"
+#include "note_buffer.h"
+#include "note_pipeline.h"
+#include "search_index.h"
+#include "blob_store.h"
+#include "file_engine.h"
+#include "data_access_layer.h"
+#include "core.h"
 
 using namespace dispatcher;
 
 constexpr double MIN_SLEEP = 2, MAX_SLEEP = 3; // seconds
 
+// Collects the counters exposed by each subsystem.
+json collectServerStats()
+{
+    Core::NoteBufferStats buffer = Core::NoteBuffer::instance().stats();
+    fileio::Stats io = fileio::stats();
+    blobstore::Stats blobs = blobstore::stats();
+    searchindex::Stats search = searchindex::stats();
+    Core::NoteActorStats actor = Core::NoteActor::instance().stats();
+    neardup::Stats sketches = neardup::stats();
+
+    json stages = json::array();
+    for (const pipeline::StageStats &stage : Core::NotePipeline::instance().stats())
+    {
+        stages.push_back({
+            {"stage", stage.name},
+            {"processed", stage.processed},
+            {"dropped", stage.dropped},
+            {"failed", stage.failed},
+            {"backlog", stage.backlog},
+            {"busySeconds", stage.busySeconds},
+            {"throughput", stage.busySeconds == 0 ? 0.0 : stage.processed / stage.busySeconds}
+        });
+    }
+
+    return {
+        {"dbRouting", DAL::routingStats()},
+        {"dbPool", DAL::poolStats()},
+        {"queryCache", DAL::queryCacheStats()},
+        {"noteBuffer", {
+            {"edits", buffer.edits},
+            {"fileWrites", buffer.fileWrites},
+            {"appendWrites", buffer.appendWrites},
+            {"compactions", buffer.compactions},
+            {"reads", buffer.reads},
+            {"residentHits", buffer.residentHits},
+            {"pageReads", buffer.pageReads},
+            {"hitRate", buffer.reads == 0 ? 0.0 : static_cast<double>(buffer.residentHits) / buffer.reads},
+            {"versionReloads", buffer.versionReloads},
+            {"budgetEvictions", buffer.budgetEvictions},
+            {"residentDocuments", buffer.residentDocuments},
+            {"residentBytes", buffer.residentBytes},
+            {"dirtyDocuments", buffer.dirtyDocuments}
+        }},
+        {"noteActor", {
+            {"jobs", actor.jobs},
+            {"failed", actor.failed},
+            {"batches", actor.batches},
+            {"jobsPerBatch", actor.batches == 0 ? 0.0 : static_cast<double>(actor.jobs) / actor.batches},
+            {"largestBatch", actor.largestBatch},
+            {"queued", actor.queued},
+            {"workers", actor.workers}
+        }},
+        {"notePipeline", stages},
+        {"nearDuplicates", {
+            {"classes", sketches.classes},
+            {"units", sketches.units},
+            {"checks", sketches.checks},
+            {"candidatesPerCheck", sketches.checks == 0 ? 0.0 : static_cast<double>(sketches.candidates) / sketches.checks},
+            {"microsPerCheck", sketches.checks == 0 ? 0.0 : static_cast<double>(sketches.checkMicros) / sketches.checks},
+            {"builds", sketches.builds}
+        }},
+        {"search", {
+            {"units", search.units},
+            {"deadUnits", search.deadUnits},
+            {"terms", search.terms},
+            {"postingBytes", search.postingBytes},
+            {"updates", search.updates},
+            {"searches", search.searches},
+            {"journalRecords", search.journalRecords}
+        }},
+        {"fileio", {
+            {"backend", io.backend == fileio::Backend::IO_URING ? "io_uring" : "pread"},
+            {"operations", io.operations},
+            {"submissions", io.submissions},
+            {"fdCacheHits", io.fdCacheHits},
+            {"fdCacheMisses", io.fdCacheMisses}
+        }},
+        {"blobs", {
+            {"puts", blobs.puts},
+            {"dedupHits", blobs.dedupHits},
+            {"bytesWritten", blobs.bytesWritten},
+            {"bytesDeduped", blobs.bytesDeduped},
+            {"bytesStored", blobs.bytesStored},
+            {"compressionRatio", blobs.bytesStored == 0 ? 0.0 : static_cast<double>(blobs.bytesWritten) / blobs.bytesStored},
+            {"dictionaryId", blobs.dictionaryId}
+        }}
+    };
+}
+
 F_Task processTask(F_Task &task)
 {
     logger::logS("Processing task: ", task.type_);
+
+    // Tag DAL calls with the requesting user so their reads follow their writes
+    std::string session = task.data_.is_object() && task.data_.contains("userId")
+                              ? task.data_["userId"].dump()
+                              : "";
+    DAL::SessionScope sessionScope(session);
     
     // Ensure PING tasks get proper responses
     if (task.type_ == F_TaskType::PING) {
         task.data_ = {{"status", "success"}, {"message", "pong from dispatch"}};
         logger::log("Created PING response with data payload");
     }
+
+    if (task.type_ == F_TaskType::SERVER_STATS) {
+        task.data_ = collectServerStats();
+    }
+
+    // Class routes all read from the same cached, hydrated class rows
+    try {
+        switch (task.type_) {
+        case F_TaskType::GET_ME_CLASSES:
+            task.data_ = Core::getUserClasses(task.data_["userId"]);
+            break;
+        case F_TaskType::GET_CLASS_DETAILS:
+            task.data_ = Core::getClassDetails(task.data_["classId"], task.data_["userId"]);
+            break;
+        case F_TaskType::GET_CLASS_OWNER: {
+            json details = Core::getClassDetails(task.data_["classId"], task.data_["userId"]);
+            task.data_ = {{"ownerId", details["ownerId"]}, {"ownerName", details["owner"]}};
+            break;
+        }
+        case F_TaskType::GET_CLASS_NAME: {
+            json details = Core::getClassDetails(task.data_["classId"], task.data_["userId"]);
+            task.data_ = {{"name", details["name"]}};
+            break;
+        }
+        case F_TaskType::GET_CLASS_DESCRIPTION: {
+            json details = Core::getClassDetails(task.data_["classId"], task.data_["userId"]);
+            task.data_ = {{"description", details["description"]}};
+            break;
+        }
+        case F_TaskType::GET_CLASS_TITLE: {
+            json details = Core::getClassDetails(task.data_["classId"], task.data_["userId"]);
+            task.data_ = {{"title", details["title"]}};
+            break;
+        }
+        case F_TaskType::GET_CLASS_BIGNOTE:
+            task.data_ = {{"bigNote", task.data_.contains("page")
+                ? Core::getBigNotePage(task.data_["classId"], task.data_["userId"],
+                                       notestore::PageQuery::fromJson(task.data_["page"]))
+                : Core::getBigNote(task.data_["classId"], task.data_["userId"])}};
+            break;
+        case F_TaskType::GET_BIGNOTE_HISTORY:
+            task.data_ = task.data_.contains("version")
+                       ? Core::getBigNoteVersion(task.data_["classId"], task.data_["userId"], task.data_["version"])
+                       : Core::getBigNoteHistory(task.data_["classId"], task.data_["userId"]);
+            break;
+        case F_TaskType::POST_UPLOAD_NOTE: {
+            std::string uploadId;
+            Core::uploadNote(task.data_["classId"], task.data_["userId"], task.data_["filePath"],
+                             task.data_.value("title", ""), &uploadId);
+            task.data_ = {{"uploadId", uploadId}, {"status", "staged"}};
+            break;
+        }
+        case F_TaskType::GET_BIGNOTE_EXPORT:
+            task.data_ = Core::prepareExport(task.data_["classId"], task.data_["userId"]);
+            break;
+        case F_TaskType::SEARCH_NOTES:
+            task.data_ = Core::searchNotes(task.data_["userId"], task.data_["query"], task.data_.value("limit", 20));
+            break;
+        case F_TaskType::GET_UPLOAD_STATUS:
+            task.data_ = Core::getUploadStatus(task.data_["classId"], task.data_["userId"], task.data_["uploadId"]);
+            break;
+        case F_TaskType::POST_CLASS_ENROLL:
+            task.data_ = Core::bulkEnroll(task.data_["classId"], task.data_["userId"],
+                                          task.data_["usernames"].get<std::vector<std::string>>());
+            break;
+        case F_TaskType::PATCH_BIGNOTE_UNIT:
+            task.data_ = Core::editBigNoteUnit(task.data_["classId"], task.data_["userId"], task.data_["unitId"],
+                                               task.data_["fields"], task.data_.value("after", ""));
+            break;
+        case F_TaskType::DELETE_BIGNOTE_UNIT:
+            task.data_ = Core::deleteBigNoteUnit(task.data_["classId"], task.data_["userId"], task.data_["unitId"]);
+            break;
+        default:
+            break;
+        }
+    } catch (const std::exception& e) {
+        // The HTTP status the gateway answers with, by what went wrong
+        int status = 500;
+        try {
+            throw;
+        } catch (const Core::Forbidden&) {
+            status = 403;
+        } catch (const Core::NotFound&) {
+            status = 404;
+        } catch (const std::invalid_argument&) {
+            status = 400;
+        } catch (...) {
+        }
+        logger::logErr(std::string("Task failed: ") + e.what());
+        task.type_ = F_TaskType::ERROR;
+        task.data_ = {{"error", e.what()}, {"status", status}};
+    }
     
     logger::logS("Done processing task: ", task.type_);
     return task;
@@ -41,6 +237,25 @@ Dispatcher::Dispatcher(ipc::FifoChannel &in, ipc::FifoChannel &out, const unsign
     out_.send(F_Task(F_TaskType::PING));
 
     createThreadPool(numThreads);
+
+    // coalesce rapid note edits into periodic writes
+    Core::NoteBuffer::instance().start();
+
+    // one writer per class at a time; mutations queued for a class are applied as a batch
+    Core::NoteActor::instance().start();
+
+    // full-text search over note units; build it once with folium-import --build-search-index
+    try
+    {
+        searchindex::setRoot("search");
+    }
+    catch (const std::exception &e)
+    {
+        logger::logErr(std::string("Search index not loaded, rebuild it with folium-import --build-search-index: ") + e.what());
+    }
+
+    // merge uploads off the request path; resumes uploads staged before a restart
+    Core::NotePipeline::instance().start();
 }
 
 void Dispatcher::createThreadPool(const unsigned int numThreads)
@@ -135,7 +350,8 @@ void Dispatcher::start()
                 // Return a message that the server is busy and the task was dropped
                 F_Task response(F_TaskType::ERROR);
                 response.data_ = {
-                    {"error", "Server busy! Request dropped, please try again later."}
+                    {"error", "Server busy! Request dropped, please try again later."},
+                    {"status", 503}
                 };
                 out_.send(response);
             } else {
@@ -153,6 +369,23 @@ void Dispatcher::start()
             thread.join();
         }
     }
+
+    // finish queued uploads while the buffer still takes their edits
+    Core::NotePipeline::instance().stop();
+    Core::NoteActor::instance().stop();
+
+    // make every buffered note edit durable before exiting
+    Core::NoteBuffer::instance().stop();
+
+    // fold the search journal into the snapshot so the next start loads quickly
+    try
+    {
+        searchindex::save();
+    }
+    catch (const std::exception &e)
+    {
+        logger::logErr(std::string("Failed to save search index: ") + e.what());
+    }
     
     logger::log("Dispatcher shut down");
 }
\ No newline at end of file
@@ -21,6 +21,7 @@ enum F_TaskType
     PING,
     SYSKILL,
     ERROR,
+    SERVER_STATS,         // GET /api/stats
 
     // Auth
     REGISTER,             // POST /api/auth/register
@@ -41,12 +42,17 @@ enum F_TaskType
     GET_CLASS_DESCRIPTION, // GET /api/me/classes/{classId}/description
     GET_CLASS_BIGNOTE,     // GET /api/me/classes/{classId}/bigNote
     GET_CLASS_TITLE,       // GET /api/me/classes/{classId}/title
+    POST_CLASS_ENROLL,     // POST /api/me/classes/{classId}/enroll
 
     // Notes
     POST_UPLOAD_NOTE,    // POST /api/me/classes/{classId}/upload-note
     PUT_BIGNOTE_EDIT,    // PUT /api/me/classes/{classId}/bigNote/edit-note
     GET_BIGNOTE_HISTORY, // GET /api/me/classes/{classId}/bigNote/history
     GET_BIGNOTE_EXPORT,  // GET /api/me/classes/{classId}/bigNote/export
+    PATCH_BIGNOTE_UNIT,  // PATCH /api/me/classes/{classId}/bigNote/units/{unitId}
+    DELETE_BIGNOTE_UNIT, // DELETE /api/me/classes/{classId}/bigNote/units/{unitId}
+    GET_UPLOAD_STATUS,   // GET /api/me/classes/{classId}/uploads/{uploadId}
+    SEARCH_NOTES,        // GET /api/search
 
     // Optionally keep these if your code references them
     CREATE_NOTE,
@@ -113,11 +119,13 @@ struct F_Task
         case GET_CLASS_DESCRIPTION:
         case GET_CLASS_BIGNOTE:
         case GET_CLASS_TITLE:
+        case GET_UPLOAD_STATUS:
             return 6;
 
         // Updating or deleting classes is a bit more “expensive”
         case PUT_CLASS:
         case DELETE_CLASS:
+        case POST_CLASS_ENROLL:
             return 7;
 
         // Notes
@@ -127,13 +135,20 @@ struct F_Task
             return 7;
         case PUT_BIGNOTE_EDIT:
         case EDIT_NOTE:
+        case PATCH_BIGNOTE_UNIT:
+        case DELETE_BIGNOTE_UNIT:
             // Editing existing notes
             return 8;
         case GET_BIGNOTE_HISTORY:
         case GET_BIGNOTE_EXPORT:
-            // Reading/exporting a big note
+        case SEARCH_NOTES:
+            // Reading/exporting/searching big notes
             return 8;
 
+        // Diagnostics should never delay real requests
+        case SERVER_STATS:
+            return 9;
+
         // Default or error
         case ERROR:
         default:
@@ -0,0 +1,1092 @@
+/**
+ * @file file_engine.cc
+ * @brief Implementation of the io_uring and pread file I/O backends.
+ *
+ * The io_uring backend talks to the kernel directly through the io_uring_setup /
+ * io_uring_enter syscalls and the mmapped submission/completion rings, so no extra
+ * library (liburing) is needed at build time. One reactor thread owns the ring:
+ * callers enqueue operations and sleep until their whole batch has completed.
+ */
+
+#include "file_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1) // renameat2 flag, from <linux/fs.h>
+#endif
+
+static logger::Logger ioLogger("fileio");
+
+namespace
+{
+    // Largest single read/write handed to the kernel (the sqe length is 32 bits).
+    constexpr size_t kMaxChunk = 1u << 30;
+
+    // How long the reactor waits before resubmitting after the kernel took nothing.
+    constexpr std::chrono::microseconds kBusyRetry{200};
+
+    /**
+     * @brief Tracks completion of a group of operations submitted together.
+     */
+    struct Batch
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t remaining = 0;
+    };
+
+    /**
+     * @brief A single file operation, shared by both backends.
+     */
+    struct Op
+    {
+        uint8_t opcode = IORING_OP_NOP;
+        int fd = -1;
+        void *buf = nullptr;
+        unsigned int len = 0;
+        uint64_t offset = 0;
+        const char *path = nullptr;  // rename source
+        const char *path2 = nullptr; // rename target
+        int result = 0;              // >= 0 on success, -errno on failure
+        Batch *batch = nullptr;
+
+        void complete(int res)
+        {
+            result = res;
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (--batch->remaining == 0)
+            {
+                batch->cv.notify_all();
+            }
+        }
+    };
+
+    std::atomic<uint64_t> operationCount{0};
+    std::atomic<uint64_t> submissionCount{0};
+    std::atomic<uint64_t> fdCacheHits{0};
+    std::atomic<uint64_t> fdCacheMisses{0};
+
+    // Runs one operation synchronously, returning >= 0 or -errno.
+    int runBlocking(const Op &op)
+    {
+        ssize_t res = 0;
+        switch (op.opcode)
+        {
+        case IORING_OP_READ:
+            res = ::pread(op.fd, op.buf, op.len, static_cast<off_t>(op.offset));
+            break;
+        case IORING_OP_WRITE:
+            res = ::pwrite(op.fd, op.buf, op.len, static_cast<off_t>(op.offset));
+            break;
+        case IORING_OP_FSYNC:
+            res = ::fsync(op.fd);
+            break;
+        case IORING_OP_RENAMEAT:
+            res = ::rename(op.path, op.path2);
+            break;
+        default:
+            return -EINVAL;
+        }
+        return res < 0 ? -errno : static_cast<int>(res);
+    }
+
+    /**
+     * @brief Minimal io_uring wrapper over the raw syscalls and mmapped rings.
+     *
+     * Only the reactor thread touches the ring after construction.
+     */
+    class Ring
+    {
+    public:
+        explicit Ring(unsigned int entries)
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd_ < 0)
+            {
+                throw std::runtime_error("io_uring_setup failed: " + std::string(std::strerror(errno)));
+            }
+
+            sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (singleMmap)
+            {
+                sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+            }
+
+            sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+            if (sqRing_ == MAP_FAILED)
+            {
+                sqRing_ = nullptr;
+                release();
+                throw std::runtime_error("io_uring: failed to map submission ring");
+            }
+            if (singleMmap)
+            {
+                cqRing_ = sqRing_;
+            }
+            else
+            {
+                cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+                if (cqRing_ == MAP_FAILED)
+                {
+                    cqRing_ = nullptr;
+                    release();
+                    throw std::runtime_error("io_uring: failed to map completion ring");
+                }
+            }
+            sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+            void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+            {
+                release();
+                throw std::runtime_error("io_uring: failed to map submission entries");
+            }
+            sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+            char *sq = static_cast<char *>(sqRing_);
+            sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            sqEntries_ = params.sq_entries;
+
+            char *cq = static_cast<char *>(cqRing_);
+            cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        }
+
+        ~Ring() { release(); }
+
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+
+        unsigned int capacity() const { return sqEntries_; }
+
+        // Places one operation in the submission queue. The caller guarantees space.
+        void push(Op *op)
+        {
+            unsigned tail = *sqTail_;
+            unsigned index = tail & sqMask_;
+            io_uring_sqe *sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = op->opcode;
+            sqe->fd = op->fd;
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+            if (op->opcode == IORING_OP_RENAMEAT)
+            {
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<uint64_t>(op->path);
+                sqe->len = static_cast<uint32_t>(AT_FDCWD);
+                sqe->addr2 = reinterpret_cast<uint64_t>(op->path2);
+            }
+            else
+            {
+                sqe->addr = reinterpret_cast<uint64_t>(op->buf);
+                sqe->len = op->len;
+                sqe->off = op->offset;
+            }
+            sqArray_[index] = index;
+            std::atomic_ref<unsigned>(*sqTail_).store(tail + 1, std::memory_order_release);
+            ++pending_;
+        }
+
+        // Entries pushed that the kernel has not consumed yet.
+        unsigned int pending() const { return pending_; }
+
+        // Submits every pending entry and waits for at least @p minComplete completions.
+        // Returns how many entries the kernel consumed, which may be fewer than were pending
+        // (0 if the kernel was busy), or -errno on any other failure.
+        long submit(unsigned int minComplete)
+        {
+            for (;;)
+            {
+                long res = syscall(__NR_io_uring_enter, fd_, pending_, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (res >= 0)
+                {
+                    pending_ -= static_cast<unsigned int>(res);
+                    return res;
+                }
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EBUSY)
+                    return 0; // out of resources or completions: reap and retry on the next loop
+                const int error = errno;
+                ioLogger.logErr("io_uring_enter failed: " + std::string(std::strerror(error)));
+                return -error;
+            }
+        }
+
+        // Takes the pending entries back out of the submission queue and returns their operations.
+        std::vector<Op *> takeBackPending()
+        {
+            std::vector<Op *> ops;
+            const unsigned tail = *sqTail_;
+            for (unsigned i = tail - pending_; i != tail; i++)
+            {
+                ops.push_back(reinterpret_cast<Op *>(sqes_[sqArray_[i & sqMask_]].user_data));
+            }
+            std::atomic_ref<unsigned>(*sqTail_).store(tail - pending_, std::memory_order_release);
+            pending_ = 0;
+            return ops;
+        }
+
+        // Hands every available completion to @p onComplete. Returns how many were reaped.
+        template <typename F>
+        unsigned int reap(F &&onComplete)
+        {
+            unsigned head = *cqHead_;
+            unsigned tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+            unsigned int reaped = 0;
+            while (head != tail)
+            {
+                const io_uring_cqe &cqe = cqes_[head & cqMask_];
+                onComplete(reinterpret_cast<Op *>(cqe.user_data), cqe.res);
+                ++head;
+                ++reaped;
+            }
+            std::atomic_ref<unsigned>(*cqHead_).store(head, std::memory_order_release);
+            return reaped;
+        }
+
+    private:
+        int fd_ = -1;
+        void *sqRing_ = nullptr;
+        void *cqRing_ = nullptr;
+        size_t sqRingSize_ = 0;
+        size_t cqRingSize_ = 0;
+        size_t sqesSize_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+
+        unsigned *sqHead_ = nullptr;
+        unsigned *sqTail_ = nullptr;
+        unsigned int pending_ = 0;
+        unsigned *sqArray_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned sqEntries_ = 0;
+
+        unsigned *cqHead_ = nullptr;
+        unsigned *cqTail_ = nullptr;
+        unsigned cqMask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+
+        void release()
+        {
+            if (sqes_)
+                munmap(sqes_, sqesSize_);
+            if (cqRing_ && cqRing_ != sqRing_)
+                munmap(cqRing_, cqRingSize_);
+            if (sqRing_)
+                munmap(sqRing_, sqRingSize_);
+            if (fd_ >= 0)
+                close(fd_);
+            sqes_ = nullptr;
+            cqRing_ = sqRing_ = nullptr;
+            fd_ = -1;
+        }
+    };
+
+    /**
+     * @brief Owns the ring and batches operations queued by any thread.
+     */
+    class Reactor
+    {
+    public:
+        explicit Reactor(unsigned int queueDepth)
+            : ring_(queueDepth), thread_(&Reactor::run, this)
+        {
+        }
+
+        ~Reactor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            cv_.notify_one();
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        // Queues all operations and blocks until every one of them has completed.
+        void execute(std::vector<Op> &ops)
+        {
+            Batch batch;
+            batch.remaining = ops.size();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (Op &op : ops)
+                {
+                    op.batch = &batch;
+                    queue_.push_back(&op);
+                }
+            }
+            cv_.notify_one();
+
+            std::unique_lock<std::mutex> lock(batch.mutex);
+            batch.cv.wait(lock, [&batch]() { return batch.remaining == 0; });
+        }
+
+    private:
+        Ring ring_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Op *> queue_;
+        bool stopping_ = false;
+        unsigned int inflight_ = 0; // pushed and not yet completed; only touched by the reactor thread
+        std::thread thread_;
+
+        void run()
+        {
+            for (;;)
+            {
+                unsigned int pushed = 0;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cv_.wait(lock, [this]() { return stopping_ || !queue_.empty() || inflight_ > 0; });
+                    if (stopping_ && queue_.empty() && inflight_ == 0)
+                        return;
+
+                    // Everything that piled up while we were busy goes out in one submission.
+                    while (!queue_.empty() && inflight_ + pushed < ring_.capacity())
+                    {
+                        ring_.push(queue_.front());
+                        queue_.pop_front();
+                        ++pushed;
+                    }
+                }
+                inflight_ += pushed;
+
+                // Entries the kernel did not take last time go out again with the new ones. With
+                // nothing to submit the enter only waits for a completion, which is not a submission.
+                const bool submitting = ring_.pending() > 0;
+                long submitted = ring_.submit(1);
+                if (submitting)
+                {
+                    submissionCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (submitted < 0)
+                {
+                    // Nothing will ever complete what is still queued; fail it rather than wait
+                    for (Op *op : ring_.takeBackPending())
+                    {
+                        op->complete(static_cast<int>(submitted));
+                        --inflight_;
+                    }
+                }
+                const unsigned int reaped = ring_.reap([](Op *op, int res) { op->complete(res); });
+                inflight_ -= reaped;
+                if (submitted == 0 && reaped == 0 && ring_.pending() > 0)
+                {
+                    std::this_thread::sleep_for(kBusyRetry);
+                }
+            }
+        }
+    };
+
+    std::mutex engineMutex;
+    std::unique_ptr<Reactor> reactor;
+    std::atomic<bool> started{false};
+    std::atomic<fileio::Backend> backend{fileio::Backend::PREAD};
+
+    void ensureStarted()
+    {
+        if (!started.load(std::memory_order_acquire))
+        {
+            fileio::init(fileio::Backend::PREAD);
+        }
+    }
+
+    // Runs a batch on the active backend.
+    void execute(std::vector<Op> &ops)
+    {
+        if (ops.empty())
+            return;
+        ensureStarted();
+        operationCount.fetch_add(ops.size(), std::memory_order_relaxed);
+        if (backend.load(std::memory_order_acquire) == fileio::Backend::IO_URING)
+        {
+            reactor->execute(ops);
+            return;
+        }
+        for (Op &op : ops)
+        {
+            op.result = runBlocking(op);
+        }
+        submissionCount.fetch_add(ops.size(), std::memory_order_relaxed);
+    }
+
+    int executeOne(Op op)
+    {
+        std::vector<Op> ops{op};
+        execute(ops);
+        return ops.front().result;
+    }
+
+    /**
+     * @brief RAII wrapper for a raw file descriptor.
+     */
+    class Fd
+    {
+    public:
+        Fd(const std::string &path, int flags, mode_t mode = 0)
+            : fd_(::open(path.c_str(), flags | O_CLOEXEC, mode))
+        {
+        }
+        explicit Fd(int fd) : fd_(fd) {}
+        ~Fd()
+        {
+            if (fd_ >= 0)
+                ::close(fd_);
+        }
+        Fd(Fd &&other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+        Fd(const Fd &) = delete;
+        Fd &operator=(const Fd &) = delete;
+
+        int get() const { return fd_; }
+        bool ok() const { return fd_ >= 0; }
+
+    private:
+        int fd_;
+    };
+
+    /**
+     * @brief Least-recently-used map of shared descriptors.
+     *
+     * Entries are shared_ptrs so an evicted descriptor stays open until the
+     * readers still using it are done.
+     */
+    class FdLru
+    {
+    public:
+        std::shared_ptr<Fd> find(const std::string &key)
+        {
+            auto it = entries_.find(key);
+            if (it == entries_.end())
+                return nullptr;
+            order_.splice(order_.begin(), order_, it->second.position);
+            return it->second.fd;
+        }
+
+        void insert(const std::string &key, std::shared_ptr<Fd> fd, size_t capacity)
+        {
+            erase(key);
+            order_.push_front(key);
+            entries_.emplace(key, Entry{std::move(fd), order_.begin()});
+            while (entries_.size() > capacity)
+            {
+                entries_.erase(order_.back());
+                order_.pop_back();
+            }
+        }
+
+        void erase(const std::string &key)
+        {
+            auto it = entries_.find(key);
+            if (it == entries_.end())
+                return;
+            order_.erase(it->second.position);
+            entries_.erase(it);
+        }
+
+        void clear()
+        {
+            entries_.clear();
+            order_.clear();
+        }
+
+    private:
+        struct Entry
+        {
+            std::shared_ptr<Fd> fd;
+            std::list<std::string>::iterator position;
+        };
+        std::unordered_map<std::string, Entry> entries_;
+        std::list<std::string> order_; // most recently used first
+    };
+
+    /**
+     * @brief Read-only file descriptors for hot files, opened with openat() on cached directory fds.
+     */
+    class FdCache
+    {
+    public:
+        void setCapacity(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            capacity_ = capacity;
+            files_.clear();
+            dirs_.clear();
+        }
+
+        /// @return An open descriptor (check ok()) and whether it came from the cache.
+        std::pair<std::shared_ptr<Fd>, bool> open(const std::string &path, int &err)
+        {
+            std::filesystem::path p(path);
+            const std::string dir = p.has_parent_path() ? p.parent_path().string() : ".";
+            const std::string name = p.filename().string();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (capacity_ == 0)
+            {
+                lock.unlock();
+                auto fd = std::make_shared<Fd>(path, O_RDONLY);
+                err = errno;
+                fdCacheMisses.fetch_add(1, std::memory_order_relaxed);
+                return {fd, false};
+            }
+            if (std::shared_ptr<Fd> cached = files_.find(path))
+            {
+                fdCacheHits.fetch_add(1, std::memory_order_relaxed);
+                return {cached, true};
+            }
+            std::shared_ptr<Fd> dirFd = dirs_.find(dir);
+            lock.unlock();
+            fdCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+            // A cached directory may have been removed (and recreated) since: retry with a fresh one.
+            int fd = -1;
+            for (int attempt = 0; attempt < 2 && fd < 0; attempt++)
+            {
+                if (!dirFd || attempt == 1)
+                {
+                    dirFd = std::make_shared<Fd>(dir, O_RDONLY | O_DIRECTORY);
+                    if (!dirFd->ok())
+                    {
+                        err = errno;
+                        return {std::make_shared<Fd>(-1), false};
+                    }
+                    lock.lock();
+                    dirs_.insert(dir, dirFd, capacity_);
+                    lock.unlock();
+                }
+                fd = ::openat(dirFd->get(), name.c_str(), O_RDONLY | O_CLOEXEC);
+                err = errno;
+            }
+            auto file = std::make_shared<Fd>(fd);
+            if (file->ok())
+            {
+                lock.lock();
+                files_.insert(path, file, capacity_);
+            }
+            return {file, false};
+        }
+
+        void invalidate(const std::string &path)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            files_.erase(path);
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            files_.clear();
+            dirs_.clear();
+        }
+
+    private:
+        std::mutex mutex_;
+        size_t capacity_ = 0;
+        FdLru files_;
+        FdLru dirs_;
+    };
+
+    FdCache fdCache;
+
+    std::string errnoMessage(int err)
+    {
+        return std::strerror(err < 0 ? -err : err);
+    }
+
+    // Writes all of @p data to @p fd at @p offset, resubmitting after short writes.
+    void writeAll(int fd, const std::string &data, const std::string &path, uint64_t offset = 0)
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            Op op;
+            op.opcode = IORING_OP_WRITE;
+            op.fd = fd;
+            op.buf = const_cast<char *>(data.data() + written);
+            op.len = static_cast<unsigned int>(std::min(kMaxChunk, data.size() - written));
+            op.offset = offset + written;
+            int res = executeOne(op);
+            if (res < 0)
+            {
+                throw std::runtime_error("fileio: write failed for " + path + ": " + errnoMessage(res));
+            }
+            if (res == 0)
+            {
+                // Nothing written for a non-empty buffer; resubmitting would spin forever.
+                throw std::runtime_error("fileio: write made no progress for " + path);
+            }
+            written += static_cast<size_t>(res);
+        }
+    }
+
+    void fsyncFd(int fd, const std::string &path)
+    {
+        Op op;
+        op.opcode = IORING_OP_FSYNC;
+        op.fd = fd;
+        int res = executeOne(op);
+        if (res < 0)
+        {
+            throw std::runtime_error("fileio: fsync failed for " + path + ": " + errnoMessage(res));
+        }
+    }
+}
+
+namespace fileio
+{
+    Backend backendFromString(const char *name)
+    {
+        const std::string value = name != nullptr ? name : "";
+        if (value == "pread")
+        {
+            return Backend::PREAD;
+        }
+        if (!value.empty() && value != "io_uring")
+        {
+            ioLogger.logWarn("Unknown file I/O backend \"" + value + "\" (expected io_uring or pread), using io_uring");
+        }
+        return Backend::IO_URING;
+    }
+
+    void init(Backend requested, unsigned int queueDepth, size_t fdCacheSize)
+    {
+        std::lock_guard<std::mutex> lock(engineMutex);
+        if (started.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        fdCache.setCapacity(fdCacheSize);
+
+        Backend chosen = Backend::PREAD;
+        if (requested == Backend::IO_URING)
+        {
+            try
+            {
+                reactor = std::make_unique<Reactor>(queueDepth);
+                chosen = Backend::IO_URING;
+            }
+            catch (const std::exception &e)
+            {
+                ioLogger.logWarn(std::string("io_uring unavailable, falling back to pread: ") + e.what());
+            }
+        }
+
+        backend.store(chosen, std::memory_order_release);
+        started.store(true, std::memory_order_release);
+        ioLogger.log(std::string("File engine started with backend: ") + (chosen == Backend::IO_URING ? "io_uring" : "pread"));
+    }
+
+    void shutdown()
+    {
+        std::lock_guard<std::mutex> lock(engineMutex);
+        reactor.reset();
+        fdCache.clear();
+        backend.store(Backend::PREAD, std::memory_order_release);
+        started.store(false, std::memory_order_release);
+    }
+
+    Backend activeBackend()
+    {
+        ensureStarted();
+        return backend.load(std::memory_order_acquire);
+    }
+
+    Stats stats()
+    {
+        return {
+            backend.load(std::memory_order_acquire),
+            operationCount.load(std::memory_order_relaxed),
+            submissionCount.load(std::memory_order_relaxed),
+            fdCacheHits.load(std::memory_order_relaxed),
+            fdCacheMisses.load(std::memory_order_relaxed)};
+    }
+
+    std::vector<std::string> readMany(const std::vector<std::string> &paths)
+    {
+        struct Pending
+        {
+            std::shared_ptr<Fd> fd;
+            std::string data;
+            size_t filled = 0;
+            bool done = false;
+        };
+
+        ensureStarted();
+        std::vector<Pending> files;
+        files.reserve(paths.size());
+        for (const std::string &path : paths)
+        {
+            struct stat st;
+            std::shared_ptr<Fd> fd;
+            for (;;)
+            {
+                int err = 0;
+                auto [opened, cached] = fdCache.open(path, err);
+                if (!opened->ok())
+                {
+                    throw std::runtime_error("fileio: cannot open " + path + ": " + errnoMessage(err));
+                }
+                if (::fstat(opened->get(), &st) != 0)
+                {
+                    throw std::runtime_error("fileio: cannot stat " + path + ": " + errnoMessage(errno));
+                }
+                if (cached && st.st_nlink == 0)
+                {
+                    // Unlinked or replaced behind our back: drop it and open the current file.
+                    fdCache.invalidate(path);
+                    continue;
+                }
+                fd = std::move(opened);
+                break;
+            }
+            Pending pending{std::move(fd), std::string(static_cast<size_t>(st.st_size), '\0')};
+            pending.done = pending.data.empty();
+            files.push_back(std::move(pending));
+        }
+
+        // Submit every outstanding read together until all files are complete.
+        for (;;)
+        {
+            std::vector<Op> ops;
+            std::vector<size_t> owners;
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                Pending &file = files[i];
+                if (file.done)
+                    continue;
+                Op op;
+                op.opcode = IORING_OP_READ;
+                op.fd = file.fd->get();
+                op.buf = file.data.data() + file.filled;
+                op.len = static_cast<unsigned int>(std::min(kMaxChunk, file.data.size() - file.filled));
+                op.offset = file.filled;
+                ops.push_back(op);
+                owners.push_back(i);
+            }
+            if (ops.empty())
+                break;
+
+            execute(ops);
+
+            for (size_t k = 0; k < ops.size(); k++)
+            {
+                Pending &file = files[owners[k]];
+                if (ops[k].result < 0)
+                {
+                    throw std::runtime_error("fileio: read failed for " + paths[owners[k]] + ": " + errnoMessage(ops[k].result));
+                }
+                file.filled += static_cast<size_t>(ops[k].result);
+                if (ops[k].result == 0 || file.filled == file.data.size())
+                {
+                    // EOF before the size we saw at open: the file shrank underneath us.
+                    file.data.resize(file.filled);
+                    file.done = true;
+                }
+            }
+        }
+
+        std::vector<std::string> contents;
+        contents.reserve(files.size());
+        for (Pending &file : files)
+        {
+            contents.push_back(std::move(file.data));
+        }
+        return contents;
+    }
+
+    std::string read(const std::string &path)
+    {
+        return std::move(readMany({path}).front());
+    }
+
+    void write(const std::string &path, const std::string &data)
+    {
+        fdCache.invalidate(path);
+        Fd fd(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (!fd.ok())
+        {
+            throw std::runtime_error("fileio: cannot open " + path + " for writing: " + errnoMessage(errno));
+        }
+        writeAll(fd.get(), data, path);
+    }
+
+    void append(const std::string &path, const std::string &data)
+    {
+        // Same inode afterwards, so cached read descriptors stay valid and see the new size.
+        Fd fd(path, O_WRONLY | O_CREAT, 0644);
+        if (!fd.ok())
+        {
+            throw std::runtime_error("fileio: cannot open " + path + " for appending: " + errnoMessage(errno));
+        }
+        struct stat st;
+        if (::fstat(fd.get(), &st) != 0)
+        {
+            throw std::runtime_error("fileio: cannot stat " + path + ": " + errnoMessage(errno));
+        }
+        writeAll(fd.get(), data, path, static_cast<uint64_t>(st.st_size));
+        fsyncFd(fd.get(), path);
+    }
+
+    void fsync(const std::string &path)
+    {
+        Fd fd(path, O_RDONLY);
+        if (!fd.ok())
+        {
+            throw std::runtime_error("fileio: cannot open " + path + " for fsync: " + errnoMessage(errno));
+        }
+        fsyncFd(fd.get(), path);
+    }
+
+    void rename(const std::string &from, const std::string &to)
+    {
+        fdCache.invalidate(from);
+        fdCache.invalidate(to);
+        Op op;
+        op.opcode = IORING_OP_RENAMEAT;
+        op.path = from.c_str();
+        op.path2 = to.c_str();
+        int res = executeOne(op);
+        if (res == -EINVAL && activeBackend() == Backend::IO_URING)
+        {
+            // Kernels before 5.11 do not know IORING_OP_RENAMEAT.
+            res = runBlocking(op);
+        }
+        if (res < 0)
+        {
+            throw std::runtime_error("fileio: rename " + from + " -> " + to + " failed: " + errnoMessage(res));
+        }
+    }
+
+    void remove(const std::string &path)
+    {
+        fdCache.invalidate(path);
+        if (::unlink(path.c_str()) != 0 && errno != ENOENT)
+        {
+            throw std::runtime_error("fileio: cannot remove " + path + ": " + errnoMessage(errno));
+        }
+    }
+
+    void writeAtomic(const std::string &path, const std::string &data)
+    {
+        writeAtomicMany({{path, data}});
+    }
+
+    void writeAtomicMany(const std::vector<std::pair<std::string, std::string>> &files)
+    {
+        struct Pending
+        {
+            Fd fd;
+            std::string tmpPath;
+            size_t written = 0;
+        };
+
+        std::vector<Pending> pending;
+        pending.reserve(files.size());
+        // Temp files a failure leaves behind; renamed ones are gone already
+        struct Cleanup
+        {
+            std::vector<Pending> &pending;
+            bool done = false;
+            ~Cleanup()
+            {
+                if (!done)
+                {
+                    for (const Pending &file : pending)
+                        ::unlink(file.tmpPath.c_str());
+                }
+            }
+        } cleanup{pending};
+
+        for (const auto &[path, data] : files)
+        {
+            // A name of its own, so writers of the same path that do not share a lock
+            // never write into each other's temp file
+            std::string tmpPath = path + ".XXXXXX.tmp";
+            Fd fd(::mkostemps(tmpPath.data(), 4, O_CLOEXEC));
+            if (!fd.ok())
+            {
+                throw std::runtime_error("fileio: cannot create a temp file for " + path + ": " + errnoMessage(errno));
+            }
+            ::fchmod(fd.get(), 0644);
+            pending.push_back({std::move(fd), std::move(tmpPath)});
+        }
+
+        // Submit every outstanding write together until all files are written.
+        for (;;)
+        {
+            std::vector<Op> ops;
+            std::vector<size_t> owners;
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                const std::string &data = files[i].second;
+                if (pending[i].written == data.size())
+                    continue;
+                Op op;
+                op.opcode = IORING_OP_WRITE;
+                op.fd = pending[i].fd.get();
+                op.buf = const_cast<char *>(data.data() + pending[i].written);
+                op.len = static_cast<unsigned int>(std::min(kMaxChunk, data.size() - pending[i].written));
+                op.offset = pending[i].written;
+                ops.push_back(op);
+                owners.push_back(i);
+            }
+            if (ops.empty())
+                break;
+
+            execute(ops);
+
+            for (size_t k = 0; k < ops.size(); k++)
+            {
+                if (ops[k].result < 0)
+                {
+                    throw std::runtime_error("fileio: write failed for " + pending[owners[k]].tmpPath + ": " + errnoMessage(ops[k].result));
+                }
+                if (ops[k].result == 0)
+                {
+                    throw std::runtime_error("fileio: write made no progress for " + pending[owners[k]].tmpPath);
+                }
+                pending[owners[k]].written += static_cast<size_t>(ops[k].result);
+            }
+        }
+
+        // One batch of fsyncs for all temp files.
+        std::vector<Op> syncs(pending.size());
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            syncs[i].opcode = IORING_OP_FSYNC;
+            syncs[i].fd = pending[i].fd.get();
+        }
+        execute(syncs);
+        for (size_t i = 0; i < syncs.size(); i++)
+        {
+            if (syncs[i].result < 0)
+            {
+                throw std::runtime_error("fileio: fsync failed for " + pending[i].tmpPath + ": " + errnoMessage(syncs[i].result));
+            }
+        }
+
+        // Renames only once every file is durable.
+        std::vector<Op> renames(pending.size());
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            fdCache.invalidate(files[i].first);
+            renames[i].opcode = IORING_OP_RENAMEAT;
+            renames[i].path = pending[i].tmpPath.c_str();
+            renames[i].path2 = files[i].first.c_str();
+        }
+        execute(renames);
+        for (size_t i = 0; i < renames.size(); i++)
+        {
+            int res = renames[i].result;
+            if (res == -EINVAL && activeBackend() == Backend::IO_URING)
+            {
+                // Kernels before 5.11 do not know IORING_OP_RENAMEAT.
+                res = runBlocking(renames[i]);
+            }
+            if (res < 0)
+            {
+                throw std::runtime_error("fileio: rename " + pending[i].tmpPath + " -> " + files[i].first + " failed: " + errnoMessage(res));
+            }
+        }
+
+        cleanup.done = true;
+
+        // Persist the directory entries as well, otherwise the renames themselves may be lost.
+        std::vector<std::string> dirPaths;
+        for (const auto &file : files)
+        {
+            std::filesystem::path parent = std::filesystem::path(file.first).parent_path();
+            dirPaths.push_back(parent.empty() ? "." : parent.string());
+        }
+        std::sort(dirPaths.begin(), dirPaths.end());
+        dirPaths.erase(std::unique(dirPaths.begin(), dirPaths.end()), dirPaths.end());
+
+        std::vector<Fd> dirs;
+        std::vector<Op> dirSyncs;
+        for (const std::string &dirPath : dirPaths)
+        {
+            Fd dir(dirPath, O_RDONLY | O_DIRECTORY);
+            if (!dir.ok())
+                continue;
+            Op op;
+            op.opcode = IORING_OP_FSYNC;
+            op.fd = dir.get();
+            dirSyncs.push_back(op);
+            dirs.push_back(std::move(dir));
+        }
+        execute(dirSyncs);
+        for (size_t i = 0; i < dirSyncs.size(); i++)
+        {
+            if (dirSyncs[i].result < 0)
+            {
+                throw std::runtime_error("fileio: fsync failed for directory: " + errnoMessage(dirSyncs[i].result));
+            }
+        }
+    }
+
+    bool replaceExisting(const std::string &path, const std::string &data)
+    {
+        std::string tmpPath = path + ".XXXXXX.tmp";
+        Fd fd(::mkostemps(tmpPath.data(), 4, O_CLOEXEC));
+        if (!fd.ok())
+        {
+            throw std::runtime_error("fileio: cannot create a temp file for " + path + ": " + errnoMessage(errno));
+        }
+        // After the exchange the temp name holds the old content; either way it goes.
+        struct Unlink
+        {
+            const std::string &path;
+            ~Unlink() { ::unlink(path.c_str()); }
+        } unlinkTmp{tmpPath};
+        ::fchmod(fd.get(), 0644);
+        writeAll(fd.get(), data, tmpPath);
+        fsyncFd(fd.get(), tmpPath);
+
+        fdCache.invalidate(path);
+        if (::syscall(SYS_renameat2, AT_FDCWD, tmpPath.c_str(), AT_FDCWD, path.c_str(), RENAME_EXCHANGE) != 0)
+        {
+            if (errno == ENOENT)
+                return false;
+            throw std::runtime_error("fileio: exchange " + tmpPath + " <-> " + path + " failed: " + errnoMessage(errno));
+        }
+
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        Fd dir(parent.empty() ? "." : parent.string(), O_RDONLY | O_DIRECTORY);
+        if (dir.ok())
+            fsyncFd(dir.get(), parent.string());
+        return true;
+    }
+}
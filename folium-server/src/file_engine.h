@@ -0,0 +1,129 @@
+/**
+ * @file file_engine.h
+ * @brief Pluggable file I/O engine used by the DAL for note reads and writes.
+ *
+ * Two backends are provided:
+ * - IO_URING: a single submission ring owned by a reactor thread. Requests coming
+ *   from any dispatcher worker are queued, submitted together with one
+ *   io_uring_enter() call and their completions are reaped in batch. Many
+ *   concurrent bigNote reads therefore cost a handful of syscalls instead of one
+ *   blocking read chain each.
+ * - PREAD: the portable fallback. pread/pwrite/fsync/rename run directly on the
+ *   calling thread. Regular files are always "ready" for epoll, so there is no
+ *   readiness-based variant; this backend is what epoll servers use for disk I/O.
+ *
+ * The backend is chosen once per process with fileio::init(). If io_uring is not
+ * available (old kernel, seccomp, ...) init() logs a warning and falls back to PREAD.
+ * If init() is never called the engine lazily starts with PREAD, which keeps tests
+ * and tools that only link the DAL working unchanged.
+ *
+ * Reads go through an LRU cache of open file descriptors. Files are opened with
+ * openat() relative to cached directory descriptors, so a hot note costs neither a
+ * path walk nor an open(). Writes, renames and removals through the engine drop the
+ * affected entries. A cached descriptor whose file was unlinked or replaced behind
+ * the engine's back (link count 0) is reopened on its next read.
+ *
+ * All functions throw std::runtime_error on failure.
+ */
+
+#ifndef FOLSERV_FILE_ENGINE_H_
+#define FOLSERV_FILE_ENGINE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace fileio
+{
+    /**
+     * @brief The available I/O backends.
+     */
+    enum class Backend
+    {
+        PREAD,
+        IO_URING
+    };
+
+    /**
+     * @brief Counters describing how the engine batches work.
+     */
+    struct Stats
+    {
+        Backend backend;
+        uint64_t operations;  // individual read/write/fsync/rename operations
+        uint64_t submissions; // io_uring_enter calls (or syscalls for PREAD)
+        uint64_t fdCacheHits;   // reads that reused a cached descriptor
+        uint64_t fdCacheMisses; // reads that had to open the file
+    };
+
+    /// @brief Parses a backend name, "io_uring" or "pread". nullptr or empty means IO_URING; any
+    ///        other name is logged as a warning and also falls back to IO_URING.
+    /// @param name The backend name, may be nullptr.
+    /// @return The matching backend.
+    Backend backendFromString(const char *name);
+
+    /// @brief Starts the engine with the requested backend. Safe to call once per process.
+    /// @param backend The preferred backend, IO_URING falls back to PREAD when unavailable.
+    /// @param queueDepth Number of submission queue entries for the io_uring backend.
+    /// @param fdCacheSize Number of open file descriptors kept for reads, 0 disables the cache.
+    void init(Backend backend, unsigned int queueDepth = 256, size_t fdCacheSize = 1024);
+
+    /// @brief Stops the reactor thread (if any). Pending operations complete first.
+    void shutdown();
+
+    /// @return The backend actually in use.
+    Backend activeBackend();
+
+    /// @return A snapshot of the engine counters.
+    Stats stats();
+
+    /// @brief Reads a whole file.
+    /// @throws std::runtime_error if the file cannot be opened or read.
+    std::string read(const std::string &path);
+
+    /// @brief Reads several files, submitting all reads together.
+    /// @throws std::runtime_error if any of the files cannot be opened or read.
+    /// @return The file contents, in the same order as @p paths.
+    std::vector<std::string> readMany(const std::vector<std::string> &paths);
+
+    /// @brief Truncates and writes a file in place (no fsync).
+    /// @throws std::runtime_error on failure.
+    void write(const std::string &path, const std::string &data);
+
+    /// @brief Appends @p data to the end of a file (created if missing) and fsyncs it.
+    /// @throws std::runtime_error on failure.
+    void append(const std::string &path, const std::string &data);
+
+    /// @brief Flushes a file's data and metadata to stable storage.
+    /// @throws std::runtime_error on failure.
+    void fsync(const std::string &path);
+
+    /// @brief Atomically renames @p from to @p to.
+    /// @throws std::runtime_error on failure.
+    void rename(const std::string &from, const std::string &to);
+
+    /// @brief Removes a file if it exists.
+    /// @throws std::runtime_error on failure other than the file not existing.
+    void remove(const std::string &path);
+
+    /// @brief Crash-safe replace: writes a temp file of its own, "<path>.XXXXXX.tmp", fsyncs it and
+    ///        renames it over @p path. Concurrent writers of one path each win or lose whole.
+    /// @throws std::runtime_error on failure.
+    void writeAtomic(const std::string &path, const std::string &data);
+
+    /// @brief writeAtomic for many files at once: all writes, then all fsyncs, then all renames are
+    ///        submitted together, and each parent directory is fsynced once at the end.
+    /// @param files (path, data) pairs; paths must be distinct.
+    /// @throws std::runtime_error on failure. Files renamed before the failure keep their new content.
+    void writeAtomicMany(const std::vector<std::pair<std::string, std::string>> &files);
+
+    /// @brief writeAtomic for a file that must already exist: the new content is swapped in with
+    ///        renameat2(RENAME_EXCHANGE), so a file removed meanwhile, by this process or another, stays removed.
+    /// @return False, writing nothing, if @p path does not exist.
+    /// @throws std::runtime_error on failure, including file systems without RENAME_EXCHANGE.
+    bool replaceExisting(const std::string &path, const std::string &data);
+}
+
+#endif // FOLSERV_FILE_ENGINE_H_
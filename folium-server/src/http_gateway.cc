@@ -4,22 +4,42 @@
  */
 #include "http_gateway.h"
 
+#include <algorithm>
 #include <string>
 #include <thread>
 #include <iostream>
 #include <exception>
+#include <memory>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <utility>
+
+#include <cstdlib>
+#include <unistd.h>
 
 #include "httplib.h"
 #include "nlohmann/json.hpp"
 
 #include "logger.h"
 #include "auth.h"
+#include "compression.h"
 #include "fifo_channel.h"
+#include "note_export.h"
+#include "note_page.h"
+#include "request_arena.h"
 
 using json = nlohmann::json;
 
 using namespace gateway;
 
+// Smaller responses are not worth the encoding overhead.
+constexpr size_t kMinCompressedResponse = 1024;
+
+// Longer upload titles are cut; the rest of a multipart upload goes to disk as it arrives.
+constexpr size_t kMaxUploadTitle = 512;
+
 /**
  * @brief Extracts a JWT from a request.
  *
@@ -45,6 +65,88 @@ std::string extractJWT(const httplib::Request &req)
     return "";
 }
 
+/**
+ * @brief Resolves the user making a request from its bearer token.
+ *
+ * @param req
+ * @return The user id, or nullopt if the token is missing or invalid.
+ */
+std::optional<int> authenticate(const httplib::Request &req)
+{
+    try
+    {
+        return auth::userIdFromToken(extractJWT(req));
+    }
+    catch (const std::exception &)
+    {
+        return std::nullopt;
+    }
+}
+
+/**
+ * @brief Takes the HTTP status the dispatcher chose for an error task out of its data
+ * (400 bad input, 403 forbidden, 404 missing, 503 busy); 500 when it chose none.
+ */
+static int takeErrorStatus(F_Task &task)
+{
+    auto status = task.data_.find("status");
+    if (status == task.data_.end() || !status->is_number_integer())
+    {
+        return 500;
+    }
+    int code = status->get<int>();
+    task.data_.erase(status);
+    return code;
+}
+
+/**
+ * @brief Sends an authenticated class task and writes its response.
+ *
+ * Errors from dispatch are answered with the status the dispatcher chose for them.
+ *
+ * @param req
+ * @param res
+ * @param type The class task to run
+ * @param classId The class from the URL, 0 for none
+ * @param payload Extra task fields taken from the request body
+ */
+void Gateway::handleClassTask(const httplib::Request &req, httplib::Response &res, F_TaskType type, int classId,
+                              json payload)
+{
+    std::optional<int> userId = authenticate(req);
+    if (!userId)
+    {
+        res.status = 401;
+        res.set_content(json{{"error", "Missing or invalid token."}}.dump(), "application/json");
+        return;
+    }
+
+    F_Task task(type);
+    task.data_ = std::move(payload);
+    task.data_["userId"] = *userId;
+    if (classId != 0)
+    {
+        task.data_["classId"] = classId;
+    }
+
+    F_Task outputTask = processTaskAndWaitForResponse(task);
+    res.status = 200;
+    if (outputTask.type_ == F_TaskType::ERROR)
+    {
+        res.status = takeErrorStatus(outputTask);
+    }
+
+    // Big notes are mostly repetitive text; send them zstd-encoded to clients that accept it
+    std::string body = outputTask.data_.dump();
+    res.set_header("Vary", "Accept-Encoding");
+    if (body.size() >= kMinCompressedResponse && compression::acceptsZstd(req.get_header_value("Accept-Encoding")))
+    {
+        body = compression::compress(body);
+        res.set_header("Content-Encoding", "zstd");
+    }
+    res.set_content(body, "application/json");
+}
+
 /**
  * @brief Helper initialize routes func.
  *
@@ -93,14 +195,339 @@ void Gateway::initializeRoutes(httplib::Server &svr)
         res.set_content(response.dump(), "application/json");
     });
 
+    // server stats (routing, buffering and storage counters)
+    svr.Get("/api/stats", [this](const httplib::Request &, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/stats.");
+
+        F_Task outputTask = processTaskAndWaitForResponse(F_Task(F_TaskType::SERVER_STATS));
+
+        res.status = outputTask.type_ == F_TaskType::ERROR ? 500 : 200;
+        res.set_content(outputTask.data_.dump(), "application/json");
+    });
+
+    // classes of the authenticated user
+    svr.Get("/api/me/classes", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/me/classes");
+        handleClassTask(req, res, F_TaskType::GET_ME_CLASSES, 0);
+    });
+
+    // one class, or a single field of it
+    const std::pair<const char *, F_TaskType> classRoutes[] = {
+        {"", F_TaskType::GET_CLASS_DETAILS},
+        {"/owner", F_TaskType::GET_CLASS_OWNER},
+        {"/name", F_TaskType::GET_CLASS_NAME},
+        {"/description", F_TaskType::GET_CLASS_DESCRIPTION},
+        {"/title", F_TaskType::GET_CLASS_TITLE},
+    };
+    for (const auto &[suffix, type] : classRoutes)
+    {
+        std::string pattern = std::string(R"(/api/me/classes/(\d+))") + suffix;
+        svr.Get(pattern, [this, pattern, type = type](const httplib::Request &req, httplib::Response &res)
+        {
+            logger::log("Gateway: GET " + pattern);
+            handleClassTask(req, res, type, std::stoi(req.matches[1]));
+        });
+    }
+
+    // big note; ?offset=&limit=, ?unitIds=a,b,c and ?fields=full|nocontent|titles return part of it
+    svr.Get(R"(/api/me/classes/(\d+)/bigNote)", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/me/classes/{classId}/bigNote");
+
+        auto badRequest = [&res](const std::string &error)
+        {
+            res.status = 400;
+            res.set_content(json{{"error", error}}.dump(), "application/json");
+        };
+        auto isCount = [](const std::string &value)
+        {
+            return !value.empty() && value.size() <= 9 && value.find_first_not_of("0123456789") == std::string::npos;
+        };
+
+        json payload = json::object();
+        if (req.has_param("offset") || req.has_param("limit") || req.has_param("unitIds") || req.has_param("fields"))
+        {
+            notestore::PageQuery query;
+            if (req.has_param("offset"))
+            {
+                if (!isCount(req.get_param_value("offset")))
+                    return badRequest("offset must be a non-negative integer.");
+                query.offset = std::stoul(req.get_param_value("offset"));
+            }
+            if (req.has_param("limit"))
+            {
+                if (!isCount(req.get_param_value("limit")))
+                    return badRequest("limit must be a non-negative integer.");
+                query.limit = std::stoul(req.get_param_value("limit"));
+            }
+            if (req.has_param("unitIds"))
+            {
+                std::stringstream unitIds(req.get_param_value("unitIds"));
+                for (std::string unitId; std::getline(unitIds, unitId, ',');)
+                {
+                    if (!unitId.empty())
+                        query.unitIds.push_back(unitId);
+                }
+            }
+            if (req.has_param("fields"))
+            {
+                std::optional<notestore::Fields> fields = notestore::parseFields(req.get_param_value("fields"));
+                if (!fields)
+                    return badRequest("fields must be full, nocontent or titles.");
+                query.fields = *fields;
+            }
+            payload["page"] = query.toJson();
+        }
+        handleClassTask(req, res, F_TaskType::GET_CLASS_BIGNOTE, std::stoi(req.matches[1]), std::move(payload));
+    });
+
+    // big note history; ?version=N rebuilds that version
+    svr.Get(R"(/api/me/classes/(\d+)/bigNote/history)", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/me/classes/{classId}/bigNote/history");
+
+        json payload = json::object();
+        if (req.has_param("version"))
+        {
+            const std::string version = req.get_param_value("version");
+            if (version.empty() || version.size() > 9 || version.find_first_not_of("0123456789") != std::string::npos)
+            {
+                res.status = 400;
+                res.set_content(json{{"error", "version must be a positive integer."}}.dump(), "application/json");
+                return;
+            }
+            payload["version"] = std::stoul(version);
+        }
+        handleClassTask(req, res, F_TaskType::GET_BIGNOTE_HISTORY, std::stoi(req.matches[1]), std::move(payload));
+    });
+
+    // big note export, rendered unit by unit into a chunked response: ?format=markdown|html|text
+    svr.Get(R"(/api/me/classes/(\d+)/bigNote/export)", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/me/classes/{classId}/bigNote/export");
+
+        std::optional<noteexport::Format> format =
+            noteexport::parseFormat(req.has_param("format") ? req.get_param_value("format") : "markdown");
+        if (!format)
+        {
+            res.status = 400;
+            res.set_content(json{{"error", "format must be markdown, html or text."}}.dump(), "application/json");
+            return;
+        }
+        std::optional<int> userId = authenticate(req);
+        if (!userId)
+        {
+            res.status = 401;
+            res.set_content(json{{"error", "Missing or invalid token."}}.dump(), "application/json");
+            return;
+        }
+
+        // The dispatcher checks access and flushes the note; the file is rendered here
+        const int classId = std::stoi(req.matches[1]);
+        F_Task task(F_TaskType::GET_BIGNOTE_EXPORT);
+        task.data_ = {{"userId", *userId}, {"classId", classId}};
+        F_Task outputTask = processTaskAndWaitForResponse(task);
+        if (outputTask.type_ == F_TaskType::ERROR)
+        {
+            res.status = takeErrorStatus(outputTask);
+            res.set_content(outputTask.data_.dump(), "application/json");
+            return;
+        }
+
+        std::shared_ptr<noteexport::ExportStream> stream;
+        try
+        {
+            stream = std::make_shared<noteexport::ExportStream>(outputTask.data_["path"], classId,
+                                                                outputTask.data_["version"], *format);
+        }
+        catch (const std::exception &e)
+        {
+            logger::logErr(std::string("Gateway: export failed: ") + e.what());
+            res.status = 500;
+            res.set_content(json{{"error", "Export failed."}}.dump(), "application/json");
+            return;
+        }
+
+        res.set_header("Content-Disposition", "attachment; filename=\"class_" + std::to_string(classId) + "_note." +
+                                                  noteexport::extension(*format) + "\"");
+        res.set_chunked_content_provider(noteexport::contentType(*format), [stream](size_t, httplib::DataSink &sink)
+        {
+            std::string chunk;
+            try
+            {
+                if (stream->next(chunk))
+                    return sink.write(chunk.data(), chunk.size());
+            }
+            catch (const std::exception &e)
+            {
+                // Headers are gone already; cutting the response short is all that is left
+                logger::logErr(std::string("Gateway: export failed mid-stream: ") + e.what());
+                return false;
+            }
+            sink.done();
+            return true;
+        });
+    });
+
+    // progress of an upload through the note pipeline
+    svr.Get(R"(/api/me/classes/(\d+)/uploads/([\w-]+))", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/me/classes/{classId}/uploads/{uploadId}");
+        handleClassTask(req, res, F_TaskType::GET_UPLOAD_STATUS, std::stoi(req.matches[1]),
+                        {{"uploadId", req.matches[2].str()}});
+    });
+
+    // full-text search over the caller's classes: ?q=terms&limit=N
+    svr.Get("/api/search", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: GET /api/search");
+
+        const std::string query = req.get_param_value("q");
+        if (query.find_first_not_of(" \t") == std::string::npos)
+        {
+            res.status = 400;
+            res.set_content(json{{"error", "q must not be empty."}}.dump(), "application/json");
+            return;
+        }
+        size_t limit = 20;
+        if (req.has_param("limit"))
+        {
+            const std::string value = req.get_param_value("limit");
+            if (value.empty() || value.size() > 3 || value.find_first_not_of("0123456789") != std::string::npos ||
+                std::stoul(value) == 0 || std::stoul(value) > 100)
+            {
+                res.status = 400;
+                res.set_content(json{{"error", "limit must be between 1 and 100."}}.dump(), "application/json");
+                return;
+            }
+            limit = std::stoul(value);
+        }
+        handleClassTask(req, res, F_TaskType::SEARCH_NOTES, 0, {{"query", query}, {"limit", limit}});
+    });
+
     /* POST ROUTES */
 
+    // upload a note; it is merged into the big note in the background
+    svr.Post(R"(/api/me/classes/(\d+)/upload-note)",
+             [this](const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &content)
+    {
+        logger::log("Gateway: POST /api/me/classes/{classId}/upload-note");
+
+        if (!req.is_multipart_form_data())
+        {
+            res.status = 400;
+            res.set_content(json{{"error", "Expected a noteFile in multipart/form-data."}}.dump(), "application/json");
+            return;
+        }
+
+        // The file is written to disk as it is received, never held in memory; the dispatcher
+        // stages its own copy, so this one only lives for the request
+        const std::filesystem::path incoming = "uploads/incoming";
+        std::filesystem::create_directories(incoming);
+        // mkstemp creates the file, so concurrent uploads never share a name
+        std::string path = (incoming / "XXXXXX").string();
+        const int fd = ::mkstemp(path.data());
+        if (fd < 0)
+        {
+            logger::logErr("Gateway: could not create an upload file in " + incoming.string());
+            res.status = 500;
+            res.set_content(json{{"error", "Could not receive the noteFile."}}.dump(), "application/json");
+            return;
+        }
+        ::close(fd);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+        std::string part, title;
+        bool hasFile = false;
+        bool received = content(
+            [&](const httplib::MultipartFormData &header)
+            {
+                part = header.name;
+                hasFile = hasFile || part == "noteFile";
+                return true;
+            },
+            [&](const char *data, size_t length)
+            {
+                if (part == "noteFile")
+                    file.write(data, static_cast<std::streamsize>(length));
+                else if (part == "title" && title.size() < kMaxUploadTitle)
+                    title.append(data, std::min(length, kMaxUploadTitle - title.size()));
+                return static_cast<bool>(file);
+            });
+        file.close();
+
+        if (!received || !hasFile || !file)
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            res.status = 400;
+            res.set_content(json{{"error", received && !hasFile ? "Expected a noteFile in multipart/form-data."
+                                                                : "Could not receive the noteFile."}}.dump(),
+                            "application/json");
+            return;
+        }
+        if (title.size() == kMaxUploadTitle)
+        {
+            // Not in the middle of a UTF-8 character
+            while (!title.empty() && (static_cast<unsigned char>(title.back()) & 0xC0) == 0x80)
+                title.pop_back();
+            if (!title.empty() && static_cast<unsigned char>(title.back()) >= 0xC0)
+                title.pop_back();
+        }
+        if (title.empty())
+        {
+            title = req.get_param_value("title");
+        }
+
+        handleClassTask(req, res, F_TaskType::POST_UPLOAD_NOTE, std::stoi(req.matches[1]),
+                        {{"filePath", path}, {"title", title}});
+        if (res.status == 200)
+        {
+            res.status = 202;
+        }
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    });
+
+
+    // bulk enrollment into a class the user owns
+    svr.Post(R"(/api/me/classes/(\d+)/enroll)", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: POST /api/me/classes/{classId}/enroll");
+
+        arena::RequestArena requestArena;
+        arena::Scope scope(requestArena);
+        RequestJson body = RequestJson::parse(req.body, nullptr, false);
+        if (body.is_discarded() || !body.contains("usernames") || !body["usernames"].is_array())
+        {
+            res.status = 400;
+            res.set_content(json{{"error", "Expected {\"usernames\": [...]}."}}.dump(), "application/json");
+            return;
+        }
+        for (const RequestJson &username : body["usernames"])
+        {
+            if (!username.is_string())
+            {
+                res.status = 400;
+                res.set_content(json{{"error", "usernames must be strings."}}.dump(), "application/json");
+                return;
+            }
+        }
+
+        handleClassTask(req, res, F_TaskType::POST_CLASS_ENROLL, std::stoi(req.matches[1]),
+                        {{"usernames", json(body["usernames"])}});
+    });
+
     // register
     svr.Post("/api/auth/register", [this](const httplib::Request &req, httplib::Response &res) {
         logger::log("Gateway: POST /api/auth/register");
 
         try {
-            json json_data = json::parse(req.body);
+            arena::RequestArena requestArena;
+            arena::Scope scope(requestArena);
+            RequestJson json_data = RequestJson::parse(req.body);
 
             std::string username = json_data["username"];
             std::string password = json_data["password"];
@@ -151,7 +578,9 @@ void Gateway::initializeRoutes(httplib::Server &svr)
         logger::log("Gateway: POST /api/auth/login"); 
 
         try {
-            json json_data = json::parse(req.body);
+            arena::RequestArena requestArena;
+            arena::Scope scope(requestArena);
+            RequestJson json_data = RequestJson::parse(req.body);
 
             std::string username = json_data["username"];
             std::string password = json_data["password"];
@@ -191,6 +620,37 @@ void Gateway::initializeRoutes(httplib::Server &svr)
     svr.Post("/api/auth/logout", [](const httplib::Request &req, httplib::Response &res)
              { logger::log("Gateway: POST /api/auth/logout"); });
 
+    /* PATCH / DELETE ROUTES */
+
+    // update or insert one unit of a big note
+    svr.Patch(R"(/api/me/classes/(\d+)/bigNote/units/([\w.-]+))", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: PATCH /api/me/classes/{classId}/bigNote/units/{unitId}");
+
+        arena::RequestArena requestArena;
+        arena::Scope scope(requestArena);
+        RequestJson body = RequestJson::parse(req.body, nullptr, false);
+        if (body.is_discarded() || !body.is_object() || (body.contains("after") && !body["after"].is_string()))
+        {
+            res.status = 400;
+            res.set_content(json{{"error", "Expected {\"title\", \"content\", \"after\"}."}}.dump(), "application/json");
+            return;
+        }
+
+        json payload = {{"unitId", req.matches[2].str()}, {"after", body.value("after", "")}};
+        body.erase("after");
+        payload["fields"] = json(body);
+        handleClassTask(req, res, F_TaskType::PATCH_BIGNOTE_UNIT, std::stoi(req.matches[1]), std::move(payload));
+    });
+
+    // delete one unit of a big note
+    svr.Delete(R"(/api/me/classes/(\d+)/bigNote/units/([\w.-]+))", [this](const httplib::Request &req, httplib::Response &res)
+    {
+        logger::log("Gateway: DELETE /api/me/classes/{classId}/bigNote/units/{unitId}");
+        handleClassTask(req, res, F_TaskType::DELETE_BIGNOTE_UNIT, std::stoi(req.matches[1]),
+                        {{"unitId", req.matches[2].str()}});
+    });
+
     logger::log("Done instantiating routes.");
 }
 
@@ -47,6 +47,12 @@ namespace gateway
          * Processes a single task and returns a response
          */
         F_Task processTaskAndWaitForResponse(const F_Task &task, int timeoutMs = 5000);
+
+        /**
+         * Runs an authenticated class task and writes its response.
+         */
+        void handleClassTask(const httplib::Request &req, httplib::Response &res, F_TaskType type, int classId,
+                             nlohmann::json payload = nlohmann::json::object());
     public:
         /**
          * @brief Creates an http gateway connected with dispatch through pipes.
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "blob_store.h"
+#include "logger.h"
+#include "version.h"
+#include "importer.h"
+#include "file_engine.h"
+#include "note_store.h"
+#include "search_index.h"
+
+static void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <manifest.json|classes.csv> [options]\n"
+              << "  --workers N      parallel import workers (default: hardware threads)\n"
+              << "  --chunk N        classes per transaction (default: 500)\n"
+              << "  --notes-dir DIR  where note files are written (default: notes)\n"
+              << "  --dry-run        parse and validate the manifest only\n"
+              << "   or: " << program << " --migrate-notes [--notes-dir DIR]\n"
+              << "  moves notes from the flat notes/ layout into hashed subdirectories\n"
+              << "   or: " << program << " --compress-blobs [--blobs-dir DIR]\n"
+              << "  trains a compression dictionary on the stored unit content and recompresses it\n"
+              << "   or: " << program << " --build-search-index [--notes-dir DIR] [--search-dir DIR]\n"
+              << "  rebuilds the full-text search index from the note files\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    importer::Options options;
+    options.workers = std::max(1u, std::thread::hardware_concurrency());
+    bool dryRun = false;
+    bool migrateNotes = false;
+    bool compressBlobs = false;
+    bool buildSearchIndex = false;
+    std::string blobsDir = "blobs";
+    std::string searchDir = "search";
+    std::string manifestPath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--workers" && hasValue)
+            options.workers = static_cast<unsigned int>(std::stoul(argv[++i]));
+        else if (arg == "--chunk" && hasValue)
+            options.chunkSize = std::stoul(argv[++i]);
+        else if (arg == "--notes-dir" && hasValue)
+            options.notesDir = argv[++i];
+        else if (arg == "--dry-run")
+            dryRun = true;
+        else if (arg == "--migrate-notes")
+            migrateNotes = true;
+        else if (arg == "--compress-blobs")
+            compressBlobs = true;
+        else if (arg == "--blobs-dir" && hasValue)
+            blobsDir = argv[++i];
+        else if (arg == "--build-search-index")
+            buildSearchIndex = true;
+        else if (arg == "--search-dir" && hasValue)
+            searchDir = argv[++i];
+        else if (manifestPath.empty() && arg.rfind("--", 0) != 0)
+            manifestPath = arg;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    logger::logS("folium-import v", Folium::VERSION);
+
+    // note file I/O backend, override with FOLIUM_IO_BACKEND=pread
+    fileio::init(fileio::backendFromString(std::getenv("FOLIUM_IO_BACKEND")));
+
+    int modes = migrateNotes + compressBlobs + buildSearchIndex;
+    if ((modes > 0) == !manifestPath.empty() || modes > 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int status = 0;
+    try
+    {
+        if (migrateNotes)
+        {
+            size_t moved = notestore::migrateLayout(options.notesDir);
+            std::cout << "Moved " << moved << " notes into hashed directories\n";
+            fileio::shutdown();
+            return 0;
+        }
+
+        if (compressBlobs)
+        {
+            blobstore::setRoot(blobsDir);
+            unsigned id = blobstore::trainDictionary();
+            size_t rewritten = blobstore::recompressAll();
+            std::cout << "Trained dictionary " << id << ", recompressed " << rewritten << " blobs\n";
+            fileio::shutdown();
+            return 0;
+        }
+
+        if (buildSearchIndex)
+        {
+            blobstore::setRoot(blobsDir);
+            try
+            {
+                searchindex::setRoot(searchDir);
+            }
+            catch (const std::exception &e)
+            {
+                // The rebuild replaces it anyway
+                std::cerr << "Discarding unreadable search index: " << e.what() << "\n";
+            }
+            size_t notes = searchindex::rebuild(options.notesDir);
+            searchindex::Stats stats = searchindex::stats();
+            std::cout << "Indexed " << stats.units << " units of " << notes << " notes, " << stats.terms << " terms\n";
+            fileio::shutdown();
+            return 0;
+        }
+
+        importer::Manifest manifest = importer::loadManifest(manifestPath);
+        std::cout << "Manifest: " << manifest.users.size() << " users, " << manifest.classes.size() << " classes\n";
+
+        if (!dryRun)
+        {
+            importer::Report report = importer::run(manifest, options);
+            std::cout << "Imported " << report.users << " users, " << report.classes << " classes, "
+                      << report.enrollments << " enrollments, " << report.notes << " notes in "
+                      << report.seconds << "s (" << static_cast<long long>(report.rowsPerSecond()) << " rows/s)\n";
+            for (const std::string &error : report.errors)
+            {
+                std::cerr << "  skipped: " << error << "\n";
+            }
+            status = report.errors.empty() ? 0 : 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Import failed: " << e.what() << "\n";
+        status = 1;
+    }
+
+    fileio::shutdown();
+    return status;
+}
@@ -0,0 +1,407 @@
+#include "importer.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <nlohmann/json.hpp>
+
+#include "auth.h"
+#include "core.h"
+#include "data_access_layer.h"
+#include "file_engine.h"
+#include "logger.h"
+#include "note_store.h"
+#include "note_view.h"
+
+using json = nlohmann::json;
+
+static logger::Logger importLogger("import");
+
+namespace
+{
+    std::vector<std::string> splitList(const std::string &list, char separator)
+    {
+        std::vector<std::string> items;
+        std::string item;
+        for (char c : list)
+        {
+            if (c == separator)
+            {
+                if (!item.empty())
+                    items.push_back(item);
+                item.clear();
+            }
+            else if (c != ' ' || !item.empty())
+            {
+                item += c;
+            }
+        }
+        while (!item.empty() && item.back() == ' ')
+            item.pop_back();
+        if (!item.empty())
+            items.push_back(item);
+        return items;
+    }
+
+    std::string resolve(const std::filesystem::path &base, const std::string &path)
+    {
+        if (path.empty() || std::filesystem::path(path).is_absolute())
+            return path;
+        return (base / path).string();
+    }
+
+    importer::Manifest fromJson(const json &j, const std::filesystem::path &base)
+    {
+        importer::Manifest manifest;
+        for (const json &u : j.value("users", json::array()))
+        {
+            importer::UserRecord user{
+                u.at("username").get<std::string>(),
+                u.value("password", ""),
+                u.value("passwordHash", "")};
+            if (user.password.empty() && user.passwordHash.empty())
+            {
+                // Hashing "" would create an account anyone can log in to.
+                throw std::runtime_error("User '" + user.username + "' needs a password or passwordHash.");
+            }
+            manifest.users.push_back(std::move(user));
+        }
+        for (const json &c : j.value("classes", json::array()))
+        {
+            importer::ClassRecord record;
+            record.name = c.at("name").get<std::string>();
+            record.description = c.value("description", "");
+            record.instructor = c.value("instructor", "");
+            record.owner = c.at("owner").get<std::string>();
+            record.students = c.value("students", std::vector<std::string>());
+            record.notePath = resolve(base, c.value("note", ""));
+            record.noteTitle = c.value("noteTitle", record.name);
+            manifest.classes.push_back(std::move(record));
+        }
+        return manifest;
+    }
+
+    importer::Manifest fromCsv(const std::string &text, const std::filesystem::path &base)
+    {
+        std::vector<std::vector<std::string>> rows = importer::parseCsv(text);
+        if (rows.empty())
+            return {};
+
+        std::unordered_map<std::string, size_t> columns;
+        for (size_t i = 0; i < rows[0].size(); i++)
+        {
+            columns[rows[0][i]] = i;
+        }
+        if (!columns.count("name") || !columns.count("owner"))
+        {
+            throw std::runtime_error("CSV header must contain at least 'name' and 'owner'.");
+        }
+        auto field = [&columns](const std::vector<std::string> &row, const std::string &column) {
+            auto it = columns.find(column);
+            return it != columns.end() && it->second < row.size() ? row[it->second] : std::string();
+        };
+
+        importer::Manifest manifest;
+        for (size_t r = 1; r < rows.size(); r++)
+        {
+            const std::vector<std::string> &row = rows[r];
+            if (row.size() == 1 && row[0].empty())
+                continue; // blank line
+            importer::ClassRecord record;
+            record.name = field(row, "name");
+            record.description = field(row, "description");
+            record.instructor = field(row, "instructor");
+            record.owner = field(row, "owner");
+            record.students = splitList(field(row, "students"), ';');
+            record.notePath = resolve(base, field(row, "note"));
+            record.noteTitle = field(row, "note_title").empty() ? record.name : field(row, "note_title");
+            manifest.classes.push_back(std::move(record));
+        }
+        return manifest;
+    }
+
+    /**
+     * @brief Shared state of one import run.
+     */
+    struct Run
+    {
+        Run(const importer::Manifest &manifest, const importer::Options &options,
+            std::unordered_map<std::string, unsigned int> userIds)
+            : manifest(manifest), options(options), userIds(std::move(userIds))
+        {
+        }
+
+        const importer::Manifest &manifest;
+        const importer::Options &options;
+        std::unordered_map<std::string, unsigned int> userIds;
+
+        std::atomic<size_t> nextChunk{0};
+        std::atomic<size_t> classes{0};
+        std::atomic<size_t> enrollments{0};
+        std::atomic<size_t> notes{0};
+
+        std::mutex errorMutex;
+        std::vector<std::string> errors;
+
+        void fail(const std::string &message)
+        {
+            importLogger.logWarn(message);
+            std::lock_guard<std::mutex> lock(errorMutex);
+            errors.push_back(message);
+        }
+    };
+
+    void importChunk(Run &run, size_t begin, size_t end)
+    {
+        const std::vector<importer::ClassRecord> &all = run.manifest.classes;
+
+        // Drop classes that cannot be imported before touching the database.
+        std::vector<const importer::ClassRecord *> records;
+        std::vector<std::string> notePaths;
+        for (size_t i = begin; i < end; i++)
+        {
+            const importer::ClassRecord &record = all[i];
+            if (!run.userIds.count(record.owner))
+            {
+                run.fail("Class '" + record.name + "': unknown owner '" + record.owner + "'.");
+                continue;
+            }
+            if (!record.notePath.empty() && !std::filesystem::is_regular_file(record.notePath))
+            {
+                run.fail("Class '" + record.name + "': note file not found: " + record.notePath);
+                continue;
+            }
+            records.push_back(&record);
+            if (!record.notePath.empty())
+                notePaths.push_back(record.notePath);
+        }
+        if (records.empty())
+            return;
+
+        std::vector<std::string> noteContents = fileio::readMany(notePaths);
+
+        std::vector<DAL::NewClass> newClasses;
+        newClasses.reserve(records.size());
+        for (const importer::ClassRecord *record : records)
+        {
+            newClasses.push_back({run.userIds.at(record->owner), record->name, record->description, record->instructor});
+        }
+        // One transaction for the chunk, so a failure leaves no class behind without its note
+        // or enrollments for a re-run to duplicate.
+        DAL::ImportedClasses imported = DAL::importClasses(newClasses, [&](const std::vector<unsigned int> &classIds) {
+            DAL::ClassRows rows;
+            size_t nextNote = 0;
+            for (size_t i = 0; i < records.size(); i++)
+            {
+                const importer::ClassRecord &record = *records[i];
+                unsigned int classId = classIds[i];
+
+                // Owners are enrolled too so the note routes let them in.
+                rows.enrollments.push_back({run.userIds.at(record.owner), classId});
+                for (const std::string &student : record.students)
+                {
+                    auto it = run.userIds.find(student);
+                    if (it == run.userIds.end())
+                    {
+                        run.fail("Class '" + record.name + "': unknown student '" + student + "' not enrolled.");
+                        continue;
+                    }
+                    rows.enrollments.push_back({it->second, classId});
+                }
+
+                if (!record.notePath.empty())
+                {
+                    std::string path = notestore::pathFor(static_cast<int>(classId), run.options.notesDir);
+                    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+                    json note = Core::noteFromContent(noteContents[nextNote++], record.noteTitle);
+                    rows.files.push_back({path, notestore::encodeSnapshot(note)});
+                    rows.notes.push_back({classId, record.noteTitle, path});
+                }
+            }
+            return rows;
+        });
+        run.classes += imported.classIds.size();
+        run.enrollments += imported.enrollments;
+        run.notes += imported.notes;
+    }
+
+    void worker(Run &run)
+    {
+        const size_t total = run.manifest.classes.size();
+        const size_t chunkSize = std::max<size_t>(1, run.options.chunkSize);
+        for (;;)
+        {
+            size_t begin = run.nextChunk.fetch_add(1) * chunkSize;
+            if (begin >= total)
+                return;
+            size_t end = std::min(total, begin + chunkSize);
+            try
+            {
+                importChunk(run, begin, end);
+            }
+            catch (const std::exception &e)
+            {
+                run.fail("Classes " + std::to_string(begin) + "-" + std::to_string(end - 1) + " failed: " + e.what());
+            }
+        }
+    }
+}
+
+namespace importer
+{
+    std::vector<std::vector<std::string>> parseCsv(const std::string &text)
+    {
+        std::vector<std::vector<std::string>> rows;
+        std::vector<std::string> row;
+        std::string field;
+        bool quoted = false;
+        bool any = false;
+
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            char c = text[i];
+            any = true;
+            if (quoted)
+            {
+                if (c == '"' && i + 1 < text.size() && text[i + 1] == '"')
+                {
+                    field += '"';
+                    i++;
+                }
+                else if (c == '"')
+                {
+                    quoted = false;
+                }
+                else
+                {
+                    field += c;
+                }
+            }
+            else if (c == '"')
+            {
+                quoted = true;
+            }
+            else if (c == ',')
+            {
+                row.push_back(std::move(field));
+                field.clear();
+            }
+            else if (c == '\n' || c == '\r')
+            {
+                if (c == '\r' && i + 1 < text.size() && text[i + 1] == '\n')
+                    i++;
+                row.push_back(std::move(field));
+                field.clear();
+                rows.push_back(std::move(row));
+                row.clear();
+                any = false;
+            }
+            else
+            {
+                field += c;
+            }
+        }
+        if (any)
+        {
+            row.push_back(std::move(field));
+            rows.push_back(std::move(row));
+        }
+        return rows;
+    }
+
+    Manifest loadManifest(const std::string &path)
+    {
+        std::string text;
+        try
+        {
+            text = fileio::read(path);
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error("Cannot read manifest " + path + ": " + e.what());
+        }
+        std::filesystem::path base = std::filesystem::path(path).parent_path();
+
+        if (std::filesystem::path(path).extension() == ".csv")
+        {
+            return fromCsv(text, base);
+        }
+        try
+        {
+            return fromJson(json::parse(text), base);
+        }
+        catch (const json::exception &e)
+        {
+            throw std::runtime_error("Malformed manifest " + path + ": " + e.what());
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error("Invalid manifest " + path + ": " + e.what());
+        }
+    }
+
+    Report run(const Manifest &manifest, const Options &options)
+    {
+        auto started = std::chrono::steady_clock::now();
+        Report report;
+
+        // Users: create the missing ones in one transaction, then resolve everyone referenced.
+        std::vector<std::string> listed;
+        for (const UserRecord &user : manifest.users)
+        {
+            listed.push_back(user.username);
+        }
+        std::unordered_map<std::string, unsigned int> existing = DAL::getUserIds(listed);
+        std::vector<std::pair<std::string, std::string>> newUsers;
+        std::unordered_set<std::string> seen;
+        std::vector<std::string> userErrors;
+        for (const UserRecord &user : manifest.users)
+        {
+            if (existing.count(user.username) || !seen.insert(user.username).second)
+                continue;
+            if (user.password.empty() && user.passwordHash.empty())
+            {
+                userErrors.push_back("User '" + user.username + "': no password or passwordHash, not created.");
+                importLogger.logWarn(userErrors.back());
+                continue;
+            }
+            std::string hash = !user.passwordHash.empty() ? user.passwordHash : auth::hashPassword(user.password);
+            newUsers.push_back({user.username, hash});
+        }
+        report.users = DAL::createUsers(newUsers);
+
+        std::unordered_set<std::string> referenced(listed.begin(), listed.end());
+        for (const ClassRecord &record : manifest.classes)
+        {
+            referenced.insert(record.owner);
+            referenced.insert(record.students.begin(), record.students.end());
+        }
+
+        Run state(manifest, options, DAL::getUserIds({referenced.begin(), referenced.end()}));
+        std::filesystem::create_directories(options.notesDir);
+
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < std::max(1u, options.workers); i++)
+        {
+            workers.emplace_back(worker, std::ref(state));
+        }
+        for (std::thread &t : workers)
+        {
+            t.join();
+        }
+
+        report.classes = state.classes;
+        report.enrollments = state.enrollments;
+        report.notes = state.notes;
+        report.errors = std::move(userErrors);
+        report.errors.insert(report.errors.end(), state.errors.begin(), state.errors.end());
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return report;
+    }
+}
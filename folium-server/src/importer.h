@@ -0,0 +1,94 @@
+/**
+ * @file importer.h
+ * @brief Bulk import of users, classes, enrollments and notes (used by folium-import).
+ *
+ * An import is described by a manifest, either JSON:
+ *
+ *     {
+ *       "users":   [ { "username": "alice", "password": "..." }, ... ],   // or "passwordHash"
+ *       "classes": [ { "name": "CS 101", "description": "...", "instructor": "...",
+ *                      "owner": "alice", "students": ["bob", "carol"],
+ *                      "note": "notes/cs101.json", "noteTitle": "CS 101 Notes" }, ... ]
+ *     }
+ *
+ * or a CSV of classes with a header row naming the columns
+ * name, description, instructor, owner, students (';'-separated), note, note_title.
+ * Note paths are relative to the manifest. Note files hold a big note in JSON,
+ * or plain text that becomes the note's only unit; they are written to
+ * notestore::pathFor() under the notes directory.
+ *
+ * Classes are split into chunks that parallel workers import independently, each
+ * in one transaction: the chunk's classes, their enrollments, one batch of note
+ * file writes sharing their fsyncs, then the note rows. A failed chunk leaves
+ * nothing behind, so the import can be re-run.
+ * Imported notes are written with inline content; the note store moves large
+ * units into the blob store on their first save.
+ */
+
+#ifndef FOLSERV_IMPORTER_H_
+#define FOLSERV_IMPORTER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace importer
+{
+    struct UserRecord
+    {
+        std::string username;
+        std::string password;     // plain text, hashed on import
+        std::string passwordHash; // used as is when set
+    };
+
+    struct ClassRecord
+    {
+        std::string name;
+        std::string description;
+        std::string instructor;
+        std::string owner;                 // username
+        std::vector<std::string> students; // usernames
+        std::string notePath;              // empty for no note
+        std::string noteTitle;
+    };
+
+    struct Manifest
+    {
+        std::vector<UserRecord> users;
+        std::vector<ClassRecord> classes;
+    };
+
+    struct Options
+    {
+        unsigned int workers = 4;
+        size_t chunkSize = 500; // classes per worker task
+        std::string notesDir = "notes";
+    };
+
+    struct Report
+    {
+        size_t users = 0;
+        size_t classes = 0;
+        size_t enrollments = 0;
+        size_t notes = 0;
+        std::vector<std::string> errors; // one per skipped class or failed chunk
+        double seconds = 0;
+
+        size_t rows() const { return users + classes + enrollments + notes; }
+        double rowsPerSecond() const { return seconds > 0 ? rows() / seconds : 0; }
+    };
+
+    /// @brief Loads a manifest; ".csv" files are read as a class CSV, anything else as JSON.
+    /// @throws std::runtime_error if the file cannot be read or is malformed.
+    Manifest loadManifest(const std::string &path);
+
+    /// @brief Splits CSV text into rows of fields (RFC 4180 quoting, quoted newlines allowed).
+    std::vector<std::vector<std::string>> parseCsv(const std::string &text);
+
+    /// @brief Imports a manifest.
+    /// Users that already exist are reused. Classes with an unknown owner or an unreadable
+    /// note are skipped and reported; a failed chunk is rolled back and reported.
+    Report run(const Manifest &manifest, const Options &options);
+}
+
+#endif // FOLSERV_IMPORTER_H_
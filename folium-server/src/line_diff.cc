@@ -0,0 +1,346 @@
+#include "line_diff.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+using json = nlohmann::json;
+
+namespace
+{
+    using linediff::Hunk;
+
+    // Both texts as line ids: equal lines, equal ids.
+    struct Interned
+    {
+        std::vector<uint32_t> a;
+        std::vector<uint32_t> b;
+        uint32_t distinct = 0;
+    };
+
+    Interned intern(const std::vector<std::string_view> &a, const std::vector<std::string_view> &b)
+    {
+        Interned lines;
+        std::unordered_map<std::string_view, uint32_t> ids;
+        ids.reserve(a.size() + b.size());
+        auto idsOf = [&](const std::vector<std::string_view> &text, std::vector<uint32_t> &out)
+        {
+            out.reserve(text.size());
+            for (std::string_view line : text)
+                out.push_back(ids.try_emplace(line, static_cast<uint32_t>(ids.size())).first->second);
+        };
+        idsOf(a, lines.a);
+        idsOf(b, lines.b);
+        lines.distinct = static_cast<uint32_t>(ids.size());
+        return lines;
+    }
+
+    struct Region
+    {
+        size_t a0, a1, b0, b1;
+    };
+
+    class Differ
+    {
+    public:
+        explicit Differ(const Interned &lines)
+            : a_(lines.a), b_(lines.b), countA_(lines.distinct), countB_(lines.distinct), firstA_(lines.distinct)
+        {
+        }
+
+        std::vector<Hunk> run()
+        {
+            // Regions are independent, so a work list stands in for recursion that can run
+            // as deep as the texts are long
+            std::vector<Region> work{{0, a_.size(), 0, b_.size()}};
+            while (!work.empty())
+            {
+                Region r = work.back();
+                work.pop_back();
+                split(r, work);
+            }
+            std::sort(hunks_.begin(), hunks_.end(), [](const Hunk &x, const Hunk &y)
+                      { return x.aStart != y.aStart ? x.aStart < y.aStart : x.bStart < y.bStart; });
+            return coalesce();
+        }
+
+    private:
+        const std::vector<uint32_t> &a_;
+        const std::vector<uint32_t> &b_;
+        std::vector<uint32_t> countA_;
+        std::vector<uint32_t> countB_;
+        std::vector<uint32_t> firstA_;
+        std::vector<Hunk> hunks_;
+
+        void changed(size_t a0, size_t a1, size_t b0, size_t b1)
+        {
+            if (a0 < a1 || b0 < b1)
+                hunks_.push_back({a0, a1 - a0, b0, b1 - b0});
+        }
+
+        void split(Region r, std::vector<Region> &work)
+        {
+            while (r.a0 < r.a1 && r.b0 < r.b1 && a_[r.a0] == b_[r.b0])
+                r.a0++, r.b0++;
+            while (r.a0 < r.a1 && r.b0 < r.b1 && a_[r.a1 - 1] == b_[r.b1 - 1])
+                r.a1--, r.b1--;
+            if (r.a0 == r.a1 || r.b0 == r.b1)
+            {
+                changed(r.a0, r.a1, r.b0, r.b1);
+                return;
+            }
+
+            count(r);
+            std::vector<std::pair<size_t, size_t>> anchors = uniqueAnchors(r);
+            if (anchors.empty())
+            {
+                size_t atA = 0, atB = 0;
+                if (rarestAnchor(r, atA, atB))
+                    anchors.push_back({atA, atB});
+            }
+            uncount(r);
+            if (anchors.empty())
+            {
+                if (!myers(r))
+                    changed(r.a0, r.a1, r.b0, r.b1);
+                return;
+            }
+
+            // The gaps between anchors are diffed in turn; the equal lines around each anchor are
+            // trimmed off them there
+            size_t a0 = r.a0, b0 = r.b0;
+            for (const auto &[atA, atB] : anchors)
+            {
+                work.push_back({a0, atA, b0, atB});
+                a0 = atA + 1;
+                b0 = atB + 1;
+            }
+            work.push_back({a0, r.a1, b0, r.b1});
+        }
+
+        void count(const Region &r)
+        {
+            for (size_t i = r.a1; i-- > r.a0;)
+            {
+                countA_[a_[i]]++;
+                firstA_[a_[i]] = static_cast<uint32_t>(i);
+            }
+            for (size_t j = r.b0; j < r.b1; j++)
+                countB_[b_[j]]++;
+        }
+
+        void uncount(const Region &r)
+        {
+            for (size_t i = r.a0; i < r.a1; i++)
+                countA_[a_[i]] = 0;
+            for (size_t j = r.b0; j < r.b1; j++)
+                countB_[b_[j]] = 0;
+        }
+
+        // Lines occurring once on each side, as in patience diff: the longest run of them in the
+        // same order on both sides, found by patience sorting.
+        std::vector<std::pair<size_t, size_t>> uniqueAnchors(const Region &r) const
+        {
+            std::vector<std::pair<size_t, size_t>> unique; // (a, b), in b order
+            for (size_t j = r.b0; j < r.b1; j++)
+            {
+                const uint32_t id = b_[j];
+                if (countA_[id] == 1 && countB_[id] == 1)
+                    unique.push_back({firstA_[id], j});
+            }
+            if (unique.empty())
+                return unique;
+
+            std::vector<size_t> piles;                             // top of each pile, an index into unique
+            std::vector<size_t> previous(unique.size(), SIZE_MAX); // top of the pile to the left when placed
+            for (size_t u = 0; u < unique.size(); u++)
+            {
+                auto pile = std::lower_bound(piles.begin(), piles.end(), unique[u].first,
+                                             [&](size_t top, size_t a) { return unique[top].first < a; });
+                if (pile != piles.begin())
+                    previous[u] = *(pile - 1);
+                if (pile == piles.end())
+                    piles.push_back(u);
+                else
+                    *pile = u;
+            }
+            std::vector<std::pair<size_t, size_t>> anchors(piles.size());
+            size_t u = piles.back();
+            for (size_t k = anchors.size(); k-- > 0; u = previous[u])
+                anchors[k] = unique[u];
+            return anchors;
+        }
+
+        // The line of the region occurring least often in both sides, at its first place in each,
+        // as in histogram diff. Lines seen more than kMaxOccurrences times do not count.
+        bool rarestAnchor(const Region &r, size_t &atA, size_t &atB) const
+        {
+            uint32_t best = UINT32_MAX;
+            for (size_t j = r.b0; j < r.b1; j++)
+            {
+                const uint32_t id = b_[j];
+                if (countA_[id] == 0 || countA_[id] > linediff::kMaxOccurrences)
+                    continue;
+                const uint32_t occurrences = countA_[id] + countB_[id];
+                if (occurrences < best)
+                {
+                    best = occurrences;
+                    atA = firstA_[id];
+                    atB = j;
+                }
+            }
+            return best != UINT32_MAX;
+        }
+
+        // Myers' greedy O(ND) diff of a region with no anchor. false past kMaxEditDistance edits.
+        bool myers(const Region &r)
+        {
+            const long n = static_cast<long>(r.a1 - r.a0), m = static_cast<long>(r.b1 - r.b0);
+            const long maxD = std::min<long>(n + m, static_cast<long>(linediff::kMaxEditDistance));
+            const long offset = maxD + 1;
+            std::vector<long> v(2 * offset + 1, 0);
+            std::vector<std::vector<long>> trace;
+            auto x = [&](long k) -> long & { return v[k + offset]; };
+
+            long d = 0;
+            bool found = false;
+            for (; d <= maxD && !found; d++)
+            {
+                trace.push_back(v);
+                for (long k = -d; k <= d; k += 2)
+                {
+                    long px = (k == -d || (k != d && x(k - 1) < x(k + 1))) ? x(k + 1) : x(k - 1) + 1;
+                    long py = px - k;
+                    while (px < n && py < m && a_[r.a0 + px] == b_[r.b0 + py])
+                        px++, py++;
+                    x(k) = px;
+                    if (px >= n && py >= m)
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+            }
+            if (!found)
+                return false;
+
+            // Walk the trace back from (n, m), one edit per step
+            std::vector<Hunk> edits;
+            long px = n, py = m;
+            for (long step = d - 1; step > 0; step--)
+            {
+                const std::vector<long> &prev = trace[static_cast<size_t>(step)];
+                auto prevX = [&](long k) { return prev[static_cast<size_t>(k + offset)]; };
+                const long k = px - py;
+                const bool down = k == -step || (k != step && prevX(k - 1) < prevX(k + 1));
+                const long fromK = down ? k + 1 : k - 1;
+                const long fromX = prevX(fromK), fromY = fromX - fromK;
+                while (px > fromX && py > fromY)
+                    px--, py--;
+                if (down)
+                    edits.push_back({r.a0 + static_cast<size_t>(fromX), 0, r.b0 + static_cast<size_t>(fromY), 1});
+                else
+                    edits.push_back({r.a0 + static_cast<size_t>(fromX), 1, r.b0 + static_cast<size_t>(fromY), 0});
+                px = fromX, py = fromY;
+            }
+            hunks_.insert(hunks_.end(), edits.begin(), edits.end());
+            return true;
+        }
+
+        // Single-line edits that touch become one hunk per differing region.
+        std::vector<Hunk> coalesce() const
+        {
+            std::vector<Hunk> merged;
+            for (const Hunk &h : hunks_)
+            {
+                if (!merged.empty() && merged.back().aStart + merged.back().aCount == h.aStart &&
+                    merged.back().bStart + merged.back().bCount == h.bStart)
+                {
+                    merged.back().aCount += h.aCount;
+                    merged.back().bCount += h.bCount;
+                }
+                else
+                {
+                    merged.push_back(h);
+                }
+            }
+            return merged;
+        }
+    };
+
+    std::vector<std::string> copyLines(const std::vector<std::string_view> &lines, size_t start, size_t count)
+    {
+        return std::vector<std::string>(lines.begin() + static_cast<long>(start), lines.begin() + static_cast<long>(start + count));
+    }
+}
+
+namespace linediff
+{
+    std::vector<std::string_view> splitLines(std::string_view text)
+    {
+        std::vector<std::string_view> lines;
+        size_t start = 0;
+        while (start < text.size())
+        {
+            size_t end = text.find('\n', start);
+            if (end == std::string_view::npos)
+                end = text.size();
+            lines.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+        return lines;
+    }
+
+    std::vector<Hunk> diff(const std::vector<std::string_view> &a, const std::vector<std::string_view> &b)
+    {
+        Interned lines = intern(a, b);
+        return Differ(lines).run();
+    }
+
+    MergeResult merge(const std::string &ours, const std::string &theirs)
+    {
+        const std::vector<std::string_view> a = splitLines(ours), b = splitLines(theirs);
+        MergeResult result;
+        result.text.reserve(ours.size() + theirs.size() / 8);
+        size_t merged = 0; // lines written so far
+        auto write = [&](std::string_view line)
+        {
+            if (merged++ > 0)
+                result.text += '\n';
+            result.text += line;
+        };
+
+        size_t next = 0; // next line of ours to copy
+        for (const Hunk &h : diff(a, b))
+        {
+            for (; next < h.aStart; next++)
+                write(a[next]);
+            if (h.aCount > 0 && h.bCount > 0)
+            {
+                if (result.conflicts.size() < kMaxConflicts)
+                    result.conflicts.push_back({merged + 1, copyLines(a, h.aStart, h.aCount), copyLines(b, h.bStart, h.bCount)});
+                result.conflictCount++;
+            }
+            // Lines the upload dropped, or changed, stay as they are
+            for (; next < h.aStart + h.aCount; next++)
+                write(a[next]);
+            if (h.aCount == 0)
+            {
+                for (size_t j = h.bStart; j < h.bStart + h.bCount; j++)
+                    write(b[j]);
+                result.inserted += h.bCount;
+            }
+        }
+        for (; next < a.size(); next++)
+            write(a[next]);
+        if (!ours.empty() && ours.back() == '\n')
+            result.text += '\n';
+        return result;
+    }
+
+    json toJson(const Conflict &conflict)
+    {
+        return {{"line", conflict.line}, {"ours", conflict.ours}, {"theirs", conflict.theirs}};
+    }
+}
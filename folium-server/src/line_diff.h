@@ -0,0 +1,82 @@
+/**
+ * @file line_diff.h
+ * @brief Line diff and two-way merge of unit text.
+ *
+ * diff() compares two texts line by line. Lines are hashed and interned to
+ * integer ids first, so every later comparison is an integer compare. Common
+ * leading and trailing lines are trimmed, then a differing region is split on
+ * anchor lines: the longest in-order run of lines occurring once on each side
+ * (patience diff), or failing that the line occurring least often (histogram
+ * diff, as in git). The gaps between anchors are diffed the same way. Regions
+ * with no line seen at most kMaxOccurrences times fall back to Myers' O(ND)
+ * diff, bounded by kMaxEditDistance; past that the region is reported as
+ * replaced. On typical notes (edits scattered through mostly unchanged text)
+ * one pass splits the note into small gaps, so the whole diff stays close to
+ * linear in the number of lines.
+ *
+ * merge() folds an uploaded copy of a unit's text into the current text:
+ * lines only the upload adds are inserted where they belong, lines the upload
+ * dropped are kept, and regions both changed keep the current lines and are
+ * reported as conflicts.
+ */
+
+#ifndef FOLSERV_LINE_DIFF_H_
+#define FOLSERV_LINE_DIFF_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace linediff
+{
+    constexpr size_t kMaxOccurrences = 64;   // lines seen more often than this are not anchors
+    constexpr size_t kMaxEditDistance = 256; // Myers gives up on a region past this many edits
+    constexpr size_t kMaxConflicts = 100;    // conflicts reported by merge(); the rest are counted
+
+    /**
+     * @brief A region that differs: lines [aStart, aStart + aCount) of the first text were
+     * replaced by lines [bStart, bStart + bCount) of the second. Either count may be 0.
+     */
+    struct Hunk
+    {
+        size_t aStart = 0;
+        size_t aCount = 0;
+        size_t bStart = 0;
+        size_t bCount = 0;
+    };
+
+    /**
+     * @brief A region changed on both sides; the current lines were kept.
+     */
+    struct Conflict
+    {
+        size_t line = 0;                 // first line of the region in the merged text, from 1
+        std::vector<std::string> ours;   // current lines, kept
+        std::vector<std::string> theirs; // the upload's lines, not merged
+    };
+
+    struct MergeResult
+    {
+        std::string text;
+        size_t inserted = 0;                // lines taken from the upload
+        std::vector<Conflict> conflicts;    // at most kMaxConflicts
+        size_t conflictCount = 0;           // all conflicts, reported or not
+    };
+
+    /// @brief Splits @p text into lines, without their '\n'. A final newline does not start a line.
+    std::vector<std::string_view> splitLines(std::string_view text);
+
+    /// @return The differing regions of @p a and @p b, in order.
+    std::vector<Hunk> diff(const std::vector<std::string_view> &a, const std::vector<std::string_view> &b);
+
+    /// @brief Merges @p theirs (an edited copy) into @p ours.
+    MergeResult merge(const std::string &ours, const std::string &theirs);
+
+    /// @return {"line", "ours", "theirs"}.
+    nlohmann::json toJson(const Conflict &conflict);
+}
+
+#endif // FOLSERV_LINE_DIFF_H_
@@ -1,5 +1,8 @@
 #include <atomic>
 #include <thread>
+#include <cstdlib>
+#include <csignal>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/wait.h>
 
@@ -7,6 +10,8 @@
 #include "logger.h"
 #include "version.h"
 #include "fifo_util.h"
+#include "data_access_layer.h"
+#include "file_engine.h"
 #include "dispatcher.h"
 #include "http_gateway.h"
 
@@ -17,6 +22,28 @@ const unsigned int num_threads = 10;
 const std::string GW2DP = "GW2DP";
 const std::string DP2GW = "DP2GW";
 
+/**
+ * @brief Runs @p onSignal on a background thread each time SIGHUP arrives.
+ *
+ * SIGHUP must already be blocked in every thread (see main), so it is only
+ * ever picked up here and never kills the process.
+ */
+template <typename F>
+static void handleReloadSignal(F onSignal)
+{
+    std::thread([onSignal]() {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGHUP);
+        for (;;) {
+            int sig;
+            if (sigwait(&set, &sig) == 0) {
+                onSignal();
+            }
+        }
+    }).detach();
+}
+
 int main(void)
 {
     logger::log("Starting Folium Server v" + Folium::VERSION);
@@ -27,6 +54,12 @@ int main(void)
     ipc::ScopedFifo fifoIn(GW2DP);
     ipc::ScopedFifo fifoOut(DP2GW);
 
+    // SIGHUP reloads dbConfig.json; block it before any thread starts so only the handler sees it
+    sigset_t reloadSignal;
+    sigemptyset(&reloadSignal);
+    sigaddset(&reloadSignal, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reloadSignal, nullptr);
+
     /*
         start gateway on parent process and
         start dispatch on child process
@@ -41,6 +74,19 @@ int main(void)
         // child
         logger::logS("Dispatch process online with pid: ", pid);
 
+        // note file I/O backend, override with FOLIUM_IO_BACKEND=pread
+        fileio::init(fileio::backendFromString(std::getenv("FOLIUM_IO_BACKEND")));
+
+        // new pool limits and timeouts apply without a restart
+        handleReloadSignal([]() {
+            logger::log("Dispatch: SIGHUP, reloading dbConfig.json.");
+            try {
+                DAL::reloadDbConfig();
+            } catch (const std::exception& e) {
+                logger::logErr(std::string("Dispatch: reload failed: ") + e.what());
+            }
+        });
+
         // create dispatcher
         ipc::FifoChannel in(GW2DP, O_RDONLY);
         ipc::FifoChannel out(DP2GW, O_WRONLY);
@@ -48,6 +94,7 @@ int main(void)
 
         // start listening
         dispatcher.start();
+        fileio::shutdown();
 
         // after close
         logger::log("Dispatch process done, closing...");
@@ -58,6 +105,9 @@ int main(void)
     else {
         logger::logS("Gateway process online with pid: ", pid);
 
+        // the database lives in the dispatch process, pass reloads on to it
+        handleReloadSignal([pid]() { kill(pid, SIGHUP); });
+
         // create gateway
         ipc::FifoChannel out(GW2DP, O_WRONLY);
         ipc::FifoChannel in(DP2GW, O_RDONLY);
@@ -0,0 +1,360 @@
+#include "near_duplicate.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "search_index.h"
+
+using json = nlohmann::json;
+
+namespace
+{
+    using neardup::kBands;
+    using neardup::kHashes;
+    using neardup::Sketch;
+
+    constexpr size_t kRows = kHashes / kBands;
+    static_assert(kHashes % kBands == 0, "bands must split the sketch evenly");
+
+    uint64_t splitmix(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Fixed seeds, so sketches are comparable across processes.
+    struct HashFunctions
+    {
+        alignas(32) std::array<uint32_t, kHashes> seeds;
+        alignas(32) std::array<uint32_t, kHashes> multipliers; // odd
+
+        HashFunctions()
+        {
+            uint64_t state = 0x6e6561726475700aull;
+            for (size_t j = 0; j < kHashes; j++)
+            {
+                seeds[j] = static_cast<uint32_t>(splitmix(state));
+                multipliers[j] = static_cast<uint32_t>(splitmix(state)) | 1u;
+            }
+        }
+    };
+
+    const HashFunctions &hashFunctions()
+    {
+        static const HashFunctions functions;
+        return functions;
+    }
+
+    // FNV-1a of each word: ASCII letters and digits, lowercased, and the bytes of multi-byte
+    // UTF-8 characters, as searchindex::tokenize() splits them.
+    std::vector<uint64_t> wordHashes(const std::string &text)
+    {
+        std::vector<uint64_t> words;
+        words.reserve(text.size() / 6);
+        uint64_t hash = 14695981039346656037ull;
+        bool inWord = false;
+        for (unsigned char c : text)
+        {
+            bool wordByte = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+            if (wordByte)
+            {
+                if (c >= 'A' && c <= 'Z')
+                    c = static_cast<unsigned char>(c - 'A' + 'a');
+                hash = (hash ^ c) * 1099511628211ull;
+                inWord = true;
+            }
+            else if (inWord)
+            {
+                words.push_back(hash);
+                hash = 14695981039346656037ull;
+                inWord = false;
+            }
+        }
+        if (inWord)
+            words.push_back(hash);
+        return words;
+    }
+
+    // Folds one shingle into the minimums. Plain loops over aligned arrays of 32-bit lanes:
+    // this is the loop that vectorizes.
+    inline void addShingle(uint32_t shingle, std::array<uint32_t, kHashes> &mins, const HashFunctions &functions)
+    {
+        for (size_t j = 0; j < kHashes; j++)
+        {
+            uint32_t v = (shingle ^ functions.seeds[j]) * functions.multipliers[j];
+            v ^= v >> 15;
+            v *= 0x2c1b3c6du;
+            v ^= v >> 12;
+            mins[j] = std::min(mins[j], v);
+        }
+    }
+
+    uint64_t bandKey(const Sketch &sketch, size_t band)
+    {
+        uint64_t key = 14695981039346656037ull ^ band;
+        for (size_t r = 0; r < kRows; r++)
+            key = (key ^ sketch.mins[band * kRows + r]) * 1099511628211ull;
+        return key;
+    }
+
+    std::string unitIdOf(const json &unit)
+    {
+        return unit.is_object() && unit.contains("unitId") && unit["unitId"].is_string()
+                   ? unit["unitId"].get<std::string>()
+                   : std::string();
+    }
+
+    // The sketches of one class's units, bucketed by band.
+    struct ClassIndex
+    {
+        struct Entry
+        {
+            std::string unitId;
+            Sketch sketch;
+            bool alive = true;
+        };
+
+        std::mutex mutex;
+        bool built = false;
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, size_t> byUnit;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets; // band key -> entries
+        size_t dead = 0;
+        std::list<int>::iterator lruPos; // guarded by the registry mutex
+
+        void add(const std::string &unitId, const Sketch &sketch)
+        {
+            remove(unitId);
+            if (sketch.empty || unitId.empty())
+                return;
+            const uint32_t at = static_cast<uint32_t>(entries.size());
+            entries.push_back({unitId, sketch});
+            byUnit[unitId] = at;
+            for (size_t band = 0; band < kBands; band++)
+                buckets[bandKey(sketch, band)].push_back(at);
+        }
+
+        void remove(const std::string &unitId)
+        {
+            auto it = byUnit.find(unitId);
+            if (it == byUnit.end())
+                return;
+            entries[it->second].alive = false;
+            byUnit.erase(it);
+            // Dead entries stay in their buckets until they outnumber the live ones
+            if (++dead > 64 && dead > byUnit.size())
+                compact();
+        }
+
+        void compact()
+        {
+            std::vector<Entry> live;
+            live.reserve(byUnit.size());
+            for (Entry &entry : entries)
+            {
+                if (entry.alive)
+                    live.push_back(std::move(entry));
+            }
+            entries.clear();
+            byUnit.clear();
+            buckets.clear();
+            dead = 0;
+            for (const Entry &entry : live)
+                add(entry.unitId, entry.sketch);
+        }
+    };
+
+    std::mutex registryMutex;
+    std::unordered_map<int, std::shared_ptr<ClassIndex>> indexes;
+    std::list<int> lru; // most recently checked first
+
+    std::atomic<uint64_t> checks = 0;
+    std::atomic<uint64_t> candidates = 0;
+    std::atomic<uint64_t> checkMicros = 0;
+    std::atomic<uint64_t> builds = 0;
+
+    // Registry mutex must be held.
+    std::shared_ptr<ClassIndex> loaded(int classId)
+    {
+        auto it = indexes.find(classId);
+        return it == indexes.end() ? nullptr : it->second;
+    }
+
+    std::shared_ptr<ClassIndex> checkedIndex(int classId)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::shared_ptr<ClassIndex> &index = indexes[classId];
+        if (!index)
+        {
+            index = std::make_shared<ClassIndex>();
+            lru.push_front(classId);
+            index->lruPos = lru.begin();
+            while (lru.size() > neardup::kMaxClasses)
+            {
+                indexes.erase(lru.back());
+                lru.pop_back();
+            }
+        }
+        else
+        {
+            lru.splice(lru.begin(), lru, index->lruPos);
+        }
+        return index;
+    }
+}
+
+namespace neardup
+{
+    Sketch sketch(const std::string &text)
+    {
+        Sketch result;
+        result.mins.fill(UINT32_MAX);
+        std::vector<uint64_t> words = wordHashes(text);
+        if (words.empty())
+            return result;
+        result.empty = false;
+
+        const HashFunctions &functions = hashFunctions();
+        // Texts shorter than a shingle are one shingle
+        const size_t shingles = words.size() >= kShingleWords ? words.size() - kShingleWords + 1 : 1;
+        const size_t width = std::min(words.size(), kShingleWords);
+        for (size_t i = 0; i < shingles; i++)
+        {
+            uint64_t h = words[i];
+            for (size_t w = 1; w < width; w++)
+                h = (h * 0x100000001b3ull) ^ words[i + w];
+            addShingle(static_cast<uint32_t>(h ^ (h >> 32)), result.mins, functions);
+        }
+        return result;
+    }
+
+    double similarity(const Sketch &a, const Sketch &b)
+    {
+        if (a.empty || b.empty)
+            return 0;
+        size_t equal = 0;
+        for (size_t j = 0; j < kHashes; j++)
+            equal += a.mins[j] == b.mins[j];
+        return static_cast<double>(equal) / kHashes;
+    }
+
+    std::optional<Match> nearest(int classId, const std::string &text, const std::function<json()> &loadNote,
+                                 double threshold)
+    {
+        auto began = std::chrono::steady_clock::now();
+        const Sketch wanted = sketch(text);
+        if (wanted.empty)
+            return std::nullopt;
+
+        std::shared_ptr<ClassIndex> index = checkedIndex(classId);
+        std::lock_guard<std::mutex> lock(index->mutex);
+        if (!index->built)
+        {
+            auto building = std::chrono::steady_clock::now();
+            json note = loadNote();
+            if (note.is_object() && note.contains("units") && note["units"].is_array())
+            {
+                for (const json &unit : note["units"])
+                    index->add(unitIdOf(unit), sketch(searchindex::unitText(unit)));
+            }
+            index->built = true;
+            builds++;
+            began += std::chrono::steady_clock::now() - building;
+        }
+
+        std::vector<uint32_t> found;
+        for (size_t band = 0; band < kBands; band++)
+        {
+            auto bucket = index->buckets.find(bandKey(wanted, band));
+            if (bucket != index->buckets.end())
+                found.insert(found.end(), bucket->second.begin(), bucket->second.end());
+        }
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+
+        std::optional<Match> best;
+        for (uint32_t at : found)
+        {
+            const ClassIndex::Entry &entry = index->entries[at];
+            if (!entry.alive)
+                continue;
+            double score = similarity(wanted, entry.sketch);
+            if (score >= threshold && (!best || score > best->similarity))
+                best = Match{entry.unitId, score};
+        }
+
+        checks++;
+        candidates += found.size();
+        checkMicros += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - began).count());
+        return best;
+    }
+
+    void update(int classId, const json &unit)
+    {
+        std::shared_ptr<ClassIndex> index;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            index = loaded(classId);
+        }
+        if (!index)
+            return;
+        std::lock_guard<std::mutex> lock(index->mutex);
+        // An index still to be built reads the unit from the note
+        if (index->built)
+            index->add(unitIdOf(unit), sketch(searchindex::unitText(unit)));
+    }
+
+    void remove(int classId, const std::string &unitId)
+    {
+        std::shared_ptr<ClassIndex> index;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            index = loaded(classId);
+        }
+        if (!index)
+            return;
+        std::lock_guard<std::mutex> lock(index->mutex);
+        index->remove(unitId);
+    }
+
+    void forget(int classId)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto it = indexes.find(classId);
+        if (it == indexes.end())
+            return;
+        lru.erase(it->second->lruPos);
+        indexes.erase(it);
+    }
+
+    Stats stats()
+    {
+        Stats s;
+        s.checks = checks;
+        s.candidates = candidates;
+        s.checkMicros = checkMicros;
+        s.builds = builds;
+        std::vector<std::shared_ptr<ClassIndex>> all;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            s.classes = indexes.size();
+            for (const auto &[classId, index] : indexes)
+                all.push_back(index);
+        }
+        for (const std::shared_ptr<ClassIndex> &index : all)
+        {
+            std::lock_guard<std::mutex> lock(index->mutex);
+            s.units += index->byUnit.size();
+        }
+        return s;
+    }
+}
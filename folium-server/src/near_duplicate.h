@@ -0,0 +1,106 @@
+/**
+ * @file near_duplicate.h
+ * @brief Near-duplicate detection for uploads with MinHash sketches and LSH.
+ *
+ * A unit's text (see searchindex::unitText()) is cut into shingles of
+ * kShingleWords consecutive words, and its sketch keeps the minimum of kHashes
+ * hash functions over them. The share of equal minimums between two sketches
+ * estimates the Jaccard similarity of their shingle sets, so "the same slides
+ * with a few words changed" scores close to 1 and unrelated notes close to 0.
+ *
+ * Words are hashed once; the hash functions are 32-bit multiply-xorshift
+ * steps over a fixed array of seeds, a loop the compiler vectorizes (SSE4.1 or
+ * AVX2 pmulld) without any intrinsics.
+ *
+ * Each class has an index of the sketches of its units, split into kBands
+ * bands of kHashes / kBands minimums. Units sharing a band with an upload are
+ * the only ones compared with it, so a check costs a few hash lookups rather
+ * than a pass over the note. Pairs at similarity 0.9 share a band with
+ * near certainty, pairs at 0.5 about two times in three.
+ *
+ * Indexes are built from the note on the first check of a class and kept in
+ * memory for the kMaxClasses classes checked most recently. Edits keep a
+ * loaded index current through update(), remove() and forget(); they are
+ * no-ops for classes that are not loaded.
+ *
+ * All functions are thread-safe.
+ */
+
+#ifndef FOLSERV_NEAR_DUPLICATE_H_
+#define FOLSERV_NEAR_DUPLICATE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+namespace neardup
+{
+    constexpr size_t kHashes = 64;        // minimums per sketch
+    constexpr size_t kBands = 16;         // LSH bands of kHashes / kBands minimums each
+    constexpr size_t kShingleWords = 3;   // words per shingle
+    constexpr size_t kMaxClasses = 256;   // class indexes kept in memory
+
+    /**
+     * @brief MinHash sketch of a text.
+     */
+    struct Sketch
+    {
+        std::array<uint32_t, kHashes> mins;
+        bool empty = true; // the text had no words
+    };
+
+    /**
+     * @brief The unit most similar to a text.
+     */
+    struct Match
+    {
+        std::string unitId;
+        double similarity = 0; // estimated Jaccard similarity, 0 to 1
+    };
+
+    /**
+     * @brief Index sizes and how much checking costs.
+     */
+    struct Stats
+    {
+        size_t classes = 0;       // class indexes in memory
+        size_t units = 0;         // sketches in them
+        uint64_t checks = 0;
+        uint64_t candidates = 0;  // sketches compared, over all checks
+        uint64_t checkMicros = 0; // time spent in checks, index builds excluded
+        uint64_t builds = 0;      // class indexes built from notes
+    };
+
+    /// @brief Sketches @p text. Case and punctuation are ignored.
+    Sketch sketch(const std::string &text);
+
+    /// @return The estimated Jaccard similarity of the texts behind @p a and @p b; 0 if either is empty.
+    double similarity(const Sketch &a, const Sketch &b);
+
+    /// @brief Finds the unit of the class whose text is most similar to @p text.
+    /// @param loadNote Returns the class's note (null if it has none); called to build the
+    ///        class's index when it is not in memory.
+    /// @param threshold Units less similar than this are not reported.
+    /// @return The best match, or nullopt if no unit reaches @p threshold.
+    std::optional<Match> nearest(int classId, const std::string &text, const std::function<nlohmann::json()> &loadNote,
+                                 double threshold);
+
+    /// @brief Sketches @p unit into the class's index, replacing the unit with the same unitId.
+    void update(int classId, const nlohmann::json &unit);
+
+    /// @brief Drops a unit from the class's index.
+    void remove(int classId, const std::string &unitId);
+
+    /// @brief Drops the class's index; the next check builds it again from the note.
+    void forget(int classId);
+
+    /// @return A snapshot of the counters.
+    Stats stats();
+}
+
+#endif // FOLSERV_NEAR_DUPLICATE_H_
@@ -0,0 +1,189 @@
+#include "note_actor.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "logger.h"
+#include "note_buffer.h"
+
+using json = nlohmann::json;
+
+static logger::Logger actorLogger("note-actor");
+
+namespace Core
+{
+    NoteActor &NoteActor::instance()
+    {
+        static NoteActor actor;
+        return actor;
+    }
+
+    NoteActor::~NoteActor()
+    {
+        stop();
+    }
+
+    void NoteActor::start(unsigned workers)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ || !workers_.empty())
+            return;
+        running_ = true;
+        for (unsigned i = 0; i < std::max(1u, workers); i++)
+            workers_.emplace_back(&NoteActor::runWorker, this);
+        actorLogger.log("Note actor started with " + std::to_string(workers_.size()) + " workers");
+    }
+
+    void NoteActor::stop()
+    {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+            workers.swap(workers_);
+        }
+        ready_.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    std::future<json> NoteActor::post(int classId, Job job)
+    {
+        std::future<json> result;
+        bool drainHere = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Mailbox &mailbox = mailboxes_[classId];
+            mailbox.mail.push_back({std::move(job), std::promise<json>()});
+            result = mailbox.mail.back().result.get_future();
+            if (!mailbox.scheduled)
+            {
+                mailbox.scheduled = true;
+                if (running_)
+                {
+                    runnable_.push_back(classId);
+                    ready_.notify_one();
+                }
+                else
+                {
+                    drainHere = true;
+                }
+            }
+        }
+        // Without workers the poster drains; anyone posting meanwhile is served by it
+        while (drainHere && drain(classId))
+        {
+        }
+        return result;
+    }
+
+    json NoteActor::run(int classId, Job job)
+    {
+        return post(classId, std::move(job)).get();
+    }
+
+    // Applies one batch of the class's mail. Only the thread that scheduled the mailbox
+    // calls this, so batches of a class never overlap.
+    // @return True if more mail arrived meanwhile; the mailbox stays scheduled then.
+    bool NoteActor::drain(int classId)
+    {
+        std::vector<Mail> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Mailbox &mailbox = mailboxes_.at(classId);
+            while (!mailbox.mail.empty() && batch.size() < kMaxBatch)
+            {
+                batch.push_back(std::move(mailbox.mail.front()));
+                mailbox.mail.pop_front();
+            }
+        }
+
+        NoteBuffer &buffer = NoteBuffer::instance();
+        std::vector<json> results(batch.size());
+        std::vector<std::exception_ptr> errors(batch.size());
+        buffer.holdWrites(classId);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            try
+            {
+                results[i] = batch[i].job();
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+                failed_++;
+            }
+        }
+
+        // The whole batch is persisted once, before anyone hears back
+        std::exception_ptr writeError;
+        try
+        {
+            buffer.releaseWrites(classId);
+        }
+        catch (const std::exception &e)
+        {
+            actorLogger.logErr("Failed to write back class " + std::to_string(classId) + ": " + e.what());
+            writeError = std::current_exception();
+        }
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (errors[i])
+                batch[i].result.set_exception(errors[i]);
+            else if (writeError)
+                batch[i].result.set_exception(writeError);
+            else
+                batch[i].result.set_value(std::move(results[i]));
+        }
+        jobs_ += batch.size();
+        batches_++;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        largestBatch_ = std::max(largestBatch_, batch.size());
+        auto it = mailboxes_.find(classId);
+        if (!it->second.mail.empty())
+            return true;
+        mailboxes_.erase(it);
+        return false;
+    }
+
+    void NoteActor::runWorker()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            // Stopping workers still finish every scheduled mailbox
+            ready_.wait(lock, [this]() { return !runnable_.empty() || !running_; });
+            if (runnable_.empty())
+                return;
+            int classId = runnable_.front();
+            runnable_.pop_front();
+            lock.unlock();
+
+            bool more = drain(classId);
+
+            lock.lock();
+            if (more)
+            {
+                // Behind the other classes, so a busy class does not starve them
+                runnable_.push_back(classId);
+                ready_.notify_one();
+            }
+        }
+    }
+
+    NoteActorStats NoteActor::stats()
+    {
+        NoteActorStats s;
+        s.jobs = jobs_;
+        s.failed = failed_;
+        s.batches = batches_;
+        std::lock_guard<std::mutex> lock(mutex_);
+        s.largestBatch = largestBatch_;
+        for (const auto &[classId, mailbox] : mailboxes_)
+            s.queued += mailbox.mail.size();
+        s.workers = workers_.size();
+        return s;
+    }
+}
@@ -0,0 +1,121 @@
+/**
+ * @file note_actor.h
+ * @brief Per-class mailboxes that serialize big-note mutations.
+ *
+ * Every mutation of a class's big note (create, edit, unit edits, merged
+ * uploads) is posted to that class's mailbox as a job that runs the whole
+ * cycle: change the note, bump notes.updated_at, record the history version,
+ * update the search index. Only one worker drains a mailbox at a time, so the
+ * jobs of a class never interleave and its history versions follow the order
+ * the edits were applied in. Jobs of different classes run in parallel.
+ *
+ * A worker takes the whole mailbox (up to kMaxBatch jobs) as one batch and
+ * holds the class's note writes in the buffer (see NoteBuffer::holdWrites())
+ * while it applies them to the resident document, so the batch is persisted
+ * once. Each job's result or exception goes to its own caller; a failed
+ * write back fails the jobs of the batch that had succeeded.
+ *
+ *     json result = NoteActor::instance().run(classId, [&]() { ...; return result; });
+ *
+ * The workers are started with start() and stopped with stop(), which finishes
+ * every job already posted. Before start() (and after stop()) the posting
+ * thread drains the mailbox itself unless another thread already is, so tools
+ * and tests that call Core directly keep running mutations inline.
+ *
+ * A job must not post to its own class's mailbox and wait for it.
+ */
+
+#ifndef FOLSERV_NOTE_ACTOR_H_
+#define FOLSERV_NOTE_ACTOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace Core
+{
+    constexpr size_t kMaxBatch = 64; // jobs a worker applies before it lets other classes run
+
+    /**
+     * @brief Counters used to judge how well mutations are being batched.
+     */
+    struct NoteActorStats
+    {
+        uint64_t jobs = 0;      // jobs run
+        uint64_t failed = 0;    // of which threw
+        uint64_t batches = 0;   // mailbox drains, each persisted once
+        size_t largestBatch = 0;
+        size_t queued = 0;      // jobs waiting in mailboxes
+        size_t workers = 0;
+    };
+
+    class NoteActor
+    {
+    public:
+        /// @brief A mutation of one class's note; its result goes back to the poster.
+        using Job = std::function<nlohmann::json()>;
+
+        /// @return The process-wide actor.
+        static NoteActor &instance();
+
+        /// @brief Starts @p workers threads that drain mailboxes.
+        void start(unsigned workers = 4);
+
+        /// @brief Runs every posted job, then stops the workers.
+        void stop();
+
+        /// @brief Queues @p job on the class's mailbox.
+        /// @return The job's result; get() rethrows what the job threw.
+        std::future<nlohmann::json> post(int classId, Job job);
+
+        /// @brief Posts @p job and waits for it.
+        /// @throws Whatever the job threw.
+        nlohmann::json run(int classId, Job job);
+
+        /// @return A snapshot of the counters.
+        NoteActorStats stats();
+
+    private:
+        struct Mail
+        {
+            Job job;
+            std::promise<nlohmann::json> result;
+        };
+
+        struct Mailbox
+        {
+            std::deque<Mail> mail;
+            bool scheduled = false; // queued for or being drained by a worker
+        };
+
+        NoteActor() = default;
+        ~NoteActor();
+
+        bool drain(int classId);
+        void runWorker();
+
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::unordered_map<int, Mailbox> mailboxes_;
+        std::deque<int> runnable_; // scheduled classes waiting for a worker
+        std::vector<std::thread> workers_;
+        bool running_ = false;
+
+        std::atomic<uint64_t> jobs_ = 0;
+        std::atomic<uint64_t> failed_ = 0;
+        std::atomic<uint64_t> batches_ = 0;
+        size_t largestBatch_ = 0; // guarded by mutex_
+    };
+}
+
+#endif // FOLSERV_NOTE_ACTOR_H_
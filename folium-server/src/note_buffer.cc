@@ -0,0 +1,637 @@
+#include "note_buffer.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include "data_access_layer.h"
+#include "logger.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+static logger::Logger bufferLogger("note-buffer");
+
+namespace
+{
+    bool hasUnits(const json &note)
+    {
+        return note.is_object() && note.contains("units") && note["units"].is_array();
+    }
+
+    // Rough memory held by a parsed document: string bytes plus a per-node overhead.
+    size_t approxBytes(const json &value)
+    {
+        size_t bytes = sizeof(json);
+        if (value.is_string())
+        {
+            bytes += value.get_ref<const std::string &>().size();
+        }
+        else if (value.is_object())
+        {
+            for (const auto &[key, item] : value.items())
+                bytes += key.size() + 32 + approxBytes(item);
+        }
+        else if (value.is_array())
+        {
+            for (const json &item : value)
+                bytes += approxBytes(item);
+        }
+        return bytes;
+    }
+
+    std::string unitIdOf(const json &unit)
+    {
+        return unit.is_object() && unit.contains("unitId") && unit["unitId"].is_string()
+                   ? unit["unitId"].get<std::string>()
+                   : std::string();
+    }
+}
+
+namespace Core
+{
+    NoteBuffer &NoteBuffer::instance()
+    {
+        static NoteBuffer buffer;
+        return buffer;
+    }
+
+    NoteBuffer::~NoteBuffer()
+    {
+        stop();
+    }
+
+    void NoteBuffer::start(const NoteBufferOptions &options)
+    {
+        std::lock_guard<std::mutex> lock(flusherMutex_);
+        if (running_)
+            return;
+        options_ = options;
+        running_ = true;
+        flusher_ = std::thread(&NoteBuffer::runFlusher, this);
+        bufferLogger.log("Write-behind started, flush interval " + std::to_string(options_.flushInterval.count()) + "ms");
+    }
+
+    void NoteBuffer::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(flusherMutex_);
+            if (!running_)
+                return;
+            running_ = false;
+        }
+        flusherCV_.notify_all();
+        if (flusher_.joinable())
+            flusher_.join();
+
+        flushAll();
+        NoteBufferStats s = stats();
+        bufferLogger.logS("Write-behind stopped: ", s.edits, " edits, ", s.fileWrites, " file writes");
+    }
+
+    std::shared_ptr<NoteBuffer::Entry> NoteBuffer::entryFor(int classId, const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mapMutex_);
+        auto &entry = entries_[classId];
+        if (!entry)
+        {
+            entry = std::make_shared<Entry>();
+            entry->path = path;
+            entry->held = held_.count(classId) > 0;
+            lru_.push_front(classId);
+            entry->lruPos = lru_.begin();
+        }
+        else
+        {
+            lru_.splice(lru_.begin(), lru_, entry->lruPos);
+        }
+        std::shared_ptr<Entry> found = entry;
+        evictOverBudget();
+        return found;
+    }
+
+    // Returns the class's entry with its mutex held by @p lock. An entry evicted or invalidated
+    // between the lookup and the lock is no longer in the map, so look it up again.
+    std::shared_ptr<NoteBuffer::Entry> NoteBuffer::lockedEntry(int classId, const std::string &path,
+                                                               std::unique_lock<std::mutex> &lock)
+    {
+        for (;;)
+        {
+            std::shared_ptr<Entry> entry = entryFor(classId, path);
+            lock = std::unique_lock<std::mutex>(entry->mutex);
+            if (!entry->evicted)
+                return entry;
+            lock.unlock();
+        }
+    }
+
+    // Map mutex must be held. Drops clean documents, least recently used first, until the
+    // resident bytes fit the budget. Dirty and busy entries are left for the flusher.
+    void NoteBuffer::evictOverBudget()
+    {
+        auto it = lru_.end();
+        while (residentBytes_ > options_.maxResidentBytes && it != lru_.begin())
+        {
+            --it;
+            if (it == lru_.begin())
+                break; // the entry being accessed
+            auto found = entries_.find(*it);
+            std::shared_ptr<Entry> entry = found->second;
+            std::unique_lock<std::mutex> entryLock(entry->mutex, std::try_to_lock);
+            if (!entryLock.owns_lock() || entry->pendingEdits > 0)
+                continue;
+            ++it; // forget() erases the current position
+            forget(found, *entry);
+            budgetEvictions_++;
+        }
+    }
+
+    // Map and entry mutex must be held.
+    void NoteBuffer::forget(std::unordered_map<int, std::shared_ptr<Entry>>::iterator it, Entry &entry)
+    {
+        lru_.erase(entry.lruPos);
+        entry.evicted = true;
+        residentBytes_ -= entry.bytes;
+        entries_.erase(it);
+    }
+
+    // Entry mutex must be held. Keeps the resident byte count in step with a document's size.
+    void NoteBuffer::resize(Entry &entry, size_t bytes)
+    {
+        if (!entry.evicted)
+        {
+            if (bytes >= entry.bytes)
+                residentBytes_ += bytes - entry.bytes;
+            else
+                residentBytes_ -= entry.bytes - bytes;
+        }
+        entry.bytes = bytes;
+    }
+
+    // Entry mutex must be held.
+    void NoteBuffer::load(Entry &entry)
+    {
+        if (entry.loaded)
+            return;
+        notestore::FileInfo info;
+        entry.document = notestore::load(entry.path, &info);
+        entry.logFormat = info.log;
+        entry.logRecords = info.appended;
+        entry.snapshot.reset();
+        entry.indexed = false;
+        entry.loaded = true;
+        resize(entry, approxBytes(entry.document));
+    }
+
+    // Entry mutex must be held. Rebuilds the unitId index after an edit that moved units.
+    const NoteBuffer::UnitIndex &NoteBuffer::indexOf(Entry &entry)
+    {
+        if (!entry.indexed)
+        {
+            entry.index.clear();
+            if (hasUnits(entry.document))
+            {
+                const json &units = entry.document["units"];
+                // First occurrence wins, matching how the note log replays edits.
+                for (size_t i = 0; i < units.size(); i++)
+                    entry.index.emplace(unitIdOf(units[i]), i);
+            }
+            entry.indexed = true;
+        }
+        return entry.index;
+    }
+
+    // Entry mutex must be held.
+    void NoteBuffer::flushEntry(Entry &entry)
+    {
+        if (entry.pendingEdits == 0)
+            return;
+        if (entry.document.is_null())
+        {
+            DAL::writeFile(entry.path, "");
+            entry.logFormat = false;
+        }
+        else if (!entry.rewrite && entry.logFormat)
+        {
+            notestore::appendRecords(entry.path, entry.records);
+            entry.logRecords += entry.records.size();
+            appendWrites_++;
+        }
+        else
+        {
+            notestore::save(entry.path, entry.document);
+            entry.logFormat = true;
+            entry.logRecords = 0;
+        }
+        fileWrites_++;
+        entry.pendingEdits = 0;
+        entry.pendingBytes = 0;
+        entry.rewrite = false;
+        entry.records = json::array();
+
+        // Without a flusher there is no background to defer compaction to.
+        if (!running_)
+            compactEntry(entry);
+    }
+
+    // Entry mutex must be held.
+    void NoteBuffer::compactEntry(Entry &entry)
+    {
+        if (entry.pendingEdits != 0 || entry.logRecords < notestore::kCompactAfter)
+            return;
+        notestore::compact(entry.path);
+        entry.logRecords = 0;
+        compactions_++;
+    }
+
+    // Entry mutex must be held.
+    void NoteBuffer::markDirty(Entry &entry, size_t payloadBytes)
+    {
+        edits_++;
+        Clock::time_point now = Clock::now();
+        if (entry.pendingEdits == 0)
+        {
+            entry.firstDirty = now;
+        }
+        entry.pendingEdits++;
+        entry.pendingBytes += payloadBytes;
+        entry.lastAccess = now;
+        entry.snapshot.reset();
+        entry.version = 0; // notes.version moves with this write; adopt it on the next read
+
+        // Write-through until the flusher runs, and early flush on size thresholds.
+        if (!entry.held && dueForFlush(entry))
+        {
+            flushEntry(entry);
+        }
+    }
+
+    // Entry mutex must be held.
+    bool NoteBuffer::dueForFlush(const Entry &entry) const
+    {
+        return entry.pendingEdits > 0 && (!running_ || entry.pendingEdits >= options_.maxPendingEdits ||
+                                          entry.pendingBytes >= options_.maxPendingBytes);
+    }
+
+    std::shared_ptr<const json> NoteBuffer::read(int classId, const std::string &path, uint64_t version)
+    {
+        reads_++;
+        std::unique_lock<std::mutex> lock;
+        std::shared_ptr<Entry> entry = lockedEntry(classId, path, lock);
+        if (entry->loaded && version != 0 && entry->version != version)
+        {
+            if (entry->version == 0 || entry->pendingEdits > 0)
+            {
+                entry->version = version; // the change is our own write
+            }
+            else
+            {
+                // Another process (e.g. folium-import) rewrote the note.
+                entry->loaded = false;
+                versionReloads_++;
+            }
+        }
+        if (entry->loaded)
+        {
+            residentHits_++;
+        }
+        else
+        {
+            load(*entry);
+            entry->version = version;
+        }
+        entry->lastAccess = Clock::now();
+        // One copy per change of the note, shared by every read until the next one.
+        if (!entry->snapshot)
+            entry->snapshot = std::make_shared<const json>(entry->document);
+        return entry->snapshot;
+    }
+
+    json NoteBuffer::readPage(int classId, const std::string &path, uint64_t version,
+                              const notestore::PageQuery &query)
+    {
+        reads_++;
+        std::unique_lock<std::mutex> lock;
+        std::shared_ptr<Entry> entry = lockedEntry(classId, path, lock);
+        if (entry->loaded && version != 0 && entry->version != version)
+        {
+            if (entry->version == 0 || entry->pendingEdits > 0)
+            {
+                entry->version = version; // the change is our own write
+            }
+            else
+            {
+                // Another process rewrote the note; page it from the file instead.
+                entry->loaded = false;
+                entry->document = json();
+                entry->snapshot.reset();
+                resize(*entry, 0);
+                versionReloads_++;
+            }
+        }
+        entry->lastAccess = Clock::now();
+        if (entry->loaded)
+        {
+            residentHits_++;
+            return notestore::page(entry->document, query);
+        }
+
+        // Nothing is pending for a note that is not resident, so the file is current.
+        // The entry lock keeps a concurrent edit from writing it while it is read.
+        pageReads_++;
+        notestore::NoteView view(path);
+        return notestore::page(view, query);
+    }
+
+    void NoteBuffer::apply(int classId, const std::string &path, const Mutation &mutation, size_t payloadBytes)
+    {
+        std::unique_lock<std::mutex> lock;
+        std::shared_ptr<Entry> entry = lockedEntry(classId, path, lock);
+        load(*entry);
+
+        mutation(entry->document);
+        entry->rewrite = true;
+        entry->indexed = false;
+        resize(*entry, approxBytes(entry->document));
+        markDirty(*entry, payloadBytes);
+    }
+
+    void NoteBuffer::appendUnit(int classId, const std::string &path, const std::string &noteTitle,
+                                const UnitBuilder &makeUnit, size_t payloadBytes)
+    {
+        std::unique_lock<std::mutex> lock;
+        std::shared_ptr<Entry> entry = lockedEntry(classId, path, lock);
+        load(*entry);
+
+        json &document = entry->document;
+        json unit = makeUnit(document, indexOf(*entry));
+        if (!hasUnits(document))
+        {
+            // Nothing to append to: start the note over around this unit.
+            if (!document.is_object())
+                document = {{"title", noteTitle}};
+            document["units"] = json::array({std::move(unit)});
+            entry->rewrite = true;
+            entry->indexed = false;
+            resize(*entry, approxBytes(document));
+        }
+        else
+        {
+            json &units = document["units"];
+            resize(*entry, entry->bytes + approxBytes(unit));
+            entry->index.emplace(unitIdOf(unit), units.size());
+            entry->records.push_back(notestore::record::append(units.size(), unit));
+            units.push_back(std::move(unit));
+        }
+        markDirty(*entry, payloadBytes);
+    }
+
+    NoteBuffer::UnitEdit NoteBuffer::upsertUnit(int classId, const std::string &path, const std::string &unitId,
+                                                const json &fields, const std::string &after, size_t payloadBytes)
+    {
+        std::unique_lock<std::mutex> lock;
+        std::shared_ptr<Entry> entry = lockedEntry(classId, path, lock);
+        load(*entry);
+        if (!hasUnits(entry->document))
+            throw std::runtime_error("Note has no units to edit.");
+
+        json &units = entry->document["units"];
+        const UnitIndex &index = indexOf(*entry);
+        UnitEdit edit;
+        auto existing = index.find(unitId);
+        if (existing != index.end())
+        {
+            json &unit = units[existing->second];
+            size_t before = approxBytes(unit);
+            for (const auto &[key, value] : fields.items())
+                unit[key] = value;
+            unit["unitId"] = unitId;
+            resize(*entry, entry->bytes - before + approxBytes(unit));
+            entry->records.push_back(notestore::record::set(unit));
+            edit = {false, existing->second, entry->records.back()};
+        }
+        else
+        {
+            size_t at = units.size();
+            if (!after.empty())
+            {
+                auto previous = index.find(after);
+                if (previous == index.end())
+                    throw std::invalid_argument("No unit " + after + " to insert after.");
+                at = previous->second + 1;
+            }
+            json unit = fields;
+            unit["unitId"] = unitId;
+            if (at == units.size())
+            {
+                entry->index.emplace(unitId, at);
+                entry->records.push_back(notestore::record::append(at, unit));
+            }
+            else
+            {
+                entry->indexed = false; // later units moved
+                entry->records.push_back(notestore::record::insert(at, unit));
+            }
+            resize(*entry, entry->bytes + approxBytes(unit));
+            units.insert(units.begin() + static_cast<std::ptrdiff_t>(at), std::move(unit));
+            edit = {true, at, entry->records.back()};
+        }
+        markDirty(*entry, payloadBytes);
+        return edit;
+    }
+
+    std::optional<size_t> NoteBuffer::deleteUnit(int classId, const std::string &path, const std::string &unitId)
+    {
+        std::unique_lock<std::mutex> lock;
+        std::shared_ptr<Entry> entry = lockedEntry(classId, path, lock);
+        load(*entry);
+        if (!hasUnits(entry->document))
+            return std::nullopt;
+
+        const UnitIndex &index = indexOf(*entry);
+        auto it = index.find(unitId);
+        if (it == index.end())
+            return std::nullopt;
+        size_t at = it->second;
+        json &units = entry->document["units"];
+        resize(*entry, entry->bytes - approxBytes(units[at]));
+        units.erase(units.begin() + static_cast<std::ptrdiff_t>(at));
+        entry->indexed = false; // later units moved
+        entry->records.push_back(notestore::record::remove(unitId));
+        markDirty(*entry, 0);
+        return at;
+    }
+
+    void NoteBuffer::holdWrites(int classId)
+    {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mapMutex_);
+            held_.insert(classId);
+            auto it = entries_.find(classId);
+            if (it == entries_.end())
+                return;
+            entry = it->second;
+        }
+        std::lock_guard<std::mutex> entryLock(entry->mutex);
+        entry->held = true;
+    }
+
+    void NoteBuffer::releaseWrites(int classId)
+    {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mapMutex_);
+            held_.erase(classId);
+            auto it = entries_.find(classId);
+            if (it == entries_.end())
+                return;
+            entry = it->second;
+        }
+        std::lock_guard<std::mutex> entryLock(entry->mutex);
+        entry->held = false;
+        if (!entry->evicted && dueForFlush(*entry))
+            flushEntry(*entry);
+    }
+
+    void NoteBuffer::invalidate(int classId)
+    {
+        std::lock_guard<std::mutex> lock(mapMutex_);
+        auto it = entries_.find(classId);
+        if (it == entries_.end())
+            return;
+        std::shared_ptr<Entry> entry = it->second;
+        std::lock_guard<std::mutex> entryLock(entry->mutex);
+        forget(it, *entry);
+    }
+
+    void NoteBuffer::flush(int classId)
+    {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mapMutex_);
+            auto it = entries_.find(classId);
+            if (it == entries_.end())
+                return;
+            entry = it->second;
+        }
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        flushEntry(*entry);
+    }
+
+    void NoteBuffer::flushAll()
+    {
+        std::vector<std::shared_ptr<Entry>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mapMutex_);
+            for (auto &[classId, entry] : entries_)
+                snapshot.push_back(entry);
+        }
+        for (auto &entry : snapshot)
+        {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            try
+            {
+                flushEntry(*entry);
+            }
+            catch (const std::exception &e)
+            {
+                bufferLogger.logErr("Failed to flush " + entry->path + ": " + e.what());
+            }
+        }
+    }
+
+    NoteBufferStats NoteBuffer::stats()
+    {
+        NoteBufferStats s;
+        s.edits = edits_;
+        s.fileWrites = fileWrites_;
+        s.appendWrites = appendWrites_;
+        s.compactions = compactions_;
+        s.reads = reads_;
+        s.residentHits = residentHits_;
+        s.pageReads = pageReads_;
+        s.versionReloads = versionReloads_;
+        s.budgetEvictions = budgetEvictions_;
+        std::lock_guard<std::mutex> lock(mapMutex_);
+        s.residentDocuments = entries_.size();
+        s.residentBytes = residentBytes_;
+        for (auto &[classId, entry] : entries_)
+        {
+            std::lock_guard<std::mutex> entryLock(entry->mutex);
+            if (entry->pendingEdits > 0)
+                s.dirtyDocuments++;
+        }
+        return s;
+    }
+
+    void NoteBuffer::runFlusher()
+    {
+        std::unique_lock<std::mutex> lock(flusherMutex_);
+        while (running_)
+        {
+            flusherCV_.wait_for(lock, options_.flushInterval / 2, [this]() { return !running_; });
+            if (!running_)
+                break;
+            lock.unlock();
+
+            Clock::time_point now = Clock::now();
+            std::vector<std::pair<int, std::shared_ptr<Entry>>> snapshot;
+            {
+                std::lock_guard<std::mutex> mapLock(mapMutex_);
+                snapshot.assign(entries_.begin(), entries_.end());
+            }
+
+            std::vector<int> idle;
+            for (auto &[classId, entry] : snapshot)
+            {
+                std::lock_guard<std::mutex> entryLock(entry->mutex);
+                if (entry->pendingEdits > 0 && now - entry->firstDirty >= options_.flushInterval)
+                {
+                    try
+                    {
+                        flushEntry(*entry);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        // Keep the entry dirty and retry on the next tick.
+                        bufferLogger.logErr("Failed to flush " + entry->path + ": " + e.what());
+                    }
+                }
+                else if (entry->pendingEdits == 0 && entry->logRecords >= notestore::kCompactAfter)
+                {
+                    try
+                    {
+                        compactEntry(*entry);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        bufferLogger.logErr("Failed to compact " + entry->path + ": " + e.what());
+                    }
+                }
+                else if (entry->pendingEdits == 0 && now - entry->lastAccess >= options_.idleEviction)
+                {
+                    idle.push_back(classId);
+                }
+            }
+
+            // Drop clean documents nobody touched recently, and any the budget no longer has room for.
+            {
+                std::lock_guard<std::mutex> mapLock(mapMutex_);
+                for (int classId : idle)
+                {
+                    auto it = entries_.find(classId);
+                    if (it == entries_.end())
+                        continue;
+                    std::shared_ptr<Entry> entry = it->second;
+                    std::lock_guard<std::mutex> entryLock(entry->mutex);
+                    if (entry->pendingEdits == 0)
+                        forget(it, *entry);
+                }
+                evictOverBudget();
+            }
+
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,253 @@
+/**
+ * @file note_buffer.h
+ * @brief Write-behind buffer for big notes.
+ *
+ * Keeps the parsed big note of recently edited classes resident in memory.
+ * Edits are applied to the resident document and only marked dirty; the
+ * document is written back once per flush interval, or earlier when too many
+ * edits (or too many edited bytes) are pending. Reads of a resident note are
+ * served straight from memory so they always see the latest edits.
+ *
+ * The background flusher is started with start() and stopped with stop(),
+ * which writes back everything that is still dirty (used on dispatcher shutdown).
+ * Before start() is called the buffer is write-through, so tools and tests that
+ * call Core directly keep the old "edit == file write" behaviour.
+ *
+ * Edits made with appendUnit(), upsertUnit() and deleteUnit() are written back
+ * by appending just the changed units to the note's log (see note_store.h); any
+ * apply() since the last write back makes it a full rewrite instead. Units are
+ * found through a unitId index kept with the resident note. Notes whose log has grown past
+ * notestore::kCompactAfter records are compacted by the flusher thread.
+ *
+ * holdWrites() and releaseWrites() bracket a batch of edits to one class so
+ * that the batch is written back once, whatever the mode.
+ *
+ * Resident notes are bounded by NoteBufferOptions::maxResidentBytes: when they
+ * grow past it, clean notes are dropped least recently used first. Reads can pass
+ * the note's notes.version; a clean resident copy whose version differs was
+ * changed by another process and is loaded again.
+ *
+ * read() hands out an immutable snapshot of the resident note, shared by every
+ * reader until the next edit, so a read does not copy the document under the
+ * entry lock.
+ */
+
+#ifndef FOLSERV_NOTE_BUFFER_H_
+#define FOLSERV_NOTE_BUFFER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <nlohmann/json.hpp>
+
+#include "note_page.h"
+
+namespace Core
+{
+    /**
+     * @brief Counters used to judge how well edits are being coalesced.
+     */
+    struct NoteBufferStats
+    {
+        uint64_t edits = 0;        // mutations applied
+        uint64_t fileWrites = 0;   // documents written back to disk
+        uint64_t appendWrites = 0; // of which only appended changed units
+        uint64_t compactions = 0;  // note logs folded back into a snapshot
+        uint64_t reads = 0;        // reads served
+        uint64_t pageReads = 0;    // of which pages read from the file without loading the note
+        uint64_t residentHits = 0; // reads served without touching the disk
+        uint64_t versionReloads = 0;  // resident notes reloaded because another process changed them
+        uint64_t budgetEvictions = 0; // clean notes dropped to stay within maxResidentBytes
+        size_t residentDocuments = 0;
+        size_t residentBytes = 0;     // approximate memory held by resident notes
+        size_t dirtyDocuments = 0;
+    };
+
+    /**
+     * @brief When the write-behind buffer writes a dirty note back.
+     */
+    struct NoteBufferOptions
+    {
+        std::chrono::milliseconds flushInterval{250};
+        size_t maxPendingEdits = 32;        // flush early after this many edits
+        size_t maxPendingBytes = 1 << 20;   // or after this many edited bytes
+        std::chrono::milliseconds idleEviction{5000}; // drop clean notes idle this long
+        size_t maxResidentBytes = 64 << 20; // evict clean notes, least recently used first, past this
+    };
+
+    class NoteBuffer
+    {
+    public:
+        /**
+         * @brief A change applied to a resident document.
+         * The document is null when the note file is empty or not valid JSON.
+         */
+        using Mutation = std::function<void(nlohmann::json &)>;
+
+        /// @return The process-wide buffer.
+        static NoteBuffer &instance();
+
+        /// @brief Starts the background flusher; from now on edits are written behind.
+        void start(const NoteBufferOptions &options = NoteBufferOptions());
+
+        /// @brief Stops the flusher and durably writes every dirty document.
+        void stop();
+
+        /// @brief Returns the class's note, loading it from @p path if it isn't resident.
+        /// @param version The note's notes.version; a clean resident copy loaded under another
+        /// version is reloaded. 0 to skip the check.
+        /// @throws std::runtime_error if the note file does not exist or cannot be read.
+        /// @return A snapshot of the parsed note, null if the file is empty or not valid JSON.
+        /// Later edits do not change it.
+        std::shared_ptr<const nlohmann::json> read(int classId, const std::string &path, uint64_t version = 0);
+
+        /// @brief Returns a page of the class's note (see note_page.h).
+        /// A resident note is paged in memory; otherwise only the selected units are read
+        /// from the file, and the note is not made resident.
+        /// @param version As for read().
+        /// @throws std::runtime_error if the note file does not exist or cannot be read.
+        nlohmann::json readPage(int classId, const std::string &path, uint64_t version,
+                                const notestore::PageQuery &query);
+
+        /// @brief Applies @p mutation to the class's resident note and schedules a write back.
+        /// @param payloadBytes Approximate size of the edit, counted towards the flush threshold.
+        /// @throws std::runtime_error if the note file cannot be read, or the flush fails in write-through mode.
+        void apply(int classId, const std::string &path, const Mutation &mutation, size_t payloadBytes = 0);
+
+        /// @brief Position of each unit in the note by unitId.
+        using UnitIndex = std::unordered_map<std::string, size_t>;
+
+        /// @brief Builds a unit to append from the resident note and its index (e.g. to pick a free unitId).
+        using UnitBuilder = std::function<nlohmann::json(const nlohmann::json &, const UnitIndex &)>;
+
+        /**
+         * @brief Outcome of upsertUnit().
+         */
+        struct UnitEdit
+        {
+            bool inserted = false; // false if an existing unit was updated
+            size_t position = 0;   // where the unit now is in the note
+            nlohmann::json record; // the note log record of the edit (see note_store.h)
+        };
+
+        /// @brief Appends the unit built by @p makeUnit to the class's note.
+        /// Unlike apply(), the write back appends only the new unit to the note file.
+        /// Notes without a units array are rebuilt around the unit and fully rewritten.
+        /// @param noteTitle Title for the note if it has to be rebuilt.
+        /// @param payloadBytes Approximate size of the edit, counted towards the flush threshold.
+        /// @throws std::runtime_error if the note file cannot be read, or the flush fails in write-through mode.
+        void appendUnit(int classId, const std::string &path, const std::string &noteTitle, const UnitBuilder &makeUnit,
+                        size_t payloadBytes = 0);
+
+        /// @brief Updates the unit with @p unitId by setting @p fields on it, or inserts it if there is none.
+        /// Only this unit is written back to the note file.
+        /// @param fields Unit fields to set, e.g. "title" and "content".
+        /// @param after Insert after this unit; empty to insert at the end. Ignored for updates.
+        /// @param payloadBytes Approximate size of the edit, counted towards the flush threshold.
+        /// @throws std::invalid_argument if @p after is not a unit of the note.
+        /// @throws std::runtime_error if the note has no units array or cannot be read or flushed.
+        UnitEdit upsertUnit(int classId, const std::string &path, const std::string &unitId,
+                            const nlohmann::json &fields, const std::string &after = "", size_t payloadBytes = 0);
+
+        /// @brief Deletes the unit with @p unitId; only the deletion is written to the note file.
+        /// @throws std::runtime_error if the note cannot be read or flushed.
+        /// @return The position the unit had, or nullopt if the note has no such unit.
+        std::optional<size_t> deleteUnit(int classId, const std::string &path, const std::string &unitId);
+
+        /// @brief Defers the class's write backs, write-through and early flushes included, until
+        /// releaseWrites(); a batch of edits is then persisted once (see note_actor.h).
+        void holdWrites(int classId);
+
+        /// @brief Ends holdWrites() and writes the note back if it would have been written meanwhile.
+        /// @throws std::runtime_error if that write back fails.
+        void releaseWrites(int classId);
+
+        /// @brief Drops the resident copy of a class's note without writing it.
+        void invalidate(int classId);
+
+        /// @brief Writes back one class's note if it is dirty.
+        void flush(int classId);
+
+        /// @brief Writes back every dirty note.
+        void flushAll();
+
+        /// @return A snapshot of the buffer counters.
+        NoteBufferStats stats();
+
+    private:
+        struct Entry
+        {
+            std::mutex mutex;
+            std::string path;
+            nlohmann::json document;
+            std::shared_ptr<const nlohmann::json> snapshot; // handed to readers, dropped on every change
+            bool loaded = false;
+            size_t pendingEdits = 0;
+            size_t pendingBytes = 0;
+            bool rewrite = false;                 // an apply() is pending, appending records is not enough
+            nlohmann::json records = nlohmann::json::array(); // log records for unit edits since the last write back
+            UnitIndex index;                      // unitId -> position, valid while indexed
+            bool indexed = false;
+            uint64_t version = 0;                 // notes.version the document matches, 0 after our own writes
+            size_t bytes = 0;                     // approximate size, counted in residentBytes_
+            bool evicted = false;                 // no longer in the map; lookups must start over
+            bool held = false;                    // write backs deferred by holdWrites()
+            std::list<int>::iterator lruPos;      // guarded by mapMutex_
+            bool logFormat = false;               // the file on disk can be appended to
+            size_t logRecords = 0;                // records appended since the last compaction
+            std::chrono::steady_clock::time_point firstDirty;
+            std::chrono::steady_clock::time_point lastAccess;
+        };
+
+        NoteBuffer() = default;
+        ~NoteBuffer();
+
+        std::shared_ptr<Entry> entryFor(int classId, const std::string &path);
+        std::shared_ptr<Entry> lockedEntry(int classId, const std::string &path, std::unique_lock<std::mutex> &lock);
+        void evictOverBudget();
+        void forget(std::unordered_map<int, std::shared_ptr<Entry>>::iterator it, Entry &entry);
+        void resize(Entry &entry, size_t bytes);
+        void load(Entry &entry);
+        const UnitIndex &indexOf(Entry &entry);
+        void markDirty(Entry &entry, size_t payloadBytes);
+        bool dueForFlush(const Entry &entry) const;
+        void flushEntry(Entry &entry);
+        void compactEntry(Entry &entry);
+        void runFlusher();
+
+        NoteBufferOptions options_;
+        std::mutex mapMutex_;
+        std::unordered_map<int, std::shared_ptr<Entry>> entries_;
+        std::list<int> lru_; // class ids, most recently used first
+        std::unordered_set<int> held_; // classes under holdWrites(), guarded by mapMutex_
+        std::atomic<size_t> residentBytes_ = 0;
+
+        std::mutex flusherMutex_;
+        std::condition_variable flusherCV_;
+        std::thread flusher_;
+        std::atomic<bool> running_ = false;
+
+        std::atomic<uint64_t> edits_ = 0;
+        std::atomic<uint64_t> fileWrites_ = 0;
+        std::atomic<uint64_t> appendWrites_ = 0;
+        std::atomic<uint64_t> compactions_ = 0;
+        std::atomic<uint64_t> reads_ = 0;
+        std::atomic<uint64_t> pageReads_ = 0;
+        std::atomic<uint64_t> residentHits_ = 0;
+        std::atomic<uint64_t> versionReloads_ = 0;
+        std::atomic<uint64_t> budgetEvictions_ = 0;
+    };
+}
+
+#endif // FOLSERV_NOTE_BUFFER_H_
@@ -0,0 +1,322 @@
+#include "note_export.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "logger.h"
+
+using json = nlohmann::json;
+
+static logger::Logger exportLogger("export");
+
+namespace
+{
+    std::string lower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+        return s;
+    }
+
+    std::string stringField(const json &object, const char *key)
+    {
+        return object.is_object() && object.contains(key) && object[key].is_string() ? object[key].get<std::string>()
+                                                                                    : std::string();
+    }
+
+    // The text of a unit. Uploads keep their JSON document as the content, so its "content"
+    // string is the text; other structured content is shown as indented JSON.
+    std::string unitBody(const json &unit, bool &code)
+    {
+        code = false;
+        if (!unit.is_object() || !unit.contains("content"))
+            return "";
+        const json &content = unit["content"];
+        if (content.is_string())
+        {
+            const std::string &raw = content.get_ref<const std::string &>();
+            size_t first = raw.find_first_not_of(" \t\r\n");
+            if (first == std::string::npos || (raw[first] != '{' && raw[first] != '['))
+                return raw;
+            json parsed = json::parse(raw, nullptr, false);
+            if (parsed.is_discarded())
+                return raw;
+            if (parsed.is_object() && parsed.contains("content") && parsed["content"].is_string())
+                return parsed["content"].get<std::string>();
+            code = true;
+            return parsed.dump(2, ' ', false, json::error_handler_t::replace);
+        }
+        code = true;
+        return content.dump(2, ' ', false, json::error_handler_t::replace);
+    }
+
+    void appendEscapedHtml(std::string &out, const std::string &text)
+    {
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&#39;"; break;
+            default: out += c;
+            }
+        }
+    }
+
+    // Blank lines separate paragraphs; single line breaks are kept.
+    void appendHtmlParagraphs(std::string &out, const std::string &text)
+    {
+        size_t start = 0;
+        while (start < text.size())
+        {
+            size_t end = text.find("\n\n", start);
+            if (end == std::string::npos)
+                end = text.size();
+            std::string paragraph = text.substr(start, end - start);
+            start = end + 2;
+            if (paragraph.find_first_not_of(" \t\r\n") == std::string::npos)
+                continue;
+            out += "<p>";
+            size_t line = 0;
+            while (true)
+            {
+                size_t lineEnd = paragraph.find('\n', line);
+                appendEscapedHtml(out, paragraph.substr(line, lineEnd == std::string::npos ? std::string::npos : lineEnd - line));
+                if (lineEnd == std::string::npos)
+                    break;
+                out += "<br>\n";
+                line = lineEnd + 1;
+            }
+            out += "</p>\n";
+        }
+    }
+
+    std::string underline(const std::string &text, char c)
+    {
+        return std::string(std::max<size_t>(text.size(), 3), c);
+    }
+}
+
+namespace noteexport
+{
+    std::optional<Format> parseFormat(const std::string &name)
+    {
+        const std::string n = lower(name);
+        if (n == "markdown" || n == "md")
+            return Format::Markdown;
+        if (n == "html" || n == "htm")
+            return Format::Html;
+        if (n == "text" || n == "txt")
+            return Format::Text;
+        return std::nullopt;
+    }
+
+    const char *contentType(Format format)
+    {
+        switch (format)
+        {
+        case Format::Markdown: return "text/markdown; charset=utf-8";
+        case Format::Html: return "text/html; charset=utf-8";
+        case Format::Text: break;
+        }
+        return "text/plain; charset=utf-8";
+    }
+
+    const char *extension(Format format)
+    {
+        switch (format)
+        {
+        case Format::Markdown: return "md";
+        case Format::Html: return "html";
+        case Format::Text: break;
+        }
+        return "txt";
+    }
+
+    Renderer::Renderer(const std::string &notePath, Format format)
+        : view_(notePath), format_(format)
+    {
+        units_ = view_.valid() ? view_.unitCount() : 0;
+    }
+
+    bool Renderer::next(std::string &out)
+    {
+        if (finished_)
+            return false;
+
+        if (!started_)
+        {
+            started_ = true;
+            std::string title = view_.valid() ? view_.title() : "";
+            if (title.empty())
+                title = "Untitled Note";
+            switch (format_)
+            {
+            case Format::Markdown:
+                out += "# " + title + "\n\n";
+                break;
+            case Format::Html:
+                out += "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>";
+                appendEscapedHtml(out, title);
+                out += "</title>\n</head>\n<body>\n<h1>";
+                appendEscapedHtml(out, title);
+                out += "</h1>\n";
+                break;
+            case Format::Text:
+                out += title + "\n" + underline(title, '=') + "\n\n";
+                break;
+            }
+            return true;
+        }
+
+        if (next_ == units_)
+        {
+            finished_ = true;
+            if (format_ != Format::Html)
+                return false;
+            out += "</body>\n</html>\n";
+            return true;
+        }
+
+        // Only this unit is decoded; it is dropped before the next one is read
+        json unit = view_.unit(next_++);
+        std::string title = stringField(unit, "title");
+        bool code = false;
+        std::string body = unitBody(unit, code);
+        while (!body.empty() && (body.back() == '\n' || body.back() == '\r'))
+            body.pop_back();
+
+        switch (format_)
+        {
+        case Format::Markdown:
+            if (!title.empty())
+                out += "## " + title + "\n\n";
+            out += code ? "```json\n" + body + "\n```\n\n" : body + "\n\n";
+            break;
+        case Format::Html:
+            out += "<section id=\"";
+            appendEscapedHtml(out, stringField(unit, "unitId"));
+            out += "\">\n";
+            if (!title.empty())
+            {
+                out += "<h2>";
+                appendEscapedHtml(out, title);
+                out += "</h2>\n";
+            }
+            if (code)
+            {
+                out += "<pre><code>";
+                appendEscapedHtml(out, body);
+                out += "</code></pre>\n";
+            }
+            else
+            {
+                appendHtmlParagraphs(out, body);
+            }
+            out += "</section>\n";
+            break;
+        case Format::Text:
+            if (!title.empty())
+                out += title + "\n" + underline(title, '-') + "\n\n";
+            out += body + "\n\n";
+            break;
+        }
+        return true;
+    }
+
+    ExportStream::ExportStream(const std::string &notePath, int classId, const std::string &version, Format format,
+                               const std::string &cacheDir)
+    {
+        // Appends change the size without always changing the timestamp within the same second
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(notePath, ec);
+        const std::string key = blobstore::hashOf(version + "\n" + std::to_string(ec ? 0 : size)).substr(0, 16);
+        const std::string dir = cacheDir + "/" + std::to_string(classId);
+        path_ = dir + "/" + key + "." + extension(format);
+
+        cachedIn_.open(path_, std::ios::binary);
+        if (cachedIn_)
+            return;
+
+        renderer_ = std::make_unique<Renderer>(notePath, format);
+        std::filesystem::create_directories(dir, ec);
+        static thread_local std::mt19937_64 random(std::random_device{}());
+        partial_ = path_ + ".partial." + std::to_string(random());
+        cacheOut_.open(partial_, std::ios::binary | std::ios::trunc);
+        if (!cacheOut_)
+        {
+            // Still served, just not cached
+            exportLogger.logWarn("Cannot cache export at " + partial_);
+            partial_.clear();
+        }
+    }
+
+    ExportStream::~ExportStream()
+    {
+        if (!partial_.empty())
+        {
+            cacheOut_.close();
+            std::error_code ec;
+            std::filesystem::remove(partial_, ec);
+        }
+    }
+
+    bool ExportStream::next(std::string &chunk)
+    {
+        chunk.clear();
+        if (done_)
+            return false;
+
+        if (!renderer_)
+        {
+            chunk.resize(kChunkSize);
+            cachedIn_.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            chunk.resize(static_cast<size_t>(cachedIn_.gcount()));
+            done_ = chunk.empty();
+            return !done_;
+        }
+
+        bool finished = false;
+        while (chunk.size() < kChunkSize && !finished)
+            finished = !renderer_->next(chunk);
+        if (!partial_.empty())
+            cacheOut_.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        if (finished)
+            complete();
+        return !chunk.empty();
+    }
+
+    void ExportStream::complete()
+    {
+        done_ = true;
+        if (partial_.empty())
+            return;
+        cacheOut_.close();
+        std::error_code ec;
+        if (!cacheOut_ || (std::filesystem::rename(partial_, path_, ec), ec))
+        {
+            exportLogger.logWarn("Cannot cache export at " + path_);
+            std::filesystem::remove(partial_, ec);
+            partial_.clear();
+            return;
+        }
+        partial_.clear();
+
+        // Older versions of this note in this format are never asked for again
+        const std::filesystem::path current(path_);
+        for (const auto &entry : std::filesystem::directory_iterator(current.parent_path(), ec))
+        {
+            const std::filesystem::path &other = entry.path();
+            if (other != current && other.extension() == current.extension())
+                std::filesystem::remove(other, ec);
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/**
+ * @file note_export.h
+ * @brief Renders big notes as Markdown, HTML or plain text, a unit at a time.
+ *
+ * A Renderer walks a note file through a NoteView (see note_view.h), so only
+ * the unit being rendered is decoded and held in memory, whatever the size of
+ * the note:
+ *
+ *     Renderer renderer(path, Format::Markdown);
+ *     std::string chunk;
+ *     while (renderer.next(chunk)) { send(chunk); chunk.clear(); }
+ *
+ * An ExportStream wraps a renderer in fixed-size chunks for an HTTP chunked
+ * response and caches the output per note version:
+ *
+ *     exports/<classId>/<version key>.<md|html|txt>
+ *
+ * The first request for a version renders while it streams and writes the
+ * cache file alongside; it is renamed into place only once complete, so an
+ * abandoned download never leaves a partial export behind. Later requests
+ * stream the cached file. Completing an export removes the cached exports of
+ * older versions of the same note in that format.
+ */
+
+#ifndef FOLSERV_NOTE_EXPORT_H_
+#define FOLSERV_NOTE_EXPORT_H_
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "note_view.h"
+
+namespace noteexport
+{
+    constexpr size_t kChunkSize = 64 * 1024; // bytes per chunk handed to the HTTP sink
+
+    enum class Format
+    {
+        Markdown,
+        Html,
+        Text,
+    };
+
+    /// @brief Parses a format name: "markdown"/"md", "html"/"htm", "text"/"txt" (any case).
+    /// @return The format, or nullopt if the name is not one of these.
+    std::optional<Format> parseFormat(const std::string &name);
+
+    /// @return The MIME type of @p format, with charset.
+    const char *contentType(Format format);
+
+    /// @return The file extension of @p format, without the dot.
+    const char *extension(Format format);
+
+    /**
+     * @brief Renders one note, unit by unit.
+     */
+    class Renderer
+    {
+    public:
+        /// @brief Maps the note file at @p notePath.
+        /// @throws std::runtime_error if the file does not exist or cannot be mapped.
+        Renderer(const std::string &notePath, Format format);
+
+        /// @brief Appends the next piece of output (the heading, one unit, or the footer) to @p out.
+        /// @throws std::runtime_error if a unit's blob is missing.
+        /// @return False once everything has been rendered; @p out is left alone then.
+        bool next(std::string &out);
+
+    private:
+        notestore::NoteView view_;
+        Format format_;
+        size_t units_ = 0;
+        size_t next_ = 0;  // next unit to render
+        bool started_ = false;
+        bool finished_ = false;
+    };
+
+    /**
+     * @brief Chunks of one export, from the cache or rendered on the way.
+     */
+    class ExportStream
+    {
+    public:
+        /// @param version Changes whenever the note does (e.g. notes.version); with the
+        ///        file size it keys the cache.
+        /// @throws std::runtime_error if the note file cannot be opened.
+        ExportStream(const std::string &notePath, int classId, const std::string &version, Format format,
+                     const std::string &cacheDir = "exports");
+
+        /// @brief Drops a partly written cache file.
+        ~ExportStream();
+
+        ExportStream(const ExportStream &) = delete;
+        ExportStream &operator=(const ExportStream &) = delete;
+
+        /// @brief Replaces @p chunk with the next chunk of about kChunkSize bytes.
+        /// @return False once the export is complete.
+        bool next(std::string &chunk);
+
+        /// @return True if this export is served from the cache.
+        bool cached() const { return !renderer_; }
+
+    private:
+        std::string path_;      // the cache file
+        std::string partial_;   // where it is written while rendering
+        std::ifstream cachedIn_;
+        std::unique_ptr<Renderer> renderer_;
+        std::ofstream cacheOut_;
+        bool done_ = false;
+
+        void complete();
+    };
+}
+
+#endif // FOLSERV_NOTE_EXPORT_H_
@@ -0,0 +1,467 @@
+#include "note_history.h"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "blob_store.h"
+#include "data_access_layer.h"
+#include "file_engine.h"
+#include "logger.h"
+#include "note_store.h"
+#include "note_view.h"
+
+using json = nlohmann::json;
+using notehistory::Version;
+
+static logger::Logger historyLogger("note-history");
+
+namespace
+{
+    // The history of one note; the index is loaded on first use.
+    struct Log
+    {
+        std::mutex mutex;
+        bool loaded = false;
+        std::vector<Version> versions;           // the kept ones, consecutive
+        std::list<std::string>::iterator lruPos; // guarded by logsMutex
+    };
+
+    std::mutex logsMutex;
+    std::unordered_map<std::string, std::shared_ptr<Log>> logs;
+    std::list<std::string> lru; // most recently used first
+
+    std::shared_ptr<Log> logFor(const std::string &dir)
+    {
+        std::lock_guard<std::mutex> lock(logsMutex);
+        std::shared_ptr<Log> &log = logs[dir];
+        if (log)
+        {
+            lru.splice(lru.begin(), lru, log->lruPos);
+            return log;
+        }
+        log = std::make_shared<Log>();
+        lru.push_front(dir);
+        log->lruPos = lru.begin();
+        std::shared_ptr<Log> found = log;
+
+        // Only logs nobody holds are evicted; references are only taken under logsMutex, so a second
+        // Log for the same note can never be loaded while the first is in use
+        for (auto it = lru.end(); logs.size() > notehistory::kMaxNotes && it != lru.begin();)
+        {
+            --it;
+            auto entry = logs.find(*it);
+            if (entry->second.use_count() == 1)
+            {
+                logs.erase(entry);
+                it = lru.erase(it);
+            }
+        }
+        return found;
+    }
+
+    std::string indexPath(const std::string &dir) { return dir + "/index"; }
+
+    std::string snapshotPath(const std::string &dir, size_t version)
+    {
+        return dir + "/" + std::to_string(version) + ".snapshot";
+    }
+
+    std::string deltasPath(const std::string &dir, size_t base)
+    {
+        return dir + "/" + std::to_string(base) + ".deltas";
+    }
+
+    std::string utcNow()
+    {
+        std::time_t now = std::time(nullptr);
+        std::tm tm{};
+        gmtime_r(&now, &tm);
+        char buffer[20];
+        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+        return buffer;
+    }
+
+    json entryOf(const Version &version)
+    {
+        return {
+            {"version", version.version},
+            {"userId", version.userId},
+            {"timestamp", version.timestamp},
+            {"description", version.description},
+            {"base", version.base}
+        };
+    }
+
+    size_t nextVersion(const Log &log)
+    {
+        return log.versions.empty() ? 1 : log.versions.back().version + 1;
+    }
+
+    // Reads the index once; the caller holds log.mutex.
+    void loadIndex(Log &log, const std::string &dir)
+    {
+        if (log.loaded)
+            return;
+        if (std::filesystem::exists(indexPath(dir)))
+        {
+            std::istringstream lines(DAL::readFile(indexPath(dir)));
+            std::string line;
+            while (std::getline(lines, line))
+            {
+                json entry = json::parse(line, nullptr, false);
+                if (entry.is_discarded() || !entry.is_object())
+                    continue; // blank, or torn by a crash
+                Version version{entry.value("version", size_t(0)), entry.value("userId", 0),
+                                entry.value("timestamp", ""), entry.value("description", ""),
+                                entry.value("base", size_t(0))};
+                // The oldest version kept is a snapshot; every later one follows it without a gap
+                const bool inSequence = log.versions.empty()
+                                            ? version.version > 0 && version.base == version.version
+                                            : version.version == nextVersion(log) &&
+                                                  version.base >= log.versions.front().version &&
+                                                  version.base <= version.version;
+                if (!inSequence)
+                {
+                    historyLogger.logWarn("Skipping out of sequence version in " + indexPath(dir) + ": " + line);
+                    continue;
+                }
+                log.versions.push_back(std::move(version));
+            }
+        }
+        log.loaded = true;
+    }
+
+    const Version &versionAt(const Log &log, size_t version)
+    {
+        return log.versions[version - log.versions.front().version];
+    }
+
+    // Makes a version visible once its content is durable.
+    void commit(Log &log, const std::string &dir, Version version)
+    {
+        // The leading newline ends a line torn by an earlier crash.
+        DAL::appendFile(indexPath(dir), "\n" + entryOf(version).dump() + "\n");
+        log.versions.push_back(std::move(version));
+    }
+
+    void releaseAll(const std::vector<std::string> &hashes)
+    {
+        for (const std::string &hash : hashes)
+            blobstore::release(hash);
+    }
+
+    // Takes a reference to @p content for a snapshot. The note already holds most of it, so only
+    // the count is bumped; content no longer in the store is written again.
+    void takeRef(const std::string &content, const std::string &hash)
+    {
+        if (blobstore::refCount(hash) > 0)
+        {
+            try
+            {
+                blobstore::addRef(hash);
+                return;
+            }
+            catch (const std::runtime_error &)
+            {
+                // Released in between
+            }
+        }
+        blobstore::put(content);
+    }
+
+    // Unit records as the deltas file stores them, large content moved to the blob store.
+    // References taken are added to @p taken.
+    json storeRecords(const json &records, std::vector<std::string> &taken)
+    {
+        json stored = json::array();
+        for (json record : records)
+        {
+            for (const char *key : {"unit", "set", "insert"})
+            {
+                if (!record.contains(key))
+                    continue;
+                std::string hash = notestore::storeUnit(record[key]);
+                if (!hash.empty())
+                    taken.push_back(std::move(hash));
+            }
+            stored.push_back(std::move(record));
+        }
+        return stored;
+    }
+
+    // Releases what the snapshot of @p base and the deltas on top of it hold, and removes them.
+    void dropSegment(const std::string &dir, size_t base)
+    {
+        const std::string snapshot = snapshotPath(dir, base), deltas = deltasPath(dir, base);
+        std::vector<std::string> held;
+        if (std::filesystem::exists(snapshot))
+        {
+            for (const auto &[hash, count] : notestore::NoteView(snapshot).heldBlobs())
+                held.insert(held.end(), static_cast<size_t>(std::max(count, 0)), hash);
+        }
+        if (std::filesystem::exists(deltas))
+        {
+            // Every line took its references when it was written, a retried version's too
+            std::istringstream lines(DAL::readFile(deltas));
+            std::string line;
+            while (std::getline(lines, line))
+            {
+                json delta = json::parse(line, nullptr, false);
+                if (delta.is_discarded() || !delta.is_object() || !delta.contains("records") || !delta["records"].is_array())
+                    continue;
+                for (const json &record : delta["records"])
+                {
+                    for (const char *key : {"unit", "set", "insert"})
+                    {
+                        if (record.is_object() && record.contains(key) && record[key].contains("blob") &&
+                            record[key]["blob"].is_string())
+                            held.push_back(record[key]["blob"].get<std::string>());
+                    }
+                }
+            }
+        }
+        releaseAll(held);
+        fileio::remove(snapshot);
+        fileio::remove(deltas);
+    }
+
+    // Drops the oldest snapshots and their deltas while the versions after them are at least
+    // kMaxVersions. The index is rewritten before anything is released.
+    void dropOldVersions(Log &log, const std::string &dir)
+    {
+        std::vector<size_t> dropped;
+        size_t first = 0; // index of the first version kept
+        while (true)
+        {
+            size_t next = first + 1;
+            while (next < log.versions.size() && log.versions[next].base != log.versions[next].version)
+                next++;
+            if (next >= log.versions.size() || log.versions.size() - next < notehistory::kMaxVersions)
+                break;
+            dropped.push_back(log.versions[first].version);
+            first = next;
+        }
+        if (dropped.empty())
+            return;
+
+        log.versions.erase(log.versions.begin(), log.versions.begin() + static_cast<std::ptrdiff_t>(first));
+        std::string index;
+        for (const Version &version : log.versions)
+            index += entryOf(version).dump() + "\n";
+        DAL::writeFile(indexPath(dir), index);
+
+        for (size_t base : dropped)
+            dropSegment(dir, base);
+        historyLogger.logDebug("Dropped " + std::to_string(dropped.size()) + " old snapshots from " + dir);
+    }
+
+    size_t writeSnapshot(Log &log, const std::string &dir, int userId, const std::string &description,
+                         const json &note)
+    {
+        const size_t version = nextVersion(log);
+        std::filesystem::create_directories(dir);
+
+        json stored = note;
+        std::vector<std::string> taken;
+        try
+        {
+            if (stored.is_object() && stored.contains("units") && stored["units"].is_array())
+            {
+                for (json &unit : stored["units"])
+                {
+                    if (!unit.is_object() || !unit.contains("content") || !unit["content"].is_string())
+                        continue;
+                    const std::string &content = unit["content"].get_ref<const std::string &>();
+                    if (content.size() < notestore::kMinBlobSize)
+                        continue;
+                    std::string hash = blobstore::hashOf(content);
+                    takeRef(content, hash);
+                    taken.push_back(hash);
+                    unit["size"] = content.size();
+                    unit.erase("content");
+                    unit["blob"] = std::move(hash);
+                }
+            }
+            DAL::writeFile(snapshotPath(dir, version), notestore::encodeSnapshot(stored));
+            commit(log, dir, {version, userId, utcNow(), description, version});
+        }
+        catch (...)
+        {
+            releaseAll(taken);
+            throw;
+        }
+        dropOldVersions(log, dir);
+        return version;
+    }
+
+    // Position of the unit with @p unitId, or units.size().
+    size_t positionOf(const json &units, const json &unitId)
+    {
+        for (size_t i = 0; i < units.size(); i++)
+        {
+            if (units[i].is_object() && units[i].contains("unitId") && units[i]["unitId"] == unitId)
+                return i;
+        }
+        return units.size();
+    }
+
+    // Applies one note_store record to a hydrated note.
+    void applyRecord(json &note, json record)
+    {
+        if (!record.is_object())
+            return;
+        if (!note.is_object())
+            note = json::object();
+        if (record.contains("title"))
+        {
+            note["title"] = record["title"];
+            return;
+        }
+        if (!note.contains("units") || !note["units"].is_array())
+            note["units"] = json::array();
+        json &units = note["units"];
+
+        if (record.contains("unit") || record.contains("insert"))
+        {
+            // Appends are replayed as inserts so their order against other edits does not matter.
+            json unit = std::move(record.contains("unit") ? record["unit"] : record["insert"]);
+            if (unit.contains("unitId") && positionOf(units, unit["unitId"]) != units.size())
+                return;
+            size_t at = std::min<size_t>(record.value(record.contains("unit") ? "n" : "at", units.size()),
+                                         units.size());
+            notestore::hydrateUnit(unit);
+            units.insert(units.begin() + static_cast<std::ptrdiff_t>(at), std::move(unit));
+        }
+        else if (record.contains("set") && record["set"].is_object() && record["set"].contains("unitId"))
+        {
+            json unit = std::move(record["set"]);
+            size_t at = positionOf(units, unit["unitId"]);
+            if (at == units.size())
+                return;
+            notestore::hydrateUnit(unit);
+            units[at] = std::move(unit);
+        }
+        else if (record.contains("delete"))
+        {
+            size_t at = positionOf(units, record["delete"]);
+            if (at != units.size())
+                units.erase(units.begin() + static_cast<std::ptrdiff_t>(at));
+        }
+    }
+
+    // Rebuilds @p version from its snapshot; the caller holds log.mutex.
+    json rebuild(const Log &log, const std::string &dir, size_t version)
+    {
+        const size_t base = versionAt(log, version).base;
+        json note = notestore::load(snapshotPath(dir, base));
+        if (version == base)
+            return note;
+
+        // A version retried after a crash can appear twice; the last line is the one the index points at.
+        std::map<size_t, json> deltas;
+        std::istringstream lines(DAL::readFile(deltasPath(dir, base)));
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            json delta = json::parse(line, nullptr, false);
+            if (delta.is_discarded() || !delta.is_object() || !delta.contains("records"))
+                continue;
+            size_t v = delta.value("version", size_t(0));
+            if (v > base && v <= version)
+                deltas[v] = std::move(delta["records"]);
+        }
+        if (deltas.size() != version - base)
+            throw std::runtime_error("History of " + dir + " is missing deltas before version " +
+                                     std::to_string(version) + ".");
+
+        for (auto &[v, records] : deltas)
+        {
+            for (json &record : records)
+                applyRecord(note, std::move(record));
+        }
+        return note;
+    }
+}
+
+namespace notehistory
+{
+    std::string dirFor(const std::string &notePath)
+    {
+        return notePath + ".history";
+    }
+
+    size_t record(const std::string &notePath, int userId, const std::string &description,
+                  const json &records, const std::function<json()> &current)
+    {
+        const std::string dir = dirFor(notePath);
+        std::shared_ptr<Log> log = logFor(dir);
+        std::lock_guard<std::mutex> lock(log->mutex);
+        loadIndex(*log, dir);
+
+        if (log->versions.empty())
+            return writeSnapshot(*log, dir, userId, description, current());
+
+        const size_t version = nextVersion(*log);
+        const size_t base = log->versions.back().base;
+        if (version - base >= kSnapshotEvery)
+        {
+            json note = rebuild(*log, dir, version - 1);
+            for (const json &record : records)
+                applyRecord(note, record);
+            return writeSnapshot(*log, dir, userId, description, note);
+        }
+
+        std::vector<std::string> taken;
+        try
+        {
+            json stored = storeRecords(records, taken);
+            DAL::appendFile(deltasPath(dir, base),
+                            "\n" + json{{"version", version}, {"records", stored}}.dump() + "\n");
+        }
+        catch (...)
+        {
+            releaseAll(taken);
+            throw;
+        }
+        // A delta line the index never points at keeps its references until its segment is dropped
+        commit(*log, dir, {version, userId, utcNow(), description, base});
+        return version;
+    }
+
+    size_t snapshot(const std::string &notePath, int userId, const std::string &description, const json &note)
+    {
+        const std::string dir = dirFor(notePath);
+        std::shared_ptr<Log> log = logFor(dir);
+        std::lock_guard<std::mutex> lock(log->mutex);
+        loadIndex(*log, dir);
+        return writeSnapshot(*log, dir, userId, description, note);
+    }
+
+    std::vector<Version> list(const std::string &notePath)
+    {
+        const std::string dir = dirFor(notePath);
+        std::shared_ptr<Log> log = logFor(dir);
+        std::lock_guard<std::mutex> lock(log->mutex);
+        loadIndex(*log, dir);
+        return log->versions;
+    }
+
+    json at(const std::string &notePath, size_t version)
+    {
+        const std::string dir = dirFor(notePath);
+        std::shared_ptr<Log> log = logFor(dir);
+        std::lock_guard<std::mutex> lock(log->mutex);
+        loadIndex(*log, dir);
+        if (log->versions.empty() || version < log->versions.front().version || version > log->versions.back().version)
+            throw std::invalid_argument("The note has no version " + std::to_string(version) + ".");
+        return rebuild(*log, dir, version);
+    }
+}
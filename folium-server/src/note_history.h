@@ -0,0 +1,90 @@
+/**
+ * @file note_history.h
+ * @brief Version history of big notes, kept as deltas between periodic snapshots.
+ *
+ * Every upload or edit of a note becomes a version. Most versions are stored as
+ * a delta: the unit records of the edit, in the same vocabulary as the note log
+ * (see note_store.h), with large unit content in the blob store. Every
+ * kSnapshotEvery versions, and whenever an edit replaces the whole note, the
+ * full note is stored instead. A note's history lives next to it:
+ *
+ *     <note>.history/index          one JSON line per version: who, when, what, and its snapshot
+ *     <note>.history/<v>.snapshot   the note at version v (note_store.h format)
+ *     <note>.history/<v>.deltas     one JSON line per version after v, up to the next snapshot
+ *
+ * Rebuilding a version loads its snapshot and applies fewer than kSnapshotEvery
+ * deltas. Listing the history reads only the index, which is also cached in
+ * memory for the kMaxNotes notes used most recently.
+ *
+ * Snapshots take their own reference to each blob, which for content the note
+ * already stores only bumps its count. Once a note has more than kMaxVersions
+ * versions, its oldest snapshots are dropped together with their deltas, and
+ * the blob references both held are released. Version numbers never change;
+ * the oldest version kept is always a snapshot.
+ *
+ * Delta records find units by unitId, and an appended unit is replayed as an
+ * insert at its position, so two edits recorded in the opposite order to the one
+ * the note saw them in still rebuild the same note.
+ *
+ * All functions throw std::runtime_error on I/O failure.
+ */
+
+#ifndef FOLSERV_NOTE_HISTORY_H_
+#define FOLSERV_NOTE_HISTORY_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace notehistory
+{
+    // A version is rebuilt from at most this many deltas, less one.
+    constexpr size_t kSnapshotEvery = 16;
+
+    // Versions kept per note, give or take one snapshot's deltas.
+    constexpr size_t kMaxVersions = 256;
+
+    // Note histories whose index is kept in memory.
+    constexpr size_t kMaxNotes = 1024;
+
+    /**
+     * @brief One entry of a note's history.
+     */
+    struct Version
+    {
+        size_t version = 0;      // from 1, counting dropped versions
+        int userId = 0;          // who made the edit
+        std::string timestamp;   // UTC, "YYYY-MM-DD HH:MM:SS"
+        std::string description; // e.g. "Uploaded Week 3"
+        size_t base = 0;         // the snapshot the version is rebuilt from; itself if it is one
+    };
+
+    /// @return The directory holding the history of the note at @p notePath.
+    std::string dirFor(const std::string &notePath);
+
+    /// @brief Records an edit made of unit records (note_store.h record:: functions) as a new version.
+    /// @param records The edit's records, with hydrated units.
+    /// @param current Returns the note as it is after the edit; only called when the note has no
+    ///        history yet, so its first version has to be a snapshot.
+    /// @return The new version number.
+    size_t record(const std::string &notePath, int userId, const std::string &description,
+                  const nlohmann::json &records, const std::function<nlohmann::json()> &current);
+
+    /// @brief Records @p note, as it is after an edit that replaced it wholesale, as a new version.
+    /// @return The new version number.
+    size_t snapshot(const std::string &notePath, int userId, const std::string &description,
+                    const nlohmann::json &note);
+
+    /// @return Every version of the note still kept, oldest first, without reading any note content.
+    std::vector<Version> list(const std::string &notePath);
+
+    /// @brief Rebuilds the note as it was at @p version.
+    /// @throws std::invalid_argument if the note has no such version, or it was dropped.
+    /// @return The hydrated note.
+    nlohmann::json at(const std::string &notePath, size_t version);
+}
+
+#endif // FOLSERV_NOTE_HISTORY_H_
@@ -0,0 +1,375 @@
+#include "note_ingest.h"
+
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+
+using json = nlohmann::json;
+
+namespace
+{
+    using noteingest::kBufferBytes;
+
+    // Buffered writes to the normalized file, hashed as they are flushed.
+    class FileSink
+    {
+    public:
+        explicit FileSink(const std::string &path) : path_(path), file_(path, std::ios::binary | std::ios::trunc)
+        {
+            if (!file_)
+                throw std::runtime_error("Cannot write " + path);
+            buffer_.reserve(kBufferBytes);
+        }
+
+        void write(const char *data, size_t size)
+        {
+            buffer_.append(data, size);
+            if (buffer_.size() >= kBufferBytes)
+                flush();
+        }
+
+        void put(char c)
+        {
+            buffer_ += c;
+            if (buffer_.size() >= kBufferBytes)
+                flush();
+        }
+
+        noteingest::Normalized close()
+        {
+            flush();
+            file_.close();
+            if (!file_)
+                throw std::runtime_error("Cannot write " + path_);
+            return {hasher_.finish(), size_};
+        }
+
+    private:
+        std::string path_;
+        std::ofstream file_;
+        std::string buffer_;
+        blobstore::Hasher hasher_;
+        uint64_t size_ = 0;
+
+        void flush()
+        {
+            hasher_.update(buffer_.data(), buffer_.size());
+            file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            size_ += buffer_.size();
+            buffer_.clear();
+        }
+    };
+
+    class StringSink
+    {
+    public:
+        explicit StringSink(std::string &out) : out_(out) {}
+        void write(const char *data, size_t size) { out_.append(data, size); }
+        void put(char c) { out_ += c; }
+
+    private:
+        std::string &out_;
+    };
+
+    // Line endings, trailing whitespace and UTF-8 repair, one byte at a time. Blanks and line
+    // breaks are held back until something follows them on the line, or in the text.
+    template <typename Sink>
+    class TextNormalizer
+    {
+    public:
+        explicit TextNormalizer(Sink &out) : out_(out) {}
+
+        void feed(const char *data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+                byte(static_cast<unsigned char>(data[i]));
+        }
+
+        void finish()
+        {
+            if (need_ > 0)
+                replacement();
+            // What is still held back is trailing
+        }
+
+    private:
+        static constexpr char kReplacement[] = "\xEF\xBF\xBD"; // U+FFFD
+
+        Sink &out_;
+        std::string blanks_;    // spaces and tabs since the last text on the line
+        size_t newlines_ = 0;   // line breaks since the last text
+        bool afterCR_ = false;
+        unsigned char sequence_[4];
+        size_t length_ = 0;     // bytes of sequence_ read
+        size_t need_ = 0;       // continuation bytes still to come
+        unsigned char low_ = 0x80, high_ = 0xBF; // range of the next continuation byte
+
+        void byte(unsigned char c)
+        {
+            if (need_ > 0)
+            {
+                if (c >= low_ && c <= high_)
+                {
+                    sequence_[length_++] = c;
+                    low_ = 0x80;
+                    high_ = 0xBF;
+                    if (--need_ == 0)
+                        text(reinterpret_cast<const char *>(sequence_), length_);
+                    return;
+                }
+                // A truncated sequence; c starts afresh
+                need_ = 0;
+                replacement();
+            }
+            if (c < 0x80)
+                ascii(static_cast<char>(c));
+            else if (c >= 0xC2 && c <= 0xDF)
+                start(c, 1, 0x80, 0xBF);
+            else if (c == 0xE0)
+                start(c, 2, 0xA0, 0xBF); // no overlong forms
+            else if (c == 0xED)
+                start(c, 2, 0x80, 0x9F); // no surrogates
+            else if (c >= 0xE1 && c <= 0xEF)
+                start(c, 2, 0x80, 0xBF);
+            else if (c == 0xF0)
+                start(c, 3, 0x90, 0xBF);
+            else if (c >= 0xF1 && c <= 0xF3)
+                start(c, 3, 0x80, 0xBF);
+            else if (c == 0xF4)
+                start(c, 3, 0x80, 0x8F); // nothing past U+10FFFF
+            else
+                replacement();
+        }
+
+        void start(unsigned char lead, size_t continuations, unsigned char low, unsigned char high)
+        {
+            sequence_[0] = lead;
+            length_ = 1;
+            need_ = continuations;
+            low_ = low;
+            high_ = high;
+        }
+
+        void ascii(char c)
+        {
+            if (afterCR_)
+            {
+                afterCR_ = false;
+                if (c == '\n')
+                    return;
+            }
+            if (c == '\r' || c == '\n')
+            {
+                blanks_.clear();
+                newlines_++;
+                afterCR_ = c == '\r';
+            }
+            else if (c == ' ' || c == '\t')
+            {
+                blanks_ += c;
+            }
+            else
+            {
+                text(&c, 1);
+            }
+        }
+
+        void replacement()
+        {
+            text(kReplacement, 3);
+        }
+
+        void text(const char *data, size_t size)
+        {
+            afterCR_ = false;
+            for (; newlines_ > 0; newlines_--)
+                out_.put('\n');
+            out_.write(blanks_.data(), blanks_.size());
+            blanks_.clear();
+            out_.write(data, size);
+        }
+    };
+
+    // Re-serializes a document compactly as the parser reports it.
+    class JsonWriter
+    {
+    public:
+        explicit JsonWriter(FileSink &out) : out_(out) {}
+
+        bool null() { return literal("null", 4); }
+        bool boolean(bool value) { return value ? literal("true", 4) : literal("false", 5); }
+        bool number_integer(json::number_integer_t value) { return number(std::to_string(value)); }
+        bool number_unsigned(json::number_unsigned_t value) { return number(std::to_string(value)); }
+        bool number_float(json::number_float_t, const std::string &raw) { return number(raw); }
+        bool binary(json::binary_t &) { return false; } // not produced by the JSON parser
+
+        bool string(std::string &value)
+        {
+            separate();
+            quoted(value);
+            return true;
+        }
+
+        bool key(std::string &name)
+        {
+            separate();
+            quoted(name);
+            out_.put(':');
+            afterKey_ = true;
+            return true;
+        }
+
+        bool start_object(std::size_t) { return open('{'); }
+        bool end_object() { return close('}'); }
+        bool start_array(std::size_t) { return open('['); }
+        bool end_array() { return close(']'); }
+
+        bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) { return false; }
+
+    private:
+        FileSink &out_;
+        std::vector<bool> first_{true}; // per open container: nothing written in it yet
+        bool afterKey_ = false;
+
+        // A comma before every value of a container but the first; none between a key and its value.
+        void separate()
+        {
+            if (afterKey_)
+            {
+                afterKey_ = false;
+                return;
+            }
+            if (!first_.back())
+                out_.put(',');
+            first_.back() = false;
+        }
+
+        bool literal(const char *text, size_t size)
+        {
+            separate();
+            out_.write(text, size);
+            return true;
+        }
+
+        bool number(const std::string &text) { return literal(text.data(), text.size()); }
+
+        bool open(char bracket)
+        {
+            separate();
+            out_.put(bracket);
+            first_.push_back(true);
+            return true;
+        }
+
+        bool close(char bracket)
+        {
+            out_.put(bracket);
+            first_.pop_back();
+            return true;
+        }
+
+        void quoted(const std::string &value)
+        {
+            static const char *kHex = "0123456789abcdef";
+            out_.put('"');
+            size_t run = 0; // start of the bytes that need no escape
+            for (size_t i = 0; i < value.size(); i++)
+            {
+                const unsigned char c = static_cast<unsigned char>(value[i]);
+                if (c >= 0x20 && c != '"' && c != '\\')
+                    continue;
+                out_.write(value.data() + run, i - run);
+                run = i + 1;
+                switch (c)
+                {
+                case '"': out_.write("\\\"", 2); break;
+                case '\\': out_.write("\\\\", 2); break;
+                case '\n': out_.write("\\n", 2); break;
+                case '\r': out_.write("\\r", 2); break;
+                case '\t': out_.write("\\t", 2); break;
+                case '\b': out_.write("\\b", 2); break;
+                case '\f': out_.write("\\f", 2); break;
+                default:
+                {
+                    const char escape[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                    out_.write(escape, 6);
+                }
+                }
+            }
+            out_.write(value.data() + run, value.size() - run);
+            out_.put('"');
+        }
+    };
+
+    // A file read through a kBufferBytes stream buffer.
+    struct Input
+    {
+        std::unique_ptr<char[]> buffer{new char[kBufferBytes]};
+        std::ifstream file;
+
+        explicit Input(const std::string &path)
+        {
+            file.rdbuf()->pubsetbuf(buffer.get(), kBufferBytes);
+            file.open(path, std::ios::binary);
+            if (!file)
+                throw std::runtime_error("Cannot read " + path);
+        }
+    };
+}
+
+namespace noteingest
+{
+    Format detect(const std::string &path)
+    {
+        Input input(path);
+        // The SAX acceptor checks the grammar without building anything
+        return json::accept(input.file) ? Format::Json : Format::Text;
+    }
+
+    Normalized normalize(const std::string &path, const std::string &out, Format format)
+    {
+        Input input(path);
+        FileSink sink(out);
+        if (format == Format::Json)
+        {
+            JsonWriter writer(sink);
+            if (!json::sax_parse(input.file, &writer))
+                throw std::runtime_error("Upload is not valid JSON.");
+            return sink.close();
+        }
+
+        TextNormalizer<FileSink> normalizer(sink);
+        std::unique_ptr<char[]> chunk(new char[kBufferBytes]);
+        bool first = true;
+        while (input.file)
+        {
+            input.file.read(chunk.get(), kBufferBytes);
+            size_t size = static_cast<size_t>(input.file.gcount());
+            size_t skip = first && size >= 3 && std::string_view(chunk.get(), 3) == "\xEF\xBB\xBF" ? 3 : 0;
+            first = false;
+            normalizer.feed(chunk.get() + skip, size - skip);
+        }
+        if (input.file.bad())
+            throw std::runtime_error("Cannot read " + path);
+        normalizer.finish();
+        return sink.close();
+    }
+
+    std::string normalizeText(const std::string &text)
+    {
+        std::string out;
+        out.reserve(text.size());
+        StringSink sink(out);
+        TextNormalizer<StringSink> normalizer(sink);
+        size_t skip = text.rfind("\xEF\xBB\xBF", 0) == 0 ? 3 : 0;
+        normalizer.feed(text.data() + skip, text.size() - skip);
+        normalizer.finish();
+        return out;
+    }
+}
@@ -0,0 +1,61 @@
+/**
+ * @file note_ingest.h
+ * @brief Streaming decode and normalization of uploaded notes.
+ *
+ * An upload is read from its staged file in kBufferBytes pieces and never held
+ * in memory whole. detect() runs it through the JSON parser's SAX interface
+ * without building a document; normalize() then writes the unit content the
+ * upload becomes to a file next to it, hashing it on the way:
+ *
+ *     JSON   the document re-serialized compactly as it is parsed, keys in the
+ *            order the upload has them
+ *     text   the text itself with Unix line endings, no trailing whitespace on
+ *            any line or at the end, no byte order mark, and invalid UTF-8
+ *            replaced by U+FFFD
+ *
+ * Text is stored as is rather than wrapped in a JSON document, so it is not
+ * escaped twice when the note is written. Memory use is the read and write
+ * buffers plus the longest single JSON string or number of the upload.
+ *
+ * All functions throw std::runtime_error if a file cannot be read or written.
+ */
+
+#ifndef FOLSERV_NOTE_INGEST_H_
+#define FOLSERV_NOTE_INGEST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace noteingest
+{
+    constexpr size_t kBufferBytes = 64 * 1024; // per read and per write
+
+    enum class Format
+    {
+        Json,
+        Text
+    };
+
+    /**
+     * @brief The unit content normalize() wrote.
+     */
+    struct Normalized
+    {
+        std::string hash;  // as blobstore::hashOf() of the content
+        uint64_t size = 0; // bytes
+    };
+
+    /// @return Json if the file at @p path is one valid JSON document (a leading byte order
+    ///         mark allowed), else Text.
+    Format detect(const std::string &path);
+
+    /// @brief Writes the unit content of the upload at @p path to @p out, replacing it.
+    /// @throws std::runtime_error also if @p format is Json and the upload is not valid JSON.
+    Normalized normalize(const std::string &path, const std::string &out, Format format);
+
+    /// @return @p text normalized as normalize() does text uploads.
+    std::string normalizeText(const std::string &text);
+}
+
+#endif // FOLSERV_NOTE_INGEST_H_
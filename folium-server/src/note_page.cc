@@ -0,0 +1,189 @@
+#include "note_page.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <unordered_map>
+
+using json = nlohmann::json;
+
+namespace
+{
+    using notestore::Fields;
+    using notestore::PageQuery;
+
+    // Positions [first, last) selected by offset and limit out of @p total units.
+    std::pair<size_t, size_t> range(const PageQuery &query, size_t total)
+    {
+        size_t first = std::min(query.offset, total);
+        size_t last = query.limit ? first + std::min(*query.limit, total - first) : total;
+        return {first, last};
+    }
+
+    // Drops what the projection leaves out. Stored units carry a blob reference
+    // ("blob", "size") in place of large content; it goes with the content.
+    json project(json unit, Fields fields)
+    {
+        if (fields == Fields::Full || !unit.is_object())
+            return unit;
+        if (fields == Fields::Titles)
+        {
+            json titled = json::object();
+            for (const char *key : {"unitId", "title"})
+            {
+                if (unit.contains(key))
+                    titled[key] = std::move(unit[key]);
+            }
+            return titled;
+        }
+        for (const char *key : {"content", "blob", "size"})
+            unit.erase(key);
+        return unit;
+    }
+
+    std::string unitIdOf(const json &unit)
+    {
+        return unit.is_object() && unit.contains("unitId") && unit["unitId"].is_string()
+                   ? unit["unitId"].get<std::string>()
+                   : std::string();
+    }
+}
+
+namespace notestore
+{
+    std::optional<Fields> parseFields(const std::string &name)
+    {
+        std::string n = name;
+        std::transform(n.begin(), n.end(), n.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (n == "full")
+            return Fields::Full;
+        if (n == "nocontent")
+            return Fields::NoContent;
+        if (n == "titles")
+            return Fields::Titles;
+        return std::nullopt;
+    }
+
+    PageQuery PageQuery::fromJson(const json &query)
+    {
+        PageQuery page;
+        if (!query.is_object())
+            throw std::invalid_argument("A page query must be an object.");
+        if (query.contains("offset"))
+        {
+            if (!query["offset"].is_number_unsigned())
+                throw std::invalid_argument("offset must be a non-negative integer.");
+            page.offset = query["offset"].get<size_t>();
+        }
+        if (query.contains("limit"))
+        {
+            if (!query["limit"].is_number_unsigned())
+                throw std::invalid_argument("limit must be a non-negative integer.");
+            page.limit = query["limit"].get<size_t>();
+        }
+        if (query.contains("unitIds"))
+        {
+            if (!query["unitIds"].is_array())
+                throw std::invalid_argument("unitIds must be an array of strings.");
+            for (const json &unitId : query["unitIds"])
+            {
+                if (!unitId.is_string())
+                    throw std::invalid_argument("unitIds must be an array of strings.");
+                page.unitIds.push_back(unitId.get<std::string>());
+            }
+        }
+        if (query.contains("fields"))
+        {
+            std::optional<Fields> fields =
+                query["fields"].is_string() ? parseFields(query["fields"].get<std::string>()) : std::nullopt;
+            if (!fields)
+                throw std::invalid_argument("fields must be full, nocontent or titles.");
+            page.fields = *fields;
+        }
+        return page;
+    }
+
+    json PageQuery::toJson() const
+    {
+        json query = {{"offset", offset}, {"unitIds", unitIds}};
+        if (limit)
+            query["limit"] = *limit;
+        query["fields"] = fields == Fields::Titles ? "titles" : fields == Fields::NoContent ? "nocontent" : "full";
+        return query;
+    }
+
+    json page(const json &note, const PageQuery &query)
+    {
+        if (note.is_null())
+            return json::object();
+        if (!note.is_object())
+            return note;
+
+        json result = json::object();
+        for (const auto &[key, value] : note.items())
+        {
+            if (key != "units")
+                result[key] = value;
+        }
+        static const json noUnits = json::array();
+        const json &units = note.contains("units") && note["units"].is_array() ? note["units"] : noUnits;
+
+        json selected = json::array();
+        if (!query.unitIds.empty())
+        {
+            // First occurrence wins, as in the note log and NoteView::find()
+            std::unordered_map<std::string, size_t> index;
+            for (size_t i = 0; i < units.size(); i++)
+                index.emplace(unitIdOf(units[i]), i);
+            for (const std::string &unitId : query.unitIds)
+            {
+                auto it = index.find(unitId);
+                if (it != index.end())
+                    selected.push_back(project(units[it->second], query.fields));
+            }
+        }
+        else
+        {
+            auto [first, last] = range(query, units.size());
+            for (size_t i = first; i < last; i++)
+                selected.push_back(project(units[i], query.fields));
+        }
+        result["units"] = std::move(selected);
+        result["totalUnits"] = units.size();
+        return result;
+    }
+
+    json page(NoteView &view, const PageQuery &query)
+    {
+        if (!view.valid())
+            return json::object();
+        json result = view.meta();
+        if (!result.is_object())
+            return result;
+
+        // Content is only read back from the blob store when it is kept
+        auto unitAt = [&](size_t i)
+        {
+            return query.fields == Fields::Full ? view.unit(i) : project(view.storedUnit(i), query.fields);
+        };
+
+        json selected = json::array();
+        if (!query.unitIds.empty())
+        {
+            for (const std::string &unitId : query.unitIds)
+            {
+                if (std::optional<size_t> i = view.find(unitId))
+                    selected.push_back(unitAt(*i));
+            }
+        }
+        else
+        {
+            auto [first, last] = range(query, view.unitCount());
+            for (size_t i = first; i < last; i++)
+                selected.push_back(unitAt(i));
+        }
+        result["units"] = std::move(selected);
+        result["totalUnits"] = view.unitCount();
+        return result;
+    }
+}
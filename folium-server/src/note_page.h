@@ -0,0 +1,71 @@
+/**
+ * @file note_page.h
+ * @brief Selecting and projecting part of a big note's units.
+ *
+ * A PageQuery picks units either by position (offset and limit) or by unitId,
+ * and says which unit fields to keep:
+ *
+ *     Fields::Full       every field, content included
+ *     Fields::NoContent  every field but the content
+ *     Fields::Titles     unitId and title only (a table of contents)
+ *
+ * The result is the note's meta fields (title, ...) with the selected units
+ * and the note's total unit count:
+ *
+ *     { "title": ..., "units": [...], "totalUnits": 5000 }
+ *
+ * page() works on a parsed note or on a NoteView. From a view only the
+ * selected units are decoded, and their blobs are only read when the content
+ * is kept, so the cost follows the size of the page rather than of the note.
+ */
+
+#ifndef FOLSERV_NOTE_PAGE_H_
+#define FOLSERV_NOTE_PAGE_H_
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "note_view.h"
+
+namespace notestore
+{
+    enum class Fields
+    {
+        Full,
+        NoContent,
+        Titles,
+    };
+
+    struct PageQuery
+    {
+        size_t offset = 0;
+        std::optional<size_t> limit;      // nullopt: to the end of the note
+        std::vector<std::string> unitIds; // if set, these units in this order instead of offset/limit
+        Fields fields = Fields::Full;
+
+        /// @brief Reads a query from {"offset", "limit", "unitIds", "fields"}; every key is optional.
+        /// @throws std::invalid_argument if a key has the wrong type or an unknown fields name.
+        static PageQuery fromJson(const nlohmann::json &query);
+
+        nlohmann::json toJson() const;
+    };
+
+    /// @brief Parses a fields name: "full", "nocontent" or "titles" (any case).
+    /// @return The projection, or nullopt if the name is not one of these.
+    std::optional<Fields> parseFields(const std::string &name);
+
+    /// @brief Selects a page of a parsed note. Unknown unitIds are skipped.
+    /// @return The page, or an empty object if the note is null.
+    nlohmann::json page(const nlohmann::json &note, const PageQuery &query);
+
+    /// @brief Selects a page of a note file, decoding only the selected units.
+    /// @throws std::runtime_error if a kept unit's blob is missing.
+    /// @return The page, or an empty object if the file is empty or not valid JSON.
+    nlohmann::json page(NoteView &view, const PageQuery &query);
+}
+
+#endif // FOLSERV_NOTE_PAGE_H_
@@ -0,0 +1,567 @@
+#include "note_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#include "core.h"
+#include "data_access_layer.h"
+#include "file_engine.h"
+#include "line_diff.h"
+#include "logger.h"
+#include "near_duplicate.h"
+#include "note_actor.h"
+#include "note_buffer.h"
+#include "note_history.h"
+#include "note_page.h"
+#include "note_store.h"
+#include "search_index.h"
+
+using json = nlohmann::json;
+
+static logger::Logger pipelineLogger("note-pipeline");
+
+namespace
+{
+    // Final statuses kept for status() lookups.
+    constexpr size_t kFinishedStatuses = 4096;
+
+    // Classes whose recent uploads are remembered for dedupe, least recently uploaded to dropped first.
+    constexpr size_t kRecentClasses = 1024;
+
+    // The text of a unit's content: plain text, or the "content" of an upload's {"title", "content"}
+    // document, which is then left in @p document. nullopt for other JSON, which is not merged by line.
+    std::optional<std::string> mergeableText(const std::string &content, json &document)
+    {
+        size_t first = content.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos || (content[first] != '{' && content[first] != '['))
+            return content;
+        document = json::parse(content, nullptr, false);
+        if (!document.is_object() || !document.contains("content") || !document["content"].is_string())
+            return std::nullopt;
+        for (const auto &[key, value] : document.items())
+        {
+            if (key != "title" && key != "content")
+                return std::nullopt;
+        }
+        return document["content"].get<std::string>();
+    }
+
+    void recordUpload(const std::string &notePath, int classId, int userId, const std::string &message,
+                      const json &records)
+    {
+        try
+        {
+            notehistory::record(notePath, userId, message, records,
+                                [&]() { return *Core::NoteBuffer::instance().read(classId, notePath); });
+        }
+        catch (const std::exception &e)
+        {
+            // The unit is merged already; a missing version is not worth failing the upload for
+            pipelineLogger.logErr("Failed to record history of " + notePath + ": " + e.what());
+        }
+    }
+
+    // Bumps notes.updated_at and indexes the merged unit for search. Runs in the same actor job as
+    // the merge, so neither can land after a later edit of the class.
+    void markUpdated(int classId, const std::string &uploadId, const json &unit)
+    {
+        DAL::bumpNoteVersion(classId);
+
+        try
+        {
+            searchindex::update(classId, unit);
+        }
+        catch (const std::exception &e)
+        {
+            pipelineLogger.logErr("Failed to index upload " + uploadId + " for search: " + e.what());
+        }
+    }
+}
+
+namespace Core
+{
+    struct NotePipeline::Stages
+    {
+        pipeline::Pipe<StagedUpload> staged;
+        pipeline::Pipe<DecodedUpload> decoded;
+        pipeline::Pipe<NormalizedUpload> normalized;
+        pipeline::Pipe<NormalizedUpload> unique;
+        pipeline::Pipe<MergedUpload> merged;
+
+        pipeline::Filter<StagedUpload, DecodedUpload> decode;
+        pipeline::Filter<DecodedUpload, NormalizedUpload> normalize;
+        pipeline::Filter<NormalizedUpload, NormalizedUpload> dedupe;
+        pipeline::Filter<NormalizedUpload, MergedUpload> merge;
+        pipeline::Filter<MergedUpload, MergedUpload> persist;
+
+        Stages(NotePipeline &p, unsigned decodeWorkers)
+            : decode("decode", [&p](StagedUpload &u) { return std::optional(p.decode(u)); }, staged, &decoded,
+                     decodeWorkers, [&p](StagedUpload &u, const std::exception &e) { p.fail(u, "", e); }),
+              normalize("normalize", [&p](DecodedUpload &u) { return std::optional(p.normalize(u)); }, decoded,
+                        &normalized, 1, [&p](DecodedUpload &u, const std::exception &e) { p.fail(u.staged, "", e); }),
+              dedupe("dedupe", [&p](NormalizedUpload &u) { return p.dedupe(u); }, normalized, &unique, 1,
+                     [&p](NormalizedUpload &u, const std::exception &e) { p.fail(u.staged, u.hash, e); }),
+              merge("merge", [&p](NormalizedUpload &u) { return std::optional(p.merge(u)); }, unique, &merged, 1,
+                    [&p](NormalizedUpload &u, const std::exception &e) { p.fail(u.staged, u.hash, e); }),
+              persist("persist",
+                      [&p](MergedUpload &u)
+                      {
+                          p.persist(u);
+                          return std::optional(std::move(u));
+                      },
+                      merged, nullptr, 1,
+                      [&p](MergedUpload &u, const std::exception &e) { p.fail(u.upload.staged, u.upload.hash, e); })
+        {
+        }
+
+        // Lets every queued upload through, then stops the threads.
+        void drain()
+        {
+            staged.close();
+            decode.join();
+            normalize.join();
+            dedupe.join();
+            merge.join();
+            persist.join();
+        }
+
+        std::vector<pipeline::StageStats> stats() const
+        {
+            return {decode.stats(), normalize.stats(), dedupe.stats(), merge.stats(), persist.stats()};
+        }
+    };
+
+    NotePipeline &NotePipeline::instance()
+    {
+        static NotePipeline pipeline;
+        return pipeline;
+    }
+
+    NotePipeline::~NotePipeline()
+    {
+        stop();
+    }
+
+    void NotePipeline::start(const NotePipelineOptions &options)
+    {
+        std::lock_guard<std::mutex> lock(stagesMutex_);
+        if (stages_)
+            return;
+        {
+            std::lock_guard<std::mutex> optionsLock(optionsMutex_);
+            options_ = std::make_shared<const NotePipelineOptions>(options);
+        }
+        stages_ = std::make_unique<Stages>(*this, std::max(1u, options.decodeWorkers));
+
+        std::vector<StagedUpload> resumed = leftovers();
+        for (const StagedUpload &upload : resumed)
+        {
+            setStatus(upload, {{"status", "staged"}});
+            stages_->staged.send(upload);
+        }
+        pipelineLogger.log("Note pipeline started, resumed " + std::to_string(resumed.size()) + " staged uploads");
+    }
+
+    void NotePipeline::stop()
+    {
+        std::unique_ptr<Stages> stages;
+        {
+            std::lock_guard<std::mutex> lock(stagesMutex_);
+            stages = std::move(stages_);
+        }
+        if (!stages)
+            return;
+        stages->drain();
+        for (const pipeline::StageStats &stage : stages->stats())
+        {
+            pipelineLogger.logS("Stage ", stage.name, ": ", stage.processed, " processed, ", stage.dropped,
+                                " dropped, ", stage.failed, " failed");
+        }
+    }
+
+    std::string NotePipeline::submitFile(int classId, int userId, const std::string &filePath, const std::string &title)
+    {
+        // Ids sort in staging order, so leftovers resume in the order they arrived.
+        char id[48];
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+        std::snprintf(id, sizeof(id), "%013lld-%06llu", static_cast<long long>(now.count()),
+                      static_cast<unsigned long long>(nextId_++ % 1000000));
+
+        const std::string dir = options()->stagingDir + "/staged";
+        StagedUpload upload{id, classId, userId, title, dir + "/" + id + ".upload"};
+        std::filesystem::create_directories(dir);
+        // Copied in the kernel, whatever the size of the upload
+        const std::string partial = upload.path + ".tmp";
+        std::filesystem::copy_file(filePath, partial, std::filesystem::copy_options::overwrite_existing);
+        fileio::fsync(partial);
+        fileio::rename(partial, upload.path);
+        // The metadata goes last: an upload without it never finished staging.
+        fileio::writeAtomic(dir + "/" + upload.id + ".json",
+                            json{{"classId", classId}, {"userId", userId}, {"title", title}}.dump());
+        setStatus(upload, {{"status", "staged"}});
+
+        {
+            std::lock_guard<std::mutex> lock(stagesMutex_);
+            if (stages_ && stages_->staged.send(upload))
+                return upload.id;
+        }
+        runInline(upload);
+        return upload.id;
+    }
+
+    void NotePipeline::runInline(const StagedUpload &staged)
+    {
+        StagedUpload upload = staged;
+        std::string hash;
+        try
+        {
+            DecodedUpload decoded = decode(upload);
+            NormalizedUpload normalized = normalize(decoded);
+            hash = normalized.hash;
+            std::optional<NormalizedUpload> unique = dedupe(normalized);
+            if (!unique)
+                return;
+            MergedUpload merged = merge(*unique);
+            persist(merged);
+        }
+        catch (const std::exception &e)
+        {
+            fail(upload, hash, e);
+            throw;
+        }
+    }
+
+    NotePipeline::DecodedUpload NotePipeline::decode(StagedUpload &upload)
+    {
+        return {upload, noteingest::detect(upload.path)};
+    }
+
+    NotePipeline::NormalizedUpload NotePipeline::normalize(DecodedUpload &upload)
+    {
+        NormalizedUpload normalized;
+        normalized.staged = std::move(upload.staged);
+        normalized.contentPath = options()->stagingDir + "/staged/" + normalized.staged.id + ".unit";
+        normalized.hash = noteingest::normalize(normalized.staged.path, normalized.contentPath, upload.format).hash;
+        return normalized;
+    }
+
+    std::optional<NotePipeline::NormalizedUpload> NotePipeline::dedupe(NormalizedUpload &upload)
+    {
+        {
+            const size_t recentUploads = options()->recentUploads;
+            std::lock_guard<std::mutex> lock(recentMutex_);
+            std::deque<std::string> &recent = recentFor(upload.staged.classId);
+            if (std::find(recent.begin(), recent.end(), upload.hash) == recent.end())
+            {
+                recent.push_back(upload.hash);
+                while (recent.size() > recentUploads)
+                    recent.pop_front();
+                return nearDuplicate(upload);
+            }
+        }
+        pipelineLogger.log("Upload " + upload.staged.id + " repeats a recent upload of class " +
+                           std::to_string(upload.staged.classId) + ", dropped");
+        removeStaged(upload.staged);
+        setStatus(upload.staged, {{"status", "duplicate"}});
+        return std::nullopt;
+    }
+
+    // Compares the upload with the units of its class's big note.
+    std::optional<NotePipeline::NormalizedUpload> NotePipeline::nearDuplicate(NormalizedUpload &upload)
+    {
+        // Repeats were dropped on their hash alone; from here on the content is needed
+        upload.content = DAL::readFile(upload.contentPath);
+        const int classId = upload.staged.classId;
+        std::shared_ptr<const NotePipelineOptions> options = this->options();
+        std::optional<neardup::Match> match;
+        try
+        {
+            match = neardup::nearest(classId, searchindex::unitText({{"content", upload.content}}), [classId]() {
+                std::string notePath = DAL::getNotePathForClass(classId);
+                return notePath.empty() ? json() : *NoteBuffer::instance().read(classId, notePath);
+            }, options->similar);
+        }
+        catch (const std::exception &e)
+        {
+            // Checking is best effort; the upload is merged either way
+            pipelineLogger.logWarn("Near-duplicate check of upload " + upload.staged.id + " failed: " + e.what());
+        }
+        if (!match)
+            return std::move(upload);
+
+        upload.similarTo = {{"unitId", match->unitId}, {"similarity", match->similarity}};
+        if (match->similarity < options->nearDuplicate)
+            return std::move(upload);
+
+        pipelineLogger.log("Upload " + upload.staged.id + " nearly repeats unit " + match->unitId + " of class " +
+                           std::to_string(classId) + ", dropped");
+        removeStaged(upload.staged);
+        setStatus(upload.staged, {{"status", "duplicate"}, {"similarTo", upload.similarTo}});
+        return std::nullopt;
+    }
+
+    NotePipeline::MergedUpload NotePipeline::merge(NormalizedUpload &upload)
+    {
+        MergedUpload merged;
+        merged.upload = std::move(upload);
+        // Bound after the move; upload.staged is empty now
+        const StagedUpload &staged = merged.upload.staged;
+        const std::string &content = merged.upload.content;
+        const std::string noteTitle = staged.title.empty() ? "Note Collection" : staged.title;
+        const std::string unitTitle = staged.title.empty() ? "Uploaded Note" : staged.title;
+
+        merged.notePath = DAL::getNotePathForClass(staged.classId);
+        if (merged.notePath.empty())
+        {
+            // Create a new note if none exists
+            merged.unit = {{"unitId", "unit_1"}, {"title", unitTitle}, {"content", content}};
+            json newNote = {{"title", unitTitle}, {"units", json::array({merged.unit})}};
+            createBigNote(staged.classId, staged.userId, newNote.dump(), unitTitle);
+            merged.notePath = DAL::getNotePathForClass(staged.classId);
+            return merged;
+        }
+
+        // Appended on the class's actor, so the unit and its history version go in the same order
+        // as the class's other edits; the buffer appends just this unit to the file later
+        NoteActor::instance().run(staged.classId, [&]() {
+            if (!merged.upload.similarTo.is_null() && mergeIntoSimilar(merged))
+                return json(true);
+            NoteBuffer::instance().appendUnit(staged.classId, merged.notePath, noteTitle,
+                                              [&](const json &existingJson, const NoteBuffer::UnitIndex &unitIds) {
+                // Generate a unique unit ID; deleted units can leave the count behind a used one
+                size_t units = existingJson.is_object() && existingJson.contains("units") && existingJson["units"].is_array()
+                             ? existingJson["units"].size() : 0;
+                size_t next = units + 1;
+                while (unitIds.count("unit_" + std::to_string(next)))
+                {
+                    next++;
+                }
+                merged.unit = {{"unitId", "unit_" + std::to_string(next)}, {"title", unitTitle}, {"content", content}};
+                merged.position = units;
+                return merged.unit;
+            }, content.size());
+            // Before the next upload's dedupe can look for it
+            neardup::update(staged.classId, merged.unit);
+
+            markUpdated(staged.classId, staged.id, merged.unit);
+            recordUpload(merged.notePath, staged.classId, staged.userId,
+                         "Uploaded " + merged.unit.value("title", std::string("note")),
+                         json::array({notestore::record::append(merged.position, merged.unit)}));
+            return json(true);
+        });
+        return merged;
+    }
+
+    // Folds a similar upload into the unit it resembles: lines only the upload has are added to the
+    // unit, the rest of the unit is kept, and regions both changed are reported. Runs on the class's
+    // actor. false if either side is structured JSON; the upload is then appended as a unit.
+    bool NotePipeline::mergeIntoSimilar(MergedUpload &merged)
+    {
+        const StagedUpload &staged = merged.upload.staged;
+        const std::string unitId = merged.upload.similarTo.value("unitId", "");
+        notestore::PageQuery query;
+        query.unitIds = {unitId};
+        json page = NoteBuffer::instance().readPage(staged.classId, merged.notePath, 0, query);
+        // The unit may have been deleted since dedupe matched it
+        if (!page.contains("units") || page["units"].empty() || !page["units"][0].value("content", json()).is_string())
+            return false;
+
+        json unit = std::move(page["units"][0]);
+        json ourDocument, theirDocument;
+        std::optional<std::string> ours = mergeableText(unit["content"].get<std::string>(), ourDocument);
+        std::optional<std::string> theirs = mergeableText(merged.upload.content, theirDocument);
+        if (!ours || !theirs)
+            return false;
+
+        linediff::MergeResult result = linediff::merge(*ours, *theirs);
+        merged.mergeConflicts = json::array();
+        for (const linediff::Conflict &conflict : result.conflicts)
+            merged.mergeConflicts.push_back(linediff::toJson(conflict));
+        merged.mergeConflictCount = result.conflictCount;
+        merged.unit = std::move(unit);
+        if (result.inserted == 0)
+            return true; // the upload adds nothing to the unit
+
+        if (ourDocument.is_object())
+        {
+            ourDocument["content"] = std::move(result.text);
+            merged.unit["content"] = ourDocument.dump(-1, ' ', false, json::error_handler_t::replace);
+        }
+        else
+        {
+            merged.unit["content"] = std::move(result.text);
+        }
+        const json &content = merged.unit["content"];
+        NoteBuffer::UnitEdit edit = NoteBuffer::instance().upsertUnit(staged.classId, merged.notePath, unitId,
+                                                                      {{"content", content}}, "",
+                                                                      content.get_ref<const std::string &>().size());
+        merged.position = edit.position;
+        neardup::update(staged.classId, merged.unit);
+        markUpdated(staged.classId, staged.id, merged.unit);
+        recordUpload(merged.notePath, staged.classId, staged.userId,
+                     "Merged an upload into " + unitId + " (" + std::to_string(result.inserted) + " lines)",
+                     json::array({edit.record}));
+        return true;
+    }
+
+    void NotePipeline::persist(MergedUpload &merged)
+    {
+        const StagedUpload &staged = merged.upload.staged;
+        // Only drop the staged copy once the merged note is on disk
+        NoteBuffer::instance().flush(staged.classId);
+        removeStaged(staged);
+        json status = {{"status", "merged"}, {"unitId", merged.unit.value("unitId", "")}};
+        if (!merged.upload.similarTo.is_null())
+            status["similarTo"] = merged.upload.similarTo;
+        if (!merged.mergeConflicts.is_null())
+        {
+            status["mergeConflicts"] = std::move(merged.mergeConflicts);
+            if (merged.mergeConflictCount > status["mergeConflicts"].size())
+                status["mergeConflictCount"] = merged.mergeConflictCount;
+        }
+        setStatus(staged, std::move(status));
+    }
+
+    void NotePipeline::fail(const StagedUpload &upload, const std::string &hash, const std::exception &error)
+    {
+        pipelineLogger.logErr("Upload " + upload.id + " of class " + std::to_string(upload.classId) +
+                              " failed: " + error.what());
+        if (!hash.empty())
+        {
+            // A retry of the same content must not be taken for a duplicate
+            std::lock_guard<std::mutex> lock(recentMutex_);
+            auto it = recent_.find(upload.classId);
+            if (it != recent_.end())
+            {
+                std::deque<std::string> &recent = it->second.hashes;
+                recent.erase(std::remove(recent.begin(), recent.end(), hash), recent.end());
+            }
+        }
+
+        // Kept for inspection, out of the way of the resume scan
+        std::error_code ec;
+        const std::string stagingDir = options()->stagingDir;
+        const std::string failedDir = stagingDir + "/failed";
+        std::filesystem::create_directories(failedDir, ec);
+        for (const char *suffix : {".upload", ".unit", ".json"})
+        {
+            std::filesystem::rename(stagingDir + "/staged/" + upload.id + suffix,
+                                    failedDir + "/" + upload.id + suffix, ec);
+        }
+        setStatus(upload, {{"status", "failed"}, {"error", error.what()}});
+    }
+
+    void NotePipeline::removeStaged(const StagedUpload &upload)
+    {
+        const std::string dir = options()->stagingDir + "/staged";
+        fileio::remove(dir + "/" + upload.id + ".json");
+        fileio::remove(upload.path);
+        fileio::remove(dir + "/" + upload.id + ".unit");
+    }
+
+    std::shared_ptr<const NotePipelineOptions> NotePipeline::options()
+    {
+        std::lock_guard<std::mutex> lock(optionsMutex_);
+        return options_;
+    }
+
+    // Recent mutex must be held. The recent uploads of a class, made the most recently used.
+    std::deque<std::string> &NotePipeline::recentFor(int classId)
+    {
+        auto [it, inserted] = recent_.try_emplace(classId);
+        if (inserted)
+        {
+            recentLru_.push_front(classId);
+            it->second.lruPos = recentLru_.begin();
+            while (recentLru_.size() > kRecentClasses)
+            {
+                recent_.erase(recentLru_.back());
+                recentLru_.pop_back();
+            }
+        }
+        else
+        {
+            recentLru_.splice(recentLru_.begin(), recentLru_, it->second.lruPos);
+        }
+        return it->second.hashes;
+    }
+
+    void NotePipeline::setStatus(const StagedUpload &upload, json status)
+    {
+        status["uploadId"] = upload.id;
+        status["classId"] = upload.classId;
+        const bool final = status["status"] != "staged";
+
+        std::lock_guard<std::mutex> lock(statusMutex_);
+        statuses_[upload.id] = std::move(status);
+        if (final)
+        {
+            finished_.push_back(upload.id);
+            while (finished_.size() > kFinishedStatuses)
+            {
+                statuses_.erase(finished_.front());
+                finished_.pop_front();
+            }
+        }
+    }
+
+    std::optional<json> NotePipeline::status(const std::string &uploadId)
+    {
+        std::lock_guard<std::mutex> lock(statusMutex_);
+        auto it = statuses_.find(uploadId);
+        if (it == statuses_.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    std::vector<pipeline::StageStats> NotePipeline::stats()
+    {
+        std::lock_guard<std::mutex> lock(stagesMutex_);
+        return stages_ ? stages_->stats() : std::vector<pipeline::StageStats>();
+    }
+
+    std::vector<NotePipeline::StagedUpload> NotePipeline::leftovers()
+    {
+        const std::string dir = options()->stagingDir + "/staged";
+        std::vector<StagedUpload> uploads;
+        if (!std::filesystem::exists(dir))
+            return uploads;
+
+        std::vector<std::filesystem::path> metas;
+        for (const auto &file : std::filesystem::directory_iterator(dir))
+        {
+            if (file.path().extension() == ".json")
+                metas.push_back(file.path());
+        }
+        std::sort(metas.begin(), metas.end());
+
+        for (const std::filesystem::path &metaPath : metas)
+        {
+            const std::string id = metaPath.stem().string();
+            const std::string path = dir + "/" + id + ".upload";
+            json meta = json::parse(DAL::readFile(metaPath.string()), nullptr, false);
+            if (meta.is_discarded() || !std::filesystem::exists(path))
+            {
+                pipelineLogger.logWarn("Dropping incomplete staged upload " + id);
+                fileio::remove(metaPath.string());
+                continue;
+            }
+            uploads.push_back({id, meta.value("classId", 0), meta.value("userId", 0), meta.value("title", ""), path});
+        }
+
+        // Raw bytes whose metadata never got written were never acknowledged; unit content is
+        // normalized again, and partial copies are of either
+        for (const auto &file : std::filesystem::directory_iterator(dir))
+        {
+            const std::filesystem::path extension = file.path().extension();
+            if (extension == ".tmp" || ((extension == ".upload" || extension == ".unit") &&
+                                        !std::filesystem::exists(dir + "/" + file.path().stem().string() + ".json")))
+                fileio::remove(file.path().string());
+        }
+        return uploads;
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ * @file note_pipeline.h
+ * @brief Background pipeline that merges uploaded notes into big notes.
+ *
+ * An upload is only staged on the request path: its raw bytes and who sent it
+ * are written durably under <stagingDir>/staged/, and the request returns an
+ * upload id. The rest runs off the request path, one stage per filter (see
+ * pipe_filter.h):
+ *
+ *     decode     check whether the staged file is JSON or plain text
+ *     normalize  write the unit content it becomes next to it, and its hash
+ *                (both stream the file, see note_ingest.h)
+ *     dedupe     drop an upload identical to a recent one of the same class, or nearly
+ *                identical to a unit of its big note (see near_duplicate.h); flag
+ *                one that is merely similar
+ *     merge      append it as a unit of the class's big note (creating the note), or
+ *                merge a similar upload's lines into that unit (see line_diff.h), then
+ *                bump notes.updated_at, record a history version and index it for
+ *                search, all in one job on the class's actor (see note_actor.h)
+ *     persist    write the note back and remove the staged files
+ *
+ * Every stage but decode runs on one thread, so the uploads of a class are
+ * merged in the order they were staged; extra decode workers trade that order
+ * for throughput on large uploads.
+ *
+ * An upload that fails in any stage is moved to <stagingDir>/failed/ and its
+ * status says why. Uploads still staged when the process died are picked up
+ * again by start().
+ *
+ * Before start() is called (and after stop()) uploads run through every stage
+ * inline, so tools and tests that call Core directly see the merged note as
+ * soon as uploadNote() returns.
+ */
+
+#ifndef FOLSERV_NOTE_PIPELINE_H_
+#define FOLSERV_NOTE_PIPELINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "note_ingest.h"
+#include "pipe_filter.h"
+
+namespace Core
+{
+    /**
+     * @brief Where uploads are staged and how the pipeline is sized.
+     */
+    struct NotePipelineOptions
+    {
+        std::string stagingDir = "uploads";
+        unsigned decodeWorkers = 1;  // more than one may reorder uploads
+        size_t recentUploads = 32;   // per class, remembered for dedupe
+        double nearDuplicate = 0.9;  // uploads at least this similar to a unit are dropped
+        double similar = 0.6;        // and at least this similar merged into the unit
+    };
+
+    class NotePipeline
+    {
+    public:
+        /// @brief An upload written durably to the staging directory.
+        struct StagedUpload
+        {
+            std::string id;
+            int classId = 0;
+            int userId = 0;
+            std::string title;
+            std::string path; // the raw bytes
+        };
+
+        /// @brief An upload whose format is known.
+        struct DecodedUpload
+        {
+            StagedUpload staged;
+            noteingest::Format format = noteingest::Format::Text;
+        };
+
+        /// @brief The unit content to merge and its hash.
+        struct NormalizedUpload
+        {
+            StagedUpload staged;
+            std::string contentPath; // the normalized unit content
+            std::string content;     // read from contentPath once the upload is not a repeat
+            std::string hash;
+            nlohmann::json similarTo; // {"unitId", "similarity"} of a similar unit, or null
+        };
+
+        /// @brief Where the upload landed in the big note.
+        struct MergedUpload
+        {
+            NormalizedUpload upload;
+            std::string notePath;
+            nlohmann::json unit;  // as appended, with its unitId
+            size_t position = 0;  // in the note's units
+            nlohmann::json mergeConflicts; // merged into a similar unit: regions kept from the unit, else null
+            size_t mergeConflictCount = 0; // all of them; mergeConflicts holds at most linediff::kMaxConflicts
+        };
+
+        /// @return The process-wide pipeline.
+        static NotePipeline &instance();
+
+        /// @brief Starts the stage threads and resumes uploads left staged by a previous run.
+        void start(const NotePipelineOptions &options = NotePipelineOptions());
+
+        /// @brief Stops taking uploads into the background and finishes every one already queued.
+        void stop();
+
+        /// @brief Stages a copy of the file at @p filePath durably and queues it; runs it inline if the
+        /// pipeline is not started. The file is copied, not read into memory.
+        /// @throws std::runtime_error if staging fails, or (inline only) if a stage fails.
+        /// @return The upload id, for status().
+        std::string submitFile(int classId, int userId, const std::string &filePath, const std::string &title);
+
+        /// @return {"uploadId", "classId", "status": "staged" | "merged" | "duplicate" | "failed", ...},
+        ///         with "unitId" once merged, "similarTo" for a near-duplicate or similar upload,
+        ///         "mergeConflicts" for one merged into the similar unit and "error" if failed;
+        ///         nullopt for an unknown id.
+        std::optional<nlohmann::json> status(const std::string &uploadId);
+
+        /// @return Counters of each stage, in pipeline order.
+        std::vector<pipeline::StageStats> stats();
+
+    private:
+        // The pipes and filters, alive while the pipeline is running.
+        struct Stages;
+
+        NotePipeline() = default;
+        ~NotePipeline();
+
+        DecodedUpload decode(StagedUpload &upload);
+        NormalizedUpload normalize(DecodedUpload &upload);
+        std::optional<NormalizedUpload> dedupe(NormalizedUpload &upload);
+        std::optional<NormalizedUpload> nearDuplicate(NormalizedUpload &upload);
+        MergedUpload merge(NormalizedUpload &upload);
+        bool mergeIntoSimilar(MergedUpload &merged);
+        void persist(MergedUpload &upload);
+        void runInline(const StagedUpload &upload);
+        void fail(const StagedUpload &upload, const std::string &hash, const std::exception &error);
+        void setStatus(const StagedUpload &upload, nlohmann::json status);
+        void removeStaged(const StagedUpload &upload);
+        std::vector<StagedUpload> leftovers();
+        std::shared_ptr<const NotePipelineOptions> options();
+        std::deque<std::string> &recentFor(int classId);
+
+        // Replaced whole by start(); readers keep the copy they took through options().
+        std::mutex optionsMutex_;
+        std::shared_ptr<const NotePipelineOptions> options_ = std::make_shared<const NotePipelineOptions>();
+
+        std::mutex stagesMutex_;
+        std::unique_ptr<Stages> stages_;
+        std::atomic<uint64_t> nextId_ = 0;
+
+        struct RecentUploads
+        {
+            std::deque<std::string> hashes;  // content hashes, newest last
+            std::list<int>::iterator lruPos; // guarded by recentMutex_
+        };
+        std::mutex recentMutex_;
+        std::unordered_map<int, RecentUploads> recent_;
+        std::list<int> recentLru_; // class ids, most recently uploaded to first
+
+        std::mutex statusMutex_;
+        std::unordered_map<std::string, nlohmann::json> statuses_;
+        std::deque<std::string> finished_; // ids with a final status, oldest first
+    };
+}
+
+#endif // FOLSERV_NOTE_PIPELINE_H_
@@ -0,0 +1,325 @@
+#include "note_store.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "blob_store.h"
+#include "data_access_layer.h"
+#include "file_engine.h"
+#include "logger.h"
+#include "note_view.h"
+
+using json = nlohmann::json;
+
+static logger::Logger storeLogger("note-store");
+
+namespace
+{
+    bool hasUnits(const json &note)
+    {
+        return note.is_object() && note.contains("units") && note["units"].is_array();
+    }
+
+    // Drops references once the version of the note that held them is gone.
+    void releaseAll(const std::unordered_map<std::string, int> &refs)
+    {
+        for (const auto &[hash, count] : refs)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                blobstore::release(hash);
+            }
+        }
+    }
+}
+
+namespace notestore
+{
+    std::string storeUnit(json &unit)
+    {
+        if (!unit.is_object() || !unit.contains("content") || !unit["content"].is_string())
+            return "";
+        const std::string &content = unit["content"].get_ref<const std::string &>();
+        if (content.size() < kMinBlobSize)
+            return "";
+        std::string hash = blobstore::put(content);
+        unit["size"] = content.size();
+        unit.erase("content");
+        unit["blob"] = hash;
+        return hash;
+    }
+
+    void hydrateUnit(json &unit)
+    {
+        if (!unit.is_object() || !unit.contains("blob") || !unit["blob"].is_string())
+            return;
+        std::string content = blobstore::get(unit["blob"].get<std::string>());
+        unit.erase("blob");
+        unit.erase("size");
+        unit["content"] = std::move(content);
+    }
+
+    json load(const std::string &path, FileInfo *info)
+    {
+        NoteView view(path);
+        if (info)
+        {
+            info->log = view.appendable();
+            info->appended = view.appendedRecords();
+        }
+        json note = view.stored();
+        if (!hasUnits(note))
+            return note;
+
+        // Fetch every referenced blob in one batch.
+        std::vector<json *> units;
+        std::vector<std::string> hashes;
+        for (json &unit : note["units"])
+        {
+            if (unit.is_object() && unit.contains("blob") && unit["blob"].is_string())
+            {
+                units.push_back(&unit);
+                hashes.push_back(unit["blob"].get<std::string>());
+            }
+        }
+        if (hashes.empty())
+            return note;
+
+        std::vector<std::string> contents;
+        try
+        {
+            contents = blobstore::getMany(hashes);
+        }
+        catch (const std::exception &e)
+        {
+            storeLogger.logErr("Missing unit content for " + path + ": " + e.what());
+            throw std::runtime_error("Note " + path + " references missing unit content.");
+        }
+        for (size_t i = 0; i < units.size(); i++)
+        {
+            json &unit = *units[i];
+            unit.erase("blob");
+            unit.erase("size");
+            unit["content"] = std::move(contents[i]);
+        }
+        return note;
+    }
+
+    void save(const std::string &path, const json &note)
+    {
+        // References held by the version currently on disk, replaced units included.
+        std::unordered_map<std::string, int> previous;
+        if (std::filesystem::exists(path))
+        {
+            previous = NoteView(path).heldBlobs();
+        }
+
+        json stored = note;
+        if (hasUnits(stored))
+        {
+            for (json &unit : stored["units"])
+            {
+                if (!unit.is_object() || !unit.contains("content") || !unit["content"].is_string())
+                    continue;
+                const std::string &content = unit["content"].get_ref<const std::string &>();
+                if (content.size() < kMinBlobSize)
+                    continue;
+
+                // Unchanged units keep the reference they already hold.
+                std::string hash = blobstore::hashOf(content);
+                auto it = previous.find(hash);
+                if (it != previous.end() && it->second > 0)
+                {
+                    it->second--;
+                }
+                else
+                {
+                    blobstore::put(content);
+                }
+                unit["size"] = content.size();
+                unit.erase("content");
+                unit["blob"] = hash;
+            }
+        }
+
+        DAL::writeFile(path, encodeSnapshot(stored));
+
+        // Only drop old references once the new version is durable.
+        releaseAll(previous);
+    }
+
+    void append(const std::string &path, const json &units, size_t firstIndex)
+    {
+        json records = json::array();
+        for (size_t i = 0; i < units.size(); i++)
+        {
+            records.push_back(record::append(firstIndex + i, units[i]));
+        }
+        appendRecords(path, records);
+    }
+
+    void appendRecords(const std::string &path, const json &records)
+    {
+        // The leading newline ends a record torn by an earlier crash.
+        std::string lines = "\n";
+        std::vector<std::string> taken;
+        try
+        {
+            for (json stored : records)
+            {
+                for (const char *key : {"unit", "set", "insert"})
+                {
+                    if (!stored.contains(key))
+                        continue;
+                    std::string hash = storeUnit(stored[key]);
+                    if (!hash.empty())
+                        taken.push_back(std::move(hash));
+                }
+                lines += stored.dump();
+                lines += '\n';
+            }
+            DAL::appendFile(path, lines);
+        }
+        catch (...)
+        {
+            // Records that never reached the file hold nothing.
+            for (const std::string &hash : taken)
+                blobstore::release(hash);
+            throw;
+        }
+    }
+
+    void compact(const std::string &path)
+    {
+        json stored;
+        std::unordered_map<std::string, int> held;
+        size_t appended;
+        {
+            NoteView view(path);
+            appended = view.appendedRecords();
+            if (!view.appendable() || appended == 0)
+                return;
+            held = view.heldBlobs();
+            stored = view.stored();
+        }
+        DAL::writeFile(path, encodeSnapshot(stored));
+
+        // Units replaced, deleted or appended twice by a retry no longer need their blobs.
+        if (hasUnits(stored))
+        {
+            for (const json &unit : stored["units"])
+            {
+                if (unit.is_object() && unit.contains("blob") && unit["blob"].is_string())
+                    held[unit["blob"].get<std::string>()]--;
+            }
+        }
+        std::erase_if(held, [](const auto &ref) { return ref.second <= 0; });
+        releaseAll(held);
+        storeLogger.logDebug("Compacted " + std::to_string(appended) + " records into " + path);
+    }
+
+    namespace record
+    {
+        json append(size_t position, json unit)
+        {
+            return {{"n", position}, {"unit", std::move(unit)}};
+        }
+
+        json set(json unit)
+        {
+            return {{"set", std::move(unit)}};
+        }
+
+        json insert(size_t position, json unit)
+        {
+            return {{"insert", std::move(unit)}, {"at", position}};
+        }
+
+        json remove(const std::string &unitId)
+        {
+            return {{"delete", unitId}};
+        }
+
+        json title(const std::string &title)
+        {
+            return {{"title", title}};
+        }
+    }
+
+    std::string pathFor(int classId, const std::string &root)
+    {
+        const std::string name = "class_" + std::to_string(classId) + "_note.fol";
+        const std::string hash = blobstore::hashOf(name);
+        return root + "/" + hash.substr(0, 2) + "/" + hash.substr(2, 2) + "/" + name;
+    }
+
+    int classIdOf(const std::string &name)
+    {
+        const std::string prefix = "class_";
+        for (const std::string suffix : {"_note.fol", "_note.json"})
+        {
+            if (name.size() <= prefix.size() + suffix.size() || name.rfind(prefix, 0) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+                continue;
+            const std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+            if (digits.size() > 9 || digits.find_first_not_of("0123456789") != std::string::npos)
+                return 0;
+            return std::stoi(digits);
+        }
+        return 0;
+    }
+
+    size_t migrateLayout(const std::string &root)
+    {
+        if (!std::filesystem::is_directory(root))
+            return 0;
+
+        // Link every flat note into its hashed directory.
+        std::vector<std::pair<std::string, std::string>> moves;
+        for (const auto &entry : std::filesystem::directory_iterator(root))
+        {
+            const std::string name = entry.path().filename().string();
+            int classId = classIdOf(name);
+            if (!entry.is_regular_file() || classId <= 0)
+                continue;
+
+            const std::string from = root + "/" + name;
+            const std::string to = pathFor(classId, root);
+            std::filesystem::create_directories(std::filesystem::path(to).parent_path());
+            std::error_code ec;
+            std::filesystem::create_hard_link(from, to, ec);
+            if (ec == std::errc::file_exists)
+            {
+                // Linked by an interrupted run, or another note is in the way.
+                if (!std::filesystem::equivalent(from, to) && fileio::read(from) != fileio::read(to))
+                    throw std::runtime_error("Cannot move " + from + ": " + to + " exists with other content");
+            }
+            else if (ec)
+            {
+                throw std::runtime_error("Cannot link " + from + " to " + to + ": " + ec.message());
+            }
+            moves.push_back({from, to});
+        }
+        if (moves.empty())
+            return 0;
+
+        DAL::updateNotePaths(moves);
+
+        // Histories (see note_history.h) are found next to their note; nothing else points at them.
+        // Moved before the old names go, so a rerun after a crash still finds every note to finish.
+        for (const auto &[from, to] : moves)
+        {
+            if (std::filesystem::is_directory(from + ".history"))
+                std::filesystem::rename(from + ".history", to + ".history");
+        }
+        for (const auto &[from, to] : moves)
+        {
+            fileio::remove(from);
+        }
+        storeLogger.log("Moved " + std::to_string(moves.size()) + " notes into hashed directories under " + root);
+        return moves.size();
+    }
+}
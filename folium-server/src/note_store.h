@@ -0,0 +1,150 @@
+/**
+ * @file note_store.h
+ * @brief On-disk representation of big notes.
+ *
+ * Callers (Core, the write-behind buffer) always work with fully hydrated notes:
+ *
+ *     { "title": ..., "units": [ { "unitId": ..., "title": ..., "content": "..." }, ... ] }
+ *
+ * On disk, unit content of at least kMinBlobSize bytes is moved into the
+ * content-addressed blob store (see blob_store.h) and the unit only keeps its
+ * metadata plus the blob hash:
+ *
+ *     { "unitId": ..., "title": ..., "blob": "<sha256>", "size": 1234 }
+ *
+ * Notes written before the blob store existed (inline content) load unchanged
+ * and are converted the next time they are saved.
+ *
+ * Note files are append-only logs: a binary snapshot of the note as of the last
+ * save or compaction (see note_view.h), followed by one JSON record per line:
+ *
+ *     {"n": 41, "unit": { ... }}                  unit appended at position 41
+ *     {"set": { "unitId": "unit_7", ... }}        unit_7 replaced
+ *     {"insert": { ... }, "at": 3}                unit inserted at position 3
+ *     {"delete": "unit_7"}                        unit_7 removed
+ *     {"title": "..."}                            title change
+ *
+ * append() adds a unit by writing only its record, so an upload costs the same
+ * whether the note has ten units or ten thousand; appendRecords() does the same
+ * for edits of a single unit. Loading replays the records on top of the
+ * snapshot, finding units by unitId. Every record can be replayed twice without
+ * effect, so a retried append is harmless, and a record torn by a crash is
+ * skipped. compact() folds the records back into the snapshot and releases the
+ * blobs of replaced and deleted units; the write-behind buffer runs it in the
+ * background once kCompactAfter records have piled up. Files from older
+ * versions (a single JSON document, or a log with a JSON text snapshot) still
+ * load and get a binary snapshot on their next save.
+ *
+ * NoteView reads the title or single units of a note file without loading the
+ * rest.
+ *
+ * Note files are fanned out over two levels of hashed directories,
+ * notes/ab/cd/class_<id>_note.fol, so no directory grows past a few entries
+ * even with hundreds of thousands of classes. The .fol extension marks the
+ * binary format; notes created before it are named class_<id>_note.json and
+ * load the same. migrateLayout() moves notes from the old flat notes/ directory,
+ * .json or .fol, to their pathFor() name, which always ends in .fol, and
+ * repoints the notes table; .json notes already in hashed directories keep
+ * their name, as the table points at it.
+ */
+
+#ifndef FOLSERV_NOTE_STORE_H_
+#define FOLSERV_NOTE_STORE_H_
+
+#include <cstddef>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+namespace notestore
+{
+    // Unit content shorter than this stays inline; a blob would cost more than it saves.
+    constexpr size_t kMinBlobSize = 128;
+
+    // Appended records a note may collect before it is worth compacting.
+    constexpr size_t kCompactAfter = 512;
+
+    /**
+     * @brief What load() found on disk.
+     */
+    struct FileInfo
+    {
+        bool log = false;    // false for empty files and single-document files from older versions
+        size_t appended = 0; // records appended since the last save or compaction
+    };
+
+    /// @brief Moves a hydrated unit's large content into the blob store, taking a new reference.
+    /// @return The hash the reference was taken on, empty if the content stays inline.
+    std::string storeUnit(nlohmann::json &unit);
+
+    /// @brief Reads a stored unit's content back from the blob store.
+    /// @throws std::runtime_error if the referenced blob is missing.
+    void hydrateUnit(nlohmann::json &unit);
+
+    /// @brief Reads a note and pulls its unit content back out of the blob store.
+    /// @param info If set, receives the file's format and how many records it has appended.
+    /// @throws std::runtime_error if the file does not exist or a referenced blob is missing.
+    /// @return The hydrated note, or null if the file is empty or not valid JSON.
+    nlohmann::json load(const std::string &path, FileInfo *info = nullptr);
+
+    /// @brief Writes a note as a fresh log (binary snapshot, no records), storing large unit content as blobs.
+    /// Only units whose content changed since the last save touch the blob store.
+    /// @throws std::runtime_error on I/O failure.
+    void save(const std::string &path, const nlohmann::json &note);
+
+    /// @brief Appends units to a note that is already in the log format, without rewriting it.
+    /// @param units Hydrated units; large content goes to the blob store as in save().
+    /// @param firstIndex Position of the first unit in the note's units array.
+    /// @throws std::runtime_error on I/O failure.
+    void append(const std::string &path, const nlohmann::json &units, size_t firstIndex);
+
+    /// @brief Appends records built with the record:: functions below to a note in the log format.
+    /// Units in the records are hydrated; large content goes to the blob store as in save().
+    /// @throws std::runtime_error on I/O failure.
+    void appendRecords(const std::string &path, const nlohmann::json &records);
+
+    /// Log records for appendRecords(). Units are identified by their "unitId".
+    namespace record
+    {
+        /// @brief Adds @p unit at @p position, which must be the end of the note.
+        nlohmann::json append(size_t position, nlohmann::json unit);
+
+        /// @brief Replaces the unit with the same unitId as @p unit.
+        nlohmann::json set(nlohmann::json unit);
+
+        /// @brief Inserts @p unit before the unit at @p position, unless its unitId is already present.
+        nlohmann::json insert(size_t position, nlohmann::json unit);
+
+        /// @brief Deletes the unit with @p unitId.
+        nlohmann::json remove(const std::string &unitId);
+
+        /// @brief Renames the note.
+        nlohmann::json title(const std::string &title);
+    }
+
+    /// @brief Folds a log's appended records into its snapshot.
+    /// Blob references held only by replaced or deleted units are released.
+    /// @throws std::runtime_error on I/O failure.
+    void compact(const std::string &path);
+
+    /// @brief Where a class's note file lives: <root>/ab/cd/class_<id>_note.fol.
+    /// The two directory levels come from a hash of the class id.
+    std::string pathFor(int classId, const std::string &root = "notes");
+
+    /// @return The class id of a note file name, class_<id>_note.fol or the older
+    /// class_<id>_note.json, or 0 if @p name is not one.
+    int classIdOf(const std::string &name);
+
+    /// @brief Moves notes from the flat <root>/class_<id>_note.json layout into hashed directories.
+    ///
+    /// Each file is hard-linked into place, the notes table is repointed in one transaction,
+    /// each note's history directory follows it, and only then are the old names removed, so
+    /// a crash never leaves a row without a file. Run it while the server is stopped.
+    ///
+    /// @return The number of notes moved.
+    /// @throws std::runtime_error if a file cannot be linked, a different file already has its
+    /// new name, or the database update or a history move fails.
+    size_t migrateLayout(const std::string &root = "notes");
+}
+
+#endif // FOLSERV_NOTE_STORE_H_
@@ -0,0 +1,495 @@
+#include "note_view.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+
+static logger::Logger viewLogger("note-view");
+
+namespace
+{
+    constexpr char kMagic[8] = {'F', 'O', 'L', 'N', 'O', 'T', 'E', '2'};
+    const std::string kLogHeader = R"({"format":"folium-note-log","version":1})";
+
+    constexpr size_t npos = static_cast<size_t>(-1);
+    constexpr uint64_t kHasUnits = 1;
+
+    // Header fields, each a uint64_t after the magic.
+    enum HeaderField
+    {
+        kUnitCount,
+        kFlags,
+        kMetaOffset,
+        kMetaLength,
+        kTableOffset,
+        kSnapshotEnd,
+        kHeaderFields
+    };
+    constexpr size_t kHeaderSize = sizeof(kMagic) + kHeaderFields * sizeof(uint64_t);
+
+    // Table entry fields, each a uint64_t.
+    enum EntryField
+    {
+        kUnitOffset,
+        kUnitLength,
+        kIdOffset,
+        kIdLength,
+        kEntryFields
+    };
+    constexpr size_t kEntrySize = kEntryFields * sizeof(uint64_t);
+
+    uint64_t readU64(const char *at)
+    {
+        uint64_t value;
+        std::memcpy(&value, at, sizeof(value));
+        return value;
+    }
+
+    void writeU64(std::string &out, size_t at, uint64_t value)
+    {
+        std::memcpy(out.data() + at, &value, sizeof(value));
+    }
+
+    bool hasUnits(const json &note)
+    {
+        return note.is_object() && note.contains("units") && note["units"].is_array();
+    }
+
+    std::string unitIdOf(const json &unit)
+    {
+        return unit.is_object() && unit.contains("unitId") && unit["unitId"].is_string()
+                   ? unit["unitId"].get<std::string>()
+                   : std::string();
+    }
+
+    void countBlob(const json &unit, std::unordered_map<std::string, int> &refs)
+    {
+        if (unit.is_object() && unit.contains("blob") && unit["blob"].is_string())
+            refs[unit["blob"].get<std::string>()]++;
+    }
+}
+
+namespace notestore
+{
+    std::string encodeSnapshot(const json &stored)
+    {
+        const bool units = hasUnits(stored);
+        json meta = stored;
+        if (units)
+            meta.erase("units");
+        const std::vector<uint8_t> metaCbor = json::to_cbor(meta);
+
+        std::vector<std::vector<uint8_t>> bodies;
+        std::vector<std::string> ids;
+        size_t idBytes = 0;
+        if (units)
+        {
+            for (const json &unit : stored["units"])
+            {
+                bodies.push_back(json::to_cbor(unit));
+                ids.push_back(unitIdOf(unit));
+                idBytes += ids.back().size();
+            }
+        }
+
+        const size_t tableOffset = kHeaderSize;
+        const size_t metaOffset = tableOffset + bodies.size() * kEntrySize;
+        const size_t idsOffset = metaOffset + metaCbor.size();
+        size_t bodyOffset = idsOffset + idBytes;
+        size_t end = bodyOffset;
+        for (const auto &body : bodies)
+            end += body.size();
+
+        std::string out(end, '\0');
+        std::memcpy(out.data(), kMagic, sizeof(kMagic));
+        auto header = [&](HeaderField field, uint64_t value) {
+            writeU64(out, sizeof(kMagic) + field * sizeof(uint64_t), value);
+        };
+        header(kUnitCount, bodies.size());
+        header(kFlags, units ? kHasUnits : 0);
+        header(kMetaOffset, metaOffset);
+        header(kMetaLength, metaCbor.size());
+        header(kTableOffset, tableOffset);
+        header(kSnapshotEnd, end);
+        std::memcpy(out.data() + metaOffset, metaCbor.data(), metaCbor.size());
+
+        size_t idOffset = idsOffset;
+        for (size_t i = 0; i < bodies.size(); i++)
+        {
+            const size_t entry = tableOffset + i * kEntrySize;
+            writeU64(out, entry + kUnitOffset * sizeof(uint64_t), bodyOffset);
+            writeU64(out, entry + kUnitLength * sizeof(uint64_t), bodies[i].size());
+            writeU64(out, entry + kIdOffset * sizeof(uint64_t), idOffset);
+            writeU64(out, entry + kIdLength * sizeof(uint64_t), ids[i].size());
+            std::memcpy(out.data() + idOffset, ids[i].data(), ids[i].size());
+            std::memcpy(out.data() + bodyOffset, bodies[i].data(), bodies[i].size());
+            idOffset += ids[i].size();
+            bodyOffset += bodies[i].size();
+        }
+        return out;
+    }
+
+    NoteView::NoteView(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == ENOENT)
+                throw std::runtime_error("Note file does not exist at path: " + path);
+            throw std::runtime_error("Cannot open note " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            int err = errno;
+            ::close(fd);
+            throw std::runtime_error("Cannot stat note " + path + ": " + std::strerror(err));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0)
+        {
+            void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                int err = errno;
+                ::close(fd);
+                throw std::runtime_error("Cannot map note " + path + ": " + std::strerror(err));
+            }
+            data_ = static_cast<const char *>(mapped);
+        }
+        ::close(fd);
+
+        try
+        {
+            if (size_ == 0)
+            {
+                format_ = Format::Empty;
+            }
+            else if (size_ >= sizeof(kMagic) && std::memcmp(data_, kMagic, sizeof(kMagic)) == 0)
+            {
+                if (size_ < kHeaderSize)
+                    throw std::runtime_error("Corrupt note snapshot header.");
+                format_ = Format::Binary;
+                parseBinary();
+            }
+            else if (std::string_view(data_, size_).substr(0, kLogHeader.size()) == kLogHeader)
+            {
+                format_ = Format::TextLog;
+                parseRecords(kLogHeader.size());
+                // The first record of a text log is its snapshot.
+                if (!records_.empty())
+                {
+                    textSnapshot_ = std::move(records_.front());
+                    records_.erase(records_.begin());
+                }
+            }
+            else
+            {
+                format_ = Format::Document;
+                textSnapshot_ = json::parse(data_, data_ + size_, nullptr, false);
+            }
+        }
+        catch (...)
+        {
+            if (data_)
+                ::munmap(const_cast<char *>(data_), size_);
+            throw;
+        }
+
+        if (format_ != Format::Binary)
+        {
+            hasUnits_ = hasUnits(textSnapshot_);
+            if (hasUnits_)
+            {
+                for (const json &unit : textSnapshot_["units"])
+                    countBlob(unit, textHeld_);
+            }
+        }
+    }
+
+    NoteView::~NoteView()
+    {
+        if (data_)
+            ::munmap(const_cast<char *>(data_), size_);
+    }
+
+    void NoteView::parseBinary()
+    {
+        auto header = [&](HeaderField field) { return readU64(data_ + sizeof(kMagic) + field * sizeof(uint64_t)); };
+        const uint64_t units = header(kUnitCount);
+        const uint64_t tableOffset = header(kTableOffset);
+        const uint64_t end = header(kSnapshotEnd);
+        metaOffset_ = header(kMetaOffset);
+        metaLength_ = header(kMetaLength);
+        if (end > size_ || tableOffset > end || units > (end - tableOffset) / kEntrySize ||
+            metaOffset_ > end || metaLength_ > end - metaOffset_)
+        {
+            throw std::runtime_error("Corrupt note snapshot header.");
+        }
+        snapshotUnits_ = units;
+        hasUnits_ = (header(kFlags) & kHasUnits) != 0;
+        table_ = data_ + tableOffset;
+        for (size_t i = 0; i < snapshotUnits_; i++)
+        {
+            const char *entry = table_ + i * kEntrySize;
+            uint64_t offset = readU64(entry + kUnitOffset * sizeof(uint64_t));
+            uint64_t length = readU64(entry + kUnitLength * sizeof(uint64_t));
+            uint64_t idOffset = readU64(entry + kIdOffset * sizeof(uint64_t));
+            uint64_t idLength = readU64(entry + kIdLength * sizeof(uint64_t));
+            if (offset > end || length > end - offset || idOffset > end || idLength > end - idOffset)
+                throw std::runtime_error("Corrupt note snapshot table.");
+        }
+        parseRecords(end);
+    }
+
+    void NoteView::parseRecords(size_t from)
+    {
+        size_t pos = from;
+        while (pos < size_)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(data_ + pos, '\n', size_ - pos));
+            size_t end = lineEnd ? static_cast<size_t>(lineEnd - data_) : size_;
+            if (end > pos)
+            {
+                json record = json::parse(data_ + pos, data_ + end, nullptr, false);
+                if (record.is_discarded())
+                    viewLogger.logWarn("Skipping torn record in note log.");
+                else
+                    records_.push_back(std::move(record));
+            }
+            pos = end + 1;
+        }
+    }
+
+    bool NoteView::valid() const
+    {
+        return format_ == Format::Binary || !(textSnapshot_.is_null() || textSnapshot_.is_discarded());
+    }
+
+    json NoteView::meta() const
+    {
+        if (meta_)
+            return *meta_;
+        json meta;
+        if (format_ == Format::Binary)
+        {
+            meta = json::from_cbor(data_ + metaOffset_, data_ + metaOffset_ + metaLength_);
+        }
+        else if (textSnapshot_.is_object())
+        {
+            meta = json::object();
+            for (const auto &[key, value] : textSnapshot_.items())
+            {
+                if (key != "units" || !hasUnits_)
+                    meta[key] = value;
+            }
+        }
+        else if (valid())
+        {
+            meta = textSnapshot_;
+        }
+        for (const json &record : records_)
+        {
+            if (record.is_object() && record.contains("title") && meta.is_object())
+                meta["title"] = record["title"];
+        }
+        meta_ = meta;
+        return meta;
+    }
+
+    std::string NoteView::title() const
+    {
+        json note = meta();
+        return note.is_object() && note.contains("title") && note["title"].is_string() ? note["title"].get<std::string>()
+                                                                                     : std::string();
+    }
+
+    std::string_view NoteView::snapshotId(size_t i) const
+    {
+        const char *entry = table_ + i * kEntrySize;
+        return std::string_view(data_ + readU64(entry + kIdOffset * sizeof(uint64_t)),
+                                readU64(entry + kIdLength * sizeof(uint64_t)));
+    }
+
+    json NoteView::snapshotUnit(size_t i) const
+    {
+        const char *entry = table_ + i * kEntrySize;
+        const char *body = data_ + readU64(entry + kUnitOffset * sizeof(uint64_t));
+        return json::from_cbor(body, body + readU64(entry + kUnitLength * sizeof(uint64_t)));
+    }
+
+    std::string NoteView::slotId(const Slot &slot) const
+    {
+        return slot.snapshot == npos ? unitIdOf(slot.unit) : std::string(snapshotId(slot.snapshot));
+    }
+
+    std::optional<size_t> NoteView::findSlot(const std::string &unitId)
+    {
+        if (unitId.empty())
+            return std::nullopt;
+        if (!indexed_)
+        {
+            // First occurrence wins, as with a linear search.
+            index_.clear();
+            for (size_t i = 0; i < slots_->size(); i++)
+                index_.emplace(slotId((*slots_)[i]), i);
+            indexed_ = true;
+        }
+        auto it = index_.find(unitId);
+        return it == index_.end() ? std::nullopt : std::optional<size_t>(it->second);
+    }
+
+    // Lays out the current units: the snapshot's, then each appended record replayed on top.
+    // Snapshot units are referenced by index and only decoded when read.
+    void NoteView::buildSlots()
+    {
+        if (slots_)
+            return;
+        slots_.emplace();
+        std::vector<Slot> &slots = *slots_;
+        if (!hasUnits_)
+            return;
+        if (format_ == Format::Binary)
+        {
+            slots.reserve(snapshotUnits_);
+            for (size_t i = 0; i < snapshotUnits_; i++)
+                slots.push_back({i, json()});
+        }
+        else
+        {
+            for (json &unit : textSnapshot_["units"])
+                slots.push_back({npos, std::move(unit)});
+            textSnapshot_.erase("units");
+        }
+
+        for (const json &record : records_)
+        {
+            if (!record.is_object() || record.contains("title"))
+                continue;
+            if (record.contains("unit"))
+            {
+                size_t n = record.value("n", slots.size());
+                if (n == slots.size())
+                {
+                    slots.push_back({npos, record["unit"]});
+                    if (indexed_)
+                        index_.emplace(unitIdOf(record["unit"]), n);
+                }
+                else if (n > slots.size())
+                {
+                    viewLogger.logWarn("Note log skips from unit " + std::to_string(slots.size()) + " to " +
+                                       std::to_string(n) + ", ignoring the record.");
+                }
+                // n < size: a retried append that already landed.
+            }
+            else if (record.contains("set"))
+            {
+                std::optional<size_t> at = findSlot(unitIdOf(record["set"]));
+                if (at)
+                    slots[*at] = {npos, record["set"]};
+            }
+            else if (record.contains("insert"))
+            {
+                const json &unit = record["insert"];
+                if (findSlot(unitIdOf(unit)))
+                    continue; // a retried insert that already landed
+                size_t at = std::min<size_t>(record.value("at", slots.size()), slots.size());
+                slots.insert(slots.begin() + static_cast<std::ptrdiff_t>(at), {npos, unit});
+                indexed_ = false;
+            }
+            else if (record.contains("delete") && record["delete"].is_string())
+            {
+                std::optional<size_t> at = findSlot(record["delete"].get<std::string>());
+                if (at)
+                {
+                    slots.erase(slots.begin() + static_cast<std::ptrdiff_t>(*at));
+                    indexed_ = false;
+                }
+            }
+        }
+    }
+
+    size_t NoteView::unitCount()
+    {
+        buildSlots();
+        return slots_->size();
+    }
+
+    std::vector<std::string> NoteView::unitIds()
+    {
+        buildSlots();
+        std::vector<std::string> ids;
+        ids.reserve(slots_->size());
+        for (const Slot &slot : *slots_)
+            ids.push_back(slotId(slot));
+        return ids;
+    }
+
+    std::optional<size_t> NoteView::find(const std::string &unitId)
+    {
+        buildSlots();
+        return findSlot(unitId);
+    }
+
+    json NoteView::storedUnit(size_t i)
+    {
+        buildSlots();
+        const Slot &slot = slots_->at(i);
+        return slot.snapshot == npos ? slot.unit : snapshotUnit(slot.snapshot);
+    }
+
+    json NoteView::unit(size_t i)
+    {
+        json unit = storedUnit(i);
+        hydrateUnit(unit);
+        return unit;
+    }
+
+    json NoteView::stored()
+    {
+        if (!valid())
+            return json();
+        buildSlots();
+        json note = meta();
+        if (!hasUnits_)
+            return note;
+        json units = json::array();
+        for (const Slot &slot : *slots_)
+            units.push_back(slot.snapshot == npos ? slot.unit : snapshotUnit(slot.snapshot));
+        note["units"] = std::move(units);
+        return note;
+    }
+
+    std::unordered_map<std::string, int> NoteView::heldBlobs()
+    {
+        std::unordered_map<std::string, int> held = textHeld_;
+        if (format_ == Format::Binary)
+        {
+            for (size_t i = 0; i < snapshotUnits_; i++)
+                countBlob(snapshotUnit(i), held);
+        }
+        for (const json &record : records_)
+        {
+            if (!record.is_object())
+                continue;
+            for (const char *key : {"unit", "set", "insert"})
+            {
+                if (record.contains(key))
+                    countBlob(record[key], held);
+            }
+        }
+        return held;
+    }
+}
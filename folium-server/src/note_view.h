@@ -0,0 +1,142 @@
+/**
+ * @file note_view.h
+ * @brief Binary snapshot format for note files, and a lazy view over it.
+ *
+ * save() writes the snapshot of a note in a binary layout that can be mapped
+ * and read piecemeal:
+ *
+ *     header     magic "FOLNOTE2", unit count, flags and section offsets
+ *     table      per unit: offset and length of its CBOR, offset and length of its unitId
+ *     meta       CBOR of the note without its units (title and any other fields)
+ *     unitIds    the unitIds, back to back
+ *     units      CBOR of each stored unit (blob reference instead of large content)
+ *     records    appended JSON text records, one per line (see note_store.h)
+ *
+ * Integers are 64-bit in host byte order (little-endian on every target we build for).
+ *
+ * NoteView maps the file and decodes only what is asked for: the title costs
+ * the header and the meta block, finding a unit costs a scan of the unitIds,
+ * and reading it decodes one CBOR value and fetches one blob. Appended records
+ * are replayed on top of the snapshot without decoding the units they do not
+ * touch. CBOR converts to and from JSON losslessly, so load() returns exactly
+ * the note that was saved.
+ *
+ * Text files from older versions (a single JSON document, or a text log whose
+ * snapshot is a JSON line) are parsed whole and served through the same view.
+ */
+
+#ifndef FOLSERV_NOTE_VIEW_H_
+#define FOLSERV_NOTE_VIEW_H_
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace notestore
+{
+    /// @brief Encodes a stored note (unit content already moved to blobs) as a binary snapshot.
+    std::string encodeSnapshot(const nlohmann::json &stored);
+
+    class NoteView
+    {
+    public:
+        /// @brief Maps the note file at @p path.
+        /// @throws std::runtime_error if the file does not exist or cannot be mapped.
+        explicit NoteView(const std::string &path);
+        ~NoteView();
+
+        NoteView(const NoteView &) = delete;
+        NoteView &operator=(const NoteView &) = delete;
+
+        /// @return True if the file can be appended to (binary or text log), false for
+        ///         empty files and single JSON documents.
+        bool appendable() const { return format_ != Format::Document && format_ != Format::Empty; }
+
+        /// @return Records appended since the snapshot was written.
+        size_t appendedRecords() const { return records_.size(); }
+
+        /// @return False if the file is empty or not valid JSON (load() returns null for it).
+        bool valid() const;
+
+        /// @return The note without its units, e.g. {"title": ...}.
+        nlohmann::json meta() const;
+
+        /// @return The note's title, or an empty string if it has none.
+        std::string title() const;
+
+        /// @return The number of units in the note.
+        size_t unitCount();
+
+        /// @return The unitIds in order; units without one give an empty string.
+        std::vector<std::string> unitIds();
+
+        /// @return The position of the first unit with @p unitId, or nullopt.
+        std::optional<size_t> find(const std::string &unitId);
+
+        /// @return Unit @p i as stored, with large content still a blob reference.
+        nlohmann::json storedUnit(size_t i);
+
+        /// @return Unit @p i with its content read back from the blob store.
+        /// @throws std::runtime_error if the referenced blob is missing.
+        nlohmann::json unit(size_t i);
+
+        /// @return The whole note as stored, records replayed; null if not valid().
+        nlohmann::json stored();
+
+        /// @return How many references each blob has from this file, counting units that a
+        ///         later record replaced or deleted.
+        std::unordered_map<std::string, int> heldBlobs();
+
+    private:
+        enum class Format
+        {
+            Empty,
+            Document, // a single JSON document
+            TextLog,  // header line, JSON snapshot line, records
+            Binary,
+        };
+
+        // A unit of the current note: a snapshot unit by index, or one taken from a record.
+        struct Slot
+        {
+            size_t snapshot;     // index into the table, or npos
+            nlohmann::json unit; // set when snapshot == npos
+        };
+
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+        Format format_ = Format::Empty;
+
+        // Binary snapshot sections.
+        size_t snapshotUnits_ = 0;
+        bool hasUnits_ = false;
+        const char *table_ = nullptr;
+        size_t metaOffset_ = 0;
+        size_t metaLength_ = 0;
+
+        // Text formats are parsed whole; binary meta is decoded on demand.
+        nlohmann::json textSnapshot_;
+        std::unordered_map<std::string, int> textHeld_; // blobs of the text snapshot's units
+        mutable std::optional<nlohmann::json> meta_;
+        std::vector<nlohmann::json> records_;
+
+        std::optional<std::vector<Slot>> slots_;
+        std::unordered_map<std::string, size_t> index_;
+        bool indexed_ = false;
+
+        void parseBinary();
+        void parseRecords(size_t from);
+        void buildSlots();
+        std::string_view snapshotId(size_t i) const;
+        nlohmann::json snapshotUnit(size_t i) const;
+        std::string slotId(const Slot &slot) const;
+        std::optional<size_t> findSlot(const std::string &unitId);
+    };
+}
+
+#endif // FOLSERV_NOTE_VIEW_H_
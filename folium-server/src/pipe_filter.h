@@ -0,0 +1,214 @@
+/**
+ * @file pipe_filter.h
+ * @brief Typed pipe-and-filter building blocks for background processing.
+ *
+ * A Pipe<T> is a thread-safe queue between two stages. A Filter<In, Out>
+ * owns worker threads that take items from its input pipe, run the stage
+ * function on them and send the results to its output pipe:
+ *
+ *     Pipe<A> a; Pipe<B> b;
+ *     Filter<A, B> decode("decode", decodeFn, a, &b);
+ *     Filter<B, B> persist("persist", persistFn, b, nullptr); // last stage
+ *
+ * A stage function returns std::nullopt to drop an item (e.g. a duplicate).
+ * An exception thrown for an item is counted and passed to the filter's error
+ * handler; the worker carries on with the next item.
+ *
+ * Shutdown drains: close() the first pipe, then join() the filters in order.
+ * Each filter finishes what is queued, and its last worker to exit closes the
+ * filter's output pipe, so the close ripples down the pipeline.
+ *
+ * Every filter counts what it processed, dropped and failed, its backlog
+ * (items waiting in its input pipe) and the time its workers spent busy.
+ */
+
+#ifndef FOLSERV_PIPE_FILTER_H_
+#define FOLSERV_PIPE_FILTER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pipeline
+{
+    /**
+     * @brief Thread-safe FIFO queue between two stages.
+     */
+    template <typename T>
+    class Pipe
+    {
+    public:
+        /// @brief Adds an item; ignored once the pipe is closed.
+        /// @return False if the pipe is closed.
+        bool send(T item)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (closed_)
+                    return false;
+                queue_.push(std::move(item));
+            }
+            cv_.notify_one();
+            return true;
+        }
+
+        /// @brief Waits for the next item.
+        /// @return The item, or nullopt once the pipe is closed and empty.
+        std::optional<T> receive()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return !queue_.empty() || closed_; });
+            if (queue_.empty())
+                return std::nullopt;
+            T item = std::move(queue_.front());
+            queue_.pop();
+            return item;
+        }
+
+        /// @brief Refuses new items; receivers drain what is queued, then get nullopt.
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                closed_ = true;
+            }
+            cv_.notify_all();
+        }
+
+        /// @return Items waiting to be received.
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return queue_.size();
+        }
+
+    private:
+        std::queue<T> queue_;
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        bool closed_ = false;
+    };
+
+    /**
+     * @brief Counters of one filter.
+     */
+    struct StageStats
+    {
+        std::string name;
+        uint64_t processed = 0;   // items the stage function returned
+        uint64_t dropped = 0;     // of which it returned nullopt for
+        uint64_t failed = 0;      // items it threw for
+        size_t backlog = 0;       // items waiting in the input pipe
+        double busySeconds = 0;   // summed over workers
+    };
+
+    /**
+     * @brief A stage: worker threads applying a function between two pipes.
+     */
+    template <typename In, typename Out>
+    class Filter
+    {
+    public:
+        using Function = std::function<std::optional<Out>(In &)>;
+        using ErrorHandler = std::function<void(In &, const std::exception &)>;
+
+        /// @brief Starts @p workers threads reading @p in.
+        /// @param out Where results go; nullptr for the last stage, whose results are discarded.
+        /// @param onError Called with the item and the exception when @p function throws.
+        Filter(std::string name, Function function, Pipe<In> &in, Pipe<Out> *out, unsigned workers = 1,
+               ErrorHandler onError = nullptr)
+            : name_(std::move(name)), function_(std::move(function)), onError_(std::move(onError)), in_(in), out_(out),
+              running_(workers)
+        {
+            for (unsigned i = 0; i < workers; i++)
+                workers_.emplace_back(&Filter::run, this);
+        }
+
+        ~Filter()
+        {
+            in_.close();
+            join();
+        }
+
+        Filter(const Filter &) = delete;
+        Filter &operator=(const Filter &) = delete;
+
+        /// @brief Waits until the input pipe is closed and drained and every worker has exited.
+        void join()
+        {
+            for (std::thread &worker : workers_)
+            {
+                if (worker.joinable())
+                    worker.join();
+            }
+        }
+
+        /// @return A snapshot of the stage counters.
+        StageStats stats() const
+        {
+            StageStats stats;
+            stats.name = name_;
+            stats.processed = processed_.load();
+            stats.dropped = dropped_.load();
+            stats.failed = failed_.load();
+            stats.backlog = in_.size();
+            stats.busySeconds = static_cast<double>(busyMicros_.load()) / 1e6;
+            return stats;
+        }
+
+    private:
+        void run()
+        {
+            while (std::optional<In> item = in_.receive())
+            {
+                auto began = std::chrono::steady_clock::now();
+                try
+                {
+                    std::optional<Out> result = function_(*item);
+                    processed_++;
+                    if (!result)
+                        dropped_++;
+                    else if (out_)
+                        out_->send(std::move(*result));
+                }
+                catch (const std::exception &e)
+                {
+                    failed_++;
+                    if (onError_)
+                        onError_(*item, e);
+                }
+                busyMicros_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now() - began)
+                                   .count();
+            }
+            // The last worker out tells the next stage nothing more is coming.
+            if (--running_ == 0 && out_)
+                out_->close();
+        }
+
+        const std::string name_;
+        Function function_;
+        ErrorHandler onError_;
+        Pipe<In> &in_;
+        Pipe<Out> *out_;
+        std::atomic<unsigned> running_;
+        std::vector<std::thread> workers_;
+
+        std::atomic<uint64_t> processed_ = 0;
+        std::atomic<uint64_t> dropped_ = 0;
+        std::atomic<uint64_t> failed_ = 0;
+        std::atomic<uint64_t> busyMicros_ = 0;
+    };
+}
+
+#endif // FOLSERV_PIPE_FILTER_H_
@@ -0,0 +1,193 @@
+#include "query_cache.h"
+
+namespace DAL
+{
+    // Rough per-entry bookkeeping cost (list node, map slots, tag sets).
+    constexpr size_t kEntryOverhead = 160;
+
+    namespace
+    {
+        // Length-prefixed so ("a,b") and ("a", "b") cannot collide.
+        std::string makeKey(const std::string &statement, const std::vector<std::string> &params)
+        {
+            std::string key = statement;
+            for (const std::string &param : params)
+            {
+                key += '\0';
+                key += std::to_string(param.size());
+                key += ':';
+                key += param;
+            }
+            return key;
+        }
+
+        size_t sizeOf(const std::string &key, const QueryCache::Rows &rows)
+        {
+            size_t bytes = kEntryOverhead + key.size();
+            for (const QueryCache::Row &row : rows)
+            {
+                bytes += sizeof(QueryCache::Row);
+                for (const std::optional<std::string> &field : row)
+                    bytes += sizeof(field) + (field ? field->size() : 0);
+            }
+            return bytes;
+        }
+    }
+
+    QueryCache::QueryCache(size_t budgetBytes, std::chrono::milliseconds ttl)
+        : budget_(budgetBytes), ttl_(ttl)
+    {
+    }
+
+    std::optional<QueryCache::Rows> QueryCache::get(const std::string &statement,
+                                                    const std::vector<std::string> &params)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StatementStats &stats = statements_[statement];
+        auto it = entries_.find(makeKey(statement, params));
+        if (it == entries_.end())
+        {
+            stats.misses++;
+            return std::nullopt;
+        }
+        if (Clock::now() - it->second->stored >= ttl_)
+        {
+            erase(it->second);
+            stats.misses++;
+            return std::nullopt;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        stats.hits++;
+        return it->second->rows;
+    }
+
+    uint64_t QueryCache::ticket()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return clock_;
+    }
+
+    void QueryCache::put(const std::string &statement, const std::vector<std::string> &params, Rows rows,
+                         const std::vector<std::string> &tags, uint64_t ticket)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool stale = clearedAt_ > ticket;
+        for (const std::string &tag : tags)
+        {
+            auto invalidated = invalidatedAt_.find(tag);
+            stale = stale || (invalidated != invalidatedAt_.end() && invalidated->second > ticket);
+        }
+        if (stale)
+        {
+            rejected_++;
+            return;
+        }
+
+        std::string key = makeKey(statement, params);
+        auto existing = entries_.find(key);
+        if (existing != entries_.end())
+            erase(existing->second);
+
+        size_t bytes = sizeOf(key, rows);
+        if (bytes > budget_)
+            return;
+
+        lru_.push_front({key, statement, std::move(rows), tags, bytes, Clock::now()});
+        entries_[key] = lru_.begin();
+        for (const std::string &tag : tags)
+            tagged_[tag].insert(key);
+        bytes_ += bytes;
+        evictToBudget();
+    }
+
+    void QueryCache::invalidate(const std::string &tag)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        invalidatedAt_[tag] = ++clock_;
+        auto it = tagged_.find(tag);
+        if (it == tagged_.end())
+            return;
+        // erase() edits tagged_, so work from a copy of the keys.
+        std::unordered_set<std::string> keys = std::move(it->second);
+        tagged_.erase(it);
+        for (const std::string &key : keys)
+        {
+            auto entry = entries_.find(key);
+            if (entry != entries_.end())
+            {
+                erase(entry->second);
+                invalidations_++;
+            }
+        }
+    }
+
+    void QueryCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clearedAt_ = ++clock_;
+        invalidations_ += entries_.size();
+        lru_.clear();
+        entries_.clear();
+        tagged_.clear();
+        bytes_ = 0;
+    }
+
+    void QueryCache::setBudget(size_t budgetBytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        budget_ = budgetBytes;
+        evictToBudget();
+    }
+
+    // Mutex must be held.
+    void QueryCache::erase(std::list<Entry>::iterator it)
+    {
+        for (const std::string &tag : it->tags)
+        {
+            auto keys = tagged_.find(tag);
+            if (keys == tagged_.end())
+                continue;
+            keys->second.erase(it->key);
+            if (keys->second.empty())
+                tagged_.erase(keys);
+        }
+        bytes_ -= it->bytes;
+        entries_.erase(it->key);
+        lru_.erase(it);
+    }
+
+    // Mutex must be held.
+    void QueryCache::evictToBudget()
+    {
+        while (bytes_ > budget_ && !lru_.empty())
+        {
+            erase(std::prev(lru_.end()));
+            evictions_++;
+        }
+    }
+
+    nlohmann::json QueryCache::stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        nlohmann::json statements = nlohmann::json::object();
+        for (const auto &[statement, s] : statements_)
+        {
+            statements[statement] = {{"hits", s.hits}, {"misses", s.misses}};
+            hits += s.hits;
+            misses += s.misses;
+        }
+        return {
+            {"hits", hits},
+            {"misses", misses},
+            {"entries", entries_.size()},
+            {"bytes", bytes_},
+            {"budgetBytes", budget_},
+            {"evictions", evictions_},
+            {"invalidations", invalidations_},
+            {"rejectedStale", rejected_},
+            {"statements", statements},
+        };
+    }
+}
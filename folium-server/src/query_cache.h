@@ -0,0 +1,109 @@
+/**
+ * @file query_cache.h
+ * @brief Result cache for DAL reads, keyed by statement and parameters.
+ *
+ * Each entry holds the raw rows of one read and the tables the statement reads
+ * from (its tags). A write through the DAL invalidates the tags of the tables it
+ * touched, so a new enrollment drops cached enrollment checks but leaves note
+ * paths alone. Entries also expire after a TTL to pick up writes made by other
+ * processes, and the least recently used ones are evicted to stay within a byte
+ * budget.
+ *
+ * A read that races with a write could otherwise cache the pre-write rows. To
+ * prevent that, readers take a ticket before querying, and put() refuses the
+ * rows if any of their tags was invalidated after the ticket.
+ */
+
+#ifndef FOLSERV_QUERY_CACHE_H_
+#define FOLSERV_QUERY_CACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace DAL
+{
+    class QueryCache
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using Row = std::vector<std::optional<std::string>>; // nullopt for SQL NULL
+        using Rows = std::vector<Row>;
+
+        /**
+         * @param budgetBytes Approximate memory the cached rows may use.
+         * @param ttl How long an entry is served before it is read again.
+         */
+        QueryCache(size_t budgetBytes, std::chrono::milliseconds ttl);
+
+        /// @brief Looks up the rows of @p statement run with @p params, counting a hit or a miss.
+        std::optional<Rows> get(const std::string &statement, const std::vector<std::string> &params);
+
+        /// @return A ticket to pass to put(), taken before running the query.
+        uint64_t ticket();
+
+        /// @brief Caches rows read under @p ticket, unless one of @p tags was invalidated since.
+        void put(const std::string &statement, const std::vector<std::string> &params, Rows rows,
+                 const std::vector<std::string> &tags, uint64_t ticket);
+
+        /// @brief Drops every entry tagged with @p tag.
+        void invalidate(const std::string &tag);
+
+        /// @brief Drops every entry, e.g. after a write whose tables are unknown.
+        void clear();
+
+        /// @brief Changes the byte budget, evicting at once if it shrank.
+        void setBudget(size_t budgetBytes);
+
+        /// @return Hit/miss counters (overall and per statement), entries, bytes and budget.
+        nlohmann::json stats();
+
+    private:
+        struct Entry
+        {
+            std::string key;
+            std::string statement;
+            Rows rows;
+            std::vector<std::string> tags;
+            size_t bytes;
+            Clock::time_point stored;
+        };
+
+        struct StatementStats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+        };
+
+        size_t budget_;
+        std::chrono::milliseconds ttl_;
+
+        std::mutex mutex_;
+        std::list<Entry> lru_; // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+        std::unordered_map<std::string, std::unordered_set<std::string>> tagged_; // tag -> keys
+        std::unordered_map<std::string, uint64_t> invalidatedAt_;                  // tag -> ticket
+        uint64_t clock_ = 0;
+        uint64_t clearedAt_ = 0;
+        size_t bytes_ = 0;
+
+        std::map<std::string, StatementStats> statements_;
+        uint64_t evictions_ = 0;
+        uint64_t invalidations_ = 0;
+        uint64_t rejected_ = 0;
+
+        void erase(std::list<Entry>::iterator it);
+        void evictToBudget();
+    };
+}
+
+#endif // FOLSERV_QUERY_CACHE_H_
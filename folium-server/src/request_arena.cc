@@ -0,0 +1,63 @@
+#include "request_arena.h"
+
+namespace
+{
+    // Ahead of every block, as big as the strictest alignment so the block keeps it
+    struct alignas(std::max_align_t) Header
+    {
+        bool fromArena;
+    };
+
+    thread_local arena::RequestArena *currentArena = nullptr;
+}
+
+namespace arena
+{
+    RequestArena::RequestArena()
+        : resource_(initial_, sizeof(initial_), std::pmr::new_delete_resource())
+    {
+    }
+
+    void *RequestArena::allocate(size_t bytes, size_t alignment)
+    {
+        void *block = resource_.allocate(bytes, alignment);
+        used_ += bytes;
+        return block;
+    }
+
+    void RequestArena::reset()
+    {
+        // Returns the chunks taken from the heap; the inline one is reused
+        resource_.release();
+        used_ = 0;
+    }
+
+    Scope::Scope(RequestArena &arena) : previous_(currentArena)
+    {
+        currentArena = &arena;
+    }
+
+    Scope::~Scope()
+    {
+        currentArena = previous_;
+    }
+
+    RequestArena *current()
+    {
+        return currentArena;
+    }
+
+    void *allocateBlock(size_t bytes)
+    {
+        void *memory = currentArena ? currentArena->allocate(sizeof(Header) + bytes, alignof(Header))
+                                    : ::operator new(sizeof(Header) + bytes);
+        return new (memory) Header{currentArena != nullptr} + 1;
+    }
+
+    void deallocateBlock(void *block) noexcept
+    {
+        Header *header = static_cast<Header *>(block) - 1;
+        if (!header->fromArena)
+            ::operator delete(header);
+    }
+}
@@ -0,0 +1,123 @@
+/**
+ * @file request_arena.h
+ * @brief Per-request arena for the JSON documents a gateway handler parses.
+ *
+ * A handler puts a RequestArena on its stack and opens a Scope over it; every
+ * RequestJson node, array and object created on that thread until the Scope
+ * closes is carved out of the arena instead of the global heap, and all of it
+ * goes at once when the arena is reset or destroyed:
+ *
+ *     arena::RequestArena requestArena;
+ *     arena::Scope scope(requestArena);
+ *     RequestJson body = RequestJson::parse(req.body, nullptr, false);
+ *     ...
+ *     handleClassTask(req, res, type, classId, {{"usernames", json(body["usernames"])}});
+ *
+ * Only documents that live and die in the handler thread may use it. Task data
+ * crosses the FIFOs as raw bytes and is freed on the other side, notes stay
+ * resident after the request, and query results are cached, so those keep
+ * using nlohmann::json; a RequestJson converts to one by copy.
+ *
+ * Strings stay on the heap: std::string keeps short ones inline and owns its
+ * buffer. Each block carries a small header saying where it came from, so a
+ * node allocated outside a Scope may be freed inside one and the other way
+ * round; freeing arena memory is a no-op.
+ */
+
+#ifndef FOLSERV_REQUEST_ARENA_H_
+#define FOLSERV_REQUEST_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace arena
+{
+    constexpr size_t kInitialBytes = 16 * 1024; // inline, before the arena asks the heap for more
+
+    /**
+     * @brief A monotonic arena over an inline first chunk. Not thread-safe; one per request.
+     */
+    class RequestArena
+    {
+    public:
+        RequestArena();
+        RequestArena(const RequestArena &) = delete;
+        RequestArena &operator=(const RequestArena &) = delete;
+
+        void *allocate(size_t bytes, size_t alignment);
+
+        /// @brief Releases everything allocated since construction or the last reset.
+        void reset();
+
+        /// @return Bytes handed out since construction or the last reset.
+        size_t used() const { return used_; }
+
+    private:
+        alignas(std::max_align_t) std::byte initial_[kInitialBytes];
+        std::pmr::monotonic_buffer_resource resource_;
+        size_t used_ = 0;
+    };
+
+    /**
+     * @brief Routes this thread's Allocator calls to @p arena while it is open. Scopes nest.
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(RequestArena &arena);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        RequestArena *previous_;
+    };
+
+    /// @return The arena of the innermost open Scope on this thread, or nullptr.
+    RequestArena *current();
+
+    void *allocateBlock(size_t bytes);
+    void deallocateBlock(void *block) noexcept;
+
+    /**
+     * @brief Stateless allocator drawing on the current arena, or the heap outside a Scope.
+     */
+    template <typename T = void>
+    class Allocator
+    {
+    public:
+        using value_type = T;
+
+        Allocator() noexcept = default;
+        template <typename U>
+        Allocator(const Allocator<U> &) noexcept {}
+
+        T *allocate(size_t n)
+        {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+            if (n > SIZE_MAX / sizeof(T))
+                throw std::bad_array_new_length();
+            return static_cast<T *>(allocateBlock(n * sizeof(T)));
+        }
+
+        void deallocate(T *p, size_t) noexcept { deallocateBlock(p); }
+
+        template <typename U>
+        bool operator==(const Allocator<U> &) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const Allocator<U> &) const noexcept { return false; }
+    };
+}
+
+/// @brief nlohmann::json with its nodes, arrays and objects allocated by arena::Allocator.
+using RequestJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t,
+                                         double, arena::Allocator>;
+
+#endif // FOLSERV_REQUEST_ARENA_H_
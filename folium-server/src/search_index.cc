@@ -0,0 +1,863 @@
+#include "search_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+#include "file_engine.h"
+#include "logger.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+
+static logger::Logger searchLogger("search");
+
+namespace
+{
+    const std::string kMagic = "FOLSRCH1";
+
+    // BM25 parameters
+    constexpr double kK1 = 1.2;
+    constexpr double kB = 0.75;
+
+    void putVarint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    uint64_t getVarint(const std::string &in, size_t &pos)
+    {
+        uint64_t value = 0;
+        for (int shift = 0; pos < in.size() && shift < 64; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(in[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("Search index is corrupt: truncated varint");
+    }
+
+    void putString(std::string &out, const std::string &value)
+    {
+        putVarint(out, value.size());
+        out += value;
+    }
+
+    std::string getString(const std::string &in, size_t &pos)
+    {
+        uint64_t size = getVarint(in, pos);
+        if (size > in.size() - pos)
+            throw std::runtime_error("Search index is corrupt: truncated string");
+        std::string value = in.substr(pos, size);
+        pos += size;
+        return value;
+    }
+
+    // FNV-1a; stable across builds, unlike std::hash.
+    uint64_t fingerprint(const std::string &text)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : text)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Uploads store their JSON document as the unit content; only its strings are text.
+    void collectStrings(const json &value, std::string &out)
+    {
+        if (value.is_string())
+        {
+            out += value.get_ref<const std::string &>();
+            out += '\n';
+        }
+        else if (value.is_structured())
+        {
+            for (const json &item : value)
+                collectStrings(item, out);
+        }
+    }
+
+    std::string textOf(const json &unit)
+    {
+        if (!unit.contains("content"))
+            return "";
+        const json &content = unit["content"];
+        if (!content.is_string())
+        {
+            std::string text;
+            collectStrings(content, text);
+            return text;
+        }
+        const std::string &raw = content.get_ref<const std::string &>();
+        size_t first = raw.find_first_not_of(" \t\r\n");
+        if (first != std::string::npos && (raw[first] == '{' || raw[first] == '['))
+        {
+            json parsed = json::parse(raw, nullptr, false);
+            if (!parsed.is_discarded())
+            {
+                std::string text;
+                collectStrings(parsed, text);
+                return text;
+            }
+        }
+        return raw;
+    }
+
+    struct Doc
+    {
+        int classId = 0;
+        std::string unitId;
+        std::string title;
+        uint32_t length = 0; // terms
+        uint64_t fingerprint = 0;
+        bool alive = true;
+    };
+
+    // Where a block of kSkipInterval entries starts.
+    struct Skip
+    {
+        uint32_t base = 0;   // the doc id before the block, plus one
+        uint32_t offset = 0; // byte offset of the block's first entry
+    };
+
+    // Entries of (doc id delta, term frequency, byte length of the positions, position deltas...).
+    struct Posting
+    {
+        std::string bytes;
+        std::vector<Skip> skips;
+        uint32_t base = 0; // last doc id plus one
+        uint32_t docs = 0;
+
+        void add(uint32_t doc, const std::vector<uint32_t> &positions)
+        {
+            if (docs % searchindex::kSkipInterval == 0)
+                skips.push_back({base, static_cast<uint32_t>(bytes.size())});
+            putVarint(bytes, doc + 1 - base);
+            putVarint(bytes, positions.size());
+            std::string encoded;
+            uint32_t previous = 0;
+            for (uint32_t position : positions)
+            {
+                putVarint(encoded, position - previous);
+                previous = position;
+            }
+            putVarint(bytes, encoded.size());
+            bytes += encoded;
+            base = doc + 1;
+            docs++;
+        }
+    };
+
+    // Walks one posting list in doc id order.
+    class Cursor
+    {
+    public:
+        explicit Cursor(const Posting &posting) : posting_(posting) {}
+
+        uint32_t doc() const { return doc_; }
+        uint32_t frequency() const { return frequency_; }
+        uint32_t documents() const { return posting_.docs; }
+        size_t offset() const { return pos_; } // of the next entry
+
+        bool next()
+        {
+            const std::string &bytes = posting_.bytes;
+            if (pos_ >= bytes.size())
+                return false;
+            started_ = true;
+            doc_ = base_ + static_cast<uint32_t>(getVarint(bytes, pos_)) - 1;
+            base_ = doc_ + 1;
+            frequency_ = static_cast<uint32_t>(getVarint(bytes, pos_));
+            size_t length = getVarint(bytes, pos_);
+            positionsAt_ = pos_;
+            pos_ += length;
+            return true;
+        }
+
+        /// Moves to the first entry at or after @p target; false if there is none.
+        bool advanceTo(uint32_t target)
+        {
+            if (started_ && doc_ >= target)
+                return true;
+            const std::vector<Skip> &skips = posting_.skips;
+            // The last block that starts at or before the target
+            auto it = std::upper_bound(skips.begin(), skips.end(), target,
+                                       [](uint32_t t, const Skip &skip) { return t < skip.base; });
+            if (it != skips.begin())
+            {
+                const Skip &skip = *std::prev(it);
+                if (skip.offset > pos_)
+                {
+                    pos_ = skip.offset;
+                    base_ = skip.base;
+                }
+            }
+            while (next())
+            {
+                if (doc_ >= target)
+                    return true;
+            }
+            return false;
+        }
+
+        std::vector<uint32_t> positions() const
+        {
+            std::vector<uint32_t> out;
+            out.reserve(frequency_);
+            size_t pos = positionsAt_;
+            uint32_t position = 0;
+            for (uint32_t i = 0; i < frequency_; i++)
+            {
+                position += static_cast<uint32_t>(getVarint(posting_.bytes, pos));
+                out.push_back(position);
+            }
+            return out;
+        }
+
+    private:
+        const Posting &posting_;
+        size_t pos_ = 0;
+        uint32_t base_ = 0;
+        uint32_t doc_ = 0;
+        uint32_t frequency_ = 0;
+        size_t positionsAt_ = 0;
+        bool started_ = false;
+    };
+
+    std::shared_mutex indexMutex;
+    std::mutex saveMutex; // held across both halves of a save
+    std::string root = "search";
+    std::vector<Doc> docs;
+    std::unordered_map<int, std::unordered_map<std::string, uint32_t>> live; // classId -> unitId -> doc id
+    std::unordered_map<std::string, Posting> postings;
+    uint64_t liveUnits = 0;
+    uint64_t liveLength = 0; // terms in live units, for the BM25 average
+    uint64_t postingBytes = 0;
+    uint64_t updates = 0;
+    std::atomic<uint64_t> searches = 0;
+    uint64_t journalRecords = 0;
+
+    std::string indexPath() { return root + "/index"; }
+    std::string journalPath() { return root + "/journal"; }
+    // The journal while a save is writing the snapshot that covers it.
+    std::string savingPath() { return root + "/journal.saving"; }
+
+    void clear()
+    {
+        docs.clear();
+        live.clear();
+        postings.clear();
+        liveUnits = liveLength = postingBytes = journalRecords = 0;
+    }
+
+    void kill(uint32_t doc)
+    {
+        Doc &d = docs[doc];
+        d.alive = false;
+        liveUnits--;
+        liveLength -= d.length;
+    }
+
+    // Caller holds the index lock exclusively.
+    void applyRemove(int classId, const std::string &unitId)
+    {
+        auto cls = live.find(classId);
+        if (cls == live.end())
+            return;
+        auto unit = cls->second.find(unitId);
+        if (unit == cls->second.end())
+            return;
+        kill(unit->second);
+        cls->second.erase(unit);
+        if (cls->second.empty())
+            live.erase(cls);
+    }
+
+    // Caller holds the index lock exclusively. False if the unit was already indexed with this text.
+    bool applyUpdate(int classId, const std::string &unitId, const std::string &title, const std::string &text)
+    {
+        const uint64_t print = fingerprint(title + '\0' + text);
+        auto &units = live[classId];
+        auto existing = units.find(unitId);
+        if (existing != units.end())
+        {
+            if (docs[existing->second].fingerprint == print)
+                return false;
+            kill(existing->second);
+        }
+
+        const uint32_t doc = static_cast<uint32_t>(docs.size());
+        std::map<std::string, std::vector<uint32_t>> positions;
+        uint32_t position = 0;
+        for (const std::string &term : searchindex::tokenize(title + '\n' + text))
+            positions[term].push_back(position++);
+
+        for (const auto &[term, at] : positions)
+        {
+            Posting &posting = postings[term];
+            size_t before = posting.bytes.size();
+            posting.add(doc, at);
+            postingBytes += posting.bytes.size() - before;
+        }
+        docs.push_back({classId, unitId, title, position, print, true});
+        units[unitId] = doc;
+        liveUnits++;
+        liveLength += position;
+        updates++;
+        return true;
+    }
+
+    json updateRecord(int classId, const std::string &unitId, const std::string &title, const std::string &text)
+    {
+        return {{"classId", classId}, {"unitId", unitId}, {"title", title}, {"text", text}};
+    }
+
+    json removeRecord(int classId, const std::string &unitId)
+    {
+        return {{"classId", classId}, {"unitId", unitId}, {"removed", true}};
+    }
+
+    // Replays are idempotent: every record sets a unit to its final text or removes it.
+    void replay(const std::string &path)
+    {
+        if (!std::filesystem::exists(path))
+            return;
+        std::string data = fileio::read(path);
+        size_t start = 0;
+        while (start < data.size())
+        {
+            size_t end = data.find('\n', start);
+            if (end == std::string::npos)
+                end = data.size();
+            json record = json::parse(data.substr(start, end - start), nullptr, false);
+            start = end + 1;
+            // A torn last line is an update that was never acknowledged
+            if (record.is_discarded() || !record.is_object())
+                continue;
+            if (record.value("removed", false))
+                applyRemove(record.value("classId", 0), record.value("unitId", ""));
+            else
+                applyUpdate(record.value("classId", 0), record.value("unitId", ""), record.value("title", ""),
+                            record.value("text", ""));
+            journalRecords++;
+        }
+    }
+
+    void loadSnapshot(const std::string &data)
+    {
+        if (data.compare(0, kMagic.size(), kMagic) != 0)
+            throw std::runtime_error("Search index is corrupt: bad magic");
+        size_t pos = kMagic.size();
+        uint64_t docCount = getVarint(data, pos);
+        for (uint64_t i = 0; i < docCount; i++)
+        {
+            Doc doc;
+            doc.classId = static_cast<int>(getVarint(data, pos));
+            doc.unitId = getString(data, pos);
+            doc.title = getString(data, pos);
+            doc.length = static_cast<uint32_t>(getVarint(data, pos));
+            doc.fingerprint = getVarint(data, pos);
+            live[doc.classId][doc.unitId] = static_cast<uint32_t>(docs.size());
+            liveUnits++;
+            liveLength += doc.length;
+            docs.push_back(std::move(doc));
+        }
+
+        uint64_t termCount = getVarint(data, pos);
+        for (uint64_t i = 0; i < termCount; i++)
+        {
+            std::string term = getString(data, pos);
+            Posting &posting = postings[term];
+            posting.bytes = getString(data, pos);
+            postingBytes += posting.bytes.size();
+            // Skips are cheap to find again and keep the file smaller
+            Cursor cursor(posting);
+            size_t entry = cursor.offset();
+            while (cursor.next())
+            {
+                if (posting.docs % searchindex::kSkipInterval == 0)
+                    posting.skips.push_back({posting.base, static_cast<uint32_t>(entry)});
+                posting.base = cursor.doc() + 1;
+                posting.docs++;
+                if (posting.base > docs.size())
+                    throw std::runtime_error("Search index is corrupt: posting for unknown unit");
+                entry = cursor.offset();
+            }
+        }
+        if (pos != data.size())
+            throw std::runtime_error("Search index is corrupt: trailing bytes");
+    }
+
+    // Renumbers live units densely and drops dead ones from every posting list. Caller holds the lock exclusively.
+    void compact()
+    {
+        if (liveUnits == docs.size())
+            return;
+        std::vector<uint32_t> renumbered(docs.size(), UINT32_MAX);
+        std::vector<Doc> kept;
+        kept.reserve(liveUnits);
+        for (uint32_t doc = 0; doc < docs.size(); doc++)
+        {
+            if (!docs[doc].alive)
+                continue;
+            renumbered[doc] = static_cast<uint32_t>(kept.size());
+            kept.push_back(std::move(docs[doc]));
+        }
+
+        postingBytes = 0;
+        for (auto it = postings.begin(); it != postings.end();)
+        {
+            Posting rewritten;
+            Cursor cursor(it->second);
+            while (cursor.next())
+            {
+                if (renumbered[cursor.doc()] != UINT32_MAX)
+                    rewritten.add(renumbered[cursor.doc()], cursor.positions());
+            }
+            if (rewritten.docs == 0)
+            {
+                it = postings.erase(it);
+                continue;
+            }
+            postingBytes += rewritten.bytes.size();
+            it->second = std::move(rewritten);
+            ++it;
+        }
+
+        docs = std::move(kept);
+        for (auto &[classId, units] : live)
+        {
+            for (auto &[unitId, doc] : units)
+                doc = renumbered[doc];
+        }
+    }
+
+    std::string serialize()
+    {
+        std::string out = kMagic;
+        putVarint(out, docs.size());
+        for (const Doc &doc : docs)
+        {
+            putVarint(out, static_cast<uint64_t>(doc.classId));
+            putString(out, doc.unitId);
+            putString(out, doc.title);
+            putVarint(out, doc.length);
+            putVarint(out, doc.fingerprint);
+        }
+        putVarint(out, postings.size());
+        for (const auto &[term, posting] : postings)
+        {
+            putString(out, term);
+            putString(out, posting.bytes);
+        }
+        return out;
+    }
+
+    // Caller holds the lock exclusively. The journal is set aside under the lock, so updates made
+    // while the snapshot is written go to a fresh journal; see save().
+    std::string prepareSave()
+    {
+        compact();
+        std::string snapshot = serialize();
+        std::filesystem::create_directories(root);
+        if (std::filesystem::exists(journalPath()))
+            fileio::rename(journalPath(), savingPath());
+        journalRecords = 0;
+        return snapshot;
+    }
+
+    void finishSave(const std::string &dir, const std::string &snapshot)
+    {
+        fileio::writeAtomic(dir + "/index", snapshot);
+        fileio::remove(dir + "/journal.saving");
+    }
+
+    // Caller holds the lock exclusively.
+    void journal(const std::vector<json> &records)
+    {
+        if (records.empty())
+            return;
+        std::string lines;
+        for (const json &record : records)
+            lines += record.dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+        std::filesystem::create_directories(root);
+        fileio::append(journalPath(), lines);
+        journalRecords += records.size();
+    }
+
+    bool journalFull()
+    {
+        return journalRecords >= std::max<uint64_t>(searchindex::kSaveAfter, liveUnits / 4);
+    }
+
+    // One clause of a query: a single term, or the terms of a quoted phrase.
+    std::vector<std::vector<std::string>> parseQuery(const std::string &query)
+    {
+        std::vector<std::vector<std::string>> clauses;
+        bool quoted = false;
+        size_t start = 0;
+        for (size_t i = 0; i <= query.size(); i++)
+        {
+            if (i < query.size() && query[i] != '"')
+                continue;
+            std::vector<std::string> terms = searchindex::tokenize(query.substr(start, i - start));
+            if (quoted && terms.size() > 1)
+                clauses.push_back(std::move(terms));
+            else
+                for (std::string &term : terms)
+                    clauses.push_back({std::move(term)});
+            quoted = !quoted;
+            start = i + 1;
+        }
+        return clauses;
+    }
+
+    bool phraseMatches(const std::vector<std::vector<uint32_t>> &positions)
+    {
+        for (uint32_t first : positions[0])
+        {
+            bool all = true;
+            for (size_t i = 1; i < positions.size() && all; i++)
+                all = std::binary_search(positions[i].begin(), positions[i].end(), first + static_cast<uint32_t>(i));
+            if (all)
+                return true;
+        }
+        return false;
+    }
+}
+
+namespace searchindex
+{
+    void setRoot(const std::string &dir)
+    {
+        std::unique_lock<std::shared_mutex> lock(indexMutex);
+        root = dir;
+        clear();
+        if (std::filesystem::exists(indexPath()))
+            loadSnapshot(fileio::read(indexPath()));
+        replay(savingPath());
+        replay(journalPath());
+        searchLogger.logS("Loaded search index: ", liveUnits, " units, ", postings.size(), " terms, ", journalRecords,
+                          " journal records");
+    }
+
+    std::string unitText(const json &unit)
+    {
+        return unit.is_object() ? textOf(unit) : std::string();
+    }
+
+    std::vector<std::string> tokenize(const std::string &text)
+    {
+        std::vector<std::string> terms;
+        std::string term;
+        for (char c : text)
+        {
+            unsigned char byte = static_cast<unsigned char>(c);
+            if (std::isalnum(byte) || byte >= 0x80)
+            {
+                if (term.size() < kMaxTermLength)
+                    term += static_cast<char>(std::tolower(byte));
+            }
+            else if (!term.empty())
+            {
+                terms.push_back(std::move(term));
+                term.clear();
+            }
+        }
+        if (!term.empty())
+            terms.push_back(std::move(term));
+        return terms;
+    }
+
+    void update(int classId, const json &unit)
+    {
+        const std::string unitId = unit.value("unitId", "");
+        if (unitId.empty())
+            return;
+        const std::string title = unit.contains("title") && unit["title"].is_string() ? unit["title"].get<std::string>() : "";
+        const std::string text = textOf(unit);
+
+        {
+            std::unique_lock<std::shared_mutex> lock(indexMutex);
+            if (!applyUpdate(classId, unitId, title, text))
+                return;
+            journal({updateRecord(classId, unitId, title, text)});
+            if (!journalFull())
+                return;
+        }
+        save();
+    }
+
+    void remove(int classId, const std::string &unitId)
+    {
+        std::unique_lock<std::shared_mutex> lock(indexMutex);
+        auto cls = live.find(classId);
+        if (cls == live.end() || !cls->second.count(unitId))
+            return;
+        applyRemove(classId, unitId);
+        journal({removeRecord(classId, unitId)});
+    }
+
+    void replaceClass(int classId, const json &note)
+    {
+        // Text extraction parses upload documents, so it happens before taking the lock
+        std::vector<std::tuple<std::string, std::string, std::string>> units;
+        if (note.is_object() && note.contains("units") && note["units"].is_array())
+        {
+            for (const json &unit : note["units"])
+            {
+                if (!unit.is_object() || !unit.contains("unitId") || !unit["unitId"].is_string())
+                    continue;
+                std::string title = unit.contains("title") && unit["title"].is_string() ? unit["title"].get<std::string>() : "";
+                units.emplace_back(unit["unitId"].get<std::string>(), std::move(title), textOf(unit));
+            }
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> lock(indexMutex);
+            std::vector<json> records;
+            std::unordered_set<std::string> present;
+            for (const auto &[unitId, title, text] : units)
+            {
+                present.insert(unitId);
+                if (applyUpdate(classId, unitId, title, text))
+                    records.push_back(updateRecord(classId, unitId, title, text));
+            }
+            auto cls = live.find(classId);
+            if (cls != live.end())
+            {
+                std::vector<std::string> gone;
+                for (const auto &[unitId, doc] : cls->second)
+                {
+                    if (!present.count(unitId))
+                        gone.push_back(unitId);
+                }
+                for (const std::string &unitId : gone)
+                {
+                    applyRemove(classId, unitId);
+                    records.push_back(removeRecord(classId, unitId));
+                }
+            }
+            journal(records);
+            if (!journalFull())
+                return;
+        }
+        save();
+    }
+
+    std::vector<Hit> search(const std::string &query, const std::unordered_set<int> &classIds, size_t limit,
+                            size_t *total)
+    {
+        if (total)
+            *total = 0;
+        std::vector<std::vector<std::string>> clauses = parseQuery(query);
+        if (clauses.empty() || classIds.empty() || limit == 0)
+            return {};
+
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        searches++;
+
+        // One cursor per distinct term
+        std::vector<std::string> terms;
+        for (const auto &clause : clauses)
+        {
+            for (const std::string &term : clause)
+            {
+                if (std::find(terms.begin(), terms.end(), term) == terms.end())
+                    terms.push_back(term);
+            }
+        }
+        std::vector<Cursor> cursors;
+        cursors.reserve(terms.size());
+        for (const std::string &term : terms)
+        {
+            auto it = postings.find(term);
+            if (it == postings.end())
+                return {};
+            cursors.emplace_back(it->second);
+        }
+        auto cursorOf = [&](const std::string &term) -> Cursor & {
+            return cursors[std::find(terms.begin(), terms.end(), term) - terms.begin()];
+        };
+
+        // Leapfrog the rarest term against the others, each jumping ahead with its skips
+        std::vector<size_t> order(cursors.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(),
+                  [&](size_t a, size_t b) { return cursors[a].documents() < cursors[b].documents(); });
+
+        const double units = static_cast<double>(docs.size());
+        const double average = liveUnits == 0 ? 1.0 : static_cast<double>(liveLength) / liveUnits;
+        std::vector<double> idf;
+        for (const Cursor &cursor : cursors)
+        {
+            double df = cursor.documents();
+            idf.push_back(std::log(1.0 + (units - df + 0.5) / (df + 0.5)));
+        }
+
+        using Scored = std::pair<double, uint32_t>;
+        std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>> best; // worst of the best on top
+        size_t matches = 0;
+
+        for (Cursor &cursor : cursors)
+        {
+            if (!cursor.next())
+                return {};
+        }
+        Cursor &lead = cursors[order[0]];
+        bool more = true;
+        while (more)
+        {
+            uint32_t doc = lead.doc();
+            bool aligned = true;
+            for (size_t i = 1; i < order.size() && aligned; i++)
+            {
+                Cursor &other = cursors[order[i]];
+                if (!other.advanceTo(doc))
+                {
+                    more = aligned = false;
+                }
+                else if (other.doc() > doc)
+                {
+                    more = lead.advanceTo(other.doc());
+                    aligned = false;
+                }
+            }
+            if (!aligned)
+                continue;
+
+            const Doc &d = docs[doc];
+            bool match = d.alive && classIds.count(d.classId);
+            for (size_t c = 0; c < clauses.size() && match; c++)
+            {
+                if (clauses[c].size() < 2)
+                    continue;
+                std::vector<std::vector<uint32_t>> positions;
+                for (const std::string &term : clauses[c])
+                    positions.push_back(cursorOf(term).positions());
+                match = phraseMatches(positions);
+            }
+            if (match)
+            {
+                matches++;
+                double score = 0;
+                for (size_t i = 0; i < cursors.size(); i++)
+                {
+                    double tf = cursors[i].frequency();
+                    score += idf[i] * tf * (kK1 + 1) / (tf + kK1 * (1 - kB + kB * d.length / average));
+                }
+                if (best.size() < limit)
+                    best.push({score, doc});
+                else if (score > best.top().first)
+                {
+                    best.pop();
+                    best.push({score, doc});
+                }
+            }
+            more = lead.next();
+        }
+
+        std::vector<Hit> hits(best.size());
+        for (size_t i = hits.size(); i-- > 0; best.pop())
+        {
+            const auto [score, doc] = best.top();
+            const Doc &d = docs[doc];
+            hits[i] = {d.classId, d.unitId, d.title, score, {}};
+            // Positions are decoded again for the few hits returned rather than kept for every match
+            Cursor cursor(postings.at(clauses[0][0]));
+            if (cursor.advanceTo(doc))
+                hits[i].positions = cursor.positions();
+        }
+        if (total)
+            *total = matches;
+        return hits;
+    }
+
+    void save()
+    {
+        std::lock_guard<std::mutex> saving(saveMutex);
+        std::string snapshot, dir;
+        {
+            std::unique_lock<std::shared_mutex> lock(indexMutex);
+            snapshot = prepareSave();
+            dir = root;
+        }
+        finishSave(dir, snapshot);
+        searchLogger.log("Saved search index to " + dir);
+    }
+
+    size_t rebuild(const std::string &notesRoot)
+    {
+        {
+            std::unique_lock<std::shared_mutex> lock(indexMutex);
+            clear();
+        }
+        size_t notes = 0;
+        if (std::filesystem::is_directory(notesRoot))
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(notesRoot))
+            {
+                int classId = notestore::classIdOf(entry.path().filename().string());
+                if (!entry.is_regular_file() || classId <= 0)
+                    continue;
+                json note = notestore::load(entry.path().string());
+                {
+                    // Indexed straight into memory; the snapshot written below covers it
+                    std::unique_lock<std::shared_mutex> lock(indexMutex);
+                    if (note.is_object() && note.contains("units") && note["units"].is_array())
+                    {
+                        for (const json &unit : note["units"])
+                        {
+                            if (!unit.is_object() || !unit.contains("unitId") || !unit["unitId"].is_string())
+                                continue;
+                            applyUpdate(classId, unit["unitId"].get<std::string>(),
+                                        unit.contains("title") && unit["title"].is_string() ? unit["title"].get<std::string>() : "",
+                                        textOf(unit));
+                        }
+                    }
+                }
+                notes++;
+            }
+        }
+        {
+            std::unique_lock<std::shared_mutex> lock(indexMutex);
+            fileio::remove(journalPath());
+        }
+        save();
+        searchLogger.log("Rebuilt search index from " + std::to_string(notes) + " notes under " + notesRoot);
+        return notes;
+    }
+
+    Stats stats()
+    {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        Stats s;
+        s.units = liveUnits;
+        s.deadUnits = docs.size() - liveUnits;
+        s.terms = postings.size();
+        s.postingBytes = postingBytes;
+        s.updates = updates;
+        s.searches = searches;
+        s.journalRecords = journalRecords;
+        return s;
+    }
+}
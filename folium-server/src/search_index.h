@@ -0,0 +1,115 @@
+/**
+ * @file search_index.h
+ * @brief In-process inverted full-text index over the units of every big note.
+ *
+ * Unit titles and content are split into lowercase terms. Each term maps to a
+ * posting list of the units containing it and the positions it occurs at:
+ *
+ *     term -> [(unit, [position, ...]), ...]          sorted by unit
+ *
+ * Posting lists are byte strings of varints (unit id deltas, counts, position
+ * deltas), with a skip entry every kSkipInterval units so that intersecting a
+ * rare term with a common one jumps over most of the common list instead of
+ * decoding it.
+ *
+ * A changed unit is indexed again under a new internal id and its old id is
+ * marked dead, so an update only appends to the end of each posting list. Dead
+ * ids are filtered out of results and dropped when the index is saved.
+ *
+ * The index lives in <root>/ (default "search"):
+ *
+ *     search/index     binary snapshot of every live unit and posting list
+ *     search/journal   one JSON line per update made since the snapshot
+ *
+ * setRoot() loads the snapshot and replays the journal. Updates append to the
+ * journal; once it holds more records than a quarter of the indexed units (at
+ * least kSaveAfter) the snapshot is rewritten and the journal emptied.
+ *
+ * All functions are thread-safe. I/O failures throw std::runtime_error.
+ */
+
+#ifndef FOLSERV_SEARCH_INDEX_H_
+#define FOLSERV_SEARCH_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace searchindex
+{
+    constexpr size_t kSkipInterval = 64;   // units between skip entries of a posting list
+    constexpr size_t kSaveAfter = 4096;    // journal records before the snapshot may be rewritten
+    constexpr size_t kMaxTermLength = 64;  // longer words are cut to this many bytes
+
+    /**
+     * @brief One matching unit.
+     */
+    struct Hit
+    {
+        int classId = 0;
+        std::string unitId;
+        std::string title;
+        double score = 0;              // BM25, higher is better
+        std::vector<uint32_t> positions; // where the first query term occurs in the unit
+    };
+
+    /**
+     * @brief Index size and activity.
+     */
+    struct Stats
+    {
+        uint64_t units = 0;          // live indexed units
+        uint64_t deadUnits = 0;      // replaced or removed units not yet dropped
+        uint64_t terms = 0;
+        uint64_t postingBytes = 0;   // compressed posting lists
+        uint64_t updates = 0;        // units indexed since startup
+        uint64_t searches = 0;
+        uint64_t journalRecords = 0;
+    };
+
+    /// @brief Sets the index directory and loads what is stored there, replacing the index in memory.
+    void setRoot(const std::string &dir);
+
+    /// @return The text of @p unit as it is indexed: its content, or the strings of an upload's JSON document.
+    std::string unitText(const nlohmann::json &unit);
+
+    /// @brief Splits @p text into lowercase terms, in order. Letters and digits make up terms;
+    ///        bytes of multi-byte UTF-8 characters are kept as they are.
+    std::vector<std::string> tokenize(const std::string &text);
+
+    /// @brief Indexes (or re-indexes) one unit, {"unitId", "title", "content"} with its content hydrated.
+    void update(int classId, const nlohmann::json &unit);
+
+    /// @brief Removes one unit; unknown units are ignored.
+    void remove(int classId, const std::string &unitId);
+
+    /// @brief Makes the index of a class match @p note: changed units are re-indexed,
+    ///        units no longer in the note removed, unchanged ones left alone.
+    void replaceClass(int classId, const nlohmann::json &note);
+
+    /// @brief Finds units containing every term of @p query, best first.
+    ///
+    /// A "quoted phrase" matches only its terms at consecutive positions.
+    ///
+    /// @param classIds Classes to search; units of other classes never match.
+    /// @param limit Most hits to return.
+    /// @param total If given, receives the number of matching units.
+    std::vector<Hit> search(const std::string &query, const std::unordered_set<int> &classIds, size_t limit = 20,
+                            size_t *total = nullptr);
+
+    /// @brief Writes the snapshot (dropping dead units) and empties the journal.
+    void save();
+
+    /// @brief Rebuilds the index from every note file under @p notesRoot and saves it.
+    /// @return The number of notes indexed.
+    size_t rebuild(const std::string &notesRoot = "notes");
+
+    /// @return A snapshot of the index counters.
+    Stats stats();
+}
+
+#endif // FOLSERV_SEARCH_INDEX_H_
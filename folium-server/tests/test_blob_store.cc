@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "data_access_layer.h"
+#include "note_store.h"
+#include "note_view.h"
+
+using json = nlohmann::json;
+
+class BlobStoreTest : public ::testing::Test {
+protected:
+    const std::string blobDir = "blob_store_test_blobs";
+    const std::string noteA = "blob_store_test_a.json";
+    const std::string noteB = "blob_store_test_b.json";
+    const std::string slides = std::string(4096, 's') + " lecture 1 slides";
+
+    void SetUp() override {
+        blobstore::setRoot(blobDir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(blobDir);
+        std::filesystem::remove(noteA);
+        std::filesystem::remove(noteB);
+    }
+
+    static json unitWith(int n, const std::string& content) {
+        return {{"unitId", "unit_" + std::to_string(n)}, {"title", "Unit"}, {"content", content}};
+    }
+
+    static json noteWith(const std::string& content) {
+        return {
+            {"title", "Note"},
+            {"units", json::array({{{"unitId", "unit_1"}, {"title", "Slides"}, {"content", content}}})}
+        };
+    }
+};
+
+TEST_F(BlobStoreTest, PutAndGet) {
+    std::string hash = blobstore::put("hello blobs");
+    EXPECT_EQ(hash, blobstore::hashOf("hello blobs"));
+    EXPECT_EQ(hash.size(), 64u);
+    EXPECT_EQ(blobstore::get(hash), "hello blobs");
+    EXPECT_EQ(blobstore::refCount(hash), 1u);
+}
+
+TEST_F(BlobStoreTest, DuplicatePutOnlyCountsReference) {
+    blobstore::Stats before = blobstore::stats();
+    std::string first = blobstore::put(slides);
+    std::string second = blobstore::put(slides);
+    blobstore::Stats after = blobstore::stats();
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(blobstore::refCount(first), 2u);
+    EXPECT_EQ(after.dedupHits - before.dedupHits, 1u);
+    EXPECT_EQ(after.bytesWritten - before.bytesWritten, slides.size());
+}
+
+TEST_F(BlobStoreTest, ReleaseDeletesLastReference) {
+    std::string hash = blobstore::put(slides);
+    blobstore::addRef(hash);
+    blobstore::release(hash);
+    EXPECT_EQ(blobstore::get(hash), slides);
+    blobstore::release(hash);
+    EXPECT_EQ(blobstore::refCount(hash), 0u);
+    EXPECT_THROW(blobstore::get(hash), std::runtime_error);
+}
+
+TEST_F(BlobStoreTest, RejectsInvalidHash) {
+    EXPECT_THROW(blobstore::get("../../etc/passwd"), std::runtime_error);
+}
+
+TEST_F(BlobStoreTest, NoteStoresHashesAndLoadsContent) {
+    notestore::save(noteA, noteWith(slides));
+
+    json stored = notestore::NoteView(noteA).stored();
+    const json& unit = stored["units"][0];
+    EXPECT_FALSE(unit.contains("content"));
+    EXPECT_EQ(unit["blob"], blobstore::hashOf(slides));
+    EXPECT_EQ(unit["size"], slides.size());
+
+    EXPECT_EQ(notestore::load(noteA), noteWith(slides));
+}
+
+TEST_F(BlobStoreTest, SmallContentStaysInline) {
+    notestore::save(noteA, noteWith("short"));
+    json stored = notestore::NoteView(noteA).stored();
+    EXPECT_EQ(stored["units"][0]["content"], "short");
+}
+
+TEST_F(BlobStoreTest, SameSlidesInTwoClassesShareOneBlob) {
+    notestore::save(noteA, noteWith(slides));
+    notestore::save(noteB, noteWith(slides));
+    std::string hash = blobstore::hashOf(slides);
+    EXPECT_EQ(blobstore::refCount(hash), 2u);
+
+    // Re-saving an unchanged note does not take another reference.
+    notestore::save(noteA, noteWith(slides));
+    EXPECT_EQ(blobstore::refCount(hash), 2u);
+
+    // Replacing the content in one note drops its reference.
+    notestore::save(noteA, noteWith(slides + " v2"));
+    EXPECT_EQ(blobstore::refCount(hash), 1u);
+    EXPECT_EQ(notestore::load(noteB), noteWith(slides));
+}
+
+TEST_F(BlobStoreTest, LegacyInlineNoteLoads) {
+    DAL::writeFile(noteA, noteWith(slides).dump());
+    EXPECT_EQ(notestore::load(noteA), noteWith(slides));
+}
+
+TEST_F(BlobStoreTest, NotePathsFanOutOverHashedDirectories) {
+    std::string path = notestore::pathFor(42);
+    EXPECT_EQ(path, notestore::pathFor(42));
+    EXPECT_EQ(std::filesystem::path(path).filename(), "class_42_note.fol");
+    EXPECT_EQ(path.size(), std::string("notes/ab/cd/class_42_note.fol").size());
+    EXPECT_EQ(notestore::classIdOf("class_42_note.fol"), 42);
+    EXPECT_EQ(notestore::classIdOf("class_42_note.json"), 42); // created before the binary format
+    EXPECT_EQ(notestore::classIdOf("class_x_note.fol"), 0);
+    EXPECT_EQ(notestore::classIdOf("class_42_note.fol.history"), 0);
+    EXPECT_EQ(notestore::pathFor(42, "other").substr(0, 6), "other/");
+
+    std::set<std::string> dirs;
+    for (int classId = 1; classId <= 200; classId++) {
+        dirs.insert(std::filesystem::path(notestore::pathFor(classId)).parent_path().string());
+    }
+    EXPECT_GT(dirs.size(), 150u);
+}
+
+TEST_F(BlobStoreTest, MigrateIgnoresHashedAndForeignFiles) {
+    const std::string root = "blob_store_test_notes";
+    std::filesystem::create_directories(root);
+    DAL::writeFile(root + "/readme.txt", "not a note");
+    DAL::writeFile(root + "/class_x_note.json", "not a note either");
+    std::string hashed = notestore::pathFor(7, root);
+    std::filesystem::create_directories(std::filesystem::path(hashed).parent_path());
+    DAL::writeFile(hashed, "{}");
+
+    // Nothing in the flat layout: no database access needed.
+    EXPECT_EQ(notestore::migrateLayout(root), 0u);
+    EXPECT_TRUE(std::filesystem::exists(hashed));
+    std::filesystem::remove_all(root);
+}
+
+TEST_F(BlobStoreTest, MigrateRefusesToReplaceAnotherNote) {
+    const std::string root = "blob_store_test_notes";
+    std::filesystem::create_directories(root);
+    DAL::writeFile(root + "/class_7_note.json", "flat note");
+    std::string hashed = notestore::pathFor(7, root);
+    std::filesystem::create_directories(std::filesystem::path(hashed).parent_path());
+    DAL::writeFile(hashed, "another note");
+
+    // Fails before the database is touched, leaving both files as they were.
+    EXPECT_THROW(notestore::migrateLayout(root), std::runtime_error);
+    EXPECT_EQ(DAL::readFile(root + "/class_7_note.json"), "flat note");
+    EXPECT_EQ(DAL::readFile(hashed), "another note");
+    std::filesystem::remove_all(root);
+}
+
+TEST_F(BlobStoreTest, AppendedUnitsReplayOnLoad) {
+    notestore::save(noteA, noteWith(slides));
+    notestore::append(noteA, json::array({unitWith(2, "short"), unitWith(3, slides + " 3")}), 1);
+
+    notestore::FileInfo info;
+    json note = notestore::load(noteA, &info);
+    EXPECT_TRUE(info.log);
+    EXPECT_EQ(info.appended, 2u);
+    ASSERT_EQ(note["units"].size(), 3u);
+    EXPECT_EQ(note["units"][1], unitWith(2, "short"));
+    EXPECT_EQ(note["units"][2], unitWith(3, slides + " 3"));
+    EXPECT_EQ(blobstore::refCount(blobstore::hashOf(slides + " 3")), 1u);
+
+    // Appended units are stored like saved ones.
+    EXPECT_TRUE(notestore::NoteView(noteA).storedUnit(2).contains("blob"));
+}
+
+TEST_F(BlobStoreTest, RetriedAppendIsIgnored) {
+    notestore::save(noteA, noteWith(slides));
+    notestore::append(noteA, json::array({unitWith(2, "once")}), 1);
+    notestore::append(noteA, json::array({unitWith(2, "once")}), 1);
+    EXPECT_EQ(notestore::load(noteA)["units"].size(), 2u);
+}
+
+TEST_F(BlobStoreTest, TornRecordIsSkipped) {
+    notestore::save(noteA, noteWith(slides));
+    DAL::appendFile(noteA, "{\"n\":1,\"unit\":{\"unitId\":\"unit_2\",\"cont");
+    notestore::append(noteA, json::array({unitWith(2, "after crash")}), 1);
+
+    json note = notestore::load(noteA);
+    ASSERT_EQ(note["units"].size(), 2u);
+    EXPECT_EQ(note["units"][1]["content"], "after crash");
+}
+
+TEST_F(BlobStoreTest, CompactFoldsRecordsIntoSnapshot) {
+    notestore::save(noteA, noteWith(slides));
+    notestore::append(noteA, json::array({unitWith(2, slides)}), 1);
+    json before = notestore::load(noteA);
+    const std::string hash = blobstore::hashOf(slides);
+    EXPECT_EQ(blobstore::refCount(hash), 2u);
+
+    notestore::compact(noteA);
+    notestore::FileInfo info;
+    EXPECT_EQ(notestore::load(noteA, &info), before);
+    EXPECT_EQ(info.appended, 0u);
+    EXPECT_EQ(blobstore::refCount(hash), 2u);
+
+    // A later save releases both references as usual.
+    notestore::save(noteA, noteWith("short"));
+    EXPECT_EQ(blobstore::refCount(hash), 0u);
+}
+
+// Upload latency as the note grows: appending must not get slower with note size.
+TEST_F(BlobStoreTest, AppendLatencyStaysFlatAsNoteGrows) {
+    notestore::save(noteA, {{"title", "Note"}, {"units", json::array()}});
+    const size_t total = 10000, bucket = 1000;
+    const std::string content(512, 'u');
+    std::vector<double> appendUs;
+    json note = {{"title", "Note"}, {"units", json::array()}};
+    for (size_t start = 0; start < total; start += bucket) {
+        auto began = std::chrono::steady_clock::now();
+        for (size_t i = start; i < start + bucket; i++) {
+            notestore::append(noteA, json::array({unitWith(static_cast<int>(i + 1), content + std::to_string(i))}), i);
+        }
+        appendUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - began).count() /
+                           bucket);
+    }
+
+    // The old way: rewrite the whole note for one more unit, at the final size.
+    json full = notestore::load(noteA);
+    ASSERT_EQ(full["units"].size(), total);
+    const int rewrites = 5;
+    auto began = std::chrono::steady_clock::now();
+    for (int i = 0; i < rewrites; i++) {
+        notestore::save(noteB, full);
+    }
+    double rewriteUs =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - began).count() / rewrites;
+
+    for (size_t b = 0; b < appendUs.size(); b++) {
+        std::cout << "[ append   ] units " << b * bucket + 1 << "-" << (b + 1) * bucket << ": " << appendUs[b]
+                  << " us/upload" << std::endl;
+    }
+    std::cout << "[ rewrite  ] " << total << " units: " << rewriteUs << " us/upload" << std::endl;
+
+    EXPECT_LT(appendUs.back(), appendUs.front() * 3 + 50);
+    EXPECT_LT(appendUs.back(), rewriteUs);
+}
+
+TEST_F(BlobStoreTest, UnitRecordsReplayByUnitId) {
+    json note = noteWith(slides);
+    note["units"].push_back(unitWith(2, "two"));
+    notestore::save(noteA, note);
+    notestore::appendRecords(noteA, json::array({
+        notestore::record::set(unitWith(1, "fixed typo")),
+        notestore::record::insert(1, unitWith(3, "between")),
+        notestore::record::remove("unit_2"),
+        notestore::record::remove("unit_2"),
+        notestore::record::insert(0, unitWith(3, "retried insert")),
+    }));
+
+    json loaded = notestore::load(noteA);
+    ASSERT_EQ(loaded["units"].size(), 2u);
+    EXPECT_EQ(loaded["units"][0], unitWith(1, "fixed typo"));
+    EXPECT_EQ(loaded["units"][1], unitWith(3, "between"));
+}
+
+TEST_F(BlobStoreTest, FailedAppendReleasesItsBlobs) {
+    const std::string edited = slides + " edited";
+    EXPECT_THROW(notestore::appendRecords("blob_store_test_missing/note.json",
+                                          json::array({notestore::record::set(unitWith(1, edited))})),
+                 std::runtime_error);
+    EXPECT_EQ(blobstore::refCount(blobstore::hashOf(edited)), 0u);
+}
+
+TEST_F(BlobStoreTest, CompactReleasesReplacedUnitBlobs) {
+    notestore::save(noteA, noteWith(slides));
+    const std::string edited = slides + " edited";
+    notestore::appendRecords(noteA, json::array({notestore::record::set(unitWith(1, edited))}));
+    EXPECT_EQ(blobstore::refCount(blobstore::hashOf(slides)), 1u);
+    EXPECT_EQ(blobstore::refCount(blobstore::hashOf(edited)), 1u);
+
+    notestore::compact(noteA);
+    EXPECT_EQ(blobstore::refCount(blobstore::hashOf(slides)), 0u);
+    EXPECT_EQ(blobstore::refCount(blobstore::hashOf(edited)), 1u);
+    EXPECT_EQ(notestore::load(noteA)["units"][0]["content"], edited);
+}
@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "blob_store.h"
+#include "compression.h"
+
+class CompressionTest : public ::testing::Test {
+protected:
+    const std::string blobDir = "compression_test_blobs";
+
+    void SetUp() override {
+        blobstore::setRoot(blobDir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(blobDir);
+        blobstore::setRoot("blobs");
+    }
+
+    // Lecture-style unit text: shared headings and phrasing, different details.
+    static std::vector<std::string> lectureUnits(size_t count, size_t bytes, unsigned seed = 7) {
+        static const std::vector<std::string> words = {
+            "the", "algorithm", "runs", "in", "linear", "time", "because", "each", "element", "is", "visited",
+            "once", "we", "prove", "invariant", "holds", "after", "every", "iteration", "of", "loop", "recall",
+            "that", "a", "graph", "tree", "heap", "stack", "queue", "pointer", "memory", "cache", "thread",
+            "lock", "proof", "lemma", "theorem", "example", "exercise", "homework", "exam", "definition",
+            "complexity", "recursion", "base", "case", "induction", "hypothesis", "array", "index", "sorted"};
+        std::mt19937 random(seed);
+        std::vector<std::string> units;
+        for (size_t i = 0; i < count; i++) {
+            std::string text = "Lecture " + std::to_string(i % 40 + 1) + " notes\n"
+                               "Learning objectives: by the end of this lecture you should be able to explain the "
+                               "main ideas below and apply them to the practice problems.\n"
+                               "Reading: chapter " + std::to_string(i % 12 + 1) + " of the course textbook.\n\n";
+            while (text.size() < bytes) {
+                for (int w = 0; w < 12; w++) {
+                    text += words[random() % words.size()];
+                    text += ' ';
+                }
+                text += random() % 4 == 0 ? "\nKey point: remember to state the invariant before the proof.\n" : ".\n";
+            }
+            text.resize(bytes);
+            units.push_back(text);
+        }
+        return units;
+    }
+
+    std::string blobFile(const std::string& hash) const {
+        return blobDir + "/" + hash.substr(0, 2) + "/" + hash;
+    }
+
+    size_t footprint() const {
+        size_t bytes = 0;
+        for (const auto& file : std::filesystem::recursive_directory_iterator(blobDir)) {
+            if (file.is_regular_file() && file.path().extension() != ".ref") bytes += file.file_size();
+        }
+        return bytes;
+    }
+
+    // Raw blobs, as written before compression existed.
+    void writeRaw(const std::string& content) {
+        std::string path = blobFile(blobstore::hashOf(content));
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+};
+
+TEST_F(CompressionTest, FramesRoundTrip) {
+    std::string text = lectureUnits(1, 5000)[0];
+    std::string frame = compression::compress(text);
+    EXPECT_TRUE(compression::isFrame(frame));
+    EXPECT_FALSE(compression::isFrame(text));
+    EXPECT_LT(frame.size(), text.size());
+    EXPECT_EQ(compression::dictionaryIdOf(frame), 0u);
+    EXPECT_EQ(compression::decompress(frame), text);
+    EXPECT_EQ(compression::decompress(compression::compress("")), "");
+    EXPECT_THROW(compression::decompress(frame.substr(0, frame.size() / 2)), std::runtime_error);
+}
+
+TEST_F(CompressionTest, DictionaryRoundTrip) {
+    compression::Dictionary dictionary(compression::train(lectureUnits(500, 2000)));
+    std::string text = lectureUnits(1, 800, 99)[0];
+    std::string frame = compression::compress(text, &dictionary);
+    EXPECT_EQ(compression::dictionaryIdOf(frame), dictionary.id());
+    EXPECT_LT(frame.size(), compression::compress(text).size());
+    EXPECT_EQ(compression::decompress(frame, &dictionary), text);
+    EXPECT_THROW(compression::decompress(frame), std::runtime_error);
+}
+
+TEST_F(CompressionTest, AcceptEncoding) {
+    EXPECT_TRUE(compression::acceptsZstd("zstd"));
+    EXPECT_TRUE(compression::acceptsZstd("gzip, deflate, br, zstd"));
+    EXPECT_TRUE(compression::acceptsZstd("gzip;q=1.0, zstd;q=0.5"));
+    EXPECT_FALSE(compression::acceptsZstd("gzip, br"));
+    EXPECT_FALSE(compression::acceptsZstd("zstd;q=0"));
+    EXPECT_FALSE(compression::acceptsZstd("xzstd"));
+    EXPECT_FALSE(compression::acceptsZstd(""));
+}
+
+TEST_F(CompressionTest, BlobsAreStoredCompressed) {
+    std::string text = lectureUnits(1, 20000)[0];
+    std::string hash = blobstore::put(text);
+    EXPECT_EQ(hash, blobstore::hashOf(text));
+    EXPECT_LT(std::filesystem::file_size(blobFile(hash)), text.size() / 2);
+    EXPECT_EQ(blobstore::get(hash), text);
+    EXPECT_EQ(blobstore::getMany({hash, hash}), (std::vector<std::string>{text, text}));
+}
+
+TEST_F(CompressionTest, RawBlobsFromEarlierVersionsStillRead) {
+    std::string text = lectureUnits(1, 3000)[0];
+    writeRaw(text);
+    EXPECT_EQ(blobstore::get(blobstore::hashOf(text)), text);
+}
+
+TEST_F(CompressionTest, TrainedDictionaryCompressesNewBlobsAndOldOnesStillRead) {
+    std::vector<std::string> units = lectureUnits(300, 2000);
+    std::vector<std::string> hashes;
+    for (size_t i = 0; i < units.size(); i++) {
+        if (i % 3 == 0) {
+            writeRaw(units[i]);
+            hashes.push_back(blobstore::hashOf(units[i]));
+        } else {
+            hashes.push_back(blobstore::put(units[i]));
+        }
+    }
+
+    unsigned id = blobstore::trainDictionary();
+    EXPECT_NE(id, 0u);
+    EXPECT_EQ(blobstore::stats().dictionaryId, id);
+
+    std::string fresh = lectureUnits(1, 2000, 1234)[0];
+    std::string freshHash = blobstore::put(fresh);
+    std::string stored;
+    std::getline(std::ifstream(blobFile(freshHash), std::ios::binary), stored, '\0');
+    EXPECT_EQ(compression::dictionaryIdOf(stored), id);
+    EXPECT_EQ(blobstore::getMany(hashes), units);
+
+    EXPECT_EQ(blobstore::recompressAll(), units.size());
+    EXPECT_EQ(blobstore::recompressAll(), 0u);
+    EXPECT_EQ(blobstore::getMany(hashes), units);
+
+    // A fresh process finds the dictionary on disk.
+    blobstore::setRoot(blobDir);
+    EXPECT_EQ(blobstore::get(freshHash), fresh);
+    EXPECT_EQ(blobstore::stats().dictionaryId, id);
+}
+
+// folium-import --compress-blobs runs in a process of its own while the server keeps serving
+TEST_F(CompressionTest, DictionaryTrainedByAnotherProcessIsFoundOnRead) {
+    std::vector<std::string> units = lectureUnits(300, 2000);
+    std::vector<std::string> hashes;
+    for (const std::string& unit : units) hashes.push_back(blobstore::put(unit));
+    EXPECT_EQ(blobstore::getMany(hashes), units); // this process has looked for dictionaries already
+
+    pid_t importer = fork();
+    ASSERT_GE(importer, 0);
+    if (importer == 0) {
+        bool ok = false;
+        try {
+            ok = blobstore::trainDictionary() != 0 && blobstore::recompressAll() == units.size();
+        } catch (...) {
+        }
+        _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(importer, &status, 0), importer);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::string stored;
+    std::getline(std::ifstream(blobFile(hashes[0]), std::ios::binary), stored, '\0');
+    const unsigned id = compression::dictionaryIdOf(stored);
+    EXPECT_NE(id, 0u);
+    EXPECT_EQ(blobstore::getMany(hashes), units);
+    EXPECT_EQ(blobstore::stats().dictionaryId, id);
+}
+
+// Footprint, read latency and how many units a fixed page cache holds: raw vs zstd vs zstd + dictionary.
+TEST_F(CompressionTest, FootprintAndReadLatency) {
+    const size_t count = 3000, bytes = 3000;
+    const size_t pageCache = 64 << 20;
+    std::vector<std::string> units = lectureUnits(count, bytes);
+    std::vector<std::string> hashes;
+    for (const std::string& unit : units) hashes.push_back(blobstore::hashOf(unit));
+
+    auto measure = [&](const char* label) {
+        size_t onDisk = footprint();
+        std::vector<std::string> read;
+        auto began = std::chrono::steady_clock::now();
+        for (int round = 0; round < 3; round++) read = blobstore::getMany(hashes);
+        double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - began).count() /
+                        (3.0 * count);
+        EXPECT_EQ(read, units);
+        std::cout << "[ zstd     ] " << label << ": " << onDisk / 1024 << " KiB on disk, " << micros
+                  << " us per unit read, " << pageCache / (onDisk / count) << " units per 64 MiB of page cache"
+                  << std::endl;
+        return onDisk;
+    };
+
+    for (const std::string& unit : units) writeRaw(unit);
+    size_t raw = measure("raw           ");
+
+    std::filesystem::remove_all(blobDir);
+    blobstore::setRoot(blobDir);
+    for (const std::string& unit : units) blobstore::put(unit);
+    size_t plain = measure("zstd          ");
+
+    blobstore::trainDictionary();
+    blobstore::recompressAll();
+    size_t trained = measure("zstd + dict   ");
+
+    EXPECT_LT(plain, raw);
+    EXPECT_LT(trained, plain);
+}
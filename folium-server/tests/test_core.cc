@@ -163,6 +163,27 @@ TEST_F(CoreTest, UploadToExistingNote) {
     std::filesystem::remove(appendFilePath);
 }
 
+// Test that an upload keeps the title it was given
+TEST_F(CoreTest, UploadKeepsItsTitle) {
+    // The first upload creates the note, named after it
+    ASSERT_NO_THROW(Core::uploadNote(testClassId, testUserId, testFilePath, testTitle));
+    nlohmann::json note = Core::getBigNote(testClassId, testUserId);
+    EXPECT_EQ(note["title"], testTitle);
+    ASSERT_EQ(note["units"].size(), 1u);
+    EXPECT_EQ(note["units"][0]["title"], testTitle);
+
+    // Later ones become units under their own titles
+    std::string appendFilePath = "append_title_test.txt";
+    create_test_file(appendFilePath, "Binary search halves the range each step.");
+    ASSERT_NO_THROW(Core::uploadNote(testClassId, testUserId, appendFilePath, "Week 2"));
+    note = Core::getBigNote(testClassId, testUserId);
+    EXPECT_EQ(note["title"], testTitle);
+    ASSERT_EQ(note["units"].size(), 2u);
+    EXPECT_EQ(note["units"][1]["title"], "Week 2");
+
+    std::filesystem::remove(appendFilePath);
+}
+
 // Test error handling - accessing class without enrollment
 TEST_F(CoreTest, AccessErrorHandling) {
     int unauthorizedUserId = 9999; // A user ID that's not enrolled
@@ -4,6 +4,7 @@
 
 #include <gtest/gtest.h>
 #include <stdexcept>
+#include <chrono>
 #include <fstream>
 #include <sstream>
 #include <cstdio>      // For std::remove
@@ -85,6 +86,62 @@ TEST(DalParameterTest, GetNoteFilePathInvalidNoteId) {
     }, std::invalid_argument);
 }
 
+TEST(DalParameterTest, GetClassDetailsInvalidIds) {
+    EXPECT_THROW({
+        DAL::getClassDetails(0);
+    }, std::invalid_argument);
+    EXPECT_THROW({
+        DAL::getClassDetail(1, 0);
+    }, std::invalid_argument);
+}
+
+TEST(DalParameterTest, BatchedWritesValidateInput) {
+    EXPECT_THROW({
+        DAL::enrollUsers(0, {1, 2});
+    }, std::invalid_argument);
+    EXPECT_THROW({
+        DAL::createUsers({{"someuser", "hash"}, {"", "hash"}});
+    }, std::invalid_argument);
+    // Nothing to write never opens a connection.
+    EXPECT_EQ(DAL::enrollUsers(1, {}), 0u);
+    EXPECT_EQ(DAL::createUsers({}), 0u);
+    EXPECT_TRUE(DAL::getUserIds({}).empty());
+}
+
+// -----------------------------------------------------------------------------
+// Multi-row INSERT chunking
+
+TEST(DalBatchTest, SplitsOnRowLimit) {
+    std::vector<std::string> rows;
+    for (int i = 0; i < 5; i++) {
+        rows.push_back("(" + std::to_string(i) + ")");
+    }
+    std::vector<std::string> batches = DAL::buildInsertBatches("INSERT INTO t (a) VALUES ", rows, 2);
+    ASSERT_EQ(batches.size(), 3u);
+    EXPECT_EQ(batches[0], "INSERT INTO t (a) VALUES (0),(1);");
+    EXPECT_EQ(batches[1], "INSERT INTO t (a) VALUES (2),(3);");
+    EXPECT_EQ(batches[2], "INSERT INTO t (a) VALUES (4);");
+}
+
+TEST(DalBatchTest, SplitsOnByteLimit) {
+    const std::string head = "INSERT INTO t (a) VALUES ";
+    std::vector<std::string> rows(4, "('" + std::string(20, 'x') + "')");
+    // Room for two rows per statement.
+    size_t maxBytes = head.size() + 2 * rows[0].size() + 2;
+    std::vector<std::string> batches = DAL::buildInsertBatches(head, rows, DAL::kMaxBatchRows, maxBytes);
+    ASSERT_EQ(batches.size(), 2u);
+    for (const std::string& batch : batches) {
+        EXPECT_LE(batch.size(), maxBytes);
+    }
+}
+
+TEST(DalBatchTest, OversizedRowGetsOwnStatement) {
+    std::vector<std::string> rows = {"(1)", "('" + std::string(100, 'x') + "')", "(3)"};
+    std::vector<std::string> batches = DAL::buildInsertBatches("INSERT INTO t (a) VALUES ", rows, 10, 40);
+    EXPECT_EQ(batches.size(), 3u);
+    EXPECT_TRUE(DAL::buildInsertBatches("INSERT INTO t (a) VALUES ", {}).empty());
+}
+
 TEST(DalParameterTest, CreateUserEmptyParams) {
     EXPECT_THROW({
         DAL::createUser("", "somepass");
@@ -112,6 +169,9 @@ TEST(DalParameterTest, UpdateUserPasswordEmptyParams) {
 class DALIntegrationTransactionTest : public ::testing::Test {
 protected:
     MYSQL* testConn; // Persistent connection for use during testing.
+    // Users a test created through DAL calls that commit on their own connection;
+    // the fixture transaction does not cover them, so TearDown deletes them.
+    std::vector<std::string> createdUsernames;
 
     void SetUp() override {
 #ifdef TESTING
@@ -132,6 +192,14 @@ protected:
         // Roll back all changes to leave the DB unchanged.
         mysql_query(testConn, "ROLLBACK;");
 #endif
+        if (!createdUsernames.empty()) {
+            // Their enrollments go with them (ON DELETE CASCADE).
+            std::string query = "DELETE FROM users WHERE username IN (";
+            for (size_t i = 0; i < createdUsernames.size(); i++) {
+                query += (i > 0 ? ", '" : "'") + DAL::escape_string(createdUsernames[i]) + "'";
+            }
+            DAL::execute_query(query + ");");
+        }
     }
 };
 
@@ -186,3 +254,48 @@ TEST_F(DALIntegrationTransactionTest, GetNoteFilePath) {
     std::string filePath = DAL::getNoteFilePath(noteIds.front());
     EXPECT_FALSE(filePath.empty());
 }
+
+TEST_F(DALIntegrationTransactionTest, GetClassDetailsCoversEnrolledClasses) {
+    auto userOpt = DAL::getUserByUsername("admin");
+    ASSERT_TRUE(userOpt.has_value()) << "User 'admin' not found.";
+    unsigned int admin_id = static_cast<unsigned int>(userOpt->id);
+
+    std::vector<DAL::ClassDetail> details = DAL::getClassDetails(admin_id);
+    for (int classId : DAL::getClassIds(admin_id)) {
+        auto detail = DAL::getClassDetail(admin_id, static_cast<unsigned int>(classId));
+        ASSERT_TRUE(detail.has_value()) << "Missing details for class " << classId;
+        EXPECT_FALSE(detail->name.empty());
+        EXPECT_FALSE(detail->ownerUsername.empty());
+    }
+    EXPECT_GE(details.size(), DAL::getClassIds(admin_id).size());
+}
+
+TEST_F(DALIntegrationTransactionTest, BulkCreateAndEnroll) {
+    std::vector<std::pair<std::string, std::string>> users;
+    std::vector<std::string> usernames;
+    // users.username is UNIQUE: names of this run only, so a leftover from a crashed run cannot collide.
+    const std::string prefix = "bulk_test_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + "_";
+    for (int i = 0; i < 25; i++) {
+        usernames.push_back(prefix + std::to_string(i));
+        users.push_back({usernames.back(), "hash"});
+    }
+    createdUsernames = usernames;
+    EXPECT_EQ(DAL::createUsers(users), users.size());
+
+    auto ids = DAL::getUserIds(usernames);
+    ASSERT_EQ(ids.size(), usernames.size());
+
+    auto admin = DAL::getUserByUsername("admin");
+    ASSERT_TRUE(admin.has_value());
+    std::vector<int> classIds = DAL::getClassIds(static_cast<unsigned int>(admin->id));
+    ASSERT_FALSE(classIds.empty());
+
+    std::vector<unsigned int> userIds;
+    for (const auto& [name, id] : ids) {
+        userIds.push_back(id);
+    }
+    unsigned int classId = static_cast<unsigned int>(classIds.front());
+    EXPECT_EQ(DAL::enrollUsers(classId, userIds), userIds.size());
+    // Enrolling again is a no-op.
+    EXPECT_EQ(DAL::enrollUsers(classId, userIds), 0u);
+}
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include "db_pool.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    // Hands out fake connections and remembers which are still open.
+    struct FakeServer
+    {
+        std::set<MYSQL *> open;
+        std::atomic<int> opens{0};
+        bool failOpen = false;
+        bool healthy = true;
+
+        DAL::ConnectionPool pool(size_t endpoints, DAL::PoolLimits limits)
+        {
+            return DAL::ConnectionPool(
+                endpoints, limits,
+                [this](size_t) {
+                    if (failOpen)
+                        throw std::runtime_error("connect failed");
+                    opens++;
+                    MYSQL *conn = new MYSQL();
+                    open.insert(conn);
+                    return conn;
+                },
+                [this](MYSQL *conn) {
+                    open.erase(conn);
+                    delete conn;
+                },
+                [this](MYSQL *) { return healthy; });
+        }
+    };
+
+    DAL::PoolLimits limits(unsigned int maxOpen, unsigned int maxIdle,
+                           std::chrono::milliseconds timeout = 50ms)
+    {
+        DAL::PoolLimits l;
+        l.maxOpen = maxOpen;
+        l.maxIdle = maxIdle;
+        l.acquireTimeout = timeout;
+        return l;
+    }
+}
+
+TEST(ConnectionPoolTest, ReusesReleasedConnection) {
+    FakeServer server;
+    {
+        DAL::ConnectionPool pool = server.pool(1, limits(4, 2));
+        MYSQL *first = pool.acquire(0);
+        pool.release(first);
+        MYSQL *second = pool.acquire(0);
+        EXPECT_EQ(first, second);
+        EXPECT_EQ(server.opens, 1);
+        EXPECT_EQ(pool.stats()["endpoints"][0]["reused"], 1);
+        pool.release(second);
+    }
+    EXPECT_TRUE(server.open.empty());
+}
+
+TEST(ConnectionPoolTest, TimesOutWhenEndpointIsFull) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(2, limits(1, 1));
+    MYSQL *held = pool.acquire(0);
+
+    EXPECT_THROW(pool.acquire(0), std::runtime_error);
+    EXPECT_EQ(pool.stats()["endpoints"][0]["timeouts"], 1);
+
+    // Endpoints have separate limits.
+    MYSQL *other = pool.acquire(1);
+    pool.release(other);
+    pool.release(held);
+}
+
+TEST(ConnectionPoolTest, WaiterGetsReleasedConnection) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(1, 1, 2000ms));
+    MYSQL *held = pool.acquire(0);
+
+    std::thread releaser([&]() {
+        std::this_thread::sleep_for(20ms);
+        pool.release(held);
+    });
+    MYSQL *next = pool.acquire(0);
+    releaser.join();
+
+    EXPECT_EQ(next, held);
+    EXPECT_EQ(pool.stats()["endpoints"][0]["waits"], 1);
+    pool.release(next);
+}
+
+TEST(ConnectionPoolTest, UnusableConnectionIsClosed) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(2, 2));
+    MYSQL *conn = pool.acquire(0);
+    pool.release(conn, false);
+
+    EXPECT_EQ(server.open.count(conn), 0u);
+    EXPECT_EQ(pool.stats()["endpoints"][0]["open"], 0);
+}
+
+TEST(ConnectionPoolTest, KeepsAtMostMaxIdle) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(4, 1));
+    MYSQL *a = pool.acquire(0);
+    MYSQL *b = pool.acquire(0);
+    pool.release(a);
+    pool.release(b);
+
+    EXPECT_EQ(server.open.size(), 1u);
+    EXPECT_EQ(pool.stats()["endpoints"][0]["idle"], 1);
+}
+
+TEST(ConnectionPoolTest, ShrinkWaitsForInFlightConnections) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(3, 3));
+    MYSQL *a = pool.acquire(0);
+    MYSQL *b = pool.acquire(0);
+    MYSQL *c = pool.acquire(0);
+    pool.release(c);
+
+    pool.reconfigure(limits(1, 1));
+    EXPECT_EQ(server.open.count(c), 0u); // idle surplus goes at once
+    EXPECT_EQ(server.open.count(a), 1u); // leased ones keep running
+    EXPECT_EQ(server.open.count(b), 1u);
+
+    pool.release(a);
+    EXPECT_EQ(server.open.count(a), 0u);
+    pool.release(b);
+    EXPECT_EQ(server.open.count(b), 1u);
+    EXPECT_EQ(pool.stats()["endpoints"][0]["open"], 1);
+}
+
+TEST(ConnectionPoolTest, GrowWakesWaiters) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(1, 1, 2000ms));
+    MYSQL *held = pool.acquire(0);
+
+    std::thread grower([&]() {
+        std::this_thread::sleep_for(20ms);
+        pool.reconfigure(limits(2, 2, 2000ms));
+    });
+    MYSQL *second = pool.acquire(0);
+    grower.join();
+
+    EXPECT_NE(second, held);
+    pool.release(second);
+    pool.release(held);
+}
+
+TEST(ConnectionPoolTest, ReconnectRetiresOldConnectionsAfterUse) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(2, 2));
+    MYSQL *idle = pool.acquire(0);
+    MYSQL *busy = pool.acquire(0);
+    pool.release(idle);
+
+    pool.reconfigure(limits(2, 2), true);
+    EXPECT_EQ(server.open.count(idle), 0u);
+    EXPECT_EQ(server.open.count(busy), 1u);
+
+    pool.release(busy);
+    EXPECT_EQ(server.open.count(busy), 0u);
+
+    MYSQL *fresh = pool.acquire(0);
+    EXPECT_EQ(server.opens, 3);
+    pool.release(fresh);
+}
+
+TEST(ConnectionPoolTest, LongIdleConnectionIsValidated) {
+    FakeServer server;
+    DAL::PoolLimits l = limits(2, 2);
+    l.validateAfter = 0ms;
+    DAL::ConnectionPool pool = server.pool(1, l);
+    MYSQL *dead = pool.acquire(0);
+    pool.release(dead);
+
+    server.healthy = false;
+    MYSQL *conn = pool.acquire(0);
+    EXPECT_EQ(server.opens, 2);
+    EXPECT_EQ(server.open.size(), 1u);
+    EXPECT_EQ(pool.stats()["endpoints"][0]["retired"], 1);
+    pool.release(conn);
+}
+
+TEST(ConnectionPoolTest, FailedOpenFreesItsSlot) {
+    FakeServer server;
+    DAL::ConnectionPool pool = server.pool(1, limits(1, 1));
+    server.failOpen = true;
+    EXPECT_THROW(pool.acquire(0), std::runtime_error);
+
+    server.failOpen = false;
+    MYSQL *conn = pool.acquire(0);
+    EXPECT_NE(conn, nullptr);
+    pool.release(conn);
+}
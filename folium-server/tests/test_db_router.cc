@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "db_router.h"
+
+using namespace std::chrono_literals;
+
+TEST(ReadRouterTest, RoundRobinsHealthyReplicas) {
+    DAL::ReadRouter router(2, 1000ms, 5000ms);
+    EXPECT_EQ(router.route("notes", "alice").replica, 0);
+    EXPECT_EQ(router.route("notes", "alice").replica, 1);
+    EXPECT_EQ(router.route("notes", "alice").replica, 0);
+}
+
+TEST(ReadRouterTest, SkipsLaggingReplica) {
+    DAL::ReadRouter router(2, 1000ms, 5000ms);
+    router.reportLag(0, 4000ms);
+    router.reportLag(1, 200ms);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(router.route("notes", "alice").replica, 1);
+    }
+}
+
+TEST(ReadRouterTest, FallsBackToPrimaryWhenNoReplicaQualifies) {
+    DAL::ReadRouter router(2, 1000ms, 5000ms);
+    router.reportLag(0, std::nullopt);
+    router.reportLag(1, 3000ms);
+
+    DAL::RouteDecision decision = router.route("notes", "alice");
+    EXPECT_EQ(decision.replica, DAL::RouteDecision::kPrimary);
+    EXPECT_EQ(decision.reason, "no-healthy-replica");
+    EXPECT_EQ(router.stats()["endpoints"]["notes"]["noHealthyReplica"], 1);
+}
+
+TEST(ReadRouterTest, WriterReadsItsOwnWrites) {
+    DAL::ReadRouter router(1, 1000ms, 50ms);
+    router.recordWrite("alice");
+
+    EXPECT_EQ(router.route("notes", "alice").reason, "read-your-writes");
+    EXPECT_EQ(router.route("notes", "bob").replica, 0);
+
+    std::this_thread::sleep_for(60ms);
+    EXPECT_EQ(router.route("notes", "alice").replica, 0);
+}
+
+TEST(ReadRouterTest, NoReplicasAlwaysUsesPrimary) {
+    DAL::ReadRouter router(0, 1000ms, 5000ms);
+    EXPECT_EQ(router.route("users", "alice").replica, DAL::RouteDecision::kPrimary);
+    EXPECT_EQ(router.stats()["endpoints"]["users"]["primary"], 1);
+    EXPECT_EQ(router.stats()["endpoints"]["users"]["noHealthyReplica"], 0);
+}
+
+TEST(ReadRouterTest, OneLagCheckPerInterval) {
+    DAL::ReadRouter router(1, 1000ms, 5000ms, 1h);
+    EXPECT_TRUE(router.claimLagCheck(0));
+    EXPECT_FALSE(router.claimLagCheck(0));
+    router.reportLag(0, 10ms);
+    EXPECT_FALSE(router.claimLagCheck(0));
+}
+
+TEST(ReadRouterTest, ConnectFailureMovesCountToPrimary) {
+    DAL::ReadRouter router(1, 1000ms, 5000ms, 1h);
+    ASSERT_EQ(router.route("notes", "alice").replica, 0);
+    router.recordConnectFailure("notes", 0);
+
+    nlohmann::json stats = router.stats();
+    EXPECT_EQ(stats["endpoints"]["notes"]["replica"], 0);
+    EXPECT_EQ(stats["endpoints"]["notes"]["primary"], 1);
+    EXPECT_EQ(stats["endpoints"]["notes"]["connectFailures"], 1);
+    EXPECT_FALSE(stats["replicas"][0]["healthy"]);
+    EXPECT_EQ(router.route("notes", "alice").replica, DAL::RouteDecision::kPrimary);
+}
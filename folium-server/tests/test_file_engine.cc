@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_engine.h"
+
+// Runs every test once per backend.
+class FileEngineTest : public ::testing::TestWithParam<fileio::Backend> {
+protected:
+    const std::string testDir = "file_engine_test_dir";
+
+    void SetUp() override {
+        std::filesystem::create_directories(testDir);
+        fileio::shutdown();
+        fileio::init(GetParam());
+        if (GetParam() == fileio::Backend::IO_URING && fileio::activeBackend() != fileio::Backend::IO_URING) {
+            GTEST_SKIP() << "io_uring is not available on this machine.";
+        }
+    }
+
+    void TearDown() override {
+        fileio::shutdown();
+        std::filesystem::remove_all(testDir);
+    }
+
+    std::string path(const std::string& name) const {
+        return testDir + "/" + name;
+    }
+};
+
+TEST(FileEngineBackendTest, ParsesBackendNames) {
+    EXPECT_EQ(fileio::backendFromString("pread"), fileio::Backend::PREAD);
+    EXPECT_EQ(fileio::backendFromString("io_uring"), fileio::Backend::IO_URING);
+    EXPECT_EQ(fileio::backendFromString(nullptr), fileio::Backend::IO_URING);
+    EXPECT_EQ(fileio::backendFromString(""), fileio::Backend::IO_URING);
+    // A typo is not silently taken for a choice; it warns and uses the default
+    EXPECT_EQ(fileio::backendFromString("pred"), fileio::Backend::IO_URING);
+}
+
+TEST_P(FileEngineTest, WriteAndRead) {
+    fileio::write(path("a.txt"), "hello engine");
+    EXPECT_EQ(fileio::read(path("a.txt")), "hello engine");
+}
+
+TEST_P(FileEngineTest, ReadEmptyFile) {
+    std::ofstream(path("empty.txt")).close();
+    EXPECT_EQ(fileio::read(path("empty.txt")), "");
+}
+
+TEST_P(FileEngineTest, ReadMissingFileThrows) {
+    EXPECT_THROW(fileio::read(path("missing.txt")), std::runtime_error);
+}
+
+TEST_P(FileEngineTest, WriteAtomicReplacesFile) {
+    fileio::write(path("note.json"), "old content that is longer");
+    fileio::writeAtomic(path("note.json"), "new");
+    EXPECT_EQ(fileio::read(path("note.json")), "new");
+    size_t files = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(testDir)) files += entry.is_regular_file();
+    EXPECT_EQ(files, 1u);
+}
+
+// Writers that share no lock still replace the file whole, and leave no temp files
+TEST_P(FileEngineTest, ConcurrentWriteAtomicNeverMixesWriters) {
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 8; t++) {
+        writers.emplace_back([this, t] {
+            const std::string data(64 * 1024, static_cast<char>('a' + t));
+            for (int i = 0; i < 20; i++) fileio::writeAtomic(path("shared.json"), data);
+        });
+    }
+    for (std::thread& writer : writers) writer.join();
+
+    std::string data = fileio::read(path("shared.json"));
+    ASSERT_EQ(data.size(), 64u * 1024);
+    EXPECT_EQ(data, std::string(data.size(), data[0]));
+    size_t files = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(testDir)) files += entry.is_regular_file();
+    EXPECT_EQ(files, 1u);
+}
+
+TEST_P(FileEngineTest, WriteAtomicManyBatchesSyncs) {
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 20; i++) {
+        files.push_back({path("batch_" + std::to_string(i) + ".json"), "note " + std::to_string(i)});
+    }
+    fileio::Stats before = fileio::stats();
+    fileio::writeAtomicMany(files);
+    fileio::Stats after = fileio::stats();
+
+    for (const auto& [file, data] : files) {
+        EXPECT_EQ(fileio::read(file), data);
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(testDir)) {
+        EXPECT_NE(entry.path().extension(), ".tmp") << "leftover temp file " << entry.path();
+    }
+    // write + fsync + rename per file, one directory fsync.
+    EXPECT_EQ(after.operations - before.operations, 3 * files.size() + 1);
+    if (GetParam() == fileio::Backend::IO_URING) {
+        // One io_uring_enter per batch: the writes, the fsyncs, the renames, the directory fsync.
+        EXPECT_EQ(after.submissions - before.submissions, 4u);
+    }
+}
+
+// A file removed before the swap is not brought back
+TEST_P(FileEngineTest, ReplaceExistingOnlyReplacesFilesThatExist) {
+    fileio::writeAtomic(path("blob"), "old");
+    EXPECT_EQ(fileio::read(path("blob")), "old");
+    EXPECT_TRUE(fileio::replaceExisting(path("blob"), "new"));
+    EXPECT_EQ(fileio::read(path("blob")), "new");
+
+    fileio::remove(path("blob"));
+    EXPECT_FALSE(fileio::replaceExisting(path("blob"), "newer"));
+    EXPECT_FALSE(std::filesystem::exists(path("blob")));
+    EXPECT_TRUE(std::filesystem::is_empty(testDir));
+}
+
+TEST_P(FileEngineTest, RepeatedReadsReuseDescriptor) {
+    fileio::writeAtomic(path("hot.json"), "hot note");
+    fileio::read(path("hot.json"));
+    fileio::Stats before = fileio::stats();
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(fileio::read(path("hot.json")), "hot note");
+    }
+    fileio::Stats after = fileio::stats();
+    EXPECT_EQ(after.fdCacheHits - before.fdCacheHits, 10u);
+    EXPECT_EQ(after.fdCacheMisses, before.fdCacheMisses);
+}
+
+TEST_P(FileEngineTest, CachedDescriptorSeesNewContent) {
+    fileio::writeAtomic(path("note.json"), "v1");
+    EXPECT_EQ(fileio::read(path("note.json")), "v1");
+
+    // Through the engine: the entry is dropped.
+    fileio::writeAtomic(path("note.json"), "v2");
+    EXPECT_EQ(fileio::read(path("note.json")), "v2");
+
+    // Behind the engine's back: the replaced inode has no links left.
+    std::ofstream(path("note.json.new")) << "v3";
+    std::filesystem::rename(path("note.json.new"), path("note.json"));
+    EXPECT_EQ(fileio::read(path("note.json")), "v3");
+
+    std::filesystem::remove(path("note.json"));
+    EXPECT_THROW(fileio::read(path("note.json")), std::runtime_error);
+}
+
+TEST_P(FileEngineTest, RecreatedDirectoryIsReopened) {
+    fileio::writeAtomic(path("a.json"), "first");
+    EXPECT_EQ(fileio::read(path("a.json")), "first");
+    std::filesystem::remove_all(testDir);
+    std::filesystem::create_directories(testDir);
+    std::ofstream(path("b.json")) << "second";
+    EXPECT_EQ(fileio::read(path("b.json")), "second");
+}
+
+TEST_P(FileEngineTest, RemoveDropsFile) {
+    fileio::writeAtomic(path("gone.json"), "bye");
+    fileio::read(path("gone.json"));
+    fileio::remove(path("gone.json"));
+    EXPECT_FALSE(std::filesystem::exists(path("gone.json")));
+    EXPECT_THROW(fileio::read(path("gone.json")), std::runtime_error);
+    EXPECT_NO_THROW(fileio::remove(path("gone.json")));
+}
+
+TEST_P(FileEngineTest, RenameMovesFile) {
+    fileio::write(path("from.txt"), "moving");
+    fileio::rename(path("from.txt"), path("to.txt"));
+    EXPECT_FALSE(std::filesystem::exists(path("from.txt")));
+    EXPECT_EQ(fileio::read(path("to.txt")), "moving");
+}
+
+TEST_P(FileEngineTest, ReadManyKeepsOrder) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < 16; i++) {
+        paths.push_back(path("many_" + std::to_string(i)));
+        fileio::write(paths.back(), std::string(i * 1000, 'a' + i));
+    }
+    std::vector<std::string> contents = fileio::readMany(paths);
+    ASSERT_EQ(contents.size(), paths.size());
+    for (int i = 0; i < 16; i++) {
+        EXPECT_EQ(contents[i], std::string(i * 1000, 'a' + i));
+    }
+}
+
+TEST_P(FileEngineTest, ConcurrentReadsShareSubmissions) {
+    const std::string content(64 * 1024, 'x');
+    fileio::write(path("shared.json"), content);
+
+    fileio::Stats before = fileio::stats();
+    std::vector<std::thread> readers;
+    std::atomic<int> mismatches{0};
+    for (int t = 0; t < 8; t++) {
+        readers.emplace_back([&]() {
+            for (int i = 0; i < 50; i++) {
+                if (fileio::read(path("shared.json")) != content) mismatches++;
+            }
+        });
+    }
+    for (auto& reader : readers) reader.join();
+    fileio::Stats after = fileio::stats();
+
+    EXPECT_EQ(mismatches, 0);
+    EXPECT_GE(after.operations - before.operations, 400u);
+    EXPECT_LE(after.submissions - before.submissions, after.operations - before.operations);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, FileEngineTest,
+                         ::testing::Values(fileio::Backend::PREAD, fileio::Backend::IO_URING));
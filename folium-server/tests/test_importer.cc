@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "importer.h"
+
+class ImporterTest : public ::testing::Test {
+protected:
+    const std::string dir = "importer_test_dir";
+
+    void SetUp() override {
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(dir);
+    }
+
+    std::string writeFile(const std::string& name, const std::string& content) {
+        std::string path = dir + "/" + name;
+        std::ofstream(path) << content;
+        return path;
+    }
+};
+
+TEST_F(ImporterTest, ParsesQuotedCsv) {
+    auto rows = importer::parseCsv("a,b,c\n\"x, y\",\"say \"\"hi\"\"\",\"multi\nline\"\r\n1,,3");
+    ASSERT_EQ(rows.size(), 3u);
+    EXPECT_EQ(rows[1][0], "x, y");
+    EXPECT_EQ(rows[1][1], "say \"hi\"");
+    EXPECT_EQ(rows[1][2], "multi\nline");
+    EXPECT_EQ(rows[2], (std::vector<std::string>{"1", "", "3"}));
+}
+
+TEST_F(ImporterTest, LoadsCsvManifest) {
+    std::string path = writeFile("classes.csv",
+        "name,owner,students,note,note_title\n"
+        "CS 101,alice,bob; carol,notes/cs101.txt,\n"
+        "Math,alice,,,Calculus\n");
+    importer::Manifest manifest = importer::loadManifest(path);
+
+    ASSERT_EQ(manifest.classes.size(), 2u);
+    const importer::ClassRecord& cs = manifest.classes[0];
+    EXPECT_EQ(cs.owner, "alice");
+    EXPECT_EQ(cs.students, (std::vector<std::string>{"bob", "carol"}));
+    EXPECT_EQ(cs.notePath, dir + "/notes/cs101.txt"); // relative to the manifest
+    EXPECT_EQ(cs.noteTitle, "CS 101");
+    EXPECT_TRUE(manifest.classes[1].notePath.empty());
+    EXPECT_EQ(manifest.classes[1].noteTitle, "Calculus");
+}
+
+TEST_F(ImporterTest, CsvNeedsNameAndOwner) {
+    std::string path = writeFile("bad.csv", "title,teacher\nCS 101,alice\n");
+    EXPECT_THROW(importer::loadManifest(path), std::runtime_error);
+}
+
+TEST_F(ImporterTest, LoadsJsonManifest) {
+    std::string path = writeFile("manifest.json", R"({
+        "users": [ { "username": "alice", "password": "pw" }, { "username": "bob", "passwordHash": "abc" } ],
+        "classes": [ { "name": "CS 101", "owner": "alice", "students": ["bob"], "note": "/abs/note.json" } ]
+    })");
+    importer::Manifest manifest = importer::loadManifest(path);
+
+    ASSERT_EQ(manifest.users.size(), 2u);
+    EXPECT_EQ(manifest.users[0].password, "pw");
+    EXPECT_EQ(manifest.users[1].passwordHash, "abc");
+    ASSERT_EQ(manifest.classes.size(), 1u);
+    EXPECT_EQ(manifest.classes[0].notePath, "/abs/note.json");
+    EXPECT_EQ(manifest.classes[0].noteTitle, "CS 101");
+}
+
+TEST_F(ImporterTest, MalformedJsonThrows) {
+    std::string path = writeFile("manifest.json", R"({ "classes": [ { "name": "no owner" } ] })");
+    EXPECT_THROW(importer::loadManifest(path), std::runtime_error);
+    EXPECT_THROW(importer::loadManifest(dir + "/missing.json"), std::runtime_error);
+    path = writeFile("manifest.json", R"({ "users": [ { "username": "nopass" } ] })");
+    EXPECT_THROW(importer::loadManifest(path), std::runtime_error);
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "line_diff.h"
+
+using json = nlohmann::json;
+
+class LineDiffTest : public ::testing::Test {
+protected:
+    std::mt19937 random{11};
+
+    std::string line() {
+        std::string text = "line " + std::to_string(random() % 100000) + ":";
+        for (int w = 0; w < 6; w++) text += " w" + std::to_string(random() % 3000);
+        return text;
+    }
+
+    std::vector<std::string> lines(size_t count) {
+        std::vector<std::string> out;
+        for (size_t i = 0; i < count; i++) {
+            // Blank lines and braces repeat, as in real notes
+            out.push_back(i % 7 == 0 ? "" : i % 11 == 0 ? "}" : line());
+        }
+        return out;
+    }
+
+    // Changes, inserts and deletes about @p share of the lines each
+    std::vector<std::string> edited(const std::vector<std::string>& original, double share) {
+        std::vector<std::string> out;
+        for (const std::string& l : original) {
+            unsigned roll = random() % 10000;
+            if (roll < share * 10000) out.push_back(line());                 // changed
+            else if (roll < share * 20000) { out.push_back(l); out.push_back(line()); } // line added after
+            else if (roll < share * 25000) continue;                         // deleted
+            else out.push_back(l);
+        }
+        return out;
+    }
+
+    static std::string join(const std::vector<std::string>& lines) {
+        std::string text;
+        for (size_t i = 0; i < lines.size(); i++) text += (i ? "\n" : "") + lines[i];
+        return text;
+    }
+
+    // Applying the hunks of diff(a, b) to a must give b
+    static void expectReproduces(const std::vector<std::string_view>& a, const std::vector<std::string_view>& b,
+                                 const std::vector<linediff::Hunk>& hunks) {
+        std::vector<std::string_view> rebuilt;
+        size_t next = 0;
+        for (const linediff::Hunk& h : hunks) {
+            ASSERT_GE(h.aStart, next);
+            ASSERT_TRUE(h.aCount > 0 || h.bCount > 0);
+            rebuilt.insert(rebuilt.end(), a.begin() + next, a.begin() + h.aStart);
+            rebuilt.insert(rebuilt.end(), b.begin() + h.bStart, b.begin() + h.bStart + h.bCount);
+            next = h.aStart + h.aCount;
+        }
+        rebuilt.insert(rebuilt.end(), a.begin() + next, a.end());
+        EXPECT_TRUE(rebuilt == b);
+    }
+};
+
+TEST_F(LineDiffTest, FindsTheChangedRegions) {
+    std::vector<std::string_view> a = linediff::splitLines("a\nb\nc\nd\ne\n");
+    std::vector<std::string_view> b = linediff::splitLines("a\nB\nc\nd\nnew\ne");
+    ASSERT_EQ(a.size(), 5u);
+
+    std::vector<linediff::Hunk> hunks = linediff::diff(a, b);
+    ASSERT_EQ(hunks.size(), 2u);
+    EXPECT_EQ(hunks[0].aStart, 1u);
+    EXPECT_EQ(hunks[0].aCount, 1u);
+    EXPECT_EQ(hunks[0].bCount, 1u);
+    EXPECT_EQ(hunks[1].aStart, 4u);
+    EXPECT_EQ(hunks[1].aCount, 0u);
+    EXPECT_EQ(hunks[1].bStart, 4u);
+    EXPECT_EQ(hunks[1].bCount, 1u);
+
+    EXPECT_TRUE(linediff::diff(a, a).empty());
+    EXPECT_EQ(linediff::diff({}, b).size(), 1u);
+    EXPECT_TRUE(linediff::diff({}, {}).empty());
+}
+
+TEST_F(LineDiffTest, HunksTurnOneTextIntoTheOther) {
+    for (int round = 0; round < 200; round++) {
+        // Few distinct lines, so most regions have no anchor and go to Myers
+        std::vector<std::string> base;
+        size_t size = random() % 60;
+        for (size_t i = 0; i < size; i++) base.push_back(std::string(1, static_cast<char>('a' + random() % 4)));
+        std::vector<std::string> other = edited(base, 0.15);
+        for (std::string& l : other) if (l.size() > 1) l = std::string(1, static_cast<char>('a' + random() % 4));
+
+        std::string textA = join(base), textB = join(other);
+        std::vector<std::string_view> a = linediff::splitLines(textA), b = linediff::splitLines(textB);
+        expectReproduces(a, b, linediff::diff(a, b));
+    }
+}
+
+TEST_F(LineDiffTest, MergeAddsTheUploadsLinesAndKeepsTheUnits) {
+    const std::string ours = "Sorting\nQuicksort picks a pivot.\nIt is O(n log n) on average.\nSee lecture 4.\n";
+    const std::string theirs = "Sorting\nQuicksort picks a pivot.\nMy note: the worst case is O(n^2).\n"
+                               "It is O(n log n) on average.\nSee lecture 4!";
+
+    linediff::MergeResult merged = linediff::merge(ours, theirs);
+    EXPECT_EQ(merged.text, "Sorting\nQuicksort picks a pivot.\nMy note: the worst case is O(n^2).\n"
+                           "It is O(n log n) on average.\nSee lecture 4.\n");
+    EXPECT_EQ(merged.inserted, 1u);
+
+    // The upload changed a line of the unit: the unit's line stays, and it is reported
+    ASSERT_EQ(merged.conflicts.size(), 1u);
+    EXPECT_EQ(merged.conflictCount, 1u);
+    EXPECT_EQ(linediff::toJson(merged.conflicts[0]),
+              json({{"line", 5}, {"ours", {"See lecture 4."}}, {"theirs", {"See lecture 4!"}}}));
+
+    // Merging an upload the unit already has changes nothing
+    EXPECT_EQ(linediff::merge(ours, ours).text, ours);
+    EXPECT_EQ(linediff::merge(merged.text, theirs).inserted, 0u);
+}
+
+TEST_F(LineDiffTest, MergeReportsAtMostTheConflictLimit) {
+    std::vector<std::string> base = lines(1000), other = base;
+    for (size_t i = 1; i < other.size(); i += 4) other[i] = line();
+    linediff::MergeResult merged = linediff::merge(join(base), join(other));
+    EXPECT_EQ(merged.text, join(base));
+    EXPECT_EQ(merged.conflicts.size(), linediff::kMaxConflicts);
+    EXPECT_EQ(merged.conflictCount, 250u);
+}
+
+// 1 MB notes against edited copies of themselves and against unrelated notes: diff time and
+// whether the hunks are right.
+TEST_F(LineDiffTest, MegabyteNotePairs) {
+    std::vector<std::string> note = lines(1);
+    while (join(note).size() < (1u << 20)) {
+        std::vector<std::string> more = lines(1000);
+        note.insert(note.end(), more.begin(), more.end());
+    }
+    struct Pair { const char* name; std::vector<std::string> other; };
+    std::vector<Pair> pairs = {
+        {"1% edited", edited(note, 0.01)},
+        {"10% edited", edited(note, 0.10)},
+        {"moved halves", {}},
+        {"unrelated", {}},
+    };
+    pairs[2].other.assign(note.begin() + note.size() / 2, note.end());
+    pairs[2].other.insert(pairs[2].other.end(), note.begin(), note.begin() + note.size() / 2);
+    pairs[3].other = lines(note.size());
+
+    const std::string textA = join(note);
+    const std::vector<std::string_view> a = linediff::splitLines(textA);
+    for (const Pair& pair : pairs) {
+        const std::string textB = join(pair.other);
+        const std::vector<std::string_view> b = linediff::splitLines(textB);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<linediff::Hunk> hunks = linediff::diff(a, b);
+        double diffMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        linediff::MergeResult merged = linediff::merge(textA, textB);
+        double mergeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        size_t changedLines = 0;
+        for (const linediff::Hunk& h : hunks) changedLines += h.aCount + h.bCount;
+        std::cout << "[ linediff ] " << pair.name << ": " << textA.size() / 1024 << " KiB vs " << textB.size() / 1024
+                  << " KiB, " << a.size() << " vs " << b.size() << " lines, " << hunks.size() << " hunks, "
+                  << changedLines << " lines changed; diff " << diffMs << " ms, merge " << mergeMs << " ms, "
+                  << merged.inserted << " lines merged, " << merged.conflictCount << " conflicts" << std::endl;
+        expectReproduces(a, b, hunks);
+    }
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "near_duplicate.h"
+
+using json = nlohmann::json;
+
+class NearDuplicateTest : public ::testing::Test {
+protected:
+    const int classId = 4646;
+    std::mt19937 random{7};
+    std::vector<std::string> vocabulary;
+
+    void SetUp() override {
+        for (int i = 0; i < 4000; i++) vocabulary.push_back("w" + std::to_string(i));
+    }
+
+    void TearDown() override {
+        for (int c = 0; c < 4; c++) neardup::forget(classId + c);
+    }
+
+    // Zipf-like: a few words are very common, as in lecture notes
+    std::string words(size_t count) {
+        std::string text;
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) text += i % 12 == 0 ? ".\n" : " ";
+            text += vocabulary[static_cast<size_t>(std::pow(random() % 10000 / 10000.0, 2.5) * vocabulary.size())];
+        }
+        return text;
+    }
+
+    // Changes about @p share of the words and appends a line, like a student's annotated copy
+    std::string lightlyEdited(const std::string& text, double share) {
+        std::string edited;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find(' ', start);
+            if (end == std::string::npos) end = text.size();
+            edited += random() % 1000 < share * 1000 ? words(1) : text.substr(start, end - start);
+            if (end < text.size()) edited += ' ';
+            start = end + 1;
+        }
+        return edited + "\nMy notes: " + words(8);
+    }
+
+    static json unit(const std::string& unitId, const std::string& content) {
+        return {{"unitId", unitId}, {"title", "Unit"}, {"content", content}};
+    }
+};
+
+TEST_F(NearDuplicateTest, SketchesEstimateSimilarity) {
+    const std::string text = words(800);
+    neardup::Sketch original = neardup::sketch(text);
+    EXPECT_DOUBLE_EQ(neardup::similarity(original, neardup::sketch(text)), 1.0);
+    EXPECT_GT(neardup::similarity(original, neardup::sketch(lightlyEdited(text, 0.02))), 0.75);
+    EXPECT_LT(neardup::similarity(original, neardup::sketch(words(800))), 0.15);
+
+    EXPECT_DOUBLE_EQ(neardup::similarity(neardup::sketch("Binary search, on SORTED arrays!"),
+                                         neardup::sketch("binary search on sorted arrays")), 1.0);
+    EXPECT_TRUE(neardup::sketch(" .,; ").empty);
+    EXPECT_EQ(neardup::similarity(neardup::sketch(""), neardup::sketch("")), 0.0);
+}
+
+TEST_F(NearDuplicateTest, FindsTheMostSimilarUnitOfTheClass) {
+    const std::string slides = words(600), other = words(600);
+    int loads = 0;
+    auto loadNote = [&]() {
+        loads++;
+        return json{{"title", "Notes"}, {"units", {unit("slides", slides), unit("other", other)}}};
+    };
+
+    std::optional<neardup::Match> match = neardup::nearest(classId, lightlyEdited(slides, 0.01), loadNote, 0.6);
+    ASSERT_TRUE(match);
+    EXPECT_EQ(match->unitId, "slides");
+    EXPECT_GT(match->similarity, 0.8);
+
+    EXPECT_FALSE(neardup::nearest(classId, words(600), loadNote, 0.6));
+    EXPECT_FALSE(neardup::nearest(classId + 1, slides, []() { return json(); }, 0.6));
+    EXPECT_EQ(loads, 1); // the index stays in memory
+
+    // Uploads store their JSON document as the content
+    std::string upload = json{{"title", "Week 1"}, {"content", other}}.dump();
+    match = neardup::nearest(classId, upload, loadNote, 0.6);
+    ASSERT_TRUE(match);
+    EXPECT_EQ(match->unitId, "other");
+}
+
+TEST_F(NearDuplicateTest, EditsKeepALoadedIndexCurrent) {
+    const std::string first = words(400), second = words(400);
+    auto loadNote = [&]() { return json{{"units", {unit("u1", first)}}}; };
+    ASSERT_TRUE(neardup::nearest(classId, first, loadNote, 0.9));
+
+    neardup::update(classId, unit("u2", second));
+    ASSERT_TRUE(neardup::nearest(classId, second, loadNote, 0.9));
+    EXPECT_EQ(neardup::nearest(classId, second, loadNote, 0.9)->unitId, "u2");
+
+    neardup::update(classId, unit("u1", words(400))); // edited away from the first text
+    EXPECT_FALSE(neardup::nearest(classId, first, loadNote, 0.9));
+    neardup::remove(classId, "u2");
+    EXPECT_FALSE(neardup::nearest(classId, second, loadNote, 0.9));
+
+    // Forgotten indexes are built again from the note
+    neardup::forget(classId);
+    EXPECT_TRUE(neardup::nearest(classId, first, loadNote, 0.9));
+
+    // Unloaded classes ignore edits
+    neardup::update(classId + 2, unit("u1", first));
+    EXPECT_FALSE(neardup::nearest(classId + 2, first, []() { return json(); }, 0.9));
+}
+
+// A term of uploads to one class: shared slides, students' lightly edited copies of them and
+// of each other's notes, and original notes. How much smaller the note stays and what a check costs.
+TEST_F(NearDuplicateTest, CorpusShrinkAndCheckCost) {
+    std::vector<std::string> uploads;
+    std::vector<std::string> slides;
+    for (int i = 0; i < 40; i++) slides.push_back(words(1500));
+    for (int i = 0; i < 1200; i++) {
+        int kind = static_cast<int>(random() % 100);
+        if (kind < 25) {
+            uploads.push_back(slides[random() % slides.size()]);                             // same slides
+        } else if (kind < 45) {
+            uploads.push_back(lightlyEdited(slides[random() % slides.size()], 0.03));         // annotated slides
+        } else if (kind < 55 && !uploads.empty()) {
+            uploads.push_back(lightlyEdited(uploads[random() % uploads.size()], 0.02));       // a friend's notes
+        } else {
+            uploads.push_back(words(300 + random() % 1500));                                  // original notes
+        }
+    }
+
+    json note = {{"units", json::array()}};
+    size_t allBytes = 0, keptBytes = 0, dropped = 0, flagged = 0, unitCount = 0;
+    double slowestMs = 0;
+    auto began = std::chrono::steady_clock::now();
+    for (const std::string& upload : uploads) {
+        allBytes += upload.size();
+        auto start = std::chrono::steady_clock::now();
+        std::optional<neardup::Match> match = neardup::nearest(classId, upload, [&]() { return note; }, 0.6);
+        slowestMs = std::max(slowestMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (match && match->similarity >= 0.9) {
+            dropped++;
+            continue;
+        }
+        flagged += match.has_value();
+        keptBytes += upload.size();
+        neardup::update(classId, unit("unit_" + std::to_string(++unitCount), upload));
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+
+    neardup::Stats stats = neardup::stats();
+    std::cout << "[ neardup  ] " << uploads.size() << " uploads, " << allBytes / 1024 << " KiB: dropped " << dropped
+              << ", flagged " << flagged << ", note " << keptBytes / 1024 << " KiB ("
+              << 100.0 * (allBytes - keptBytes) / allBytes << "% smaller)" << std::endl;
+    std::cout << "[ neardup  ] " << totalMs * 1000 / uploads.size() << " us per check including sketching, slowest "
+              << slowestMs << " ms, " << static_cast<double>(stats.candidates) / stats.checks
+              << " candidates per check, " << stats.units << " sketches" << std::endl;
+
+    // Every exact copy of the slides is caught; annotated copies mostly are
+    EXPECT_GT(dropped, uploads.size() / 4);
+    EXPECT_LT(keptBytes, allBytes * 3 / 4);
+}
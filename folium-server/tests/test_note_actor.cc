@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "data_access_layer.h"
+#include "note_actor.h"
+#include "note_buffer.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+using namespace std::chrono_literals;
+
+class NoteActorTest : public ::testing::Test {
+protected:
+    const int classId = 4545;
+    const std::string notePath = "note_actor_test.json";
+
+    void SetUp() override {
+        DAL::writeFile(notePath, json{{"title", "Actor"}, {"units", json::array()}}.dump());
+        Core::NoteBuffer::instance().invalidate(classId);
+    }
+
+    void TearDown() override {
+        Core::NoteActor::instance().stop();
+        Core::NoteBuffer::instance().stop();
+        Core::NoteBuffer::instance().invalidate(classId);
+        std::filesystem::remove(notePath);
+    }
+
+    // A read-modify-write over two buffer calls, like a merge picking the next unitId
+    Core::NoteActor::Job appendNext() const {
+        return [this]() {
+            std::shared_ptr<const json> note = Core::NoteBuffer::instance().read(classId, notePath);
+            std::string unitId = "unit_" + std::to_string((*note)["units"].size() + 1);
+            std::this_thread::sleep_for(100us);
+            Core::NoteBuffer::instance().apply(classId, notePath, [&](json& doc) {
+                doc["units"].push_back({{"unitId", unitId}, {"content", "x"}});
+            });
+            return json(unitId);
+        };
+    }
+
+    // Posts @p perThread jobs from each of @p threads threads and waits for them all.
+    std::vector<json> postConcurrently(int threads, int perThread) {
+        std::vector<std::future<json>> results(threads * perThread);
+        std::vector<std::thread> posters;
+        for (int t = 0; t < threads; t++) {
+            posters.emplace_back([&, t]() {
+                for (int i = 0; i < perThread; i++)
+                    results[t * perThread + i] = Core::NoteActor::instance().post(classId, appendNext());
+            });
+        }
+        for (std::thread& poster : posters) poster.join();
+        std::vector<json> values;
+        for (auto& result : results) values.push_back(result.get());
+        return values;
+    }
+};
+
+TEST_F(NoteActorTest, ConcurrentMutationsOfAClassDoNotInterleave) {
+    Core::NoteActor::instance().start(4);
+    std::vector<json> unitIds = postConcurrently(8, 25);
+
+    // Every job saw the previous one's unit: no unitId was handed out twice
+    std::set<std::string> distinct;
+    for (const json& unitId : unitIds) distinct.insert(unitId.get<std::string>());
+    EXPECT_EQ(distinct.size(), 200u);
+    EXPECT_EQ(notestore::load(notePath)["units"].size(), 200u);
+}
+
+TEST_F(NoteActorTest, RunsInlineWithoutWorkers) {
+    std::vector<json> unitIds = postConcurrently(4, 10);
+    std::set<std::string> distinct;
+    for (const json& unitId : unitIds) distinct.insert(unitId.get<std::string>());
+    EXPECT_EQ(distinct.size(), 40u);
+    EXPECT_EQ(notestore::load(notePath)["units"].size(), 40u);
+}
+
+TEST_F(NoteActorTest, EachCallerGetsItsOwnResult) {
+    Core::NoteActor::instance().start(2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    // The first job holds the mailbox so the rest queue up behind it as one batch
+    auto first = Core::NoteActor::instance().post(classId, [released]() {
+        released.wait();
+        return json("first");
+    });
+    auto ok = Core::NoteActor::instance().post(classId, []() { return json(1); });
+    auto bad = Core::NoteActor::instance().post(classId, []() -> json { throw std::invalid_argument("bad edit"); });
+    auto after = Core::NoteActor::instance().post(classId, []() { return json(2); });
+    release.set_value();
+
+    EXPECT_EQ(first.get(), "first");
+    EXPECT_EQ(ok.get(), 1);
+    EXPECT_THROW(bad.get(), std::invalid_argument);
+    EXPECT_EQ(after.get(), 2);
+    EXPECT_GE(Core::NoteActor::instance().stats().largestBatch, 3u);
+}
+
+TEST_F(NoteActorTest, ClassesRunInParallel) {
+    Core::NoteActor::instance().start(2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    auto blocked = Core::NoteActor::instance().post(classId, [released]() {
+        released.wait();
+        return json(true);
+    });
+    // Another class is not stuck behind it
+    EXPECT_EQ(Core::NoteActor::instance().run(classId + 1, []() { return json("other"); }), "other");
+    release.set_value();
+    EXPECT_TRUE(blocked.get().get<bool>());
+}
+
+TEST_F(NoteActorTest, BatchesArePersistedOnce) {
+    // Write-through buffer: without the actor every edit would write the file
+    Core::NoteActor::instance().start(1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    uint64_t fileWrites = Core::NoteBuffer::instance().stats().fileWrites;
+
+    auto first = Core::NoteActor::instance().post(classId, [this, released]() {
+        released.wait();
+        return appendNext()();
+    });
+    std::vector<std::future<json>> rest;
+    for (int i = 0; i < 20; i++) rest.push_back(Core::NoteActor::instance().post(classId, appendNext()));
+    release.set_value();
+    first.get();
+    for (auto& result : rest) result.get();
+
+    Core::NoteActorStats stats = Core::NoteActor::instance().stats();
+    EXPECT_EQ(notestore::load(notePath)["units"].size(), 21u);
+    EXPECT_LE(Core::NoteBuffer::instance().stats().fileWrites - fileWrites, 2u);
+    EXPECT_EQ(stats.queued, 0u);
+}
+
+TEST_F(NoteActorTest, StopFinishesPostedJobs) {
+    Core::NoteActor::instance().start(1);
+    std::vector<std::future<json>> results;
+    for (int i = 0; i < 50; i++) results.push_back(Core::NoteActor::instance().post(classId, appendNext()));
+    Core::NoteActor::instance().stop();
+    for (auto& result : results) EXPECT_EQ(result.wait_for(0s), std::future_status::ready);
+    EXPECT_EQ(notestore::load(notePath)["units"].size(), 50u);
+}
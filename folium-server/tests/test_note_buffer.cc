@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "data_access_layer.h"
+#include "note_buffer.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+using namespace std::chrono_literals;
+
+class NoteBufferTest : public ::testing::Test {
+protected:
+    const int classId = 4242;
+    const std::string notePath = "note_buffer_test.json";
+
+    void SetUp() override {
+        DAL::writeFile(notePath, json{{"title", "Buffered"}, {"units", json::array()}}.dump());
+        Core::NoteBuffer::instance().invalidate(classId);
+    }
+
+    void TearDown() override {
+        Core::NoteBuffer::instance().stop();
+        Core::NoteBuffer::instance().invalidate(classId);
+        std::filesystem::remove(notePath);
+    }
+
+    static Core::NoteBuffer::Mutation appendUnit(int n) {
+        return [n](json& note) {
+            note["units"].push_back({{"unitId", "unit_" + std::to_string(n)}, {"content", "edit"}});
+        };
+    }
+
+    size_t unitsOnDisk() const {
+        return notestore::load(notePath)["units"].size();
+    }
+};
+
+TEST_F(NoteBufferTest, WriteThroughBeforeStart) {
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(1));
+    EXPECT_EQ(unitsOnDisk(), 1u);
+}
+
+TEST_F(NoteBufferTest, ReadsSeePendingEdits) {
+    Core::NoteBufferOptions options;
+    options.flushInterval = 10s;
+    Core::NoteBuffer::instance().start(options);
+
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(1));
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(2));
+
+    EXPECT_EQ(unitsOnDisk(), 0u);
+    EXPECT_EQ((*Core::NoteBuffer::instance().read(classId, notePath))["units"].size(), 2u);
+}
+
+TEST_F(NoteBufferTest, StopFlushesDirtyNotes) {
+    Core::NoteBufferOptions options;
+    options.flushInterval = 10s;
+    Core::NoteBuffer::instance().start(options);
+
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(1));
+    Core::NoteBuffer::instance().stop();
+
+    EXPECT_EQ(unitsOnDisk(), 1u);
+}
+
+TEST_F(NoteBufferTest, FlushesOnEditThreshold) {
+    Core::NoteBufferOptions options;
+    options.flushInterval = 10s;
+    options.maxPendingEdits = 4;
+    Core::NoteBuffer::instance().start(options);
+
+    for (int i = 0; i < 4; i++) {
+        Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(i));
+    }
+    EXPECT_EQ(unitsOnDisk(), 4u);
+}
+
+TEST_F(NoteBufferTest, FlushesOnInterval) {
+    Core::NoteBufferOptions options;
+    options.flushInterval = 20ms;
+    Core::NoteBuffer::instance().start(options);
+
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(1));
+    std::this_thread::sleep_for(200ms);
+    EXPECT_EQ(unitsOnDisk(), 1u);
+}
+
+// Bursty load: several writers hammering one class. Reports file writes per edit.
+TEST_F(NoteBufferTest, BurstCoalescesWrites) {
+    Core::NoteBufferOptions options;
+    options.flushInterval = 50ms;
+    Core::NoteBuffer::instance().start(options);
+
+    Core::NoteBufferStats before = Core::NoteBuffer::instance().stats();
+    const int writers = 8, editsPerWriter = 100;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < writers; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < editsPerWriter; i++) {
+                Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(t * editsPerWriter + i), 64);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    Core::NoteBuffer::instance().stop();
+    Core::NoteBufferStats after = Core::NoteBuffer::instance().stats();
+
+    const uint64_t edits = after.edits - before.edits;
+    const uint64_t writes = after.fileWrites - before.fileWrites;
+    std::cout << "[ burst    ] " << edits << " edits -> " << writes << " file writes ("
+              << static_cast<double>(writes) / edits << " writes/edit)" << std::endl;
+
+    EXPECT_EQ(edits, static_cast<uint64_t>(writers * editsPerWriter));
+    EXPECT_LT(writes, edits / 4);
+    EXPECT_EQ(unitsOnDisk(), static_cast<size_t>(writers * editsPerWriter));
+}
+
+TEST_F(NoteBufferTest, AppendUnitOnlyAppendsToLog) {
+    auto numbered = [](const json& note, const Core::NoteBuffer::UnitIndex&) {
+        return json{{"unitId", "unit_" + std::to_string(note["units"].size() + 1)}, {"content", "upload"}};
+    };
+    Core::NoteBufferStats before = Core::NoteBuffer::instance().stats();
+    for (int i = 0; i < 3; i++) {
+        Core::NoteBuffer::instance().appendUnit(classId, notePath, "Buffered", numbered);
+    }
+    Core::NoteBufferStats after = Core::NoteBuffer::instance().stats();
+
+    // The legacy document is rewritten once as a log; later uploads only append.
+    EXPECT_EQ(after.fileWrites - before.fileWrites, 3u);
+    EXPECT_EQ(after.appendWrites - before.appendWrites, 2u);
+    json note = notestore::load(notePath);
+    ASSERT_EQ(note["units"].size(), 3u);
+    EXPECT_EQ(note["units"][2]["unitId"], "unit_3");
+}
+
+TEST_F(NoteBufferTest, ApplyAfterAppendRewritesNote) {
+    notestore::save(notePath, {{"title", "Buffered"}, {"units", json::array()}});
+    Core::NoteBufferOptions options;
+    options.flushInterval = 10s;
+    Core::NoteBuffer::instance().start(options);
+
+    Core::NoteBuffer::instance().appendUnit(classId, notePath, "Buffered",
+                                            [](const json&, const Core::NoteBuffer::UnitIndex&) { return json{{"unitId", "unit_1"}}; });
+    Core::NoteBuffer::instance().apply(classId, notePath, [](json& note) { note["title"] = "Renamed"; });
+    Core::NoteBuffer::instance().stop();
+
+    notestore::FileInfo info;
+    json note = notestore::load(notePath, &info);
+    EXPECT_EQ(note["title"], "Renamed");
+    EXPECT_EQ(note["units"].size(), 1u);
+    EXPECT_EQ(info.appended, 0u);
+}
+
+TEST_F(NoteBufferTest, LongLogIsCompacted) {
+    Core::NoteBufferStats before = Core::NoteBuffer::instance().stats();
+    for (size_t i = 0; i <= notestore::kCompactAfter; i++) {
+        Core::NoteBuffer::instance().appendUnit(classId, notePath, "Buffered",
+                                                [](const json&, const Core::NoteBuffer::UnitIndex&) { return json{{"unitId", "unit"}}; });
+    }
+    Core::NoteBufferStats after = Core::NoteBuffer::instance().stats();
+
+    EXPECT_EQ(after.compactions - before.compactions, 1u);
+    notestore::FileInfo info;
+    EXPECT_EQ(notestore::load(notePath, &info)["units"].size(), notestore::kCompactAfter + 1);
+    EXPECT_EQ(info.appended, 0u);
+}
+
+TEST_F(NoteBufferTest, UnitEditsOnlyAppendTheUnit) {
+    for (int i = 1; i <= 3; i++) {
+        Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(i));
+    }
+    Core::NoteBufferStats before = Core::NoteBuffer::instance().stats();
+
+    auto updated = Core::NoteBuffer::instance().upsertUnit(classId, notePath, "unit_2", {{"content", "fixed"}});
+    EXPECT_FALSE(updated.inserted);
+    EXPECT_EQ(updated.position, 1u);
+
+    auto inserted = Core::NoteBuffer::instance().upsertUnit(classId, notePath, "unit_9", {{"content", "new"}}, "unit_1");
+    EXPECT_TRUE(inserted.inserted);
+    EXPECT_EQ(inserted.position, 1u);
+
+    EXPECT_EQ(Core::NoteBuffer::instance().deleteUnit(classId, notePath, "unit_3"), 3u);
+    EXPECT_FALSE(Core::NoteBuffer::instance().deleteUnit(classId, notePath, "unit_3"));
+    EXPECT_THROW(Core::NoteBuffer::instance().upsertUnit(classId, notePath, "unit_10", json::object(), "missing"),
+                 std::invalid_argument);
+
+    Core::NoteBufferStats after = Core::NoteBuffer::instance().stats();
+    EXPECT_EQ(after.appendWrites - before.appendWrites, 3u);
+
+    Core::NoteBuffer::instance().invalidate(classId);
+    json note = notestore::load(notePath);
+    ASSERT_EQ(note["units"].size(), 3u);
+    EXPECT_EQ(note["units"][0]["unitId"], "unit_1");
+    EXPECT_EQ(note["units"][1]["unitId"], "unit_9");
+    EXPECT_EQ(note["units"][2]["unitId"], "unit_2");
+    EXPECT_EQ(note["units"][2]["content"], "fixed");
+}
+
+TEST_F(NoteBufferTest, EvictsLeastRecentlyUsedOverBudget) {
+    const std::string otherPath = "note_buffer_test_other.json";
+    const int otherClass = classId + 1;
+    const std::string big(4000, 'x');
+    notestore::save(notePath, {{"title", "A"}, {"units", json::array({{{"unitId", "unit_1"}, {"content", big}}})}});
+    notestore::save(otherPath, {{"title", "B"}, {"units", json::array({{{"unitId", "unit_1"}, {"content", big}}})}});
+    Core::NoteBuffer::instance().invalidate(otherClass);
+
+    Core::NoteBufferOptions options;
+    options.flushInterval = 10s;
+    options.maxResidentBytes = 6000; // room for one of the two notes
+    Core::NoteBuffer::instance().start(options);
+
+    Core::NoteBufferStats before = Core::NoteBuffer::instance().stats();
+    Core::NoteBuffer::instance().read(classId, notePath);
+    Core::NoteBuffer::instance().read(otherClass, otherPath);
+    Core::NoteBuffer::instance().read(otherClass, otherPath);
+    Core::NoteBufferStats after = Core::NoteBuffer::instance().stats();
+
+    EXPECT_EQ(after.budgetEvictions - before.budgetEvictions, 1u);
+    EXPECT_EQ(after.residentHits - before.residentHits, 1u);
+    EXPECT_LE(after.residentBytes, options.maxResidentBytes);
+    EXPECT_GT(after.residentBytes, big.size());
+
+    Core::NoteBuffer::instance().stop();
+    Core::NoteBuffer::instance().invalidate(otherClass);
+    std::filesystem::remove(otherPath);
+}
+
+TEST_F(NoteBufferTest, ReloadsWhenAnotherProcessChangedTheNote) {
+    const uint64_t reloads = Core::NoteBuffer::instance().stats().versionReloads;
+    Core::NoteBuffer::instance().read(classId, notePath, 1);
+
+    // Rewritten behind the buffer's back, e.g. by folium-import.
+    notestore::save(notePath, {{"title", "Imported"}, {"units", json::array()}});
+    EXPECT_EQ((*Core::NoteBuffer::instance().read(classId, notePath, 1))["title"], "Buffered");
+    EXPECT_EQ((*Core::NoteBuffer::instance().read(classId, notePath, 2))["title"], "Imported");
+    EXPECT_EQ(Core::NoteBuffer::instance().stats().versionReloads - reloads, 1u);
+
+    // Our own edits move notes.version too; that version is adopted without a reload.
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(1));
+    Core::NoteBuffer::instance().read(classId, notePath, 3);
+    EXPECT_EQ(Core::NoteBuffer::instance().stats().versionReloads - reloads, 1u);
+}
+
+TEST_F(NoteBufferTest, ReadsShareOneSnapshotUntilTheNextEdit) {
+    std::shared_ptr<const json> first = Core::NoteBuffer::instance().read(classId, notePath);
+    EXPECT_EQ(Core::NoteBuffer::instance().read(classId, notePath), first);
+
+    Core::NoteBuffer::instance().apply(classId, notePath, appendUnit(1));
+    std::shared_ptr<const json> edited = Core::NoteBuffer::instance().read(classId, notePath);
+    EXPECT_NE(edited, first);
+    EXPECT_EQ((*edited)["units"].size(), (*first)["units"].size() + 1);
+}
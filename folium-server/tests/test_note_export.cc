@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "note_export.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+using noteexport::Format;
+
+class NoteExportTest : public ::testing::Test {
+protected:
+    const std::string blobDir = "note_export_test_blobs";
+    const std::string cacheDir = "note_export_test_cache";
+    const std::string notePath = "note_export_test_note.json";
+
+    void SetUp() override {
+        blobstore::setRoot(blobDir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(blobDir);
+        std::filesystem::remove_all(cacheDir);
+        std::filesystem::remove(notePath);
+        blobstore::setRoot("blobs");
+    }
+
+    static json unit(const std::string& unitId, const std::string& title, const std::string& content) {
+        return {{"unitId", unitId}, {"title", title}, {"content", content}};
+    }
+
+    std::string render(Format format) const {
+        noteexport::Renderer renderer(notePath, format);
+        std::string out;
+        while (renderer.next(out)) {}
+        return out;
+    }
+
+    std::string stream(noteexport::ExportStream& exportStream) const {
+        std::string out, chunk;
+        while (exportStream.next(chunk)) out += chunk;
+        return out;
+    }
+
+    std::vector<std::string> cacheFiles() const {
+        std::vector<std::string> files;
+        if (!std::filesystem::exists(cacheDir)) return files;
+        for (const auto& file : std::filesystem::recursive_directory_iterator(cacheDir)) {
+            if (file.is_regular_file()) files.push_back(file.path().filename().string());
+        }
+        return files;
+    }
+};
+
+TEST_F(NoteExportTest, ParsesFormats) {
+    EXPECT_EQ(noteexport::parseFormat("markdown"), Format::Markdown);
+    EXPECT_EQ(noteexport::parseFormat("MD"), Format::Markdown);
+    EXPECT_EQ(noteexport::parseFormat("html"), Format::Html);
+    EXPECT_EQ(noteexport::parseFormat("txt"), Format::Text);
+    EXPECT_EQ(noteexport::parseFormat("pdf"), std::nullopt);
+    EXPECT_STREQ(noteexport::extension(Format::Html), "html");
+}
+
+TEST_F(NoteExportTest, RendersEveryFormat) {
+    notestore::save(notePath, {{"title", "Algorithms"},
+                               {"units", {unit("unit_1", "Sorting", "Merge sort.\n\nQuick <sort> & co."),
+                                          unit("unit_2", "Upload", json{{"title", "Up"}, {"content", "From a file"}}.dump())}}});
+
+    EXPECT_EQ(render(Format::Markdown),
+              "# Algorithms\n\n## Sorting\n\nMerge sort.\n\nQuick <sort> & co.\n\n## Upload\n\nFrom a file\n\n");
+    EXPECT_EQ(render(Format::Text),
+              "Algorithms\n==========\n\nSorting\n-------\n\nMerge sort.\n\nQuick <sort> & co.\n\n"
+              "Upload\n------\n\nFrom a file\n\n");
+
+    std::string html = render(Format::Html);
+    EXPECT_EQ(html.rfind("<!DOCTYPE html>", 0), 0u);
+    EXPECT_NE(html.find("<title>Algorithms</title>"), std::string::npos);
+    EXPECT_NE(html.find("<section id=\"unit_1\">\n<h2>Sorting</h2>\n<p>Merge sort.</p>\n<p>Quick &lt;sort&gt; &amp; co.</p>"),
+              std::string::npos);
+    EXPECT_NE(html.find("<p>From a file</p>"), std::string::npos);
+    EXPECT_EQ(html.substr(html.size() - 16), "</body>\n</html>\n");
+}
+
+TEST_F(NoteExportTest, RendersAppendedRecordsAndBlobContent) {
+    const std::string big(20000, 'b');
+    notestore::save(notePath, {{"title", "Log"}, {"units", {unit("u1", "One", "first")}}});
+    notestore::appendRecords(notePath, {notestore::record::append(1, unit("u2", "Two", big)),
+                                        notestore::record::set(unit("u1", "One", "changed"))});
+
+    EXPECT_EQ(render(Format::Markdown), "# Log\n\n## One\n\nchanged\n\n## Two\n\n" + big + "\n\n");
+}
+
+TEST_F(NoteExportTest, CachesEachVersionAndDropsOlderOnes) {
+    notestore::save(notePath, {{"title", "Cached"}, {"units", {unit("u1", "One", "first")}}});
+    std::string expected = render(Format::Markdown);
+
+    {
+        noteexport::ExportStream first(notePath, 7, "2026-01-01 10:00:00", Format::Markdown, cacheDir);
+        EXPECT_FALSE(first.cached());
+        EXPECT_EQ(stream(first), expected);
+    }
+    EXPECT_EQ(cacheFiles().size(), 1u);
+    {
+        noteexport::ExportStream again(notePath, 7, "2026-01-01 10:00:00", Format::Markdown, cacheDir);
+        EXPECT_TRUE(again.cached());
+        EXPECT_EQ(stream(again), expected);
+    }
+
+    // Another format is cached next to it
+    {
+        noteexport::ExportStream text(notePath, 7, "2026-01-01 10:00:00", Format::Text, cacheDir);
+        stream(text);
+    }
+    EXPECT_EQ(cacheFiles().size(), 2u);
+
+    // A new version replaces the cached export of the old one
+    notestore::save(notePath, {{"title", "Cached"}, {"units", {unit("u1", "One", "second")}}});
+    {
+        noteexport::ExportStream changed(notePath, 7, "2026-01-01 10:05:00", Format::Markdown, cacheDir);
+        EXPECT_FALSE(changed.cached());
+        EXPECT_NE(stream(changed).find("second"), std::string::npos);
+    }
+    EXPECT_EQ(cacheFiles().size(), 2u);
+}
+
+TEST_F(NoteExportTest, AbandonedExportsAreNotCached) {
+    json note = {{"title", "Big"}, {"units", json::array()}};
+    for (int i = 0; i < 40; i++) note["units"].push_back(unit("u" + std::to_string(i), "Unit", std::string(8000, 'a' + i % 26)));
+    notestore::save(notePath, note);
+    {
+        noteexport::ExportStream partial(notePath, 8, "v1", Format::Html, cacheDir);
+        std::string chunk;
+        ASSERT_TRUE(partial.next(chunk));
+    }
+    EXPECT_TRUE(cacheFiles().empty());
+}
+
+// Time to first chunk and largest chunk for a note of about 50 MB.
+TEST_F(NoteExportTest, StreamsLargeNotesInBoundedChunks) {
+    json note = {{"title", "Huge"}, {"units", json::array()}};
+    const size_t units = 5000, bytes = 10000;
+    for (size_t i = 0; i < units; i++) {
+        note["units"].push_back(unit("unit_" + std::to_string(i), "Unit " + std::to_string(i),
+                                     std::to_string(i) + std::string(bytes, 'x')));
+    }
+    notestore::save(notePath, note);
+    note = json();
+
+    auto began = std::chrono::steady_clock::now();
+    noteexport::ExportStream exportStream(notePath, 9, "v1", Format::Markdown, cacheDir);
+    std::string chunk;
+    ASSERT_TRUE(exportStream.next(chunk));
+    double firstMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+
+    size_t total = chunk.size(), largest = chunk.size();
+    while (exportStream.next(chunk)) {
+        total += chunk.size();
+        largest = std::max(largest, chunk.size());
+    }
+    double allMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+    std::cout << "[ export   ] " << total / (1 << 20) << " MiB: first chunk after " << firstMs << " ms, all after "
+              << allMs << " ms, largest chunk " << largest << " bytes" << std::endl;
+
+    EXPECT_GT(total, units * bytes);
+    EXPECT_LT(largest, noteexport::kChunkSize + bytes + 100);
+}
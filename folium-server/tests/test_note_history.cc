@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "data_access_layer.h"
+#include "note_history.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+
+class NoteHistoryTest : public ::testing::Test {
+protected:
+    const std::string blobDir = "note_history_test_blobs";
+    std::string notePath;
+
+    void SetUp() override {
+        blobstore::setRoot(blobDir);
+        // The history index is cached per note for the life of the process, so every test gets its own note.
+        notePath = std::string("note_history_test_") + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(blobDir);
+        std::filesystem::remove_all(notehistory::dirFor(notePath));
+    }
+
+    static json unitWith(const std::string& unitId, const std::string& content) {
+        return {{"unitId", unitId}, {"title", "Unit " + unitId}, {"content", content}};
+    }
+
+    static json emptyNote() {
+        return {{"title", "Lecture notes"}, {"units", json::array()}};
+    }
+};
+
+TEST_F(NoteHistoryTest, RebuildsEveryVersionFromSnapshotsAndDeltas) {
+    json note = emptyNote();
+    std::vector<json> expected = {json()};
+    notehistory::snapshot(notePath, 1, "Created note", note);
+    expected.push_back(note);
+
+    for (int i = 1; i <= 40; i++) {
+        json records = json::array();
+        if (i % 5 == 0) {
+            // edit an earlier unit
+            json unit = unitWith("unit_" + std::to_string(i - 2), "edited " + std::to_string(i));
+            for (json& existing : note["units"]) {
+                if (existing["unitId"] == unit["unitId"]) existing = unit;
+            }
+            records.push_back(notestore::record::set(unit));
+        } else if (i % 7 == 0) {
+            records.push_back(notestore::record::remove(note["units"][0]["unitId"].get<std::string>()));
+            note["units"].erase(note["units"].begin());
+        } else {
+            json unit = unitWith("unit_" + std::to_string(i), std::string(200 + i, 'a' + i % 26));
+            records.push_back(notestore::record::append(note["units"].size(), unit));
+            note["units"].push_back(unit);
+        }
+        if (i == 20) {
+            records.push_back({{"title", "Renamed"}});
+            note["title"] = "Renamed";
+        }
+        EXPECT_EQ(notehistory::record(notePath, 2, "Edit " + std::to_string(i), records, []() { return json(); }),
+                  static_cast<size_t>(i + 1));
+        expected.push_back(note);
+    }
+
+    std::vector<notehistory::Version> versions = notehistory::list(notePath);
+    ASSERT_EQ(versions.size(), 41u);
+    for (size_t v = 1; v <= versions.size(); v++) {
+        EXPECT_EQ(notehistory::at(notePath, v), expected[v]) << "version " << v;
+        EXPECT_LT(v - versions[v - 1].base, notehistory::kSnapshotEvery);
+    }
+    EXPECT_EQ(versions[16].base, 17u);
+    EXPECT_EQ(versions[40].base, 33u);
+    EXPECT_EQ(versions[0].description, "Created note");
+    EXPECT_EQ(versions[40].userId, 2);
+    EXPECT_EQ(versions[40].timestamp.size(), 19u);
+}
+
+TEST_F(NoteHistoryTest, FirstRecordOfAnUntrackedNoteIsASnapshot) {
+    json note = emptyNote();
+    note["units"].push_back(unitWith("unit_1", "one"));
+    bool asked = false;
+    size_t version = notehistory::record(notePath, 1, "Uploaded one",
+                                         json::array({notestore::record::append(0, unitWith("unit_1", "one"))}),
+                                         [&]() { asked = true; return note; });
+    EXPECT_EQ(version, 1u);
+    EXPECT_TRUE(asked);
+    EXPECT_EQ(notehistory::at(notePath, 1), note);
+    EXPECT_TRUE(std::filesystem::exists(notehistory::dirFor(notePath) + "/1.snapshot"));
+}
+
+TEST_F(NoteHistoryTest, DeltasKeepLargeContentInBlobs) {
+    notehistory::snapshot(notePath, 1, "Created note", emptyNote());
+    const std::string content(10000, 'z');
+    notehistory::record(notePath, 1, "Uploaded big", json::array({notestore::record::append(0, unitWith("unit_1", content))}),
+                        []() { return json(); });
+
+    std::string deltas = DAL::readFile(notehistory::dirFor(notePath) + "/1.deltas");
+    EXPECT_LT(deltas.size(), 500u);
+    EXPECT_NE(deltas.find(blobstore::hashOf(content)), std::string::npos);
+    EXPECT_EQ(notehistory::at(notePath, 2)["units"][0]["content"], content);
+}
+
+TEST_F(NoteHistoryTest, AppendsRecordedOutOfOrderRebuildTheSameNote) {
+    notehistory::snapshot(notePath, 1, "Created note", emptyNote());
+    // The note saw unit_1 at 0 then unit_2 at 1; the history got them the other way around.
+    notehistory::record(notePath, 1, "Second", json::array({notestore::record::append(1, unitWith("unit_2", "two"))}),
+                        []() { return json(); });
+    notehistory::record(notePath, 1, "First", json::array({notestore::record::append(0, unitWith("unit_1", "one"))}),
+                        []() { return json(); });
+
+    json units = notehistory::at(notePath, 3)["units"];
+    ASSERT_EQ(units.size(), 2u);
+    EXPECT_EQ(units[0]["unitId"], "unit_1");
+    EXPECT_EQ(units[1]["unitId"], "unit_2");
+}
+
+TEST_F(NoteHistoryTest, LoadsIndexFromDiskSkippingTornLines) {
+    const std::string dir = notehistory::dirFor(notePath);
+    std::filesystem::create_directories(dir);
+    notestore::save(dir + "/1.snapshot", emptyNote());
+    DAL::writeFile(dir + "/index",
+                   "\n{\"version\":1,\"userId\":4,\"timestamp\":\"2026-01-01 00:00:00\",\"description\":\"Created note\",\"base\":1}\n"
+                   "\n{\"version\":2,\"userId\":4,\"times");
+
+    std::vector<notehistory::Version> versions = notehistory::list(notePath);
+    ASSERT_EQ(versions.size(), 1u);
+    EXPECT_EQ(versions[0].userId, 4);
+    EXPECT_EQ(versions[0].timestamp, "2026-01-01 00:00:00");
+
+    // The torn version is written again, after a line break that ends the torn one.
+    EXPECT_EQ(notehistory::record(notePath, 4, "Retried", json::array({{{"title", "Again"}}}), []() { return json(); }), 2u);
+    EXPECT_EQ(notehistory::at(notePath, 2)["title"], "Again");
+}
+
+TEST_F(NoteHistoryTest, UnknownVersionThrows) {
+    notehistory::snapshot(notePath, 1, "Created note", emptyNote());
+    EXPECT_THROW(notehistory::at(notePath, 0), std::invalid_argument);
+    EXPECT_THROW(notehistory::at(notePath, 2), std::invalid_argument);
+}
+
+TEST_F(NoteHistoryTest, SnapshotsReferenceContentTheStoreAlreadyHas) {
+    const std::string content(5000, 'q');
+    const std::string hash = blobstore::put(content); // as the note itself holds it
+    json note = emptyNote();
+    note["units"].push_back(unitWith("unit_1", content));
+
+    const uint64_t puts = blobstore::stats().puts;
+    notehistory::snapshot(notePath, 1, "Created note", note);
+    EXPECT_EQ(blobstore::stats().puts, puts);
+    EXPECT_EQ(blobstore::refCount(hash), 2u);
+    EXPECT_EQ(notehistory::at(notePath, 1), note);
+}
+
+TEST_F(NoteHistoryTest, DropsTheOldestVersionsAndTheirBlobs) {
+    json note = emptyNote();
+    note["units"].push_back(unitWith("unit_1", std::string(300, 'a')));
+    notehistory::snapshot(notePath, 1, "Created note", note);
+    const size_t total = notehistory::kMaxVersions + 2 * notehistory::kSnapshotEvery;
+    std::vector<std::string> hashes = {blobstore::hashOf(note["units"][0]["content"])};
+    for (size_t v = 2; v <= total; v++) {
+        json unit = unitWith("unit_1", "version " + std::to_string(v) + std::string(300, 'b'));
+        hashes.push_back(blobstore::hashOf(unit["content"]));
+        note["units"][0] = unit;
+        notehistory::record(notePath, 1, "Edit", json::array({notestore::record::set(unit)}), []() { return json(); });
+    }
+
+    std::vector<notehistory::Version> versions = notehistory::list(notePath);
+    ASSERT_FALSE(versions.empty());
+    const size_t first = versions.front().version;
+    EXPECT_GT(first, 1u);
+    EXPECT_GE(versions.size(), notehistory::kMaxVersions);
+    EXPECT_LE(versions.size(), notehistory::kMaxVersions + notehistory::kSnapshotEvery);
+    EXPECT_EQ(versions.front().base, first);
+    EXPECT_EQ(versions.back().version, total);
+    EXPECT_THROW(notehistory::at(notePath, first - 1), std::invalid_argument);
+    EXPECT_EQ(notehistory::at(notePath, total), note);
+    EXPECT_FALSE(std::filesystem::exists(notehistory::dirFor(notePath) + "/1.snapshot"));
+    EXPECT_FALSE(std::filesystem::exists(notehistory::dirFor(notePath) + "/1.deltas"));
+
+    // Content only dropped versions had is gone; what the kept ones have stays
+    for (size_t v = 1; v < first; v++) EXPECT_EQ(blobstore::refCount(hashes[v - 1]), 0u) << "version " << v;
+    for (size_t v = first; v <= total; v++) EXPECT_GT(blobstore::refCount(hashes[v - 1]), 0u) << "version " << v;
+}
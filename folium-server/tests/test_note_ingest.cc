@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "data_access_layer.h"
+#include "note_ingest.h"
+
+using json = nlohmann::json;
+
+class NoteIngestTest : public ::testing::Test {
+protected:
+    const std::string uploadPath = "note_ingest_test.upload";
+    const std::string unitPath = "note_ingest_test.unit";
+
+    void TearDown() override {
+        std::filesystem::remove(uploadPath);
+        std::filesystem::remove(unitPath);
+    }
+
+    void writeUpload(const std::string& content) {
+        std::ofstream(uploadPath, std::ios::binary) << content;
+    }
+
+    // Normalizes the upload as the pipeline does and returns the unit content
+    std::string ingest(noteingest::Normalized* normalized = nullptr) {
+        noteingest::Normalized result =
+            noteingest::normalize(uploadPath, unitPath, noteingest::detect(uploadPath));
+        std::string content = DAL::readFile(unitPath);
+        EXPECT_EQ(result.size, content.size());
+        EXPECT_EQ(result.hash, blobstore::hashOf(content));
+        if (normalized) *normalized = result;
+        return content;
+    }
+
+    static long peakRssKiB() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+};
+
+TEST_F(NoteIngestTest, TellsJsonFromText) {
+    writeUpload(R"({"title": "Week 1", "content": "Sorting"})");
+    EXPECT_EQ(noteingest::detect(uploadPath), noteingest::Format::Json);
+    writeUpload("\xEF\xBB\xBF[1, 2]");
+    EXPECT_EQ(noteingest::detect(uploadPath), noteingest::Format::Json);
+    writeUpload("Binary search halves the range.\n");
+    EXPECT_EQ(noteingest::detect(uploadPath), noteingest::Format::Text);
+    writeUpload(R"({"title": "Week 1"} and more)");
+    EXPECT_EQ(noteingest::detect(uploadPath), noteingest::Format::Text);
+}
+
+TEST_F(NoteIngestTest, JsonIsWrittenCompactlyInUploadOrder) {
+    const std::string upload = "\xEF\xBB\xBF{\n  \"title\": \"Week 1\",\n  \"content\": \"Line \\\"one\\\"\\n\\ttab \\u00e9 \\u0001\",\n"
+                               "  \"tags\": [ \"a\", [], {} ],\n  \"pages\": 12, \"ratio\": 1.50e1, \"draft\": false, \"note\": null\n}\n";
+    writeUpload(upload);
+    std::string content = ingest();
+    EXPECT_EQ(content, "{\"title\":\"Week 1\",\"content\":\"Line \\\"one\\\"\\n\\ttab \xC3\xA9 \\u0001\","
+                       "\"tags\":[\"a\",[],{}],\"pages\":12,\"ratio\":1.50e1,\"draft\":false,\"note\":null}");
+    EXPECT_EQ(json::parse(content), json::parse(upload.substr(3)));
+}
+
+TEST_F(NoteIngestTest, TextIsStoredNormalizedNotWrapped) {
+    writeUpload("\xEF\xBB\xBF\r\nSorting  \r\n\tQuicksort\t\rpicks a pivot \xFF\xC3 ok \xE2\x82\xAC\n  \n\n");
+    EXPECT_EQ(ingest(), "\nSorting\n\tQuicksort\npicks a pivot \xEF\xBF\xBD\xEF\xBF\xBD ok \xE2\x82\xAC");
+    EXPECT_EQ(noteingest::normalizeText("a \r\n\r\nb\t\n"), "a\n\nb");
+    EXPECT_EQ(noteingest::normalizeText("\xED\xA0\x80"), "\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD"); // a surrogate
+    EXPECT_EQ(noteingest::normalizeText("\xF0\x9F\x93"), "\xEF\xBF\xBD");                         // cut short
+}
+
+// Line breaks, blanks and multi-byte characters across the read buffer's edges
+TEST_F(NoteIngestTest, StreamingMatchesInMemory) {
+    std::mt19937 random(5);
+    const char* pieces[] = {"word", " ", "\t", "\r\n", "\r", "\n", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x93\x9D", "\xFF"};
+    std::string text;
+    while (text.size() < 3 * noteingest::kBufferBytes) text += pieces[random() % 10];
+    writeUpload(text);
+    EXPECT_EQ(ingest(), noteingest::normalizeText(text));
+}
+
+// A large upload of either kind costs the buffers, not a multiple of its size
+TEST_F(NoteIngestTest, LargeUploadsStayWithinTheBuffers) {
+    const size_t target = 48u << 20;
+    const long before = peakRssKiB();
+    {
+        std::ofstream out(uploadPath, std::ios::binary);
+        std::string line = "Quicksort picks a pivot and partitions the range around it.   \r\n";
+        for (size_t written = 0; written < target; written += line.size()) out << line;
+    }
+    auto start = std::chrono::steady_clock::now();
+    noteingest::Normalized text = noteingest::normalize(uploadPath, unitPath, noteingest::detect(uploadPath));
+    double textMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    {
+        std::ofstream out(uploadPath, std::ios::binary);
+        out << "{\"title\": \"Term\", \"units\": [";
+        std::string unit = "{\"unitId\": \"u\", \"content\": \"Quicksort picks a pivot\\nand partitions.\"}";
+        for (size_t written = 0; written < target; written += unit.size() + 2) out << (written ? ", " : "") << unit;
+        out << "]}";
+    }
+    start = std::chrono::steady_clock::now();
+    ASSERT_EQ(noteingest::detect(uploadPath), noteingest::Format::Json);
+    noteingest::Normalized document = noteingest::normalize(uploadPath, unitPath, noteingest::Format::Json);
+    double jsonMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const long grown = peakRssKiB() - before;
+
+    std::cout << "[ ingest   ] " << (target >> 20) << " MiB text in " << textMs << " ms -> " << (text.size >> 20)
+              << " MiB, " << (target >> 20) << " MiB JSON in " << jsonMs << " ms -> " << (document.size >> 20)
+              << " MiB; peak RSS grew " << grown << " KiB" << std::endl;
+    EXPECT_LT(text.size, target);
+    EXPECT_LT(document.size, target);
+    EXPECT_LT(grown, 8 * 1024);
+}
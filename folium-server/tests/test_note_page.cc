@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "note_buffer.h"
+#include "note_page.h"
+#include "note_store.h"
+
+using json = nlohmann::json;
+using notestore::Fields;
+using notestore::PageQuery;
+
+class NotePageTest : public ::testing::Test {
+protected:
+    const int classId = 4343;
+    const std::string blobDir = "note_page_test_blobs";
+    const std::string notePath = "note_page_test_note.json";
+    const std::string big = std::string(20000, 'c'); // stored as a blob
+
+    void SetUp() override {
+        blobstore::setRoot(blobDir);
+        Core::NoteBuffer::instance().invalidate(classId);
+        notestore::save(notePath, {{"title", "Paged"},
+                                   {"units", {unit("u1", "One", "first"), unit("u2", "Two", big),
+                                              unit("u3", "Three", "third"), unit("u4", "Four", "fourth")}}});
+    }
+
+    void TearDown() override {
+        Core::NoteBuffer::instance().stop();
+        Core::NoteBuffer::instance().invalidate(classId);
+        std::filesystem::remove(notePath);
+        std::filesystem::remove_all(blobDir);
+        blobstore::setRoot("blobs");
+    }
+
+    static json unit(const std::string& unitId, const std::string& title, const std::string& content) {
+        return {{"unitId", unitId}, {"title", title}, {"content", content}};
+    }
+
+    static PageQuery range(size_t offset, std::optional<size_t> limit, Fields fields = Fields::Full) {
+        PageQuery query;
+        query.offset = offset;
+        query.limit = limit;
+        query.fields = fields;
+        return query;
+    }
+
+    // The same page from the file and from the parsed note
+    json bothWays(const PageQuery& query) const {
+        notestore::NoteView view(notePath);
+        json fromView = notestore::page(view, query);
+        EXPECT_EQ(fromView, notestore::page(notestore::load(notePath), query));
+        return fromView;
+    }
+
+    static std::vector<std::string> unitIds(const json& page) {
+        std::vector<std::string> ids;
+        for (const json& unit : page["units"]) ids.push_back(unit["unitId"]);
+        return ids;
+    }
+};
+
+TEST_F(NotePageTest, SelectsRanges) {
+    json page = bothWays(range(1, 2));
+    EXPECT_EQ(page["title"], "Paged");
+    EXPECT_EQ(page["totalUnits"], 4);
+    EXPECT_EQ(unitIds(page), (std::vector<std::string>{"u2", "u3"}));
+    EXPECT_EQ(page["units"][0]["content"], big);
+
+    EXPECT_EQ(unitIds(bothWays(range(2, std::nullopt))), (std::vector<std::string>{"u3", "u4"}));
+    EXPECT_EQ(unitIds(bothWays(range(3, 100))), (std::vector<std::string>{"u4"}));
+    EXPECT_TRUE(bothWays(range(9, 1))["units"].empty());
+    EXPECT_TRUE(bothWays(range(0, 0))["units"].empty());
+}
+
+TEST_F(NotePageTest, SelectsUnitIdsInOrder) {
+    PageQuery query;
+    query.unitIds = {"u4", "missing", "u1"};
+    EXPECT_EQ(unitIds(bothWays(query)), (std::vector<std::string>{"u4", "u1"}));
+}
+
+TEST_F(NotePageTest, ProjectsFields) {
+    json titles = bothWays(range(0, std::nullopt, Fields::Titles));
+    EXPECT_EQ(titles["units"][1], (json{{"unitId", "u2"}, {"title", "Two"}}));
+
+    json noContent = bothWays(range(1, 1, Fields::NoContent));
+    EXPECT_EQ(noContent["units"][0], (json{{"unitId", "u2"}, {"title", "Two"}}));
+
+    // Without content, a unit's blob is never read
+    std::filesystem::remove_all(blobDir);
+    notestore::NoteView view(notePath);
+    EXPECT_EQ(notestore::page(view, range(0, std::nullopt, Fields::Titles))["units"].size(), 4u);
+    EXPECT_THROW(notestore::page(view, range(1, 1)), std::runtime_error);
+}
+
+TEST_F(NotePageTest, QueriesRoundTripThroughJson) {
+    PageQuery query = range(5, 10, Fields::NoContent);
+    query.unitIds = {"a"};
+    PageQuery copy = PageQuery::fromJson(query.toJson());
+    EXPECT_EQ(copy.offset, 5u);
+    EXPECT_EQ(copy.limit, std::optional<size_t>(10));
+    EXPECT_EQ(copy.unitIds, query.unitIds);
+    EXPECT_EQ(copy.fields, Fields::NoContent);
+
+    EXPECT_EQ(PageQuery::fromJson(json::object()).limit, std::nullopt);
+    EXPECT_THROW(PageQuery::fromJson({{"offset", -1}}), std::invalid_argument);
+    EXPECT_THROW(PageQuery::fromJson({{"fields", "everything"}}), std::invalid_argument);
+    EXPECT_EQ(notestore::parseFields("NoContent"), Fields::NoContent);
+}
+
+TEST_F(NotePageTest, BufferPagesResidentNotesAndReadsOthersFromTheFile) {
+    Core::NoteBuffer& buffer = Core::NoteBuffer::instance();
+    uint64_t pageReads = buffer.stats().pageReads;
+
+    // Not resident: read from the file and left that way
+    EXPECT_EQ(unitIds(buffer.readPage(classId, notePath, 0, range(0, 2))), (std::vector<std::string>{"u1", "u2"}));
+    EXPECT_EQ(buffer.stats().pageReads, pageReads + 1);
+    EXPECT_EQ(buffer.stats().residentBytes, 0u);
+
+    // Pending edits are visible
+    Core::NoteBufferOptions options;
+    options.flushInterval = std::chrono::hours(1);
+    buffer.start(options);
+    buffer.upsertUnit(classId, notePath, "u5", {{"title", "Five"}, {"content", "fifth"}});
+    json page = buffer.readPage(classId, notePath, 0, range(3, 5, Fields::Titles));
+    EXPECT_EQ(page["totalUnits"], 5);
+    EXPECT_EQ(page["units"][1], (json{{"unitId", "u5"}, {"title", "Five"}}));
+    EXPECT_EQ(buffer.stats().pageReads, pageReads + 1);
+}
+
+// A table of contents of a large note against the whole note.
+TEST_F(NotePageTest, TableOfContentsCostsKilobytes) {
+    json note = {{"title", "Huge"}, {"units", json::array()}};
+    for (int i = 0; i < 5000; i++) {
+        note["units"].push_back(unit("unit_" + std::to_string(i), "Unit " + std::to_string(i),
+                                     std::to_string(i) + std::string(2000, 'x')));
+    }
+    notestore::save(notePath, note);
+    note = json();
+
+    auto time = [&](const PageQuery& query, size_t& bytes) {
+        auto began = std::chrono::steady_clock::now();
+        notestore::NoteView view(notePath);
+        bytes = notestore::page(view, query).dump().size();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+    };
+    size_t wholeBytes = 0, tocBytes = 0, firstBytes = 0;
+    double wholeMs = time(range(0, std::nullopt), wholeBytes);
+    double tocMs = time(range(0, std::nullopt, Fields::Titles), tocBytes);
+    double firstMs = time(range(0, 20), firstBytes);
+    std::cout << "[ page     ] whole note " << wholeBytes << " bytes in " << wholeMs << " ms, titles " << tocBytes
+              << " bytes in " << tocMs << " ms, first 20 units " << firstBytes << " bytes in " << firstMs << " ms"
+              << std::endl;
+
+    EXPECT_LT(tocBytes * 20, wholeBytes);
+    EXPECT_LT(firstBytes * 100, wholeBytes);
+}
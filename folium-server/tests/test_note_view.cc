@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "data_access_layer.h"
+#include "note_store.h"
+#include "note_view.h"
+
+using json = nlohmann::json;
+
+class NoteViewTest : public ::testing::Test {
+protected:
+    const std::string blobDir = "note_view_test_blobs";
+    const std::string notePath = "note_view_test.note";
+
+    void SetUp() override {
+        blobstore::setRoot(blobDir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(blobDir);
+        std::filesystem::remove(notePath);
+    }
+
+    static json unitWith(const std::string& unitId, const std::string& content) {
+        return {{"unitId", unitId}, {"title", "Unit " + unitId}, {"content", content}};
+    }
+
+    static json noteOf(size_t units, size_t contentBytes) {
+        json note = {{"title", "Lecture notes"}, {"units", json::array()}};
+        for (size_t i = 1; i <= units; i++) {
+            std::string content = "unit " + std::to_string(i) + " ";
+            content.resize(contentBytes, static_cast<char>('a' + i % 26));
+            note["units"].push_back(unitWith("unit_" + std::to_string(i), content));
+        }
+        return note;
+    }
+
+    template <typename F>
+    static double microsPerCall(int calls, F&& f) {
+        auto began = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            f();
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - began).count() / calls;
+    }
+};
+
+TEST_F(NoteViewTest, RoundTripIsLossless) {
+    json note = {
+        {"title", "Café ☃"},
+        {"course", {{"code", "CS 101"}, {"credits", 4}, {"weight", 0.25}, {"tags", {"intro", nullptr, true}}}},
+        {"units", json::array({
+            unitWith("unit_1", std::string(300, 'x')),
+            {{"title", "no id"}, {"content", "inline"}, {"order", -3}},
+            unitWith("unit_3", ""),
+        })},
+    };
+    notestore::save(notePath, note);
+    EXPECT_EQ(notestore::load(notePath), note);
+
+    // Notes that are not unit documents survive too.
+    notestore::save(notePath, json::array({1, "two", 3.5}));
+    EXPECT_EQ(notestore::load(notePath), json::array({1, "two", 3.5}));
+}
+
+TEST_F(NoteViewTest, ReadsTitleAndSingleUnits) {
+    notestore::save(notePath, noteOf(50, 1000));
+
+    notestore::NoteView view(notePath);
+    EXPECT_TRUE(view.appendable());
+    EXPECT_EQ(view.title(), "Lecture notes");
+    EXPECT_EQ(view.unitCount(), 50u);
+    EXPECT_EQ(view.unitIds()[9], "unit_10");
+
+    std::optional<size_t> at = view.find("unit_42");
+    ASSERT_TRUE(at);
+    EXPECT_EQ(*at, 41u);
+    EXPECT_TRUE(view.storedUnit(*at).contains("blob"));
+    EXPECT_EQ(view.unit(*at), noteOf(50, 1000)["units"][41]);
+    EXPECT_FALSE(view.find("unit_51"));
+}
+
+TEST_F(NoteViewTest, ReplaysRecordsOverSnapshot) {
+    notestore::save(notePath, noteOf(3, 10));
+    notestore::appendRecords(notePath, json::array({
+        notestore::record::append(3, unitWith("unit_4", "four")),
+        notestore::record::set(unitWith("unit_1", "edited")),
+        notestore::record::remove("unit_2"),
+        notestore::record::insert(0, unitWith("unit_0", "first")),
+    }));
+    DAL::appendFile(notePath, "{\"title\": \"Renamed\"}\n");
+
+    notestore::NoteView view(notePath);
+    EXPECT_EQ(view.appendedRecords(), 5u);
+    EXPECT_EQ(view.title(), "Renamed");
+    EXPECT_EQ(view.unitIds(), (std::vector<std::string>{"unit_0", "unit_1", "unit_3", "unit_4"}));
+    EXPECT_EQ(view.unit(*view.find("unit_1"))["content"], "edited");
+
+    // Compaction keeps the note as replayed.
+    json before = notestore::load(notePath);
+    notestore::compact(notePath);
+    EXPECT_EQ(notestore::load(notePath), before);
+    EXPECT_EQ(notestore::NoteView(notePath).appendedRecords(), 0u);
+}
+
+TEST_F(NoteViewTest, TextLogFromPreviousVersionLoads) {
+    json note = noteOf(2, 10);
+    DAL::writeFile(notePath, "{\"format\":\"folium-note-log\",\"version\":1}\n" + note.dump() + "\n" +
+                                 notestore::record::append(2, unitWith("unit_3", "three")).dump() + "\n");
+    note["units"].push_back(unitWith("unit_3", "three"));
+
+    notestore::FileInfo info;
+    EXPECT_EQ(notestore::load(notePath, &info), note);
+    EXPECT_TRUE(info.log);
+    EXPECT_EQ(info.appended, 1u);
+
+    notestore::save(notePath, note);
+    EXPECT_EQ(DAL::readFile(notePath).substr(0, 8), "FOLNOTE2");
+    EXPECT_EQ(notestore::load(notePath), note);
+}
+
+TEST_F(NoteViewTest, CorruptSnapshotThrows) {
+    notestore::save(notePath, noteOf(2, 10));
+    std::string content = DAL::readFile(notePath);
+    DAL::writeFile(notePath, content.substr(0, 40));
+    EXPECT_THROW(notestore::NoteView view(notePath), std::runtime_error);
+    EXPECT_THROW(notestore::NoteView view("note_view_test_missing.note"), std::runtime_error);
+}
+
+// A 50 MB note: the title and one unit, through the view and through a full load.
+TEST_F(NoteViewTest, TitleAndUnitOfLargeNote) {
+    const size_t units = 5000, contentBytes = 10000;
+    json note = noteOf(units, contentBytes);
+    notestore::save(notePath, note);
+    const std::string text = note.dump();
+
+    double parseTitle = microsPerCall(2, [&]() { json::parse(text)["title"].get<std::string>(); });
+    double loadTitle = microsPerCall(2, [&]() { notestore::load(notePath)["title"].get<std::string>(); });
+    double viewTitle = microsPerCall(200, [&]() { notestore::NoteView(notePath).title(); });
+    double loadUnit = microsPerCall(2, [&]() { notestore::load(notePath)["units"][units / 2]; });
+    double viewUnit = microsPerCall(200, [&]() {
+        notestore::NoteView view(notePath);
+        view.unit(*view.find("unit_" + std::to_string(units / 2)));
+    });
+
+    std::cout << "[ 50MB     ] text JSON parse, title: " << parseTitle << " us" << std::endl;
+    std::cout << "[ 50MB     ] full load, title:       " << loadTitle << " us" << std::endl;
+    std::cout << "[ 50MB     ] view, title:            " << viewTitle << " us" << std::endl;
+    std::cout << "[ 50MB     ] full load, one unit:    " << loadUnit << " us" << std::endl;
+    std::cout << "[ 50MB     ] view, one unit:         " << viewUnit << " us" << std::endl;
+
+    EXPECT_EQ(notestore::NoteView(notePath).unit(units / 2 - 1), note["units"][units / 2 - 1]);
+    EXPECT_LT(viewTitle * 100, loadTitle);
+    EXPECT_LT(viewUnit * 10, loadUnit);
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipe_filter.h"
+
+using pipeline::Filter;
+using pipeline::Pipe;
+
+TEST(PipeFilterTest, PipeDrainsAfterClose) {
+    Pipe<int> pipe;
+    EXPECT_TRUE(pipe.send(1));
+    EXPECT_TRUE(pipe.send(2));
+    pipe.close();
+    EXPECT_FALSE(pipe.send(3));
+    EXPECT_EQ(pipe.size(), 2u);
+    EXPECT_EQ(pipe.receive(), 1);
+    EXPECT_EQ(pipe.receive(), 2);
+    EXPECT_EQ(pipe.receive(), std::nullopt);
+}
+
+TEST(PipeFilterTest, StagesKeepOrderAndDrainOnClose) {
+    Pipe<int> numbers;
+    Pipe<std::string> texts;
+    Pipe<std::string> out;
+    Filter<int, std::string> format("format", [](int &n) { return std::optional(std::to_string(n)); }, numbers, &texts);
+    Filter<std::string, std::string> tag("tag", [](std::string &s) { return std::optional("#" + s); }, texts, &out);
+
+    for (int i = 0; i < 1000; i++) numbers.send(i);
+    numbers.close();
+    format.join();
+    tag.join();
+
+    for (int i = 0; i < 1000; i++) EXPECT_EQ(out.receive(), "#" + std::to_string(i));
+    // The close reached the end of the pipeline.
+    EXPECT_EQ(out.receive(), std::nullopt);
+    EXPECT_EQ(format.stats().processed, 1000u);
+    EXPECT_EQ(tag.stats().processed, 1000u);
+}
+
+TEST(PipeFilterTest, DropsAndFailuresAreCountedAndHandled) {
+    Pipe<int> in;
+    Pipe<int> out;
+    std::vector<int> failed;
+    Filter<int, int> odd("odd",
+                         [](int &n) -> std::optional<int> {
+                             if (n % 5 == 0) throw std::runtime_error("multiple of five");
+                             if (n % 2 == 0) return std::nullopt;
+                             return n;
+                         },
+                         in, &out, 1, [&](int &n, const std::exception &) { failed.push_back(n); });
+
+    for (int i = 1; i <= 20; i++) in.send(i);
+    in.close();
+    odd.join();
+
+    std::vector<int> passed;
+    while (std::optional<int> n = out.receive()) passed.push_back(*n);
+    EXPECT_EQ(passed, (std::vector<int>{1, 3, 7, 9, 11, 13, 17, 19}));
+    EXPECT_EQ(failed, (std::vector<int>{5, 10, 15, 20}));
+
+    pipeline::StageStats stats = odd.stats();
+    EXPECT_EQ(stats.name, "odd");
+    EXPECT_EQ(stats.processed, 16u);
+    EXPECT_EQ(stats.dropped, 8u);
+    EXPECT_EQ(stats.failed, 4u);
+    EXPECT_EQ(stats.backlog, 0u);
+}
+
+TEST(PipeFilterTest, ExtraWorkersShareTheBacklog) {
+    auto slow = [](int &n) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return std::optional(n);
+    };
+
+    auto run = [&](unsigned workers) {
+        Pipe<int> input;
+        Pipe<int> output;
+        Filter<int, int> stage("slow", slow, input, &output, workers);
+        auto began = std::chrono::steady_clock::now();
+        for (int i = 0; i < 200; i++) input.send(i);
+        input.close();
+        stage.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+        size_t received = 0;
+        while (output.receive()) received++;
+        EXPECT_EQ(received, 200u);
+        EXPECT_GT(stage.stats().busySeconds, 0.0);
+        std::cout << "[ pipeline ] " << workers << " worker(s): " << 200 / seconds << " items/s" << std::endl;
+        return seconds;
+    };
+
+    double one = run(1);
+    double four = run(4);
+    EXPECT_LT(four, one);
+}
+
+TEST(PipeFilterTest, DestructorClosesAndJoins) {
+    Pipe<int> in;
+    Pipe<int> out;
+    {
+        Filter<int, int> stage("identity", [](int &n) { return std::optional(n); }, in, &out);
+        in.send(7);
+    }
+    EXPECT_EQ(out.receive(), 7);
+    EXPECT_EQ(out.receive(), std::nullopt);
+}
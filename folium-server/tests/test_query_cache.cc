@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "query_cache.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    DAL::QueryCache::Rows rowsOf(const std::string &value)
+    {
+        return {{value}};
+    }
+
+    void store(DAL::QueryCache &cache, const std::string &statement, const std::vector<std::string> &params,
+               const std::string &value, const std::vector<std::string> &tags)
+    {
+        cache.put(statement, params, rowsOf(value), tags, cache.ticket());
+    }
+}
+
+TEST(QueryCacheTest, HitsByStatementAndParams) {
+    DAL::QueryCache cache(1 << 20, 30s);
+    EXPECT_FALSE(cache.get("notePath", {"7"}));
+    store(cache, "notePath", {"7"}, "notes/a.json", {"notes"});
+
+    auto rows = cache.get("notePath", {"7"});
+    ASSERT_TRUE(rows);
+    EXPECT_EQ(*(*rows)[0][0], "notes/a.json");
+    EXPECT_FALSE(cache.get("notePath", {"8"}));
+    EXPECT_FALSE(cache.get("other", {"7"}));
+
+    nlohmann::json stats = cache.stats();
+    EXPECT_EQ(stats["hits"], 1);
+    EXPECT_EQ(stats["misses"], 3);
+    EXPECT_EQ(stats["statements"]["notePath"]["hits"], 1);
+}
+
+TEST(QueryCacheTest, ParamsDoNotCollide) {
+    DAL::QueryCache cache(1 << 20, 30s);
+    store(cache, "s", {"1", "23"}, "a", {"t"});
+    EXPECT_FALSE(cache.get("s", {"12", "3"}));
+    EXPECT_FALSE(cache.get("s", {"123"}));
+    EXPECT_TRUE(cache.get("s", {"1", "23"}));
+}
+
+TEST(QueryCacheTest, InvalidatesOnlyMatchingTags) {
+    DAL::QueryCache cache(1 << 20, 30s);
+    store(cache, "notePath", {"1"}, "n", {"notes"});
+    store(cache, "enrollment", {"1", "2"}, "1", {"user_classes"});
+    store(cache, "classDetails", {"2"}, "c", {"classes", "notes"});
+
+    cache.invalidate("notes");
+    EXPECT_FALSE(cache.get("notePath", {"1"}));
+    EXPECT_FALSE(cache.get("classDetails", {"2"}));
+    EXPECT_TRUE(cache.get("enrollment", {"1", "2"}));
+    EXPECT_EQ(cache.stats()["invalidations"], 2);
+}
+
+TEST(QueryCacheTest, RejectsRowsReadBeforeAnInvalidation) {
+    DAL::QueryCache cache(1 << 20, 30s);
+    uint64_t ticket = cache.ticket();
+    cache.invalidate("notes"); // a write lands while the read is in flight
+    cache.put("notePath", {"1"}, rowsOf("old"), {"notes"}, ticket);
+    EXPECT_FALSE(cache.get("notePath", {"1"}));
+
+    // Unrelated tags are unaffected.
+    cache.put("enrollment", {"1"}, rowsOf("1"), {"user_classes"}, ticket);
+    EXPECT_TRUE(cache.get("enrollment", {"1"}));
+
+    cache.clear();
+    cache.put("enrollment", {"2"}, rowsOf("1"), {"user_classes"}, ticket);
+    EXPECT_FALSE(cache.get("enrollment", {"2"}));
+    EXPECT_EQ(cache.stats()["rejectedStale"], 2);
+}
+
+TEST(QueryCacheTest, EvictsLeastRecentlyUsedWithinBudget) {
+    std::string value(1000, 'x');
+    DAL::QueryCache cache(3000, 30s);
+    store(cache, "s", {"a"}, value, {"t"});
+    store(cache, "s", {"b"}, value, {"t"});
+    EXPECT_TRUE(cache.get("s", {"a"})); // a is now more recent than b
+    store(cache, "s", {"c"}, value, {"t"});
+
+    EXPECT_TRUE(cache.get("s", {"a"}));
+    EXPECT_FALSE(cache.get("s", {"b"}));
+    EXPECT_TRUE(cache.get("s", {"c"}));
+    EXPECT_LE(cache.stats()["bytes"].get<size_t>(), 3000u);
+    EXPECT_EQ(cache.stats()["evictions"], 1);
+
+    cache.setBudget(0);
+    EXPECT_EQ(cache.stats()["entries"], 0);
+}
+
+TEST(QueryCacheTest, EntriesExpire) {
+    DAL::QueryCache cache(1 << 20, 20ms);
+    store(cache, "s", {"a"}, "v", {"t"});
+    EXPECT_TRUE(cache.get("s", {"a"}));
+    std::this_thread::sleep_for(30ms);
+    EXPECT_FALSE(cache.get("s", {"a"}));
+    EXPECT_EQ(cache.stats()["entries"], 0);
+}
+
+TEST(QueryCacheTest, KeepsNullsApartFromEmptyStrings) {
+    DAL::QueryCache cache(1 << 20, 30s);
+    cache.put("s", {}, {{std::nullopt, std::string()}}, {"t"}, cache.ticket());
+    auto rows = cache.get("s", {});
+    ASSERT_TRUE(rows);
+    EXPECT_FALSE((*rows)[0][0].has_value());
+    EXPECT_EQ((*rows)[0][1], std::string());
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "request_arena.h"
+
+using json = nlohmann::json;
+
+// Every global heap allocation of the process, counted. All forms are replaced so that
+// whatever operator new hands out, the matching operator delete gives back to the same place.
+static std::atomic<size_t> heapAllocations{0};
+
+static void* countedAlloc(size_t size, size_t alignment) noexcept {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void* countedNew(size_t size, size_t alignment) {
+    if (void* p = countedAlloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+// The replacements pair malloc with free by design
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) { return countedNew(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size) { return countedNew(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t al) { return countedNew(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, std::align_val_t al) { return countedNew(size, static_cast<size_t>(al)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return countedAlloc(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return countedAlloc(size, static_cast<size_t>(al)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+class RequestArenaTest : public ::testing::Test {
+protected:
+    // Request bodies as the enroll and unit PATCH routes get them
+    static std::string enrollBody() {
+        json usernames = json::array();
+        for (int i = 0; i < 40; i++) usernames.push_back("student" + std::to_string(i));
+        return json{{"usernames", usernames}}.dump();
+    }
+
+    static std::string unitBody() {
+        json tags = json::array();
+        for (int i = 0; i < 16; i++) tags.push_back({{"tag", "t" + std::to_string(i)}, {"weight", i}});
+        return json{{"title", "Week 3"}, {"content", std::string(2000, 'x')}, {"tags", tags}, {"after", "week-2"}}.dump();
+    }
+
+    // A handler's JSON work: the body parsed, checked and turned into task data
+    template <typename Json>
+    static size_t handle(const std::string& enroll, const std::string& unit) {
+        Json body = Json::parse(enroll, nullptr, false);
+        size_t valid = 0;
+        for (const Json& username : body["usernames"]) valid += username.is_string();
+        json task = {{"usernames", json(body["usernames"])}, {"classId", 7}};
+
+        Json fields = Json::parse(unit, nullptr, false);
+        json payload = {{"unitId", "week-3"}, {"after", fields.value("after", "")}};
+        fields.erase("after");
+        payload["fields"] = json(fields);
+        return valid + task.size() + payload["fields"].size();
+    }
+
+    struct Run {
+        double allocationsPerRequest;
+        double p50Us;
+        double p99Us;
+    };
+
+    // 64 threads, each handling requests back to back
+    template <typename Json>
+    static Run run(bool useArena) {
+        const int threads = 64, requests = 400;
+        const std::string enroll = enrollBody(), unit = unitBody();
+        std::vector<std::vector<double>> latencies(threads);
+        const size_t before = heapAllocations.load();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            latencies[t].reserve(requests);
+            workers.emplace_back([&, t] {
+                for (int r = 0; r < requests; r++) {
+                    auto start = std::chrono::steady_clock::now();
+                    if (useArena) {
+                        arena::RequestArena requestArena;
+                        arena::Scope scope(requestArena);
+                        handle<Json>(enroll, unit);
+                    } else {
+                        handle<Json>(enroll, unit);
+                    }
+                    latencies[t].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        const size_t allocations = heapAllocations.load() - before;
+
+        std::vector<double> all;
+        for (const auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+        std::sort(all.begin(), all.end());
+        return {static_cast<double>(allocations) / all.size(), all[all.size() / 2], all[all.size() * 99 / 100]};
+    }
+};
+
+TEST_F(RequestArenaTest, DocumentsMatchPlainJson) {
+    arena::RequestArena requestArena;
+    arena::Scope scope(requestArena);
+    const std::string body = unitBody();
+    RequestJson parsed = RequestJson::parse(body);
+    EXPECT_EQ(parsed.dump(), json::parse(body).dump());
+    EXPECT_EQ(json(parsed), json::parse(body));
+    EXPECT_GT(requestArena.used(), 0u);
+}
+
+TEST_F(RequestArenaTest, NodesComeFromTheArenaOnlyInsideAScope) {
+    EXPECT_EQ(arena::current(), nullptr);
+    arena::RequestArena requestArena;
+    const std::string body = enrollBody();
+    {
+        arena::Scope scope(requestArena);
+        EXPECT_EQ(arena::current(), &requestArena);
+        size_t heapBefore = heapAllocations.load();
+        json plain = json::parse(body);
+        const size_t plainAllocations = heapAllocations.load() - heapBefore;
+        heapBefore = heapAllocations.load();
+        RequestJson parsed = RequestJson::parse(body);
+        // Short usernames stay inside their strings; what is left is the parser's own buffers
+        EXPECT_LT(heapAllocations.load() - heapBefore, plainAllocations / 4);
+        {
+            arena::RequestArena inner;
+            arena::Scope nested(inner);
+            EXPECT_EQ(arena::current(), &inner);
+        }
+        EXPECT_EQ(arena::current(), &requestArena);
+    }
+    EXPECT_EQ(arena::current(), nullptr);
+
+    size_t used = requestArena.used();
+    RequestJson outside = RequestJson::parse(body);
+    EXPECT_EQ(requestArena.used(), used);
+}
+
+// A document may outlive the Scope it was made in, or be changed in another, until the reset
+TEST_F(RequestArenaTest, BlocksAreFreedWhereverTheyCameFrom) {
+    RequestJson heapDocument = RequestJson::parse(enrollBody());
+    arena::RequestArena requestArena;
+    RequestJson arenaDocument;
+    {
+        arena::Scope scope(requestArena);
+        arenaDocument = RequestJson::parse(unitBody());
+        heapDocument["usernames"].clear(); // heap nodes freed inside the Scope
+        heapDocument["more"] = RequestJson::array({1, 2, 3});
+    }
+    arenaDocument["tags"] = nullptr; // arena nodes freed outside it
+    heapDocument.erase("more");
+    EXPECT_EQ(arenaDocument["title"], "Week 3");
+    arenaDocument = nullptr;
+
+    requestArena.reset();
+    EXPECT_EQ(requestArena.used(), 0u);
+    arena::Scope scope(requestArena);
+    EXPECT_EQ(RequestJson::parse(enrollBody())["usernames"].size(), 40u);
+}
+
+TEST_F(RequestArenaTest, ConcurrentRequestsAllocateLess) {
+    Run plain = run<json>(false);
+    Run pooled = run<RequestJson>(true);
+    std::cout << "[ arena    ] 64 threads: plain json " << plain.allocationsPerRequest << " allocations/request, p50 "
+              << plain.p50Us << " us, p99 " << plain.p99Us << " us; arena " << pooled.allocationsPerRequest
+              << " allocations/request, p50 " << pooled.p50Us << " us, p99 " << pooled.p99Us << " us" << std::endl;
+    // The task data is still copied to the heap
+    EXPECT_LT(pooled.allocationsPerRequest, plain.allocationsPerRequest * 3 / 4);
+}
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "note_store.h"
+#include "search_index.h"
+
+using json = nlohmann::json;
+
+class SearchIndexTest : public ::testing::Test {
+protected:
+    const std::string indexDir = "search_index_test";
+    const std::string notesDir = "search_index_test_notes";
+    const std::string blobDir = "search_index_test_blobs";
+
+    void SetUp() override {
+        std::filesystem::remove_all(indexDir);
+        blobstore::setRoot(blobDir);
+        searchindex::setRoot(indexDir);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(indexDir);
+        std::filesystem::remove_all(notesDir);
+        std::filesystem::remove_all(blobDir);
+        blobstore::setRoot("blobs");
+    }
+
+    static json unit(const std::string& unitId, const std::string& title, const std::string& content) {
+        return {{"unitId", unitId}, {"title", title}, {"content", content}};
+    }
+
+    static std::vector<std::string> unitIds(const std::vector<searchindex::Hit>& hits) {
+        std::vector<std::string> ids;
+        for (const searchindex::Hit& hit : hits) ids.push_back(hit.unitId);
+        return ids;
+    }
+};
+
+TEST_F(SearchIndexTest, Tokenizes) {
+    EXPECT_EQ(searchindex::tokenize("Binary-search trees, O(log n)!"),
+              (std::vector<std::string>{"binary", "search", "trees", "o", "log", "n"}));
+    EXPECT_EQ(searchindex::tokenize("Größe über"), (std::vector<std::string>{"größe", "über"}));
+    EXPECT_EQ(searchindex::tokenize(std::string(100, 'a'))[0].size(), searchindex::kMaxTermLength);
+    EXPECT_TRUE(searchindex::tokenize(" ,.; ").empty());
+}
+
+TEST_F(SearchIndexTest, FindsUnitsWithEveryTermInTheCallersClasses) {
+    searchindex::update(1, unit("unit_1", "Sorting", "Merge sort splits the array and merges sorted halves."));
+    searchindex::update(1, unit("unit_2", "Searching", "Binary search needs a sorted array."));
+    searchindex::update(2, unit("unit_1", "Graphs", "Breadth first search visits a graph level by level."));
+    // Uploads keep their JSON document as the content
+    searchindex::update(2, unit("unit_2", "Upload", json{{"title", "Heaps"}, {"content", "A heap is a sorted tree"}}.dump()));
+
+    EXPECT_EQ(unitIds(searchindex::search("sorted array", {1, 2})), (std::vector<std::string>{"unit_2", "unit_1"}));
+    EXPECT_EQ(unitIds(searchindex::search("search", {2})), (std::vector<std::string>{"unit_1"}));
+    EXPECT_EQ(unitIds(searchindex::search("SORTED TREE", {1, 2})), (std::vector<std::string>{"unit_2"}));
+    EXPECT_TRUE(searchindex::search("content", {2}).empty()); // JSON keys are not text
+    EXPECT_TRUE(searchindex::search("sorted", {3}).empty());
+    EXPECT_TRUE(searchindex::search("sorted quantum", {1, 2}).empty());
+    EXPECT_TRUE(searchindex::search("", {1, 2}).empty());
+
+    size_t total = 0;
+    std::vector<searchindex::Hit> hits = searchindex::search("sorted", {1, 2}, 2, &total);
+    EXPECT_EQ(hits.size(), 2u);
+    EXPECT_EQ(total, 3u);
+
+    hits = searchindex::search("binary", {1});
+    ASSERT_EQ(hits.size(), 1u);
+    EXPECT_EQ(hits[0].classId, 1);
+    EXPECT_EQ(hits[0].title, "Searching");
+    EXPECT_EQ(hits[0].positions, (std::vector<uint32_t>{1})); // after the title
+}
+
+TEST_F(SearchIndexTest, PhrasesNeedConsecutiveTerms) {
+    searchindex::update(1, unit("a", "", "binary search on a sorted array"));
+    searchindex::update(1, unit("b", "", "search the binary tree"));
+    EXPECT_EQ(searchindex::search("binary search", {1}).size(), 2u);
+    EXPECT_EQ(unitIds(searchindex::search("\"binary search\"", {1})), (std::vector<std::string>{"a"}));
+    EXPECT_EQ(unitIds(searchindex::search("\"binary tree\" search", {1})), (std::vector<std::string>{"b"}));
+    EXPECT_TRUE(searchindex::search("\"sorted binary\"", {1}).empty());
+}
+
+TEST_F(SearchIndexTest, UpdatesReplaceAndRemoveUnits) {
+    searchindex::update(1, unit("unit_1", "Intro", "stacks and queues"));
+    searchindex::update(1, unit("unit_1", "Intro", "hash tables"));
+    EXPECT_TRUE(searchindex::search("stacks", {1}).empty());
+    EXPECT_EQ(searchindex::search("hash", {1}).size(), 1u);
+    EXPECT_EQ(searchindex::stats().units, 1u);
+    EXPECT_EQ(searchindex::stats().deadUnits, 1u);
+
+    // Unchanged units are not indexed again
+    uint64_t updates = searchindex::stats().updates;
+    searchindex::update(1, unit("unit_1", "Intro", "hash tables"));
+    EXPECT_EQ(searchindex::stats().updates, updates);
+
+    searchindex::remove(1, "unit_1");
+    EXPECT_TRUE(searchindex::search("hash", {1}).empty());
+    EXPECT_EQ(searchindex::stats().units, 0u);
+
+    json note = {{"title", "Notes"}, {"units", {unit("u1", "One", "red green"), unit("u2", "Two", "green blue")}}};
+    searchindex::replaceClass(1, note);
+    EXPECT_EQ(searchindex::search("green", {1}).size(), 2u);
+    note["units"] = {unit("u2", "Two", "green yellow")};
+    searchindex::replaceClass(1, note);
+    EXPECT_EQ(unitIds(searchindex::search("green", {1})), (std::vector<std::string>{"u2"}));
+    EXPECT_TRUE(searchindex::search("blue", {1}).empty());
+}
+
+TEST_F(SearchIndexTest, PersistsThroughSnapshotAndJournal) {
+    searchindex::update(1, unit("u1", "Old", "photosynthesis in plants"));
+    searchindex::update(1, unit("u1", "New", "photosynthesis and respiration"));
+    searchindex::save();
+    EXPECT_EQ(searchindex::stats().deadUnits, 0u);
+    searchindex::update(2, unit("u1", "Cells", "respiration in cells"));
+    searchindex::remove(1, "u1");
+    EXPECT_EQ(searchindex::stats().journalRecords, 2u);
+
+    // A fresh process loads the snapshot and replays the journal
+    searchindex::setRoot(indexDir);
+    EXPECT_EQ(unitIds(searchindex::search("respiration", {1, 2})), (std::vector<std::string>{"u1"}));
+    EXPECT_EQ(searchindex::search("respiration", {1, 2})[0].classId, 2);
+    EXPECT_TRUE(searchindex::search("photosynthesis", {1, 2}).empty());
+
+    searchindex::save();
+    searchindex::setRoot(indexDir);
+    EXPECT_EQ(searchindex::stats().units, 1u);
+    EXPECT_EQ(searchindex::stats().journalRecords, 0u);
+    EXPECT_EQ(searchindex::search("cells", {2}).size(), 1u);
+}
+
+TEST_F(SearchIndexTest, RebuildsFromNoteFiles) {
+    for (int classId : {3, 4}) {
+        std::string path = notestore::pathFor(classId, notesDir);
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        notestore::save(path, {{"title", "Notes"},
+                               {"units", {unit("unit_1", "Lecture", "class " + std::to_string(classId) + " entropy"),
+                                          unit("unit_2", "Long", "entropy " + std::string(5000, 'x'))}}});
+    }
+    searchindex::update(9, unit("stale", "", "entropy"));
+
+    EXPECT_EQ(searchindex::rebuild(notesDir), 2u);
+    EXPECT_EQ(searchindex::search("entropy", {3, 4, 9}).size(), 4u);
+    EXPECT_EQ(unitIds(searchindex::search("entropy 4", {3, 4})), (std::vector<std::string>{"unit_1"}));
+    searchindex::setRoot(indexDir);
+    EXPECT_EQ(searchindex::search("entropy", {3, 4, 9}).size(), 4u);
+}
+
+// Query latency with a large index: rare, common and mixed terms, restricted to a few classes.
+TEST_F(SearchIndexTest, QueryLatency) {
+    const int units = 200000, classes = 2000;
+    std::vector<std::string> words;
+    for (int i = 0; i < 5000; i++) words.push_back("w" + std::to_string(i));
+    std::mt19937 random(11);
+    // Zipf-like: low word numbers are far more common
+    auto word = [&]() { return words[static_cast<size_t>(std::pow(random() % 10000 / 10000.0, 3) * words.size())]; };
+
+    auto began = std::chrono::steady_clock::now();
+    for (int c = 1; c <= classes; c++) {
+        json note = {{"title", "Notes"}, {"units", json::array()}};
+        for (int i = 0; i < units / classes; i++) {
+            std::string text = "lecture";
+            for (int w = 0; w < 40; w++) text += " " + word();
+            if ((c * units / classes + i) % 1000 == 0) text += " needle";
+            note["units"].push_back(unit("unit_" + std::to_string(i), "Unit", text));
+        }
+        searchindex::replaceClass(c, note);
+    }
+    double indexing = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    searchindex::save();
+
+    std::unordered_set<int> mine;
+    for (int c = 1; c <= 20; c++) mine.insert(c);
+    std::unordered_set<int> everything;
+    for (int c = 1; c <= classes; c++) everything.insert(c);
+
+    auto time = [&](const std::string& query, const std::unordered_set<int>& classIds) {
+        size_t total = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < 20; round++) searchindex::search(query, classIds, 20, &total);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 20;
+        std::cout << "[ search   ] " << query << " (" << classIds.size() << " classes): " << total << " hits, " << ms
+                  << " ms" << std::endl;
+        return ms;
+    };
+
+    searchindex::Stats stats = searchindex::stats();
+    std::cout << "[ search   ] " << stats.units << " units, " << stats.terms << " terms, "
+              << stats.postingBytes / (1 << 20) << " MiB of postings, indexed in " << indexing << " s" << std::endl;
+    EXPECT_EQ(stats.units, static_cast<uint64_t>(units));
+
+    EXPECT_LT(time("needle", everything), 50.0);
+    EXPECT_LT(time("needle w0", everything), 50.0);
+    EXPECT_LT(time("w0 w1", mine), 500.0);
+    time("\"lecture w0\"", everything);
+}